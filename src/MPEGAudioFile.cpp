@@ -89,6 +89,105 @@ static const uint8_t mpeg_slot_size[4] = { 0, 1, 1, 4 }; // Rsvd, 3, 2, 1
 // Number of output channels - [channel_idx]
 static const uint8_t mpeg_channels[4] = { 2, 2, 2, 1 };
 
+// The furthest we search for the first frame sync when reading file info
+static const size_t MPEG_MAX_SYNC_SEARCH = 65536;
+
+// Reads a big-endian 32-bit integer from a buffer
+static uint32_t mpeg_audio_file_read_be32(const unsigned char *buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+// Reads a big-endian 16-bit integer from a buffer
+static uint16_t mpeg_audio_file_read_be16(const unsigned char *buffer)
+{
+	return ((uint16_t)buffer[0] << 8) | (uint16_t)buffer[1];
+}
+
+// Builds a MP3 Header structure from four bytes of the file
+static void mpeg_audio_file_parse_frame_header(const unsigned char *frame_header_buffer, MP3FrameHeader *frame_header)
+{
+	frame_header->frame_sync = ((uint16_t)frame_header_buffer[0] << 3) | (((uint8_t)frame_header_buffer[1] & 0xE0) >> 5);
+	frame_header->mpeg_version = ((uint8_t)frame_header_buffer[1] & 0x18) >> 3;
+	frame_header->layer = ((uint8_t)frame_header_buffer[1] & 0x06) >> 1;
+	frame_header->protection = (uint8_t)frame_header_buffer[1] & 0x01;
+	frame_header->bit_rate = ((uint8_t)frame_header_buffer[2] & 0xF0) >> 4;
+	frame_header->sample_rate = ((uint8_t)frame_header_buffer[2] & 0x0C) >> 2;
+	frame_header->padding = ((uint8_t)frame_header_buffer[2] & 0x02) >> 1;
+	frame_header->pri = (uint8_t)frame_header_buffer[2] & 0x01;
+	frame_header->channel_mode = ((uint8_t)frame_header_buffer[3] & 0xC0) >> 6;
+	frame_header->mode_extension = ((uint8_t)frame_header_buffer[3] & 0x20) >> 4;
+	frame_header->copyright = ((uint8_t)frame_header_buffer[3] & 0x08) >> 3;
+	frame_header->original = ((uint8_t)frame_header_buffer[3] & 0x04) >> 2;
+	frame_header->emphasis = (uint8_t)frame_header_buffer[3] & 0x02;
+}
+
+// Calculates the size of a frame in bytes from its header
+static uint16_t mpeg_audio_file_get_frame_size(const MP3FrameHeader *frame_header)
+{
+	uint16_t samples_per_frame = mpeg_frame_samples[frame_header->mpeg_version][frame_header->layer];
+	uint16_t frame_bit_rate = mpeg_bitrates[frame_header->mpeg_version][frame_header->layer][frame_header->bit_rate];
+	uint16_t frame_sample_rate = mpeg_srates[frame_header->mpeg_version][frame_header->sample_rate];
+	uint8_t frame_slot_size = mpeg_slot_size[frame_header->layer];
+	uint16_t frame_bits_per_sample = samples_per_frame / 8;
+
+	if (frame_sample_rate == 0)
+	{
+		return 0;
+	}
+
+	return (uint16_t)((float)frame_bits_per_sample * (float)(frame_bit_rate * 1000) / (float)frame_sample_rate) + (frame_header->padding ? frame_slot_size : 0);
+}
+
+// Determines if the first frame of the file is a Xing, Info or VBRI frame
+// rather than audio. The buffer should contain the frame minus its four byte
+// header
+static bool mpeg_audio_file_is_info_frame(const unsigned char *buffer, size_t bytes_in_buffer, uint16_t channels)
+{
+	if (bytes_in_buffer > 36)
+	{
+		const unsigned char *h = &buffer[channels == 2 ? 32 : 17];
+		if ((h[0] == 'X' && h[1] == 'i' && h[2] == 'n' && h[3] == 'g') || (h[0] == 'I' && h[1] == 'n' && h[2] == 'f' && h[3] == 'o'))
+		{
+			return true;
+		}
+
+		// VBRI headers are always at a fixed offset
+		h = &buffer[32];
+		if (h[0] == 'V' && h[1] == 'B' && h[2] == 'R' && h[3] == 'I')
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Reads the encoder delay and padding from a LAME/Lavc/Lavf header that follows
+// a Xing/Info header. The buffer should contain the frame minus its four byte
+// header
+static bool mpeg_audio_file_read_lame_header(const unsigned char *buffer, size_t bytes_in_buffer, uint16_t channels, uint16_t *delay, uint16_t *padding)
+{
+	if (bytes_in_buffer <= 0xb4)
+	{
+		return false;
+	}
+
+	const unsigned char *h = &buffer[channels == 2 ? 0x98 : 0x89];
+	if (!(h[0] == 'L' && ((h[1] == 'A' && h[2] == 'M' && h[3] == 'E') || (h[1] == 'a' && h[2] == 'v' && (h[3] == 'c' || h[3] == 'f')))))
+	{
+		return false;
+	}
+
+	// Grab the first 12 bits at 'd' for the delay, and the next 12 bits for
+	// the padding
+	const unsigned char *d = &buffer[channels == 2 ? 0xad : 0x9e];
+	*delay = (((uint16_t)d[0] << 4) | ((uint16_t)d[1] & 0xf0) >> 4) + DEFAULT_DECODER_DELAY;
+	*padding = ((((uint16_t)d[1] & 0x0f) << 8) | (uint16_t)d[2]) - DEFAULT_DECODER_DELAY;
+
+	return true;
+}
+
 /// Skips past an ID3v2 header if it finds one
 size_t mpeg_audio_file_skip_id3v2(GInputStream *stream)
 {
@@ -137,7 +236,7 @@ size_t mpeg_audio_file_skip_id3v2(GInputStream *stream)
 	}
 }
 
-bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint32_t *sample_rate, uint32_t *frames, uint64_t *samples, std::vector<MP3FrameInfo> *frame_info, uint16_t *delay, uint16_t *padding)
+bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint32_t *sample_rate, uint32_t *frames, uint64_t *samples, std::vector<MP3FrameInfo> *frame_info, uint16_t *delay, uint16_t *padding, const std::atomic<bool> *cancel)
 {
 	size_t total_read = 0, frame_idx = 0, total_samples = 0;
 	uint16_t local_delay = 0;
@@ -158,6 +257,13 @@ bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint3
 	bool lost_sync = false;
 	while (true)
 	{
+		// Allow whoever is scanning in the background to give up early
+		if (cancel != NULL && cancel->load())
+		{
+			stack_log("mpeg_audio_file_find_frames(): Cancelled\n");
+			return false;
+		}
+
 		// Keep track of the offset in the file where this frame started
 		size_t frame_start = total_read;
 
@@ -172,19 +278,7 @@ bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint3
 
 		// Build a MP3 Header structure from the buffer
 		MP3FrameHeader frame_header;
-		frame_header.frame_sync = ((uint16_t)frame_header_buffer[0] << 3) | (((uint8_t)frame_header_buffer[1] & 0xE0) >> 5);
-		frame_header.mpeg_version = ((uint8_t)frame_header_buffer[1] & 0x18) >> 3;
-		frame_header.layer = ((uint8_t)frame_header_buffer[1] & 0x06) >> 1;
-		frame_header.protection = (uint8_t)frame_header_buffer[1] & 0x01;
-		frame_header.bit_rate = ((uint8_t)frame_header_buffer[2] & 0xF0) >> 4;
-		frame_header.sample_rate = ((uint8_t)frame_header_buffer[2] & 0x0C) >> 2;
-		frame_header.padding = ((uint8_t)frame_header_buffer[2] & 0x02) >> 1;
-		frame_header.pri = (uint8_t)frame_header_buffer[2] & 0x01;
-		frame_header.channel_mode = ((uint8_t)frame_header_buffer[3] & 0xC0) >> 6;
-		frame_header.mode_extension = ((uint8_t)frame_header_buffer[3] & 0x20) >> 4;
-		frame_header.copyright = ((uint8_t)frame_header_buffer[3] & 0x08) >> 3;
-		frame_header.original = ((uint8_t)frame_header_buffer[3] & 0x04) >> 2;
-		frame_header.emphasis = (uint8_t)frame_header_buffer[3] & 0x02;
+		mpeg_audio_file_parse_frame_header(frame_header_buffer, &frame_header);
 
 		// Check for a frame sync
 		if (frame_header.frame_sync != 0x7FF)
@@ -242,11 +336,8 @@ bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint3
 
 		// Figure out the frame size
 		uint16_t samples_per_frame = mpeg_frame_samples[frame_header.mpeg_version][frame_header.layer];
-		uint16_t frame_bit_rate = mpeg_bitrates[frame_header.mpeg_version][frame_header.layer][frame_header.bit_rate];
 		uint16_t frame_sample_rate = mpeg_srates[frame_header.mpeg_version][frame_header.sample_rate];
-		uint8_t frame_slot_size = mpeg_slot_size[frame_header.layer];
-		uint16_t frame_bits_per_sample = samples_per_frame / 8;
-		uint16_t frame_size = (uint16_t)((float)frame_bits_per_sample * (float)(frame_bit_rate * 1000) / (float)frame_sample_rate) + (frame_header.padding ? frame_slot_size : 0);
+		uint16_t frame_size = mpeg_audio_file_get_frame_size(&frame_header);
 
 		// Ensure we have a valid frame size
 		if (frame_size < 4)
@@ -268,47 +359,23 @@ bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint3
 			unsigned char *buffer = new unsigned char[frame_size - 4];
 			size_t bytes_in_buffer = g_input_stream_read(stream, buffer, frame_size - 4, NULL, NULL);
 
-			// Check for an info frame (should be the first frame)
-			if (bytes_in_buffer > 36)
-			{
-				unsigned char *h = &buffer[*channels == 2 ? 32 : 17];
-
-				// Skip past the Xing or Info frame if we have one
-				if (h[0] == 'X' && h[1] == 'i' && h[2] == 'n' && h[3] == 'g')
-				{
-					is_info = true;
-				}
-				else if (h[0] == 'I' && h[1] == 'n' && h[2] == 'f' && h[3] == 'o')
-				{
-					is_info = true;
-				}
-			}
+			// Check for an info frame (should be the first frame), which we
+			// skip past if we have one
+			is_info = mpeg_audio_file_is_info_frame(buffer, bytes_in_buffer, *channels);
 
 			// If we found a Xing/Info frame, check for a LAME/Lavc/Lavf header
-			if (is_info && bytes_in_buffer > 0x9f)
+			if (is_info)
 			{
-				bool get_delay = false;
-				unsigned char *h = &buffer[*channels == 2 ? 0x98 : 0x89];
-				if (h[0] == 'L' && ((h[1] == 'A' && h[2] == 'M' && h[3] == 'E') || (h[1] == 'a' && h[2] == 'v' && (h[3] == 'c' || h[3] == 'f'))))
+				uint16_t local_padding = 0;
+				if (mpeg_audio_file_read_lame_header(buffer, bytes_in_buffer, *channels, &local_delay, &local_padding))
 				{
-					get_delay = true;
-				}
-
-				if (get_delay && bytes_in_buffer > 0xb4)
-				{
-					unsigned char *d = &buffer[*channels == 2 ? 0xad : 0x9e];
-					local_delay = (((uint16_t)d[0] << 4) | ((uint16_t)d[1] & 0xf0) >> 4) + DEFAULT_DECODER_DELAY;
-
-					// Grab the first 12 bits at 'd' for the delay
 					if (delay != NULL)
 					{
 						*delay = local_delay;
 					}
-
-					// Grab the next 12 bits for the padding
 					if (padding != NULL)
 					{
-						*padding = ((((uint16_t)d[1] & 0x0f) << 8) | (uint16_t)d[2]) - DEFAULT_DECODER_DELAY;
+						*padding = local_padding;
 					}
 				}
 			}
@@ -362,3 +429,183 @@ bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint3
 
 	return true;
 }
+
+bool mpeg_audio_file_read_quick_info(GInputStream *stream, MP3QuickInfo *info)
+{
+	// Determine the size of the file
+	if (!g_seekable_seek(G_SEEKABLE(stream), 0, G_SEEK_END, NULL, NULL))
+	{
+		return false;
+	}
+	size_t stream_size = (size_t)g_seekable_tell(G_SEEKABLE(stream));
+	g_seekable_seek(G_SEEKABLE(stream), 0, G_SEEK_SET, NULL, NULL);
+
+	// Get the size of the ID3 header and skip past it in the stream
+	size_t position = mpeg_audio_file_skip_id3v2(stream);
+	if (position == (size_t)-1)
+	{
+		return false;
+	}
+
+	// Search for the first frame header. As we don't go on to check that
+	// subsequent frames follow on from this one, we're a bit stricter about
+	// what we consider to be valid than mpeg_audio_file_find_frames is. We
+	// read a block and search that, rather than reading the stream a byte at
+	// a time
+	std::vector<unsigned char> search_buffer(MPEG_MAX_SYNC_SEARCH + 4);
+	gsize search_bytes = 0;
+	if (!g_input_stream_read_all(stream, search_buffer.data(), search_buffer.size(), &search_bytes, NULL, NULL))
+	{
+		return false;
+	}
+
+	MP3FrameHeader frame_header;
+	uint16_t frame_size = 0;
+	size_t offset = 0;
+	for (; offset + 4 <= search_bytes; offset++)
+	{
+		mpeg_audio_file_parse_frame_header(&search_buffer[offset], &frame_header);
+		if (frame_header.frame_sync == 0x7FF && frame_header.mpeg_version != 1 && frame_header.layer != 0 && frame_header.bit_rate != 0 && frame_header.bit_rate != 15 && frame_header.sample_rate != 3)
+		{
+			frame_size = mpeg_audio_file_get_frame_size(&frame_header);
+			if (frame_size >= 4)
+			{
+				break;
+			}
+		}
+	}
+
+	if (offset + 4 > search_bytes)
+	{
+		stack_log("mpeg_audio_file_read_quick_info(): Failed to find frame sync\n");
+		return false;
+	}
+	position += offset;
+
+	// Carry on reading from just after the frame header
+	if (!g_seekable_seek(G_SEEKABLE(stream), position + 4, G_SEEK_SET, NULL, NULL))
+	{
+		return false;
+	}
+
+	info->channels = mpeg_channels[frame_header.channel_mode];
+	info->sample_rate = mpeg_srates[frame_header.mpeg_version][frame_header.sample_rate];
+	info->frame_size_samples = mpeg_frame_samples[frame_header.mpeg_version][frame_header.layer];
+	info->first_frame_position = position;
+	info->frames = 0;
+	info->delay = 0;
+	info->padding = 0;
+	info->seek_points.clear();
+
+	// Read the rest of the first frame to look for an info frame
+	unsigned char *buffer = new unsigned char[frame_size - 4];
+	size_t bytes_in_buffer = g_input_stream_read(stream, buffer, frame_size - 4, NULL, NULL);
+	bool is_info = mpeg_audio_file_is_info_frame(buffer, bytes_in_buffer, info->channels);
+	if (is_info)
+	{
+		// Audio starts with the next frame
+		info->first_frame_position = position + frame_size;
+
+		const unsigned char *h = &buffer[info->channels == 2 ? 32 : 17];
+		if (h[0] == 'X' || h[0] == 'I')
+		{
+			// Xing/Info header: a set of flags determines which fields follow
+			uint32_t flags = mpeg_audio_file_read_be32(&h[4]);
+			const unsigned char *p = &h[8];
+			const unsigned char *end = &buffer[bytes_in_buffer];
+			uint32_t xing_bytes = 0;
+			const unsigned char *toc = NULL;
+
+			if ((flags & 0x1) && p + 4 <= end)
+			{
+				info->frames = mpeg_audio_file_read_be32(p);
+				p += 4;
+			}
+			if ((flags & 0x2) && p + 4 <= end)
+			{
+				xing_bytes = mpeg_audio_file_read_be32(p);
+				p += 4;
+			}
+			if ((flags & 0x4) && p + 100 <= end)
+			{
+				toc = p;
+			}
+
+			mpeg_audio_file_read_lame_header(buffer, bytes_in_buffer, info->channels, &info->delay, &info->padding);
+
+			// The TOC gives, for each percent of the duration, the position
+			// in the file as a fraction (out of 256) of the stream size
+			if (toc != NULL && info->frames > 0 && xing_bytes > 0)
+			{
+				const uint64_t total_samples = (uint64_t)info->frames * info->frame_size_samples;
+				for (size_t i = 0; i < 100; i++)
+				{
+					info->seek_points.push_back(MP3SeekPoint{ total_samples * i / 100, position + (size_t)((uint64_t)toc[i] * xing_bytes / 256) });
+				}
+			}
+		}
+		else if (bytes_in_buffer > 58)
+		{
+			// VBRI header: follows 32 bytes after the frame header
+			const unsigned char *v = &buffer[32];
+			uint32_t vbri_frames = mpeg_audio_file_read_be32(&v[14]);
+			uint16_t toc_entries = mpeg_audio_file_read_be16(&v[18]);
+			uint16_t toc_scale = mpeg_audio_file_read_be16(&v[20]);
+			uint16_t entry_size = mpeg_audio_file_read_be16(&v[22]);
+			uint16_t frames_per_entry = mpeg_audio_file_read_be16(&v[24]);
+			info->frames = vbri_frames;
+
+			// Each entry in the TOC is the number of bytes taken by the next
+			// 'frames_per_entry' frames
+			const unsigned char *entry = &v[26];
+			if (entry_size >= 1 && entry_size <= 4 && entry + (size_t)toc_entries * entry_size <= &buffer[bytes_in_buffer])
+			{
+				size_t byte_position = position;
+				for (size_t i = 0; i < toc_entries; i++)
+				{
+					info->seek_points.push_back(MP3SeekPoint{ (uint64_t)i * frames_per_entry * info->frame_size_samples, byte_position });
+
+					uint32_t entry_bytes = 0;
+					for (size_t j = 0; j < entry_size; j++)
+					{
+						entry_bytes = (entry_bytes << 8) | entry[j];
+					}
+					byte_position += (size_t)entry_bytes * toc_scale;
+					entry += entry_size;
+				}
+			}
+		}
+	}
+	delete [] buffer;
+
+	// Without a frame count, assume the file is CBR and estimate from the
+	// size of the first frame
+	if (info->frames == 0 && stream_size > info->first_frame_position)
+	{
+		info->frames = (uint32_t)((stream_size - info->first_frame_position) / frame_size);
+	}
+
+	// Without a TOC, assume a constant bitrate across the file
+	if (info->seek_points.empty())
+	{
+		const uint64_t total_samples = (uint64_t)info->frames * info->frame_size_samples;
+		const size_t audio_bytes = stream_size > info->first_frame_position ? stream_size - info->first_frame_position : 0;
+		for (size_t i = 0; i < 100; i++)
+		{
+			info->seek_points.push_back(MP3SeekPoint{ total_samples * i / 100, info->first_frame_position + audio_bytes * i / 100 });
+		}
+	}
+
+	// The first seek point should always be the first audio frame so that we
+	// never try to decode the info frame
+	info->seek_points[0].sample_position = 0;
+	for (auto &seek_point : info->seek_points)
+	{
+		if (seek_point.byte_position < info->first_frame_position)
+		{
+			seek_point.byte_position = info->first_frame_position;
+		}
+	}
+
+	return info->frames > 0;
+}
@@ -2,6 +2,7 @@
 #define _MPEGAUDIOFILE_H_INCLUDED
 
 // Includes:
+#include <atomic>
 #include <cstdint>
 #include <gtk/gtk.h>
 #include <vector>
@@ -14,9 +15,29 @@ struct MP3FrameInfo
 	uint16_t frame_size_samples;  // The size of the frame in samples
 };
 
+struct MP3SeekPoint
+{
+	uint64_t sample_position;   // The decoded sample, counted from the first audio frame
+	size_t byte_position;       // Location in the file to start decoding from
+};
+
+// Information about a file that can be determined without scanning every frame
+struct MP3QuickInfo
+{
+	uint16_t channels;
+	uint32_t sample_rate;
+	uint16_t frame_size_samples;         // The number of samples in each frame
+	size_t first_frame_position;         // Location of the first audio frame in the file
+	uint32_t frames;                     // The number of audio frames (estimated if there's no Xing/Info/VBRI frame)
+	uint16_t delay;                      // Encoder delay (from LAME header)
+	uint16_t padding;                    // Padding in last frame (from LAME header)
+	std::vector<MP3SeekPoint> seek_points; // Approximate seek table
+};
+
 // Functions:
 size_t mpeg_audio_file_skip_id3v2(GInputStream *stream);
-bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint32_t *sample_rate, uint32_t *frames, uint64_t *samples, std::vector<MP3FrameInfo> *frame_info, uint16_t *delay, uint16_t *padding);
+bool mpeg_audio_file_find_frames(GInputStream *stream, uint16_t *channels, uint32_t *sample_rate, uint32_t *frames, uint64_t *samples, std::vector<MP3FrameInfo> *frame_info, uint16_t *delay, uint16_t *padding, const std::atomic<bool> *cancel = NULL);
+bool mpeg_audio_file_read_quick_info(GInputStream *stream, MP3QuickInfo *info);
 
 #endif
 
@@ -17,6 +17,15 @@ static GdkPixbuf *icon_pause = NULL;
 static GdkPixbuf *icon_play = NULL;
 static GdkPixbuf *icon_stop = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackActionCueKeys
+{
+	stack_property_key_t target;
+	stack_property_key_t action;
+};
+static StackActionCueKeys sac_keys;
+
 static void stack_action_cue_ccb_target(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -90,12 +99,12 @@ static StackCue* stack_action_cue_create(StackCueList *cue_list)
 	cue->target_cue_id_string[0] = '\0';
 
 	// Add our properties
-	StackProperty *target = stack_property_create("target", STACK_PROPERTY_TYPE_UINT64);
+	StackProperty *target = stack_property_create_keyed(sac_keys.target, STACK_PROPERTY_TYPE_UINT64);
 	stack_cue_add_property(STACK_CUE(cue), target);
 	stack_property_set_uint64(target, STACK_PROPERTY_VERSION_DEFINED, STACK_CUE_UID_NONE);
 	stack_property_set_changed_callback(target, stack_action_cue_ccb_target, (void*)cue);
 
-	StackProperty *action = stack_property_create("action", STACK_PROPERTY_TYPE_INT32);
+	StackProperty *action = stack_property_create_keyed(sac_keys.action, STACK_PROPERTY_TYPE_INT32);
 	stack_cue_add_property(STACK_CUE(cue), action);
 	stack_property_set_int32(action, STACK_PROPERTY_VERSION_DEFINED, STACK_ACTION_CUE_STOP);
 	stack_property_set_changed_callback(action, stack_action_cue_ccb_action, (void*)cue);
@@ -508,6 +517,10 @@ void stack_action_cue_register()
 	icon_play = gdk_pixbuf_new_from_resource("/org/stack/icons/stackactioncue-play.png", NULL);
 	icon_stop = gdk_pixbuf_new_from_resource("/org/stack/icons/stackactioncue-stop.png", NULL);
 
+	// Register the names of our properties
+	sac_keys.target = stack_property_register_key("target");
+	sac_keys.action = stack_property_register_key("action");
+
 	// Register built in cue types
 	StackCueClass* action_cue_class = new StackCueClass{ "StackActionCue", "StackCue", "Action Cue", stack_action_cue_create, stack_action_cue_destroy, stack_action_cue_play, NULL, NULL, stack_action_cue_pulse, stack_action_cue_set_tabs, stack_action_cue_unset_tabs, stack_action_cue_to_json, stack_action_cue_free_json, stack_action_cue_from_json, stack_action_cue_get_error, NULL, NULL, stack_action_cue_get_field, stack_action_cue_get_icon, NULL, NULL };
 	stack_register_cue_class(action_cue_class);
@@ -105,6 +105,10 @@ void stack_alsa_audio_device_destroy(StackAudioDevice *device)
 		snd_pcm_close(STACK_ALSA_AUDIO_DEVICE(device)->stream);
 	}
 
+	// Tidy up our buffers
+	delete [] alsa_device->float_buffer;
+	delete [] (int32_t*)alsa_device->convert_buffer;
+
 	if (device->device_name != NULL)
 	{
 		free(device->device_name);
@@ -131,9 +135,20 @@ static void stack_alsa_audio_device_output_thread(void *user_data)
 
 		while (writable >= 256)
 		{
-			// Get a buffer of that size and read (up to) that many bytes
+			// Make sure our buffers are big enough (four bytes per sample
+			// covers all the formats we support)
 			size_t total_sample_count = writable * channels;
-			float *buffer = new float[total_sample_count];
+			if (total_sample_count > device->buffer_samples)
+			{
+				delete [] device->float_buffer;
+				delete [] (int32_t*)device->convert_buffer;
+				device->float_buffer = new float[total_sample_count];
+				device->convert_buffer = new int32_t[total_sample_count];
+				device->buffer_samples = total_sample_count;
+			}
+
+			// Read (up to) that many frames
+			float *buffer = device->float_buffer;
 			size_t read = STACK_AUDIO_DEVICE(device)->request_audio(writable, buffer, STACK_AUDIO_DEVICE(device)->request_audio_user_data);
 
 			if (read < writable)
@@ -149,44 +164,24 @@ static void stack_alsa_audio_device_output_thread(void *user_data)
 			}
 			else if (device->format == SND_PCM_FORMAT_S32)
 			{
-				// Convert to int32s
-				int32_t *i32_buffer = new int32_t[total_sample_count];
-				stack_audio_device_to_s32(buffer, i32_buffer, total_sample_count);
-
-				// Write out
-				snd_pcm_writei(device->stream, i32_buffer, read);
-
-				// Tidy up
-				delete [] i32_buffer;
+				// Convert to int32s and write out
+				stack_audio_device_to_s32(buffer, (int32_t*)device->convert_buffer, total_sample_count);
+				snd_pcm_writei(device->stream, device->convert_buffer, read);
 			}
 			else if (device->format == SND_PCM_FORMAT_S24)
 			{
-				// Convert to int24s (24-bit int wrapped in 32-bit)
-				int32_t *i24_buffer = new int32_t[total_sample_count];
-				stack_audio_device_to_s24_32(buffer, i24_buffer, total_sample_count);
-
-				// Write out
-				snd_pcm_writei(device->stream, i24_buffer, read);
-
-				// Tidy up
-				delete [] i24_buffer;
+				// Convert to int24s (24-bit int wrapped in 32-bit) and write out
+				stack_audio_device_to_s24_32(buffer, (int32_t*)device->convert_buffer, total_sample_count);
+				snd_pcm_writei(device->stream, device->convert_buffer, read);
 			}
 			else if (device->format == SND_PCM_FORMAT_S16)
 			{
-				// Convert to int16s
-				int16_t *i16_buffer = new int16_t[total_sample_count];
-				stack_audio_device_to_s16(buffer, i16_buffer, total_sample_count);
-
-				// Write out
-				snd_pcm_writei(device->stream, i16_buffer, read);
-
-				// Tidy up
-				delete [] i16_buffer;
+				// Convert to int16s and write out
+				StackAudioDevice *super = STACK_AUDIO_DEVICE(device);
+				stack_audio_device_to_s16(buffer, (int16_t*)device->convert_buffer, total_sample_count, super->dither ? &super->dither_state : NULL);
+				snd_pcm_writei(device->stream, device->convert_buffer, read);
 			}
 
-			// Tidy up
-			delete [] buffer;
-
 			// Determine if more data is required
 			writable = snd_pcm_avail_update(device->stream);
 		}
@@ -205,6 +200,9 @@ StackAudioDevice *stack_alsa_audio_device_create(const char *name, uint32_t chan
 	StackAlsaAudioDevice *device = new StackAlsaAudioDevice();
 	device->stream = NULL;
 	device->format = SND_PCM_FORMAT_FLOAT;
+	device->float_buffer = NULL;
+	device->convert_buffer = NULL;
+	device->buffer_samples = 0;
 	if (snd_pcm_open(&device->stream, name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK) != 0)
 	{
 		stack_log("stack_alsa_audio_device_create: snd_pcm_open() failed\n");
@@ -24,6 +24,13 @@ struct StackAlsaAudioDevice
 
 	// Kill flag for the thread
 	bool thread_running;
+
+	// Buffers used by the output thread, kept between writes so we don't
+	// allocate on every period. 'convert_buffer' holds the output in the
+	// device's format if it isn't float
+	float *float_buffer;
+	void *convert_buffer;
+	size_t buffer_samples;
 };
 
 // Functions: Register the device
@@ -7,6 +7,7 @@
 #include "StackTrigger.h"
 #include "StackMidiDevice.h"
 #include "StackLog.h"
+#include "StackAudioFile.h"
 
 // GTK stuff
 G_DEFINE_TYPE(StackApp, stack_app, GTK_TYPE_APPLICATION);
@@ -107,11 +108,22 @@ static void stack_app_activate(GApplication *app)
 	gtk_window_present(GTK_WINDOW(window));
 }
 
+// Application shutdown
+static void stack_app_shutdown(GApplication *app)
+{
+	// Stop indexing before we exit so we're not part way through writing to
+	// the media cache
+	stack_audio_file_index_stop();
+
+	G_APPLICATION_CLASS(stack_app_parent_class)->shutdown(app);
+}
+
 // Class initialisation
 static void stack_app_class_init(StackAppClass *cls)
 {
 	G_APPLICATION_CLASS(cls)->activate = stack_app_activate;
 	G_APPLICATION_CLASS(cls)->open = stack_app_open;
+	G_APPLICATION_CLASS(cls)->shutdown = stack_app_shutdown;
 }
 
 // Creates a new Stack application
@@ -51,6 +51,9 @@ struct StackAppWindow
 	// A cue list that's currently loading
 	StackCueList *loading_cue_list;
 
+	// The URI the cue list is being saved to in the background (or NULL)
+	char *save_uri;
+
 	// Our cue list widget
 	StackCueListWidget *sclw;
 
@@ -66,8 +69,8 @@ struct StackAppWindow
 	// Whether to use our custom style
 	bool use_custom_style;
 
-	// Timer state (0 = not started, 1 = running, 2 = stopping, 3 = stopped)
-	int timer_state;
+	// The ID of the frame clock tick callback that refreshes the UI
+	guint tick_callback;
 
 	// Master out widget
 	StackLevelMeter *master_out_meter;
@@ -0,0 +1,786 @@
+// Includes:
+#include "StackAudioAnalysis.h"
+#include "StackMediaCache.h"
+#include "StackLog.h"
+#include <gtk/gtk.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The version of the "anly" cache payload. Bump this if the format of the
+// payload or the way the analysis is calculated changes
+#define STACK_AUDIO_ANALYSIS_CACHE_VERSION 1
+
+// The number of frames to decode at a time
+#define STACK_AUDIO_ANALYSIS_READ_FRAMES 16384
+
+// The maximum number of threads to analyse files with
+#define STACK_AUDIO_ANALYSIS_MAX_THREADS 4
+
+// The true peak interpolation filter: 4x oversampling with 12 taps per phase
+#define STACK_AUDIO_ANALYSIS_TP_PHASES 4
+#define STACK_AUDIO_ANALYSIS_TP_TAPS 12
+
+// Samples at or above this level are counted as clipped
+#define STACK_AUDIO_ANALYSIS_CLIP_LEVEL (32767.0f / 32768.0f)
+
+// Layout of the cache payload
+#pragma pack(push, 1)
+struct StackAudioAnalysisCacheData
+{
+	double integrated_loudness;
+	double true_peak;
+	double sample_peak;
+	int64_t content_start_time;
+	int64_t content_end_time;
+	uint64_t clipped_samples;
+};
+#pragma pack(pop)
+
+// The coefficients of a biquad filter (with a0 normalised to one)
+struct StackAudioAnalysisBiquad
+{
+	double b0, b1, b2, a1, a2;
+};
+
+// The state of an analysis in progress
+struct StackAudioAnalyser
+{
+	size_t channels;
+	uint32_t sample_rate;
+
+	// The K-weighting filters, and the state of each for every channel (shelf
+	// z1, shelf z2, high-pass z1, high-pass z2)
+	StackAudioAnalysisBiquad shelf;
+	StackAudioAnalysisBiquad highpass;
+	std::vector<double> filter_state;
+
+	// The weighting of each channel when summing loudness
+	std::vector<double> weights;
+
+	// The K-weighted energy of each channel in the current 100ms sub-block
+	std::vector<double> subblock_energy;
+	uint32_t subblock_frames;
+	uint32_t frames_per_subblock;
+
+	// The weighted mean square of each completed sub-block
+	std::vector<double> subblocks;
+
+	// The true peak interpolation filter, stored [tap][phase], and the last
+	// few samples of each channel
+	float tp_coefficients[STACK_AUDIO_ANALYSIS_TP_TAPS][STACK_AUDIO_ANALYSIS_TP_PHASES];
+	float true_peak;
+
+	// Each channel de-interleaved, preceded by the history needed by the
+	// interpolation filter
+	std::vector<float> channel_buffer;
+
+	// Sample peak, clipping and silence
+	float sample_peak;
+	float silence_level;
+	uint64_t clipped_samples;
+	uint64_t samples;
+	int64_t first_loud_sample;
+	int64_t last_loud_sample;
+};
+
+// A queued analysis request
+struct StackAudioAnalysisJob
+{
+	uint64_t id;
+	char *uri;
+	StackAudioAnalysisCallback callback;
+	void *user_data;
+	bool success;
+	StackAudioAnalysis result;
+};
+
+// The state of the analysis service. This is created on first use and never
+// destroyed, as its threads run until the process exits
+struct StackAudioAnalysisService
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<StackAudioAnalysisJob*> queue;
+
+	// Requests that have neither been delivered nor cancelled
+	std::set<uint64_t> active;
+	uint64_t next_id;
+};
+
+// Global: The analysis service
+static StackAudioAnalysisService *service = NULL;
+static std::once_flag service_once;
+
+////////////////////////////////////////////////////////////////////////////////
+// Filter design
+
+// Calculates the K-weighting filters from ITU-R BS.1770 for a given sample
+// rate. The standard only gives coefficients for 48kHz, so we re-derive them
+// from the analogue prototype
+static void stack_audio_analysis_k_weighting(uint32_t sample_rate, StackAudioAnalysisBiquad *shelf, StackAudioAnalysisBiquad *highpass)
+{
+	// Stage 1: high shelf modelling the acoustic effect of the head
+	double f0 = 1681.974450955533;
+	double gain = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / (double)sample_rate);
+	double vh = pow(10.0, gain / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	shelf->b0 = (vh + vb * k / q + k * k) / a0;
+	shelf->b1 = 2.0 * (k * k - vh) / a0;
+	shelf->b2 = (vh - vb * k / q + k * k) / a0;
+	shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+	shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+	// Stage 2: RLB high-pass
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / (double)sample_rate);
+	a0 = 1.0 + k / q + k * k;
+	highpass->b0 = 1.0;
+	highpass->b1 = -2.0;
+	highpass->b2 = 1.0;
+	highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+	highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+// Calculates a Hann-windowed sinc interpolation filter for 4x oversampling,
+// normalising each phase to unity gain at DC
+static void stack_audio_analysis_tp_filter(float coefficients[STACK_AUDIO_ANALYSIS_TP_TAPS][STACK_AUDIO_ANALYSIS_TP_PHASES])
+{
+	const size_t length = STACK_AUDIO_ANALYSIS_TP_TAPS * STACK_AUDIO_ANALYSIS_TP_PHASES;
+	double h[STACK_AUDIO_ANALYSIS_TP_TAPS * STACK_AUDIO_ANALYSIS_TP_PHASES];
+	for (size_t n = 0; n < length; n++)
+	{
+		const double m = ((double)n - (double)(length - 1) / 2.0) / (double)STACK_AUDIO_ANALYSIS_TP_PHASES;
+		const double sinc = (m == 0.0) ? 1.0 : sin(M_PI * m) / (M_PI * m);
+		const double window = 0.5 - 0.5 * cos(2.0 * M_PI * ((double)n + 0.5) / (double)length);
+		h[n] = sinc * window;
+	}
+
+	for (size_t phase = 0; phase < STACK_AUDIO_ANALYSIS_TP_PHASES; phase++)
+	{
+		double sum = 0.0;
+		for (size_t tap = 0; tap < STACK_AUDIO_ANALYSIS_TP_TAPS; tap++)
+		{
+			sum += h[tap * STACK_AUDIO_ANALYSIS_TP_PHASES + phase];
+		}
+		for (size_t tap = 0; tap < STACK_AUDIO_ANALYSIS_TP_TAPS; tap++)
+		{
+			coefficients[tap][phase] = (float)(h[tap * STACK_AUDIO_ANALYSIS_TP_PHASES + phase] / sum);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Kernels
+
+// Finds the peak, counts the clipped samples and finds the first and last
+// samples above the silence threshold in a block of interleaved samples
+// @param data The samples
+// @param count The number of samples
+// @param offset The index of the first sample within the whole file
+static void stack_audio_analysis_scan(StackAudioAnalyser *analyser, const float *data, size_t count, uint64_t offset)
+{
+	size_t i = 0;
+	float peak = analyser->sample_peak;
+	uint64_t clipped = 0;
+	int64_t first = -1, last = -1;
+
+#if defined(__SSE2__)
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 clip_level = _mm_set1_ps(STACK_AUDIO_ANALYSIS_CLIP_LEVEL);
+	const __m128 silence_level = _mm_set1_ps(analyser->silence_level);
+	__m128 vpeak = _mm_set1_ps(peak);
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 v = _mm_and_ps(_mm_loadu_ps(&data[i]), abs_mask);
+		vpeak = _mm_max_ps(vpeak, v);
+		clipped += __builtin_popcount(_mm_movemask_ps(_mm_cmpge_ps(v, clip_level)));
+
+		const int loud = _mm_movemask_ps(_mm_cmpgt_ps(v, silence_level));
+		if (loud != 0)
+		{
+			if (first < 0)
+			{
+				first = i + __builtin_ctz(loud);
+			}
+			last = i + 31 - __builtin_clz(loud);
+		}
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, vpeak);
+	peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+
+	for (; i < count; i++)
+	{
+		const float v = fabsf(data[i]);
+		if (v > peak) { peak = v; }
+		if (v >= STACK_AUDIO_ANALYSIS_CLIP_LEVEL) { clipped++; }
+		if (v > analyser->silence_level)
+		{
+			if (first < 0)
+			{
+				first = i;
+			}
+			last = i;
+		}
+	}
+
+	analyser->sample_peak = peak;
+	analyser->clipped_samples += clipped;
+	if (first >= 0)
+	{
+		if (analyser->first_loud_sample < 0)
+		{
+			analyser->first_loud_sample = offset + first;
+		}
+		analyser->last_loud_sample = offset + last;
+	}
+}
+
+// Returns the highest absolute value of the 4x oversampled signal. The data
+// must be preceded by STACK_AUDIO_ANALYSIS_TP_TAPS - 1 samples of history
+static float stack_audio_analysis_true_peak(const StackAudioAnalyser *analyser, const float *data, size_t count)
+{
+	float peak = 0.0f;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Each vector holds all four phases of the oversampled output for one
+	// input sample
+	__m128 coefficients[STACK_AUDIO_ANALYSIS_TP_TAPS];
+	for (size_t tap = 0; tap < STACK_AUDIO_ANALYSIS_TP_TAPS; tap++)
+	{
+		coefficients[tap] = _mm_loadu_ps(analyser->tp_coefficients[tap]);
+	}
+
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vpeak = _mm_setzero_ps();
+	for (; i < count; i++)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for (size_t tap = 0; tap < STACK_AUDIO_ANALYSIS_TP_TAPS; tap++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(data[(ssize_t)i - (ssize_t)tap]), coefficients[tap]));
+		}
+		vpeak = _mm_max_ps(vpeak, _mm_and_ps(sum, abs_mask));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, vpeak);
+	peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+	for (; i < count; i++)
+	{
+		for (size_t phase = 0; phase < STACK_AUDIO_ANALYSIS_TP_PHASES; phase++)
+		{
+			float sum = 0.0f;
+			for (size_t tap = 0; tap < STACK_AUDIO_ANALYSIS_TP_TAPS; tap++)
+			{
+				sum += data[(ssize_t)i - (ssize_t)tap] * analyser->tp_coefficients[tap][phase];
+			}
+			peak = std::max(peak, fabsf(sum));
+		}
+	}
+#endif
+
+	return peak;
+}
+
+// Applies the K-weighting filters to a channel and adds up the energy
+// @param state The four filter state variables of the channel
+// @param energy Receives the sum of squares of the filtered samples
+static void stack_audio_analysis_filter(const StackAudioAnalyser *analyser, const float *data, size_t count, double *state, double *energy)
+{
+	const StackAudioAnalysisBiquad &s = analyser->shelf, &h = analyser->highpass;
+	double sz1 = state[0], sz2 = state[1], hz1 = state[2], hz2 = state[3];
+	double sum = 0.0;
+
+	// Transposed direct form II
+	for (size_t i = 0; i < count; i++)
+	{
+		const double x = data[i];
+		const double y = s.b0 * x + sz1;
+		sz1 = s.b1 * x - s.a1 * y + sz2;
+		sz2 = s.b2 * x - s.a2 * y;
+		const double z = h.b0 * y + hz1;
+		hz1 = h.b1 * y - h.a1 * z + hz2;
+		hz2 = h.b2 * y - h.a2 * z;
+		sum += z * z;
+	}
+
+	state[0] = sz1; state[1] = sz2; state[2] = hz1; state[3] = hz2;
+	*energy += sum;
+}
+
+#if defined(__SSE2__)
+// As stack_audio_analysis_filter, but filters two channels at once
+static void stack_audio_analysis_filter_pair(const StackAudioAnalyser *analyser, const float *data0, const float *data1, size_t count, double *state0, double *state1, double *energy0, double *energy1)
+{
+	const StackAudioAnalysisBiquad &s = analyser->shelf, &h = analyser->highpass;
+	const __m128d sb0 = _mm_set1_pd(s.b0), sb1 = _mm_set1_pd(s.b1), sb2 = _mm_set1_pd(s.b2), sa1 = _mm_set1_pd(s.a1), sa2 = _mm_set1_pd(s.a2);
+	const __m128d hb0 = _mm_set1_pd(h.b0), hb1 = _mm_set1_pd(h.b1), hb2 = _mm_set1_pd(h.b2), ha1 = _mm_set1_pd(h.a1), ha2 = _mm_set1_pd(h.a2);
+	__m128d sz1 = _mm_set_pd(state1[0], state0[0]), sz2 = _mm_set_pd(state1[1], state0[1]);
+	__m128d hz1 = _mm_set_pd(state1[2], state0[2]), hz2 = _mm_set_pd(state1[3], state0[3]);
+	__m128d sum = _mm_setzero_pd();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const __m128d x = _mm_set_pd(data1[i], data0[i]);
+		const __m128d y = _mm_add_pd(_mm_mul_pd(sb0, x), sz1);
+		sz1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)), sz2);
+		sz2 = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+		const __m128d z = _mm_add_pd(_mm_mul_pd(hb0, y), hz1);
+		hz1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(hb1, y), _mm_mul_pd(ha1, z)), hz2);
+		hz2 = _mm_sub_pd(_mm_mul_pd(hb2, y), _mm_mul_pd(ha2, z));
+		sum = _mm_add_pd(sum, _mm_mul_pd(z, z));
+	}
+
+	double values[2];
+	_mm_storeu_pd(values, sz1); state0[0] = values[0]; state1[0] = values[1];
+	_mm_storeu_pd(values, sz2); state0[1] = values[0]; state1[1] = values[1];
+	_mm_storeu_pd(values, hz1); state0[2] = values[0]; state1[2] = values[1];
+	_mm_storeu_pd(values, hz2); state0[3] = values[0]; state1[3] = values[1];
+	_mm_storeu_pd(values, sum); *energy0 += values[0]; *energy1 += values[1];
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Analysis
+
+static void stack_audio_analyser_init(StackAudioAnalyser *analyser, size_t channels, uint32_t sample_rate)
+{
+	analyser->channels = channels;
+	analyser->sample_rate = sample_rate;
+
+	stack_audio_analysis_k_weighting(sample_rate, &analyser->shelf, &analyser->highpass);
+	analyser->filter_state.assign(channels * 4, 0.0);
+
+	// Surround channels (of 5.1) are weighted more heavily, and the LFE channel
+	// is ignored
+	analyser->weights.assign(channels, 1.0);
+	if (channels == 6)
+	{
+		analyser->weights[3] = 0.0;
+		analyser->weights[4] = 1.41;
+		analyser->weights[5] = 1.41;
+	}
+
+	analyser->subblock_energy.assign(channels, 0.0);
+	analyser->subblock_frames = 0;
+	analyser->frames_per_subblock = std::max(sample_rate / 10, 1u);
+	analyser->subblocks.clear();
+
+	stack_audio_analysis_tp_filter(analyser->tp_coefficients);
+	analyser->true_peak = 0.0f;
+	analyser->channel_buffer.assign(channels * (STACK_AUDIO_ANALYSIS_TP_TAPS - 1 + STACK_AUDIO_ANALYSIS_READ_FRAMES), 0.0f);
+
+	analyser->sample_peak = 0.0f;
+	analyser->silence_level = (float)pow(10.0, STACK_AUDIO_ANALYSIS_SILENCE_THRESHOLD / 20.0);
+	analyser->clipped_samples = 0;
+	analyser->samples = 0;
+	analyser->first_loud_sample = -1;
+	analyser->last_loud_sample = -1;
+}
+
+// Stores the current sub-block of loudness measurements
+static void stack_audio_analyser_end_subblock(StackAudioAnalyser *analyser)
+{
+	double sum = 0.0;
+	for (size_t channel = 0; channel < analyser->channels; channel++)
+	{
+		sum += analyser->weights[channel] * analyser->subblock_energy[channel] / (double)analyser->subblock_frames;
+		analyser->subblock_energy[channel] = 0.0;
+	}
+	analyser->subblocks.push_back(sum);
+	analyser->subblock_frames = 0;
+}
+
+// Analyses a block of interleaved audio
+static void stack_audio_analyser_process(StackAudioAnalyser *analyser, const float *data, size_t frames)
+{
+	const size_t channels = analyser->channels;
+	const size_t history = STACK_AUDIO_ANALYSIS_TP_TAPS - 1;
+	const size_t stride = history + STACK_AUDIO_ANALYSIS_READ_FRAMES;
+
+	stack_audio_analysis_scan(analyser, data, frames * channels, analyser->samples);
+	analyser->samples += frames * channels;
+
+	// De-interleave each channel after its history, and measure its true peak
+	for (size_t channel = 0; channel < channels; channel++)
+	{
+		float *buffer = &analyser->channel_buffer[channel * stride];
+		for (size_t i = 0; i < frames; i++)
+		{
+			buffer[history + i] = data[i * channels + channel];
+		}
+
+		analyser->true_peak = std::max(analyser->true_peak, stack_audio_analysis_true_peak(analyser, &buffer[history], frames));
+	}
+
+	// Filter the audio for loudness, splitting at the sub-block boundaries
+	size_t offset = 0;
+	while (offset < frames)
+	{
+		const size_t count = std::min(frames - offset, (size_t)(analyser->frames_per_subblock - analyser->subblock_frames));
+		size_t channel = 0;
+#if defined(__SSE2__)
+		for (; channel + 2 <= channels; channel += 2)
+		{
+			stack_audio_analysis_filter_pair(analyser, &analyser->channel_buffer[channel * stride + history + offset], &analyser->channel_buffer[(channel + 1) * stride + history + offset], count, &analyser->filter_state[channel * 4], &analyser->filter_state[(channel + 1) * 4], &analyser->subblock_energy[channel], &analyser->subblock_energy[channel + 1]);
+		}
+#endif
+		for (; channel < channels; channel++)
+		{
+			stack_audio_analysis_filter(analyser, &analyser->channel_buffer[channel * stride + history + offset], count, &analyser->filter_state[channel * 4], &analyser->subblock_energy[channel]);
+		}
+
+		analyser->subblock_frames += count;
+		offset += count;
+		if (analyser->subblock_frames == analyser->frames_per_subblock)
+		{
+			stack_audio_analyser_end_subblock(analyser);
+		}
+	}
+
+	// Keep the end of each channel as the history for the next block
+	for (size_t channel = 0; channel < channels; channel++)
+	{
+		float *buffer = &analyser->channel_buffer[channel * stride];
+		memmove(buffer, &buffer[frames], history * sizeof(float));
+	}
+}
+
+// Converts a mean square to loudness in LUFS
+static double stack_audio_analysis_lufs(double mean_square)
+{
+	return -0.691 + 10.0 * log10(mean_square);
+}
+
+// Calculates the gated integrated loudness from the sub-blocks
+static double stack_audio_analyser_integrated_loudness(StackAudioAnalyser *analyser)
+{
+	// If we don't have enough audio for a single 400ms block, make do with
+	// what we have
+	if (analyser->subblocks.size() < 4 && analyser->subblock_frames > 0)
+	{
+		stack_audio_analyser_end_subblock(analyser);
+	}
+	const std::vector<double> &subblocks = analyser->subblocks;
+	if (subblocks.size() == 0)
+	{
+		return -HUGE_VAL;
+	}
+
+	// Build the 400ms blocks, which overlap by 75%
+	std::vector<double> blocks;
+	if (subblocks.size() < 4)
+	{
+		double sum = 0.0;
+		for (double subblock : subblocks)
+		{
+			sum += subblock;
+		}
+		blocks.push_back(sum / (double)subblocks.size());
+	}
+	else
+	{
+		for (size_t i = 0; i + 4 <= subblocks.size(); i++)
+		{
+			blocks.push_back((subblocks[i] + subblocks[i + 1] + subblocks[i + 2] + subblocks[i + 3]) / 4.0);
+		}
+	}
+
+	// Absolute gate at -70 LUFS
+	const double absolute_gate = pow(10.0, (-70.0 + 0.691) / 10.0);
+	double sum = 0.0;
+	size_t count = 0;
+	for (double block : blocks)
+	{
+		if (block > absolute_gate)
+		{
+			sum += block;
+			count++;
+		}
+	}
+	if (count == 0)
+	{
+		return -HUGE_VAL;
+	}
+
+	// Relative gate 10 LU below the absolute-gated loudness
+	const double relative_gate = (sum / (double)count) * 0.1;
+	sum = 0.0;
+	count = 0;
+	for (double block : blocks)
+	{
+		if (block > absolute_gate && block > relative_gate)
+		{
+			sum += block;
+			count++;
+		}
+	}
+
+	return stack_audio_analysis_lufs(sum / (double)count);
+}
+
+// Converts a frame number to a time
+static stack_time_t stack_audio_analysis_frame_to_time(uint64_t frame, uint32_t sample_rate)
+{
+	return (stack_time_t)((frame / sample_rate) * NANOSECS_PER_SEC + (frame % sample_rate) * NANOSECS_PER_SEC / sample_rate);
+}
+
+bool stack_audio_analysis_analyse(const char *uri, StackAudioAnalysis *result, bool (*cancel)(void*), void *user_data)
+{
+	StackAudioFile *file = stack_audio_file_create(uri);
+	if (file == NULL)
+	{
+		stack_log("stack_audio_analysis_analyse(): File open failed\n");
+		return false;
+	}
+
+	StackAudioAnalyser analyser;
+	stack_audio_analyser_init(&analyser, file->channels, file->sample_rate);
+
+	float *read_buffer = new float[STACK_AUDIO_ANALYSIS_READ_FRAMES * file->channels];
+	size_t frames_read = 0;
+	bool cancelled = false;
+	while ((frames_read = stack_audio_file_read(file, read_buffer, STACK_AUDIO_ANALYSIS_READ_FRAMES)) > 0)
+	{
+		if (cancel != NULL && cancel(user_data))
+		{
+			cancelled = true;
+			break;
+		}
+
+		stack_audio_analyser_process(&analyser, read_buffer, frames_read);
+	}
+
+	// Tidy up
+	delete [] read_buffer;
+	stack_audio_file_destroy(file);
+
+	if (cancelled)
+	{
+		return false;
+	}
+
+	result->integrated_loudness = stack_audio_analyser_integrated_loudness(&analyser);
+	result->sample_peak = 20.0 * log10(analyser.sample_peak);
+	result->true_peak = 20.0 * log10(std::max(analyser.true_peak, analyser.sample_peak));
+	result->clipped_samples = analyser.clipped_samples;
+	if (analyser.first_loud_sample >= 0)
+	{
+		result->content_start_time = stack_audio_analysis_frame_to_time(analyser.first_loud_sample / analyser.channels, analyser.sample_rate);
+		result->content_end_time = stack_audio_analysis_frame_to_time(analyser.last_loud_sample / analyser.channels + 1, analyser.sample_rate);
+	}
+	else
+	{
+		result->content_start_time = 0;
+		result->content_end_time = 0;
+	}
+
+	return true;
+}
+
+double stack_audio_analysis_suggest_gain(const StackAudioAnalysis *analysis)
+{
+	if (!std::isfinite(analysis->integrated_loudness))
+	{
+		return 0.0;
+	}
+
+	double gain = STACK_AUDIO_ANALYSIS_TARGET_LOUDNESS - analysis->integrated_loudness;
+	if (std::isfinite(analysis->true_peak))
+	{
+		gain = std::min(gain, STACK_AUDIO_ANALYSIS_MAX_TRUE_PEAK - analysis->true_peak);
+	}
+
+	return gain;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Caching
+
+static bool stack_audio_analysis_load_cache(const char *uri, StackAudioAnalysis *result)
+{
+	GFile *file = stack_audio_file_new_gfile(uri);
+	const char *payload = NULL;
+	size_t payload_size = 0;
+	GMappedFile *mapped = stack_media_cache_map(file, "anly", STACK_AUDIO_ANALYSIS_CACHE_VERSION, &payload, &payload_size);
+	g_object_unref(file);
+
+	if (mapped == NULL)
+	{
+		return false;
+	}
+
+	bool valid = (payload_size == sizeof(StackAudioAnalysisCacheData));
+	if (valid)
+	{
+		StackAudioAnalysisCacheData data;
+		memcpy(&data, payload, sizeof(StackAudioAnalysisCacheData));
+		result->integrated_loudness = data.integrated_loudness;
+		result->true_peak = data.true_peak;
+		result->sample_peak = data.sample_peak;
+		result->content_start_time = data.content_start_time;
+		result->content_end_time = data.content_end_time;
+		result->clipped_samples = data.clipped_samples;
+	}
+	g_mapped_file_unref(mapped);
+
+	return valid;
+}
+
+static void stack_audio_analysis_save_cache(const char *uri, const StackAudioAnalysis *result)
+{
+	StackAudioAnalysisCacheData data;
+	data.integrated_loudness = result->integrated_loudness;
+	data.true_peak = result->true_peak;
+	data.sample_peak = result->sample_peak;
+	data.content_start_time = result->content_start_time;
+	data.content_end_time = result->content_end_time;
+	data.clipped_samples = result->clipped_samples;
+
+	GFile *file = stack_audio_file_new_gfile(uri);
+	stack_media_cache_write(file, "anly", STACK_AUDIO_ANALYSIS_CACHE_VERSION, &data, sizeof(StackAudioAnalysisCacheData));
+	g_object_unref(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Service
+
+// Returns whether a request has been cancelled
+static bool stack_audio_analysis_is_cancelled(void *user_data)
+{
+	const uint64_t id = *(uint64_t*)user_data;
+	std::unique_lock<std::mutex> lock(service->mutex);
+	return service->active.count(id) == 0;
+}
+
+// Delivers the result of a request on the UI thread
+static gboolean stack_audio_analysis_deliver(gpointer user_data)
+{
+	StackAudioAnalysisJob *job = (StackAudioAnalysisJob*)user_data;
+
+	// Only deliver if the request hasn't been cancelled
+	std::unique_lock<std::mutex> lock(service->mutex);
+	const bool wanted = service->active.erase(job->id) > 0;
+	lock.unlock();
+
+	if (wanted)
+	{
+		job->callback(job->uri, job->success ? &job->result : NULL, job->user_data);
+	}
+
+	// Tidy up
+	free(job->uri);
+	delete job;
+
+	return G_SOURCE_REMOVE;
+}
+
+// Thread that analyses the files in the queue
+static void stack_audio_analysis_worker_thread()
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-analysis");
+
+	// Run at a lower priority so as not to compete with playback or the UI
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+
+	while (true)
+	{
+		// Wait for a request
+		std::unique_lock<std::mutex> lock(service->mutex);
+		service->condition.wait(lock, []{ return !service->queue.empty(); });
+		StackAudioAnalysisJob *job = service->queue.front();
+		service->queue.pop_front();
+		const bool cancelled = service->active.count(job->id) == 0;
+		lock.unlock();
+
+		// Skip requests that were cancelled whilst they were queued
+		if (cancelled)
+		{
+			free(job->uri);
+			delete job;
+			continue;
+		}
+
+		// Use the cached analysis if there is one
+		job->success = stack_audio_analysis_load_cache(job->uri, &job->result);
+		if (!job->success)
+		{
+			job->success = stack_audio_analysis_analyse(job->uri, &job->result, stack_audio_analysis_is_cancelled, &job->id);
+			if (job->success)
+			{
+				stack_audio_analysis_save_cache(job->uri, &job->result);
+			}
+		}
+
+		gdk_threads_add_idle(stack_audio_analysis_deliver, job);
+	}
+}
+
+// Creates the service and starts its threads
+static void stack_audio_analysis_start()
+{
+	service = new StackAudioAnalysisService;
+	service->next_id = 1;
+
+	// Leave most of the processors for everything else
+	size_t thread_count = std::max(std::thread::hardware_concurrency() / 2, 1u);
+	thread_count = std::min(thread_count, (size_t)STACK_AUDIO_ANALYSIS_MAX_THREADS);
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		std::thread(stack_audio_analysis_worker_thread).detach();
+	}
+}
+
+uint64_t stack_audio_analysis_request(const char *uri, StackAudioAnalysisCallback callback, void *user_data)
+{
+	std::call_once(service_once, stack_audio_analysis_start);
+
+	StackAudioAnalysisJob *job = new StackAudioAnalysisJob;
+	job->uri = strdup(uri);
+	job->callback = callback;
+	job->user_data = user_data;
+	job->success = false;
+
+	std::unique_lock<std::mutex> lock(service->mutex);
+	job->id = service->next_id++;
+	service->active.insert(job->id);
+	service->queue.push_back(job);
+	lock.unlock();
+	service->condition.notify_one();
+
+	return job->id;
+}
+
+void stack_audio_analysis_cancel(uint64_t request)
+{
+	if (service == NULL)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(service->mutex);
+	service->active.erase(request);
+}
@@ -0,0 +1,77 @@
+#ifndef _STACKAUDIOANALYSIS_H_INCLUDED
+#define _STACKAUDIOANALYSIS_H_INCLUDED
+
+// Includes:
+#include "StackAudioFile.h"
+
+// The background analysis service decodes audio files on a small pool of
+// low-priority threads, measuring their loudness (per EBU R128), true peak,
+// leading and trailing silence and clipping. Results are cached in the media
+// cache so each file is only analysed once, and are delivered on the UI thread
+
+// The integrated loudness we suggest gain changes towards (LUFS)
+#define STACK_AUDIO_ANALYSIS_TARGET_LOUDNESS -23.0
+
+// The maximum true peak we allow suggested gain changes to reach (dBTP)
+#define STACK_AUDIO_ANALYSIS_MAX_TRUE_PEAK -1.0
+
+// The level below which audio is considered to be silence (dBFS)
+#define STACK_AUDIO_ANALYSIS_SILENCE_THRESHOLD -60.0
+
+// The results of analysing a file
+struct StackAudioAnalysis
+{
+	// The integrated loudness in LUFS, or -HUGE_VAL if the file is silent
+	double integrated_loudness;
+
+	// The highest true (inter-sample) peak in dBTP
+	double true_peak;
+
+	// The highest sample peak in dBFS
+	double sample_peak;
+
+	// The times of the first and last audio above the silence threshold. If
+	// the whole file is silent these are both zero
+	stack_time_t content_start_time;
+	stack_time_t content_end_time;
+
+	// The number of samples at full scale
+	uint64_t clipped_samples;
+};
+
+// Callback to receive the results of an analysis, called on the UI thread
+// @param uri The URI of the file that was analysed
+// @param analysis The results, or NULL if the file could not be analysed
+// @param user_data The user data passed to stack_audio_analysis_request
+typedef void (*StackAudioAnalysisCallback)(const char *uri, const StackAudioAnalysis *analysis, void *user_data);
+
+// Functions:
+
+// Queues a file for analysis. Never blocks: the result is always delivered
+// later via the callback, even if it was already cached. Safe to call from
+// any thread
+// @param uri The URI of the audio file
+// @param callback The function to receive the results
+// @param user_data Passed to the callback
+// @returns An identifier for the request which can be passed to
+// stack_audio_analysis_cancel
+uint64_t stack_audio_analysis_request(const char *uri, StackAudioAnalysisCallback callback, void *user_data);
+
+// Cancels an analysis request. The callback for the request will not be
+// called after this returns, provided that this is called on the UI thread
+// @param request The identifier returned by stack_audio_analysis_request
+void stack_audio_analysis_cancel(uint64_t request);
+
+// Analyses a file immediately on the calling thread
+// @param uri The URI of the audio file
+// @param result Receives the results
+// @param cancel If not NULL, analysis stops early when this returns true
+// @param user_data Passed to the cancel function
+// @returns Whether the analysis completed
+bool stack_audio_analysis_analyse(const char *uri, StackAudioAnalysis *result, bool (*cancel)(void*) = NULL, void *user_data = NULL);
+
+// Returns the gain change (in dB) that would bring the file to the target
+// loudness without its true peak exceeding the maximum
+double stack_audio_analysis_suggest_gain(const StackAudioAnalysis *analysis);
+
+#endif
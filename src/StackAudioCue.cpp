@@ -6,9 +6,13 @@
 #include "StackGtkHelper.h"
 #include "StackJson.h"
 #include "MPEGAudioFile.h"
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <time.h>
 
@@ -22,6 +26,44 @@ static GtkBuilder *sac_builder = NULL;
 // Global: A single instace of our icon
 static GdkPixbuf *icon = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackAudioCueKeys
+{
+	stack_property_key_t file;
+	stack_property_key_t media_start_time;
+	stack_property_key_t media_end_time;
+	stack_property_key_t loops;
+	stack_property_key_t master_volume;
+	stack_property_key_t rate;
+	stack_property_key_t crosspoint;
+};
+static StackAudioCueKeys sac_keys;
+
+// When files are opened lazily, how long a cue keeps its file open for after
+// it stops, or after it was opened ahead of time and not played
+#define STACK_AUDIO_CUE_IDLE_CLOSE_SECONDS 60
+
+// A file being opened in the background ahead of a cue being played. It's
+// shared between the cue and the opening thread so that either can let go of
+// it first (protected by open_service_mutex)
+struct StackAudioCuePendingOpen
+{
+	std::string uri;
+	StackAudioFile *file;
+	bool started;
+	bool done;
+	bool abandoned;
+};
+
+// Global: The queue of files for the opening thread to open, and the lock that
+// protects it along with the pending_open and idle_close_timer of every audio
+// cue
+static std::mutex open_service_mutex;
+static std::condition_variable open_service_condition;
+static std::deque<std::shared_ptr<StackAudioCuePendingOpen>> open_service_queue;
+static std::once_flag open_service_once;
+
 // Pre-define this:
 StackProperty *stack_audio_cue_get_volume_property(StackCue *cue, size_t channel, bool create);
 
@@ -71,6 +113,344 @@ static void stack_audio_cue_update_action_time(StackAudioCue *cue)
 	stack_cue_set_action_time(STACK_CUE(cue), action_time);
 }
 
+// Opens files in the background for cues that are likely to be played soon
+static void stack_audio_cue_open_thread()
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-open");
+
+	while (true)
+	{
+		// Wait for a request
+		std::unique_lock<std::mutex> lock(open_service_mutex);
+		open_service_condition.wait(lock, []{ return !open_service_queue.empty(); });
+		std::shared_ptr<StackAudioCuePendingOpen> pending = open_service_queue.front();
+		open_service_queue.pop_front();
+
+		// Don't bother if the cue has already given up on it
+		if (pending->abandoned)
+		{
+			continue;
+		}
+		pending->started = true;
+		lock.unlock();
+
+		StackAudioFile *file = stack_audio_file_create(pending->uri.c_str(), true);
+
+		lock.lock();
+		pending->done = true;
+		if (!pending->abandoned)
+		{
+			pending->file = file;
+			file = NULL;
+		}
+		open_service_condition.notify_all();
+		lock.unlock();
+
+		// Tidy up if nobody wants the file any more
+		if (file != NULL)
+		{
+			stack_audio_file_destroy(file);
+		}
+	}
+}
+
+// Starts the background opening thread
+static void stack_audio_cue_open_service_start()
+{
+	std::thread(stack_audio_cue_open_thread).detach();
+}
+
+// Pre-define this:
+static gboolean stack_audio_cue_idle_close(gpointer user_data);
+
+// Starts the timer that closes the file of the cue if it isn't played again
+// for a while, so that the number of files we have open depends on how many
+// cues are in use rather than how many have ever been used
+static void stack_audio_cue_schedule_idle_close(StackAudioCue *cue)
+{
+	if (!stack_audio_file_use_lazy_open())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(open_service_mutex);
+	if (cue->idle_close_timer == 0)
+	{
+		cue->idle_close_timer = g_timeout_add_seconds(STACK_AUDIO_CUE_IDLE_CLOSE_SECONDS, stack_audio_cue_idle_close, (gpointer)cue);
+	}
+}
+
+// Stops the timer that closes the file of the cue, as we're about to use it
+static void stack_audio_cue_cancel_idle_close(StackAudioCue *cue)
+{
+	std::unique_lock<std::mutex> lock(open_service_mutex);
+	if (cue->idle_close_timer != 0)
+	{
+		g_source_remove(cue->idle_close_timer);
+		cue->idle_close_timer = 0;
+	}
+}
+
+// Starts opening the file of the cue in the background, so that it's likely to
+// be open by the time the cue is played. The file is closed again if the cue
+// isn't played for a while
+static void stack_audio_cue_preopen_file(StackAudioCue *cue)
+{
+	if (!stack_audio_file_use_lazy_open() || !cue->file_valid || cue->playback_file != NULL)
+	{
+		return;
+	}
+
+	char *uri = NULL;
+	stack_property_get_string(stack_cue_get_property(STACK_CUE(cue), "file"), STACK_PROPERTY_VERSION_DEFINED, &uri);
+	if (uri == NULL)
+	{
+		return;
+	}
+
+	std::call_once(open_service_once, stack_audio_cue_open_service_start);
+
+	std::unique_lock<std::mutex> lock(open_service_mutex);
+	if (cue->pending_open)
+	{
+		return;
+	}
+
+	std::shared_ptr<StackAudioCuePendingOpen> pending = std::make_shared<StackAudioCuePendingOpen>();
+	pending->uri = uri;
+	pending->file = NULL;
+	pending->started = false;
+	pending->done = false;
+	pending->abandoned = false;
+	cue->pending_open = pending;
+	open_service_queue.push_back(pending);
+	open_service_condition.notify_all();
+	lock.unlock();
+
+	stack_audio_cue_schedule_idle_close(cue);
+}
+
+// Takes the file that was opened in the background for the cue, waiting for
+// it if it's part-way through being opened. Returns NULL if there isn't one,
+// if it was of a different file, or if it hasn't started opening yet (in which
+// case it's quicker to open it ourselves). Either way, the background open is
+// forgotten about. Passing a NULL uri just cancels the background open
+static StackAudioFile *stack_audio_cue_take_preopened_file(StackAudioCue *cue, const char *uri)
+{
+	std::unique_lock<std::mutex> lock(open_service_mutex);
+	std::shared_ptr<StackAudioCuePendingOpen> pending = cue->pending_open;
+	cue->pending_open.reset();
+	if (!pending)
+	{
+		return NULL;
+	}
+
+	const bool wanted = (uri != NULL && pending->uri == uri);
+	if (wanted && pending->started)
+	{
+		open_service_condition.wait(lock, [&pending]{ return pending->done; });
+	}
+
+	// Tell the opening thread not to bother if it hasn't got to it yet
+	pending->abandoned = true;
+	StackAudioFile *file = pending->file;
+	pending->file = NULL;
+	lock.unlock();
+
+	if (file != NULL && !wanted)
+	{
+		stack_audio_file_destroy(file);
+		file = NULL;
+	}
+
+	return file;
+}
+
+// Opens the file of the cue if it is not already open
+static bool stack_audio_cue_open_file(StackAudioCue *cue)
+{
+	// We're about to use the file, so don't close it
+	stack_audio_cue_cancel_idle_close(cue);
+
+	if (cue->playback_file != NULL)
+	{
+		return true;
+	}
+
+	char *uri = NULL;
+	stack_property_get_string(stack_cue_get_property(STACK_CUE(cue), "file"), STACK_PROPERTY_VERSION_DEFINED, &uri);
+	if (uri == NULL)
+	{
+		return false;
+	}
+
+	// Take the file if it was opened in the background ahead of time, or if
+	// the cue list opened it for us whilst loading
+	cue->playback_file = stack_audio_cue_take_preopened_file(cue, uri);
+	StackCueList *cue_list = STACK_CUE(cue)->parent;
+	if (cue->playback_file == NULL && cue_list != NULL && cue_list->media_prefetch != NULL)
+	{
+		cue->playback_file = stack_audio_file_prefetch_take(cue_list->media_prefetch, uri);
+	}
+	if (cue->playback_file == NULL)
+	{
+		cue->playback_file = stack_audio_file_create(uri, true);
+	}
+	if (cue->playback_file == NULL)
+	{
+		return false;
+	}
+
+	// If we already knew about the file, the volume properties depend on its
+	// channel count, which mustn't have changed underneath us
+	if (cue->file_valid && cue->playback_file->channels != cue->file_info.channels)
+	{
+		stack_log("stack_audio_cue_open_file(): Channel count of file has changed since it was loaded\n");
+		stack_audio_file_destroy(cue->playback_file);
+		cue->playback_file = NULL;
+		return false;
+	}
+
+	cue->file_info.format = cue->playback_file->format;
+	cue->file_info.channels = cue->playback_file->channels;
+	cue->file_info.sample_rate = cue->playback_file->sample_rate;
+	cue->file_info.length = cue->playback_file->length;
+	cue->file_info.frames = cue->playback_file->frames;
+
+	return true;
+}
+
+// Closes the file of the cue
+static void stack_audio_cue_close_file(StackAudioCue *cue)
+{
+	stack_audio_cue_cancel_idle_close(cue);
+
+	// Cancel any background open
+	stack_audio_cue_take_preopened_file(cue, NULL);
+
+	if (cue->playback_file != NULL)
+	{
+		stack_audio_file_destroy(cue->playback_file);
+		cue->playback_file = NULL;
+	}
+}
+
+// Timer callback that closes the file of a cue that has been idle for a while,
+// including one that was opened ahead of time but never played
+static gboolean stack_audio_cue_idle_close(gpointer user_data)
+{
+	StackAudioCue *cue = STACK_AUDIO_CUE(user_data);
+
+	stack_cue_list_lock(STACK_CUE(cue)->parent);
+
+	// Ignore us if the timer was replaced whilst we waited for the lock
+	{
+		std::unique_lock<std::mutex> lock(open_service_mutex);
+		if (cue->idle_close_timer != g_source_get_id(g_main_current_source()))
+		{
+			lock.unlock();
+			stack_cue_list_unlock(STACK_CUE(cue)->parent);
+			return G_SOURCE_REMOVE;
+		}
+		cue->idle_close_timer = 0;
+	}
+
+	// Only close the file if we've not been played since, and we're not still
+	// likely to be played (i.e. we're not selected or armed by a trigger). If
+	// we're selected, the timer starts again when we're deselected
+	const bool stopped = (STACK_CUE(cue)->state == STACK_CUE_STATE_STOPPED || STACK_CUE(cue)->state == STACK_CUE_STATE_ERROR);
+	if (stopped && cue->media_tab == NULL && STACK_CUE(cue)->triggers->empty())
+	{
+		stack_audio_cue_close_file(cue);
+	}
+	stack_cue_list_unlock(STACK_CUE(cue)->parent);
+
+	return G_SOURCE_REMOVE;
+}
+
+// Shows the results of the analysis of the file on the media tab
+static void stack_audio_cue_update_analysis_label(StackAudioCue *cue)
+{
+	if (cue->media_tab == NULL)
+	{
+		return;
+	}
+
+	char text_buffer[256];
+	if (cue->analysis_request != 0)
+	{
+		snprintf(text_buffer, 256, "Analysing...");
+	}
+	else if (cue->analysis_valid)
+	{
+		char start_buffer[32], end_buffer[32];
+		stack_format_time_as_string(cue->analysis.content_start_time, start_buffer, 32);
+		stack_format_time_as_string(cue->analysis.content_end_time, end_buffer, 32);
+		snprintf(text_buffer, 256, "%.1f LUFS, true peak %.1f dBTP, %lu clipped samples. Audible from %s to %s, suggested volume %.2f dB", cue->analysis.integrated_loudness, cue->analysis.true_peak, cue->analysis.clipped_samples, start_buffer, end_buffer, stack_audio_analysis_suggest_gain(&cue->analysis));
+	}
+	else if (cue->file_valid && cue->analysis_attempted)
+	{
+		snprintf(text_buffer, 256, "Analysis failed");
+	}
+	else
+	{
+		text_buffer[0] = '\0';
+	}
+
+	gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(sac_builder, "acpAnalysisLabel")), text_buffer);
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(sac_builder, "acpAnalysisApply")), cue->analysis_valid);
+}
+
+// Called on the UI thread when the analysis of our file completes
+static void stack_audio_cue_analysis_complete(const char *uri, const StackAudioAnalysis *analysis, void *user_data)
+{
+	StackAudioCue *cue = STACK_AUDIO_CUE(user_data);
+
+	cue->analysis_request = 0;
+	cue->analysis_attempted = true;
+	cue->analysis_valid = (analysis != NULL);
+	if (analysis != NULL)
+	{
+		cue->analysis = *analysis;
+	}
+
+	stack_audio_cue_update_analysis_label(cue);
+}
+
+// Starts analysing the file in the background if we haven't already. This is
+// done when the cue is selected rather than for every cue, and never whilst
+// we're loading, so that opening a show doesn't queue up a scan of every file
+static void stack_audio_cue_request_analysis(StackAudioCue *cue)
+{
+	if (!cue->file_valid || cue->loading || cue->analysis_request != 0 || cue->analysis_attempted)
+	{
+		return;
+	}
+
+	char *uri = NULL;
+	stack_property_get_string(stack_cue_get_property(STACK_CUE(cue), "file"), STACK_PROPERTY_VERSION_DEFINED, &uri);
+	if (uri != NULL && uri[0] != '\0')
+	{
+		cue->analysis_request = stack_audio_analysis_request(uri, stack_audio_cue_analysis_complete, (void*)cue);
+	}
+}
+
+// Fills in the levels tab for the channels of the current file
+static void stack_audio_cue_populate_levels_tab(StackAudioCue *cue)
+{
+	size_t input_channels = 0;
+	if (cue->file_valid)
+	{
+		input_channels = cue->file_info.channels;
+	}
+
+	stack_audio_levels_tab_populate(cue->levels_tab, input_channels, STACK_CUE(cue)->parent->channels, true, cue->affect_live, (GCallback)(ToggleButtonCallback)[](GtkToggleButton *self, gpointer user_data) -> void {
+		StackAudioCue *cue = STACK_AUDIO_CUE(user_data);
+		cue->affect_live = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self));
+	});
+}
+
 static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -85,19 +465,34 @@ static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersi
 		stack_cue_set_state(STACK_CUE(cue), STACK_CUE_STATE_STOPPED);
 
 		// Tidy up the existing file
-		if (cue->playback_file != NULL)
+		if (cue->file_valid)
 		{
-			old_channels = cue->playback_file->channels;
-			stack_audio_file_destroy(cue->playback_file);
+			old_channels = cue->file_info.channels;
 		}
+		stack_audio_cue_close_file(cue);
+		cue->file_valid = false;
 
-		// Attempt to create the new audiofile object
+		// Find out about the new file. When opening lazily we avoid opening the
+		// file until we need it
 		char *uri = NULL;
 		stack_property_get_string(property, STACK_PROPERTY_VERSION_DEFINED, &uri);
-		StackAudioFile *new_playback_file = stack_audio_file_create(uri);
-
-		// Store the new file (regardless of whether it succeeded)
-		cue->playback_file = new_playback_file;
+		if (stack_audio_file_use_lazy_open())
+		{
+			// Use the details the cue list fetched whilst loading if it has them
+			StackCueList *cue_list = STACK_CUE(cue)->parent;
+			if (cue_list != NULL && cue_list->media_prefetch != NULL)
+			{
+				cue->file_valid = stack_audio_file_prefetch_get_info(cue_list->media_prefetch, uri, &cue->file_info);
+			}
+			if (!cue->file_valid)
+			{
+				cue->file_valid = stack_audio_file_get_info(uri, &cue->file_info);
+			}
+		}
+		else
+		{
+			cue->file_valid = stack_audio_cue_open_file(cue);
+		}
 
 		// Store the filename
 		free(cue->short_filename);
@@ -106,7 +501,7 @@ static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersi
 		stack_time_t new_file_length = 0;
 
 		// If it didn't succeed....
-		if (new_playback_file == NULL)
+		if (!cue->file_valid)
 		{
 			// Set the state to error
 			stack_cue_set_state(STACK_CUE(cue), STACK_CUE_STATE_ERROR);
@@ -114,13 +509,29 @@ static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersi
 		else
 		{
 			// Grab the new file length and channel count
-			new_file_length = new_playback_file->length;
-			new_channels = new_playback_file->channels;
+			new_file_length = cue->file_info.length;
+			new_channels = cue->file_info.channels;
 		}
 
-		// Reset the media start/end times to the whole file
-		stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_start_time"), STACK_PROPERTY_VERSION_DEFINED, 0);
-		stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_end_time"), STACK_PROPERTY_VERSION_DEFINED, new_file_length);
+		// Discard any analysis of the old file. The new one is analysed when
+		// the cue is selected, so only start now if it already is
+		stack_audio_analysis_cancel(cue->analysis_request);
+		cue->analysis_request = 0;
+		cue->analysis_attempted = false;
+		cue->analysis_valid = false;
+		if (cue->media_tab)
+		{
+			stack_audio_cue_request_analysis(cue);
+		}
+		stack_audio_cue_update_analysis_label(cue);
+
+		// Reset the media start/end times to the whole file (unless we're
+		// loading, in which case they're about to be loaded)
+		if (!cue->loading)
+		{
+			stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_start_time"), STACK_PROPERTY_VERSION_DEFINED, 0);
+			stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_end_time"), STACK_PROPERTY_VERSION_DEFINED, new_file_length);
+		}
 
 		// Update the cue action time;
 		stack_audio_cue_update_action_time(cue);
@@ -141,9 +552,9 @@ static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersi
 
 			// Display the file length
 			char time_buffer[32], text_buffer[128];
-			if (cue->playback_file)
+			if (cue->file_valid)
 			{
-				stack_format_time_as_string(cue->playback_file->length, time_buffer, 32);
+				stack_format_time_as_string(cue->file_info.length, time_buffer, 32);
 				snprintf(text_buffer, 128, "(Length is %s)", time_buffer);
 			}
 			else
@@ -156,17 +567,7 @@ static void stack_audio_cue_ccb_file(StackProperty *property, StackPropertyVersi
 		// Update tabs if we're active
 		if (cue->levels_tab)
 		{
-			size_t input_channels = 0;
-			if (cue->playback_file != NULL)
-			{
-				input_channels = cue->playback_file->channels;
-			}
-
-			stack_audio_levels_tab_populate(cue->levels_tab, input_channels, STACK_CUE(cue)->parent->channels, true, cue->affect_live, (GCallback)(ToggleButtonCallback)[](GtkToggleButton *self, gpointer user_data) -> void {
-				StackAudioCue *cue = STACK_AUDIO_CUE(user_data);
-				cue->affect_live = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self));
-			});
-
+			stack_audio_cue_populate_levels_tab(cue);
 			gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpFileEntry")), uri);
 		}
 
@@ -261,7 +662,7 @@ static void stack_audio_cue_ccb_loops(StackProperty *property, StackPropertyVers
 	}
 }
 
-// This is used by master, per-channel and crosspoints
+// This is used by master and per-channel volumes
 static void stack_audio_cue_ccb_volume(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -289,6 +690,44 @@ static void stack_audio_cue_ccb_volume(StackProperty *property, StackPropertyVer
 	}
 }
 
+static void stack_audio_cue_ccb_crosspoint(StackProperty *property, StackPropertyVersion version, void *user_data)
+{
+	// If a defined-version property has changed, we should notify the cue list
+	// that we're now different
+	if (version == STACK_PROPERTY_VERSION_DEFINED)
+	{
+		StackAudioCue* cue = STACK_AUDIO_CUE(user_data);
+
+		// Notify cue list that we've changed
+		stack_cue_list_changed(STACK_CUE(cue)->parent, STACK_CUE(cue), property);
+
+		// Fire an updated-selected-cue signal to signal the UI to change
+		if (cue->media_tab)
+		{
+			StackAppWindow *window = (StackAppWindow*)gtk_widget_get_toplevel(GTK_WIDGET(cue->media_tab));
+			g_signal_emit_by_name((gpointer)window, "update-selected-cue");
+		}
+
+		// Only copy the crosspoint that changed to live (or all of them if
+		// several changed in a batch)
+		if (cue->affect_live)
+		{
+			const StackPropertyMatrix *crosspoints = STACK_PROPERTY_MATRIX(property);
+			size_t rows = 0, columns = 0;
+			stack_property_matrix_get_size(property, &rows, &columns);
+			double volume = 0.0;
+			if (crosspoints->changed_row >= rows || crosspoints->changed_column >= columns)
+			{
+				stack_property_copy_defined_to_live(property);
+			}
+			else if (stack_property_matrix_get(property, STACK_PROPERTY_VERSION_DEFINED, crosspoints->changed_row, crosspoints->changed_column, &volume))
+			{
+				stack_property_matrix_set(property, STACK_PROPERTY_VERSION_LIVE, crosspoints->changed_row, crosspoints->changed_column, volume);
+			}
+		}
+	}
+}
+
 static void stack_audio_cue_ccb_rate(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -328,9 +767,9 @@ int64_t stack_audio_cue_validate_media_start_time(StackPropertyUInt64 *property,
 		StackAudioCue* cue = STACK_AUDIO_CUE(user_data);
 
 		// Can't be past the end of the file
-		if (cue->playback_file && value > cue->playback_file->length)
+		if (cue->file_valid && value > cue->file_info.length)
 		{
-			return cue->playback_file->length;
+			return cue->file_info.length;
 		}
 
 		// Can't be greater than our end time
@@ -354,9 +793,9 @@ int64_t stack_audio_cue_validate_media_end_time(StackPropertyUInt64 *property, S
 		StackAudioCue* cue = STACK_AUDIO_CUE(user_data);
 
 		// Can't be past the end of the file
-		if (cue->playback_file && value > cue->playback_file->length)
+		if (cue->file_valid && value > cue->file_info.length)
 		{
-			return cue->playback_file->length;
+			return cue->file_info.length;
 		}
 
 		// Can't be earlier than our start time
@@ -431,38 +870,52 @@ static StackCue* stack_audio_cue_create(StackCueList *cue_list)
 	cue->affect_live = false;
 	cue->playback_buffer = NULL;
 	cue->playback_buffer_frames = 0;
+	cue->analysis_request = 0;
+	cue->analysis_attempted = false;
+	cue->analysis_valid = false;
+	cue->file_valid = false;
+	cue->idle_close_timer = 0;
+	cue->loading = false;
 
 	// Add our properties
-	StackProperty *file = stack_property_create("file", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *file = stack_property_create_keyed(sac_keys.file, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(STACK_CUE(cue), file);
 	stack_property_set_changed_callback(file, stack_audio_cue_ccb_file, (void*)cue);
 
-	StackProperty *media_start_time = stack_property_create("media_start_time", STACK_PROPERTY_TYPE_INT64);
+	StackProperty *media_start_time = stack_property_create_keyed(sac_keys.media_start_time, STACK_PROPERTY_TYPE_INT64);
 	stack_cue_add_property(STACK_CUE(cue), media_start_time);
 	stack_property_set_changed_callback(media_start_time, stack_audio_cue_ccb_media_time, (void*)cue);
 	stack_property_set_validator(media_start_time, (stack_property_validator_t)stack_audio_cue_validate_media_start_time, (void*)cue);
 
-	StackProperty *media_end_time = stack_property_create("media_end_time", STACK_PROPERTY_TYPE_INT64);
+	StackProperty *media_end_time = stack_property_create_keyed(sac_keys.media_end_time, STACK_PROPERTY_TYPE_INT64);
 	stack_cue_add_property(STACK_CUE(cue), media_end_time);
 	stack_property_set_changed_callback(media_end_time, stack_audio_cue_ccb_media_time, (void*)cue);
 	stack_property_set_validator(media_end_time, (stack_property_validator_t)stack_audio_cue_validate_media_end_time, (void*)cue);
 
-	StackProperty *loops = stack_property_create("loops", STACK_PROPERTY_TYPE_INT32);
+	StackProperty *loops = stack_property_create_keyed(sac_keys.loops, STACK_PROPERTY_TYPE_INT32);
 	stack_cue_add_property(STACK_CUE(cue), loops);
 	stack_property_set_int32(loops, STACK_PROPERTY_VERSION_DEFINED, 1);
 	stack_property_set_changed_callback(loops, stack_audio_cue_ccb_loops, (void*)cue);
 
-	StackProperty *volume = stack_property_create("master_volume", STACK_PROPERTY_TYPE_DOUBLE);
+	StackProperty *volume = stack_property_create_keyed(sac_keys.master_volume, STACK_PROPERTY_TYPE_DOUBLE);
 	stack_cue_add_property(STACK_CUE(cue), volume);
 	stack_property_set_changed_callback(volume, stack_audio_cue_ccb_volume, (void*)cue);
 	stack_property_set_validator(volume, (stack_property_validator_t)stack_audio_cue_validate_volume, (void*)cue);
 
-	StackProperty *rate = stack_property_create("rate", STACK_PROPERTY_TYPE_DOUBLE);
+	StackProperty *rate = stack_property_create_keyed(sac_keys.rate, STACK_PROPERTY_TYPE_DOUBLE);
 	stack_cue_add_property(STACK_CUE(cue), rate);
 	stack_property_set_double(rate, STACK_PROPERTY_VERSION_DEFINED, 1.0);
 	stack_property_set_changed_callback(rate, stack_audio_cue_ccb_rate, (void*)cue);
 	stack_property_set_validator(rate, (stack_property_validator_t)stack_audio_cue_validate_rate, (void*)cue);
 
+	// Crosspoints are stored as one matrix, with a row for each output channel
+	// and a column for each input channel. They're written to JSON as
+	// crosspoint_<output>_<input>
+	StackProperty *crosspoints = stack_property_create_keyed(sac_keys.crosspoint, STACK_PROPERTY_TYPE_MATRIX);
+	stack_cue_add_property(STACK_CUE(cue), crosspoints);
+	stack_property_set_changed_callback(crosspoints, stack_audio_cue_ccb_crosspoint, (void*)cue);
+	stack_property_set_validator(crosspoints, (stack_property_validator_t)stack_audio_cue_validate_volume, (void*)cue);
+
 	// Initialise our variables: preview
 	cue->preview_widget = NULL;
 
@@ -485,11 +938,11 @@ static void stack_audio_cue_destroy(StackCue *cue)
 	// Our tidy up here
 	free(acue->short_filename);
 
+	// Make sure we don't receive the results of any outstanding analysis
+	stack_audio_analysis_cancel(acue->analysis_request);
+
 	// Tidy up our file
-	if (acue->playback_file != NULL)
-	{
-		stack_audio_file_destroy(acue->playback_file);
-	}
+	stack_audio_cue_close_file(acue);
 
 	// Tidy up our resampler
 	if (acue->resampler != NULL)
@@ -515,7 +968,7 @@ static void stack_audio_cue_destroy(StackCue *cue)
 bool stack_audio_cue_set_file(StackAudioCue *cue, const char *uri)
 {
 	stack_property_set_string(stack_cue_get_property(STACK_CUE(cue), "file"), STACK_PROPERTY_VERSION_DEFINED, uri);
-	return cue->playback_file != NULL;
+	return cue->file_valid;
 }
 
 static void acp_file_choose(GtkWidget *widget, gpointer user_data)
@@ -708,6 +1161,53 @@ static gboolean acp_rate_changed(GtkWidget *widget, GdkEvent *event, gpointer us
 	return false;
 }
 
+static void acp_analysis_apply(GtkWidget *widget, gpointer user_data)
+{
+	StackAppWindow *window = (StackAppWindow*)gtk_widget_get_toplevel(GTK_WIDGET(widget));
+	StackAudioCue *cue = STACK_AUDIO_CUE(window->selected_cue);
+	if (!cue->analysis_valid)
+	{
+		return;
+	}
+
+	// Trim off the silence (unless the whole file is silent)
+	if (cue->analysis.content_end_time > cue->analysis.content_start_time)
+	{
+		stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_start_time"), STACK_PROPERTY_VERSION_DEFINED, cue->analysis.content_start_time);
+		stack_property_set_int64(stack_cue_get_property(STACK_CUE(cue), "media_end_time"), STACK_PROPERTY_VERSION_DEFINED, cue->analysis.content_end_time);
+
+		// Refresh the trim entries and the preview selection from the
+		// validated times
+		if (cue->media_tab)
+		{
+			stack_time_t media_start_time = 0, media_end_time = 0;
+			stack_property_get_int64(stack_cue_get_property(STACK_CUE(cue), "media_start_time"), STACK_PROPERTY_VERSION_DEFINED, &media_start_time);
+			stack_property_get_int64(stack_cue_get_property(STACK_CUE(cue), "media_end_time"), STACK_PROPERTY_VERSION_DEFINED, &media_end_time);
+
+			if (cue->preview_widget)
+			{
+				stack_audio_preview_set_selection(cue->preview_widget, media_start_time, media_end_time);
+			}
+
+			char buffer[32];
+			stack_format_time_as_string(media_start_time, buffer, 32);
+			gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpTrimStart")), buffer);
+			stack_format_time_as_string(media_end_time, buffer, 32);
+			gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpTrimEnd")), buffer);
+		}
+	}
+
+	// Set the master volume, keeping within the range of the volume sliders
+	const double gain = std::min(std::max(stack_audio_analysis_suggest_gain(&cue->analysis), -50.0), 20.0);
+	stack_property_set_double(stack_cue_get_property(STACK_CUE(cue), "master_volume"), STACK_PROPERTY_VERSION_DEFINED, gain);
+
+	// Update the levels tab to show the new volume
+	if (cue->levels_tab)
+	{
+		stack_audio_cue_populate_levels_tab(cue);
+	}
+}
+
 // Note that channel is one-based, not zero
 StackProperty *stack_audio_cue_get_volume_property(StackCue *cue, size_t channel, bool create)
 {
@@ -738,59 +1238,45 @@ StackProperty *stack_audio_cue_get_volume_property(StackCue *cue, size_t channel
 	return property;
 }
 
+// Returns the crosspoint matrix property if the given crosspoint has been set,
+// optionally setting it to its default value if not
 StackProperty *stack_audio_cue_get_crosspoint_property(StackCue *cue, size_t input_channel, size_t output_channel, bool create)
 {
-	// Build property name
-	char property_name[64];
-	snprintf(property_name, 64, "crosspoint_%lu_%lu", output_channel, input_channel);
-
-	// Get the property, creating it with a default value if it does not exist
-	StackProperty *property = stack_cue_get_property(STACK_CUE(cue), property_name);
-	if (property == NULL && create)
-	{
-		// Property does not exist - create it
-		property = stack_property_create(property_name, STACK_PROPERTY_TYPE_DOUBLE);
-		stack_property_set_changed_callback(property, stack_audio_cue_ccb_volume, (void*)cue);
-		stack_property_set_validator(property, (stack_property_validator_t)stack_audio_cue_validate_volume, (void*)cue);
-
-		// Set the value to 0.0 if the output channel is the same as the input
-		// channels (i.e. create a one-to-one mapping), otherwise set it to -INFINITY.
-		// One exception: if the file is single-channel, then it's more likely that
-		// we're going to want to map to stereo, so do that
-		double initial_value = -INFINITY;
-		if (STACK_AUDIO_CUE(cue)->playback_file != NULL)
-		{
-			if (STACK_AUDIO_CUE(cue)->playback_file->channels == 1 && output_channel < 2)
-			{
-				initial_value = 0.0;
-			}
+	StackProperty *property = stack_cue_get_property_by_key(cue, sac_keys.crosspoint);
+	if (stack_property_matrix_get_assigned(property, output_channel, input_channel))
+	{
+		return property;
+	}
+	if (!create)
+	{
+		return NULL;
+	}
 
-			if (output_channel == input_channel)
-			{
-				initial_value = 0.0;
-			}
+	// Set the value to 0.0 if the output channel is the same as the input
+	// channels (i.e. create a one-to-one mapping), otherwise set it to -INFINITY.
+	// One exception: if the file is single-channel, then it's more likely that
+	// we're going to want to map to stereo, so do that
+	double initial_value = -INFINITY;
+	if (STACK_AUDIO_CUE(cue)->file_valid)
+	{
+		if (STACK_AUDIO_CUE(cue)->file_info.channels == 1 && output_channel < 2)
+		{
+			initial_value = 0.0;
 		}
-		stack_property_set_double(property, STACK_PROPERTY_VERSION_DEFINED, initial_value);
-		stack_property_set_double(property, STACK_PROPERTY_VERSION_LIVE, initial_value);
 
-		stack_cue_add_property(cue, property);
+		if (output_channel == input_channel)
+		{
+			initial_value = 0.0;
+		}
 	}
 
-	return property;
-}
-
-static double stack_audio_cue_get_crosspoint(StackAudioCue *cue, size_t input_channel, size_t output_channel, StackPropertyVersion version)
-{
-	double result;
-	char property_name[64];
-
-	// Build property name
-	snprintf(property_name, 64, "crosspoint_%lu_%lu", output_channel, input_channel);
+	// Defaults aren't a change to the cue
+	bool paused = stack_property_pause_change_callback(property, true);
+	stack_property_matrix_set(property, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, initial_value);
+	stack_property_matrix_set(property, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, initial_value);
+	stack_property_pause_change_callback(property, paused);
 
-	// Get the property, creating it with a default value if it does not exist
-	StackProperty *property = stack_audio_cue_get_crosspoint_property(STACK_CUE(cue), input_channel, output_channel, true);
-	stack_property_get_double(property, version, &result);
-	return result;
+	return property;
 }
 
 // Called when we're being played
@@ -822,6 +1308,14 @@ static bool stack_audio_cue_play(StackCue *cue)
 		return false;
 	}
 
+	// Open the file (if we're opening lazily and it's not been opened yet)
+	if (!stack_audio_cue_open_file(audio_cue))
+	{
+		audio_cue->file_valid = false;
+		stack_cue_set_state(STACK_CUE(cue), STACK_CUE_STATE_ERROR);
+		return false;
+	}
+
 	// Initialise playback
 	stack_property_copy_defined_to_live(stack_cue_get_property(cue, "file"));
 	stack_property_copy_defined_to_live(stack_cue_get_property(cue, "media_start_time"));
@@ -829,16 +1323,18 @@ static bool stack_audio_cue_play(StackCue *cue)
 	stack_property_copy_defined_to_live(stack_cue_get_property(cue, "loops"));
 	stack_property_copy_defined_to_live(stack_cue_get_property(cue, "master_volume"));
 	stack_property_copy_defined_to_live(stack_cue_get_property(cue, "rate"));
-	for (size_t channel = 0; channel < audio_cue->playback_file->channels; channel++)
+	for (size_t channel = 0; channel < audio_cue->file_info.channels; channel++)
 	{
 		stack_property_copy_defined_to_live(stack_audio_cue_get_volume_property(cue, channel + 1, false));
+
+		// Make sure every crosspoint we'll play through has a value, so that
+		// playback never has to create them
 		for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
 		{
-			char property_name[64];
-			snprintf(property_name, 64, "crosspoint_%lu_%lu", output_channel, channel);
-			stack_property_copy_defined_to_live(stack_cue_get_property(cue, property_name));
+			stack_audio_cue_get_crosspoint_property(cue, channel, output_channel, true);
 		}
 	}
+	stack_property_copy_defined_to_live(stack_cue_get_property_by_key(cue, sac_keys.crosspoint));
 	audio_cue->playback_loops = 0;
 
 	// Get the custom playback rate
@@ -898,6 +1394,12 @@ static void stack_audio_cue_stop(StackCue *cue)
 	{
 		stack_audio_preview_show_playback(audio_cue->preview_widget, false);
 	}
+
+	// Close the file if we're not played again for a while
+	if (audio_cue->playback_file != NULL)
+	{
+		stack_audio_cue_schedule_idle_close(audio_cue);
+	}
 }
 
 // Called when we're pulsed (every few milliseconds whilst the cue is in playback)
@@ -908,11 +1410,11 @@ static void stack_audio_cue_pulse(StackCue *cue, stack_time_t clocktime)
 	// Get the current action time and complete action time
 	stack_time_t run_action_time = 0, cue_action_time = 0;
 	stack_cue_get_running_times(cue, clocktime, NULL, &run_action_time, NULL, NULL, NULL, NULL);
-	stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
 
 	// Get the number of loops
 	int32_t loops = 1;
-	stack_property_get_int32(stack_cue_get_property(cue, "loops"), STACK_PROPERTY_VERSION_LIVE, &loops);
+	stack_property_get_int32(stack_cue_get_property_by_key(cue, sac_keys.loops), STACK_PROPERTY_VERSION_LIVE, &loops);
 
 	// Get the length of a single iteration of the audio
 	double rate = 1.0;
@@ -943,7 +1445,7 @@ static void stack_audio_cue_pulse(StackCue *cue, stack_time_t clocktime)
 		{
 			// Seek back in the file
 			stack_time_t media_start_time = 0;
-			stack_property_get_int64(stack_cue_get_property(cue, "media_start_time"), STACK_PROPERTY_VERSION_LIVE, &media_start_time);
+			stack_property_get_int64(stack_cue_get_property_by_key(cue, sac_keys.media_start_time), STACK_PROPERTY_VERSION_LIVE, &media_start_time);
 			stack_audio_file_seek(audio_cue->playback_file, media_start_time);
 
 			// We need to reset the resampler as we may have told it
@@ -965,7 +1467,7 @@ static void stack_audio_cue_pulse(StackCue *cue, stack_time_t clocktime)
 	if (audio_cue->media_tab != NULL && audio_cue->preview_widget != NULL && stack_get_clock_time() - audio_cue->preview_widget->last_redraw_time > 33 * NANOSECS_PER_MILLISEC)
 	{
 		stack_time_t media_start_time = 0;
-		stack_property_get_int64(stack_cue_get_property(cue, "media_start_time"), STACK_PROPERTY_VERSION_LIVE, &media_start_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, sac_keys.media_start_time), STACK_PROPERTY_VERSION_LIVE, &media_start_time);
 		audio_cue->preview_widget->last_redraw_time = stack_get_clock_time();
 		stack_audio_preview_set_playback(audio_cue->preview_widget, media_start_time + (stack_time_t)((double)(run_action_time % loop_length) * rate));
 	}
@@ -976,6 +1478,10 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 {
 	StackAudioCue *audio_cue = STACK_AUDIO_CUE(cue);
 
+	// The selected cue is usually the next to be played, so make sure its
+	// file is ready so that playing it doesn't have to wait
+	stack_audio_cue_preopen_file(audio_cue);
+
 	// Create the tabs
 	GtkWidget *media_label = gtk_label_new("Media");
 	GtkWidget *levels_label = gtk_label_new("Levels");
@@ -993,6 +1499,7 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 		gtk_builder_add_callback_symbol(sac_builder, "acp_trim_end_changed", G_CALLBACK(acp_trim_end_changed));
 		gtk_builder_add_callback_symbol(sac_builder, "acp_loops_changed", G_CALLBACK(acp_loops_changed));
 		gtk_builder_add_callback_symbol(sac_builder, "acp_rate_changed", G_CALLBACK(acp_rate_changed));
+		gtk_builder_add_callback_symbol(sac_builder, "acp_analysis_apply", G_CALLBACK(acp_analysis_apply));
 
 		// Apply input limiting
 		stack_limit_gtk_entry_time(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpTrimStart")), false);
@@ -1024,10 +1531,10 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 	{
 		audio_cue->preview_widget = STACK_AUDIO_PREVIEW(stack_audio_preview_new());
 
-		if (file && audio_cue->playback_file)
+		if (file && audio_cue->file_valid)
 		{
 			stack_audio_preview_set_file(audio_cue->preview_widget, file);
-			stack_audio_preview_set_view_range(audio_cue->preview_widget, 0, audio_cue->playback_file->length);
+			stack_audio_preview_set_view_range(audio_cue->preview_widget, 0, audio_cue->file_info.length);
 			stack_audio_preview_set_selection(audio_cue->preview_widget, media_start_time, media_end_time);
 			stack_audio_preview_show_playback(audio_cue->preview_widget, cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST);
 		}
@@ -1055,15 +1562,7 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 	audio_cue->levels_tab = stack_audio_levels_tab_new(cue, stack_audio_cue_get_volume_property, stack_audio_cue_get_crosspoint_property);
 	gtk_notebook_append_page(notebook, audio_cue->media_tab, media_label);
 	gtk_notebook_append_page(notebook, audio_cue->levels_tab->root, levels_label);
-	size_t input_channels = 0;
-	if (audio_cue->playback_file != NULL)
-	{
-		input_channels = audio_cue->playback_file->channels;
-	}
-	stack_audio_levels_tab_populate(audio_cue->levels_tab, input_channels, cue->parent->channels, true, STACK_AUDIO_CUE(cue)->affect_live, (GCallback)(ToggleButtonCallback)[](GtkToggleButton *self, gpointer user_data) -> void {
-		StackAudioCue *cue = STACK_AUDIO_CUE(user_data);
-		cue->affect_live = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self));
-	});
+	stack_audio_cue_populate_levels_tab(audio_cue);
 	gtk_widget_show(audio_cue->media_tab);
 	gtk_widget_show(audio_cue->levels_tab->root);
 
@@ -1073,11 +1572,11 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 		// Set the filename
 		gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpFileEntry")), file);
 
-		if (audio_cue->playback_file != NULL)
+		if (audio_cue->file_valid)
 		{
 			// Display the file length
 			char time_buffer[32], text_buffer[128];
-			stack_format_time_as_string(audio_cue->playback_file->length, time_buffer, 32);
+			stack_format_time_as_string(audio_cue->file_info.length, time_buffer, 32);
 			snprintf(text_buffer, 128, "(Length is %s)", time_buffer);
 			gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(sac_builder, "acpFileLengthLabel")), text_buffer);
 		}
@@ -1103,6 +1602,10 @@ static void stack_audio_cue_set_tabs(StackCue *cue, GtkNotebook *notebook)
 	// Set the values: loops
 	snprintf(buffer, 32, "%.2f", rate);
 	gtk_entry_set_text(GTK_ENTRY(gtk_builder_get_object(sac_builder, "acpRate")), buffer);
+
+	// Set the values: analysis (analysing the file if we haven't yet)
+	stack_audio_cue_request_analysis(audio_cue);
+	stack_audio_cue_update_analysis_label(audio_cue);
 }
 
 // Removes the properties tabs for an audio cue
@@ -1150,14 +1653,30 @@ static void stack_audio_cue_unset_tabs(StackCue *cue, GtkNotebook *notebook)
 		delete [] audio_cue->channel_values;
 		audio_cue->channel_values = NULL;
 	}
+
+	// We're no longer selected, so close our file if we're not played soon
+	stack_audio_cue_schedule_idle_close(audio_cue);
 }
 
-static char *stack_audio_cue_to_json(StackCue *cue)
+// Gets the file ready ahead of the cue being played, as it has been armed by
+// a trigger or follows a cue that has just started. Playing the cue then
+// doesn't have to wait for the file to open
+static void stack_audio_cue_prepare(StackCue *cue)
+{
+	// Whilst we're loading we might not know our file yet, and we're prepared
+	// once we do
+	StackAudioCue *audio_cue = STACK_AUDIO_CUE(cue);
+	if (!audio_cue->loading)
+	{
+		stack_audio_cue_preopen_file(audio_cue);
+	}
+}
+
+static void stack_audio_cue_to_json_value(StackCue *cue, Json::Value &cue_root)
 {
 	StackAudioCue *audio_cue = STACK_AUDIO_CUE(cue);
 
 	// Build JSON
-	Json::Value cue_root;
 	stack_property_write_json(stack_cue_get_property(cue, "file"), &cue_root);
 	stack_property_write_json(stack_cue_get_property(cue, "media_start_time"), &cue_root);
 	stack_property_write_json(stack_cue_get_property(cue, "media_end_time"), &cue_root);
@@ -1167,9 +1686,9 @@ static char *stack_audio_cue_to_json(StackCue *cue)
 
 	// If we've got a file
 	size_t input_channels = 0;
-	if (audio_cue->playback_file != NULL)
+	if (audio_cue->file_valid)
 	{
-		input_channels = audio_cue->playback_file->channels;
+		input_channels = audio_cue->file_info.channels;
 		cue_root["_last_input_channels"] = (int32_t)input_channels;
 	}
 
@@ -1185,18 +1704,13 @@ static char *stack_audio_cue_to_json(StackCue *cue)
 	}
 
 	// Write crosspoints to JSON
-	size_t output_channels = cue->parent->channels;
-	for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
-	{
-		for (size_t output_channel = 0; output_channel < output_channels; output_channel++)
-		{
-			StackProperty *crosspoint_prop = stack_audio_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-			if (crosspoint_prop != NULL)
-			{
-				stack_property_write_json(crosspoint_prop, &cue_root);
-			}
-		}
-	}
+	stack_property_write_json(stack_cue_get_property_by_key(cue, sac_keys.crosspoint), &cue_root);
+}
+
+static char *stack_audio_cue_to_json(StackCue *cue)
+{
+	Json::Value cue_root;
+	stack_audio_cue_to_json_value(cue, cue_root);
 
 	// Write out JSON string and return (to be free'd by stack_audio_cue_free_json)
 	Json::StreamWriterBuilder builder;
@@ -1208,14 +1722,9 @@ static void stack_audio_cue_free_json(StackCue *cue, char *json_data)
 	free(json_data);
 }
 
-// Re-initialises this cue from JSON Data
-void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
+// Re-initialises this cue from a JSON value
+static void stack_audio_cue_from_json_value(StackCue *cue, const Json::Value &cue_root)
 {
-	Json::Value cue_root;
-
-	// Parse JSON data
-	stack_json_read_string(json_data, &cue_root);
-
 	// Get the data that's pertinent to us
 	if (!cue_root.isMember("StackAudioCue"))
 	{
@@ -1223,9 +1732,10 @@ void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
 		return;
 	}
 
-	Json::Value& cue_data = cue_root["StackAudioCue"];
+	const Json::Value& cue_data = cue_root["StackAudioCue"];
 
 	// Load in our audio file, and set the state based on whether it succeeds
+	STACK_AUDIO_CUE(cue)->loading = true;
 	if (stack_audio_cue_set_file(STACK_AUDIO_CUE(cue), cue_data["file"].asString().c_str()))
 	{
 		stack_cue_set_state(cue, STACK_CUE_STATE_STOPPED);
@@ -1252,6 +1762,7 @@ void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
 	{
 		stack_property_set_int64(stack_cue_get_property(cue, "media_end_time"), STACK_PROPERTY_VERSION_DEFINED, 0);
 	}
+	STACK_AUDIO_CUE(cue)->loading = false;
 	stack_audio_cue_update_action_time(STACK_AUDIO_CUE(cue));
 
 	// Load loops
@@ -1329,6 +1840,8 @@ void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
 			}
 		}
 
+		StackProperty *crosspoints = stack_cue_get_property_by_key(cue, sac_keys.crosspoint);
+		stack_property_matrix_ensure_size(crosspoints, cue->parent->channels, input_channels);
 		for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
 		{
 			for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
@@ -1338,19 +1851,36 @@ void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
 
 				if (cue_data.isMember(property_name))
 				{
-					StackProperty *crosspoint_property = stack_audio_cue_get_crosspoint_property(cue, input_channel, output_channel, true);
 					if (cue_data[property_name].isString() && cue_data[property_name].asString() == "-Infinite")
 					{
-						stack_property_set_double(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, -INFINITY);
+						stack_property_matrix_set(crosspoints, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, -INFINITY);
 					}
 					else
 					{
-						stack_property_set_double(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, cue_data[property_name].asDouble());
+						stack_property_matrix_set(crosspoints, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, cue_data[property_name].asDouble());
 					}
 				}
 			}
 		}
 	}
+
+	// If we've already been armed by a trigger, get our file ready now that we
+	// know what it is
+	if (!cue->triggers->empty())
+	{
+		stack_audio_cue_prepare(cue);
+	}
+}
+
+// Re-initialises this cue from JSON Data
+void stack_audio_cue_from_json(StackCue *cue, const char *json_data)
+{
+	Json::Value cue_root;
+
+	// Parse JSON data
+	stack_json_read_string(json_data, &cue_root);
+
+	stack_audio_cue_from_json_value(cue, cue_root);
 }
 
 /// Gets the error message for the cue
@@ -1363,7 +1893,7 @@ bool stack_audio_cue_get_error(StackCue *cue, char *message, size_t size)
 		snprintf(message, size, "No audio file selected");
 		return true;
 	}
-	else if (STACK_AUDIO_CUE(cue)->playback_file == NULL)
+	else if (!STACK_AUDIO_CUE(cue)->file_valid)
 	{
 		snprintf(message, size, "Invalid audio file");
 		return true;
@@ -1384,9 +1914,9 @@ size_t stack_audio_cue_get_active_channels(StackCue *cue, bool *channels, bool l
 {
 	if (!live)
 	{
-		if (STACK_AUDIO_CUE(cue)->playback_file != NULL)
+		if (STACK_AUDIO_CUE(cue)->file_valid)
 		{
-			return STACK_AUDIO_CUE(cue)->playback_file->channels;
+			return STACK_AUDIO_CUE(cue)->file_info.channels;
 		}
 		else
 		{
@@ -1426,6 +1956,10 @@ size_t stack_audio_cue_get_audio(StackCue *cue, float *buffer, size_t frames)
 
 	// For tidiness
 	StackAudioCue *audio_cue = STACK_AUDIO_CUE(cue);
+	if (audio_cue->playback_file == NULL)
+	{
+		return 0;
+	}
 
 	// Store these locally for efficiency
 	const size_t input_channels = audio_cue->playback_file->channels;
@@ -1490,8 +2024,9 @@ size_t stack_audio_cue_get_audio(StackCue *cue, float *buffer, size_t frames)
 	// Calculate audio scalar (using the live playback volume). Also use this to
 	// scale from 16-bit signed int to 0.0-1.0 range
 	double playback_live_volume = 0.0;
-	stack_property_get_double(stack_cue_get_property(cue, "master_volume"), STACK_PROPERTY_VERSION_LIVE, &playback_live_volume);
+	stack_property_get_double(stack_cue_get_property_by_key(cue, sac_keys.master_volume), STACK_PROPERTY_VERSION_LIVE, &playback_live_volume);
 	float base_audio_scaler = (float)stack_db_to_scalar(playback_live_volume);
+	const StackProperty *crosspoints = stack_cue_get_property_by_key(cue, sac_keys.crosspoint);
 
 	// For each output channel in the cue list
 	for (size_t output_channel = 0; output_channel < output_channels; output_channel++)
@@ -1504,8 +2039,13 @@ size_t stack_audio_cue_get_audio(StackCue *cue, float *buffer, size_t frames)
 			StackProperty *property = stack_audio_cue_get_volume_property(cue, input_channel + 1, false);
 			stack_property_get_double(property, STACK_PROPERTY_VERSION_LIVE, &channel_volume);
 
+			// Get the live crosspoint (these are all set when the cue is played,
+			// but the cue list may have gained channels since)
+			double crosspoint = -INFINITY;
+			stack_property_matrix_get(crosspoints, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, &crosspoint);
+
 			// Get the total scalar for the master volume, the channel volume and the crosspoint
-			float scalar = base_audio_scaler * (float)stack_db_to_scalar(channel_volume) * (float)stack_db_to_scalar(stack_audio_cue_get_crosspoint(audio_cue, input_channel, output_channel, STACK_PROPERTY_VERSION_LIVE));
+			float scalar = base_audio_scaler * (float)stack_db_to_scalar(channel_volume) * (float)stack_db_to_scalar(crosspoint);
 
 			// Skip channels where the scalar is zero to not waste time
 			if (scalar > 0.0)
@@ -1575,8 +2115,17 @@ void stack_audio_cue_register()
 	// Load the icon
 	icon = gdk_pixbuf_new_from_resource("/org/stack/icons/stackaudiocue.png", NULL);
 
+	// Register the names of our properties
+	sac_keys.file = stack_property_register_key("file");
+	sac_keys.media_start_time = stack_property_register_key("media_start_time");
+	sac_keys.media_end_time = stack_property_register_key("media_end_time");
+	sac_keys.loops = stack_property_register_key("loops");
+	sac_keys.master_volume = stack_property_register_key("master_volume");
+	sac_keys.rate = stack_property_register_key("rate");
+	sac_keys.crosspoint = stack_property_register_key("crosspoint");
+
 	// Register cue types
-	StackCueClass* audio_cue_class = new StackCueClass{ "StackAudioCue", "StackCue", "Audio Cue", stack_audio_cue_create, stack_audio_cue_destroy, stack_audio_cue_play, NULL, stack_audio_cue_stop, stack_audio_cue_pulse, stack_audio_cue_set_tabs, stack_audio_cue_unset_tabs, stack_audio_cue_to_json, stack_audio_cue_free_json, stack_audio_cue_from_json, stack_audio_cue_get_error, stack_audio_cue_get_active_channels, stack_audio_cue_get_audio, stack_audio_cue_get_field, stack_audio_cue_get_icon, NULL, NULL };
+	StackCueClass* audio_cue_class = new StackCueClass{ "StackAudioCue", "StackCue", "Audio Cue", stack_audio_cue_create, stack_audio_cue_destroy, stack_audio_cue_play, NULL, stack_audio_cue_stop, stack_audio_cue_pulse, stack_audio_cue_set_tabs, stack_audio_cue_unset_tabs, stack_audio_cue_to_json, stack_audio_cue_free_json, stack_audio_cue_from_json, stack_audio_cue_get_error, stack_audio_cue_get_active_channels, stack_audio_cue_get_audio, stack_audio_cue_get_field, stack_audio_cue_get_icon, NULL, NULL, stack_audio_cue_to_json_value, stack_audio_cue_from_json_value, stack_audio_cue_prepare };
 	stack_register_cue_class(audio_cue_class);
 
 	stack_log("stack_audio_cue_register(): Audio file support: Wave\n");
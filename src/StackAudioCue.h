@@ -4,11 +4,16 @@
 // Includes:
 #include "StackCue.h"
 #include "StackAudioFile.h"
+#include "StackAudioAnalysis.h"
 #include "StackAudioPreview.h"
 #include "StackResampler.h"
 #include "StackAudioLevelsTab.h"
+#include <memory>
 #include <thread>
 
+// Pre-define this (see StackAudioCue.cpp)
+struct StackAudioCuePendingOpen;
+
 // An audio cue
 struct StackAudioCue
 {
@@ -31,9 +36,27 @@ struct StackAudioCue
 	GtkWidget **channel_values;
 	bool affect_live;
 
-	// The currently open file
+	// The details of the current file (available even when it isn't open)
+	StackAudioFileInfo file_info;
+	bool file_valid;
+
+	// Whether the cue is being loaded from JSON, in which case changing the
+	// file leaves the media start/end times alone as they're loaded after it
+	bool loading;
+
+	// The currently open file. When files are opened lazily, this isn't open
+	// until the cue is selected, prepared or played, and is closed again once
+	// the cue has been idle for a while
 	StackAudioFile *playback_file;
 
+	// The timer that closes the file once the cue has been idle for a while
+	// (protected by the lock in StackAudioCue.cpp)
+	guint idle_close_timer;
+
+	// The file being opened in the background ahead of the cue being played
+	// (protected by the lock in StackAudioCue.cpp)
+	std::shared_ptr<StackAudioCuePendingOpen> pending_open;
+
 	// The resampler to resample from file-rate to device-rate
 	StackResampler *resampler;
 
@@ -50,6 +73,17 @@ struct StackAudioCue
 
 	// Size of playback buffer in frames
 	size_t playback_buffer_frames;
+
+	// Analysis: The outstanding analysis request (zero if there isn't one)
+	uint64_t analysis_request;
+
+	// Analysis: Whether the current file has been analysed (successfully or
+	// not), so that we don't ask again each time the cue is selected
+	bool analysis_attempted;
+
+	// Analysis: The results of analysing the current file
+	bool analysis_valid;
+	StackAudioAnalysis analysis;
 };
 
 // Functions: Audio cue functions
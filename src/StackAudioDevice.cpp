@@ -1,8 +1,12 @@
 // Includes:
 #include "StackAudioDevice.h"
 #include "StackLog.h"
+#include <cmath>
 #include <cstring>
 #include <map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <string>
 using namespace std;
 
@@ -143,59 +147,183 @@ const StackAudioDeviceClassMap *stack_audio_device_class_get_map()
 	return &adev_class_map;
 }
 
-void stack_audio_device_to_s32(float *input, int32_t *output, size_t count)
+// Full-scale for signed 32-bit output. 2147483647 isn't representable as a
+// float (it rounds up to 2^31, which overflows), so we clamp to the largest
+// float below 2^31 after scaling
+static const float S32_SCALE = 2147483648.0f;
+static const float S32_MAX = 2147483520.0f;
+static const float S24_SCALE = 8388607.0f;
+static const float S16_SCALE = 32767.0f;
+
+// Clamps a sample to [-1.0, 1.0]. Written so that NaN becomes 1.0, which
+// matches what the SSE min/max instructions do
+static inline float stack_audio_device_clamp(float sample, float min, float max)
+{
+	sample = sample < max ? sample : max;
+	return sample > min ? sample : min;
+}
+
+// Advances a xorshift random number generator
+static inline uint32_t stack_audio_device_xorshift(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// Mixes the bits of a number, for seeding random number generators
+static inline uint32_t stack_audio_device_hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+// Turns a random number in to a float in the range [0.0, 1.0)
+static inline float stack_audio_device_random_to_float(uint32_t x)
+{
+	uint32_t bits = (x >> 9) | 0x3f800000;
+	float result;
+	memcpy(&result, &bits, sizeof(float));
+	return result - 1.0f;
+}
+
+void stack_audio_device_to_s32(const float *input, int32_t *output, size_t count)
 {
-	for (size_t i = 0; i < count; i++)
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(S32_SCALE), scaled_max = _mm_set1_ps(S32_MAX);
+	for (; i + 4 <= count; i += 4)
 	{
-		if (input[i] < -1.0)
-		{
-			output[i] = -2147483647;
-		}
-		else if (input[i] > 1.0)
-		{
-			output[i] = 2147483647;
-		}
-		else
-		{
-			output[i] = (int32_t)(input[i] * 2147483647.0f);
-		}
+		__m128 v = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i]), max), min);
+		v = _mm_min_ps(_mm_mul_ps(v, scale), scaled_max);
+		_mm_storeu_si128((__m128i*)&output[i], _mm_cvtps_epi32(v));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float v = stack_audio_device_clamp(input[i], -1.0f, 1.0f) * S32_SCALE;
+		output[i] = (int32_t)lrintf(v < S32_MAX ? v : S32_MAX);
 	}
 }
 
-void stack_audio_device_to_s24_32(float *input, int32_t *output, size_t count)
+void stack_audio_device_to_s24_32(const float *input, int32_t *output, size_t count)
 {
-	for (size_t i = 0; i < count; i++)
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(S24_SCALE);
+	for (; i + 4 <= count; i += 4)
 	{
-		if (input[i] < -1.0)
-		{
-			output[i] = -16777215;
-		}
-		else if (input[i] > 1.0)
-		{
-			output[i] = 16777215;
-		}
-		else
-		{
-			output[i] = (int32_t)(input[i] * 16777215.0f);
-		}
+		__m128 v = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i]), max), min);
+		_mm_storeu_si128((__m128i*)&output[i], _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		output[i] = (int32_t)lrintf(stack_audio_device_clamp(input[i], -1.0f, 1.0f) * S24_SCALE);
 	}
 }
 
-void stack_audio_device_to_s16(float *input, int16_t *output, size_t count)
+#if defined(__SSE2__)
+// Vectorised stack_audio_device_xorshift
+static inline __m128i stack_audio_device_xorshift_sse2(__m128i x)
 {
-	for (size_t i = 0; i < count; i++)
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+// Vectorised stack_audio_device_random_to_float
+static inline __m128 stack_audio_device_random_to_float_sse2(__m128i x)
+{
+	__m128i bits = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+	return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f));
+}
+#endif
+
+void stack_audio_device_to_s16(const float *input, int16_t *output, size_t count, uint32_t *dither_state)
+{
+	// TPDF dither is the difference of two uniform random values, giving a
+	// triangular distribution of +/- 1 LSB. The generator mustn't be zero
+	uint32_t state = 0;
+	if (dither_state != NULL)
+	{
+		state = *dither_state != 0 ? *dither_state : 0x9e3779b9;
+	}
+
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(S16_SCALE);
+	if (dither_state == NULL)
 	{
-		if (input[i] < -1.0)
+		for (; i + 8 <= count; i += 8)
 		{
-			output[i] = -32767;
+			__m128 lo = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i]), max), min);
+			__m128 hi = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i + 4]), max), min);
+			__m128i lo_i = _mm_cvtps_epi32(_mm_mul_ps(lo, scale));
+			__m128i hi_i = _mm_cvtps_epi32(_mm_mul_ps(hi, scale));
+			_mm_storeu_si128((__m128i*)&output[i], _mm_packs_epi32(lo_i, hi_i));
 		}
-		else if (input[i] > 1.0)
+	}
+	else if (count >= 8)
+	{
+		// Give each lane its own generator, seeded by hashing ours so that
+		// the lanes aren't just offsets of the same sequence
+		uint32_t seeds[4];
+		for (size_t lane = 0; lane < 4; lane++)
+		{
+			seeds[lane] = stack_audio_device_hash(state + (uint32_t)lane * 0x9e3779b9) | 1;
+		}
+		__m128i lane_state = _mm_loadu_si128((const __m128i*)seeds);
+
+		for (; i + 8 <= count; i += 8)
 		{
-			output[i] = 32767;
+			__m128 lo = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i]), max), min);
+			__m128 hi = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(&input[i + 4]), max), min);
+
+			__m128i r1 = stack_audio_device_xorshift_sse2(lane_state);
+			__m128i r2 = stack_audio_device_xorshift_sse2(r1);
+			__m128i r3 = stack_audio_device_xorshift_sse2(r2);
+			lane_state = stack_audio_device_xorshift_sse2(r3);
+			__m128 lo_dither = _mm_sub_ps(stack_audio_device_random_to_float_sse2(r1), stack_audio_device_random_to_float_sse2(r2));
+			__m128 hi_dither = _mm_sub_ps(stack_audio_device_random_to_float_sse2(r3), stack_audio_device_random_to_float_sse2(lane_state));
+
+			// Saturation in the pack deals with dither taking us over
+			// full-scale
+			__m128i lo_i = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(lo, scale), lo_dither));
+			__m128i hi_i = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(hi, scale), hi_dither));
+			_mm_storeu_si128((__m128i*)&output[i], _mm_packs_epi32(lo_i, hi_i));
 		}
-		else
+
+		// Carry on from the first lane's generator
+		_mm_storeu_si128((__m128i*)seeds, lane_state);
+		state = seeds[0] != 0 ? seeds[0] : 0x9e3779b9;
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float v = stack_audio_device_clamp(input[i], -1.0f, 1.0f) * S16_SCALE;
+		if (dither_state != NULL)
 		{
-			output[i] = (int16_t)(input[i] * 32767.0f);
+			state = stack_audio_device_xorshift(state);
+			float r1 = stack_audio_device_random_to_float(state);
+			state = stack_audio_device_xorshift(state);
+			float r2 = stack_audio_device_random_to_float(state);
+			v += r1 - r2;
 		}
+		long sample = lrintf(v);
+		output[i] = (int16_t)(sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample));
+	}
+
+	if (dither_state != NULL)
+	{
+		*dither_state = state;
 	}
 }
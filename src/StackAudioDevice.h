@@ -31,6 +31,11 @@ struct StackAudioDevice
 
 	// The name of the audio device
 	char *device_name;
+
+	// Whether to apply TPDF dither when converting to a 16-bit output format,
+	// and the state of the random number generator used to do so
+	bool dither;
+	uint32_t dither_state;
 };
 
 // Structure: Descriptor of an audio device
@@ -84,12 +89,14 @@ const StackAudioDeviceClass *stack_audio_device_get_class(const char *name);
 // Functions: Get map of classes
 const StackAudioDeviceClassMap *stack_audio_device_class_get_map();
 
-// Functions: audio transformation
-void stack_audio_device_to_s32(float *input, int32_t *output, size_t count)
+// Functions: audio transformation. These clamp to [-1.0, 1.0] and round to the
+// nearest integer. If dither_state is not NULL, stack_audio_device_to_s16
+// applies TPDF dither, using and updating the random number generator state
+void stack_audio_device_to_s32(const float *input, int32_t *output, size_t count)
 	__attribute__((access (write_only, 2, 3))) __attribute__((access (read_only, 1, 3)));
-void stack_audio_device_to_s24_32(float *input, int32_t *output, size_t count)
+void stack_audio_device_to_s24_32(const float *input, int32_t *output, size_t count)
 	__attribute__((access (write_only, 2, 3))) __attribute__((access (read_only, 1, 3)));
-void stack_audio_device_to_s16(float *input, int16_t *output, size_t count)
+void stack_audio_device_to_s16(const float *input, int16_t *output, size_t count, uint32_t *dither_state)
 	__attribute__((access (write_only, 2, 3))) __attribute__((access (read_only, 1, 3)));
 
 // Defines:
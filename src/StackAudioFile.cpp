@@ -11,6 +11,70 @@
 #include "StackAudioFileFLAC.h"
 #endif
 #include "StackLog.h"
+#include "StackMediaCache.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The vectorised sample conversions are for x86 only, and as they operate on
+// little-endian data directly, also rely on the host being little-endian
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define STACK_AUDIO_FILE_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+// The maximum number of threads to open files with when prefetching. Opening
+// files is mostly spent waiting on storage, so this isn't tied to the number
+// of processors
+#define STACK_AUDIO_FILE_PREFETCH_THREADS 8
+
+// A seek table waiting to be built by the indexing thread
+struct StackAudioFileIndexJob
+{
+	GFile *file;
+	std::string type;
+	StackAudioFileSeekTableBuilder builder;
+	std::shared_ptr<StackAudioFileSharedSeekTable> seek_table;
+};
+
+// The seek tables of open files (by type and URI), the queue of tables for the
+// indexing thread to build, and the thread itself. Tables are freed when the
+// last file using them is closed, and are loaded from the media cache again
+// next time
+struct StackAudioFileIndexService
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::map<std::string, std::weak_ptr<StackAudioFileSharedSeekTable>> seek_tables;
+	std::deque<StackAudioFileIndexJob> queue;
+	std::thread thread;
+	std::atomic<bool> kill_thread;
+};
+static StackAudioFileIndexService *index_service = NULL;
+static std::once_flag index_service_once;
+
+// The version of the "info" cache payload
+#define STACK_AUDIO_FILE_INFO_CACHE_VERSION 1
+
+// Layout of the "info" cache payload
+#pragma pack(push, 1)
+struct StackAudioFileInfoCacheData
+{
+	uint32_t format;
+	uint32_t channels;
+	uint32_t sample_rate;
+	uint64_t frames;
+	int64_t length;
+};
+#pragma pack(pop)
 
 static const float INT8_SCALAR = 7.8125e-3f;
 static const float INT16_SCALAR = 3.051757812e-5f;
@@ -25,22 +89,103 @@ static bool stack_audio_file_reset_stream(GFileInputStream *stream)
 	return false;
 }
 
-// Creates a new StackAudioFile object from the supplied file
-StackAudioFile *stack_audio_file_create(const char *filename)
+// Determines the format of a file from the signature at the start of it,
+// leaving the stream at the start of the file. Returns
+// STACK_AUDIO_FILE_FORMAT_NONE if the signature isn't recognised
+static StackAudioFileFormat stack_audio_file_sniff_format(GFileInputStream *stream)
 {
-	StackAudioFile* result = NULL;
+	StackAudioFileFormat format = STACK_AUDIO_FILE_FORMAT_NONE;
 
-	// Open the file
-	GFile *file = NULL;
-	if (filename[0] == '/')
+	unsigned char header[12];
+	gsize bytes_read = 0;
+	g_input_stream_read_all(G_INPUT_STREAM(stream), header, sizeof(header), &bytes_read, NULL, NULL);
+	if (bytes_read < sizeof(header))
 	{
-		file = g_file_new_for_path(filename);
+		stack_audio_file_reset_stream(stream);
+		return STACK_AUDIO_FILE_FORMAT_NONE;
 	}
-	else
+
+	if ((memcmp(header, "RIFF", 4) == 0 || memcmp(header, "RF64", 4) == 0) && memcmp(&header[8], "WAVE", 4) == 0)
+	{
+		format = STACK_AUDIO_FILE_FORMAT_WAVE;
+	}
+	else if (memcmp(header, "OggS", 4) == 0)
+	{
+		format = STACK_AUDIO_FILE_FORMAT_OGG;
+	}
+	else if (memcmp(header, "fLaC", 4) == 0)
+	{
+		format = STACK_AUDIO_FILE_FORMAT_FLAC;
+	}
+	else if (memcmp(header, "ID3", 3) == 0)
 	{
-		file = g_file_new_for_uri(filename);
+		// An ID3v2 tag is usually followed by MP3 data, but is occasionally
+		// found in front of FLAC data, so look past it. The size of the tag
+		// is a 28-bit 'synchsafe' integer
+		uint32_t tag_size = ((uint32_t)(header[6] & 0x7f) << 21) | ((uint32_t)(header[7] & 0x7f) << 14) | ((uint32_t)(header[8] & 0x7f) << 7) | (uint32_t)(header[9] & 0x7f);
+		unsigned char after_tag[4];
+		format = STACK_AUDIO_FILE_FORMAT_MP3;
+		if (g_seekable_seek(G_SEEKABLE(stream), 10 + tag_size, G_SEEK_SET, NULL, NULL))
+		{
+			g_input_stream_read_all(G_INPUT_STREAM(stream), after_tag, sizeof(after_tag), &bytes_read, NULL, NULL);
+			if (bytes_read == sizeof(after_tag) && memcmp(after_tag, "fLaC", 4) == 0)
+			{
+				format = STACK_AUDIO_FILE_FORMAT_FLAC;
+			}
+		}
 	}
+	else if (header[0] == 0xff && (header[1] & 0xe0) == 0xe0)
+	{
+		// MPEG audio frame sync
+		format = STACK_AUDIO_FILE_FORMAT_MP3;
+	}
+
+	stack_audio_file_reset_stream(stream);
 
+	return format;
+}
+
+// Attempts to load a file as the given format, returning NULL if it can't be
+// (including if the format isn't supported by this build)
+static StackAudioFile *stack_audio_file_open_as(StackAudioFileFormat format, GFile *file, GFileInputStream *stream, bool for_playback)
+{
+	switch (format)
+	{
+		case STACK_AUDIO_FILE_FORMAT_WAVE:
+			return (StackAudioFile*)stack_audio_file_create_wave(stream);
+#if HAVE_VORBISFILE == 1
+		case STACK_AUDIO_FILE_FORMAT_OGG:
+			return (StackAudioFile*)stack_audio_file_create_ogg(file, stream, for_playback);
+#endif
+#if HAVE_LIBFLAC == 1
+		case STACK_AUDIO_FILE_FORMAT_FLAC:
+			return (StackAudioFile*)stack_audio_file_create_flac(file, stream, for_playback);
+#endif
+#if HAVE_LIBMAD == 1
+		case STACK_AUDIO_FILE_FORMAT_MP3:
+			return (StackAudioFile*)stack_audio_file_create_mp3(file, stream, for_playback);
+#endif
+		default:
+			return NULL;
+	}
+}
+
+GFile *stack_audio_file_new_gfile(const char *uri)
+{
+	if (uri[0] == '/')
+	{
+		return g_file_new_for_path(uri);
+	}
+	return g_file_new_for_uri(uri);
+}
+
+// Opens a file and creates the StackAudioFile object for it
+static StackAudioFile *stack_audio_file_open(const char *filename, bool for_playback)
+{
+	StackAudioFile* result = NULL;
+
+	// Open the file
+	GFile *file = stack_audio_file_new_gfile(filename);
 	if (file == NULL)
 	{
 		stack_log("stack_audio_file_create(): Failed to open file\n");
@@ -56,19 +201,41 @@ StackAudioFile *stack_audio_file_create(const char *filename)
 	    return NULL;
 	}
 
-	// Attempt to load as the various types
-	if (!((result = (StackAudioFile*)stack_audio_file_create_wave(stream))
-		  || stack_audio_file_reset_stream(stream)
-#if HAVE_VORBISFILE == 1
-		  || (result = (StackAudioFile*)stack_audio_file_create_ogg(stream))
-#endif
-#if HAVE_LIBFLAC == 1
-		  || (result = (StackAudioFile*)stack_audio_file_create_flac(stream))
-#endif
-#if HAVE_LIBMAD == 1 /* note that we do MP3 last as it doesn't always necessarily have a standard header */
-		  || (result = (StackAudioFile*)stack_audio_file_create_mp3(stream))
-#endif
-		))
+	// Determine the format from the start of the file so that we only need to
+	// parse it once
+	StackAudioFileFormat format = stack_audio_file_sniff_format(stream);
+	if (format != STACK_AUDIO_FILE_FORMAT_NONE)
+	{
+		result = stack_audio_file_open_as(format, file, stream, for_playback);
+	}
+
+	if (result == NULL)
+	{
+		// Either the signature was unrecognised (e.g. an MP3 with junk at the
+		// start), or the file has a valid signature but the backend for it
+		// couldn't load it, so attempt to load it as the other types. Note
+		// that we do MP3 last as it doesn't always have a standard header
+		if (format == STACK_AUDIO_FILE_FORMAT_NONE)
+		{
+			stack_log("stack_audio_file_create(): Unrecognised file signature, trying all formats\n");
+		}
+		else
+		{
+			stack_log("stack_audio_file_create(): Failed to load file as format %d, trying other formats\n", format);
+		}
+
+		const StackAudioFileFormat fallback_formats[] = { STACK_AUDIO_FILE_FORMAT_WAVE, STACK_AUDIO_FILE_FORMAT_OGG, STACK_AUDIO_FILE_FORMAT_FLAC, STACK_AUDIO_FILE_FORMAT_MP3 };
+		for (size_t i = 0; i < sizeof(fallback_formats) / sizeof(StackAudioFileFormat) && result == NULL; i++)
+		{
+			if (fallback_formats[i] != format)
+			{
+				stack_audio_file_reset_stream(stream);
+				result = stack_audio_file_open_as(fallback_formats[i], file, stream, for_playback);
+			}
+		}
+	}
+
+	if (result == NULL)
 	{
 		stack_log("stack_audio_file_create(): Failed to load file as any format\n");
 		g_object_unref(stream);
@@ -84,6 +251,205 @@ StackAudioFile *stack_audio_file_create(const char *filename)
 	return result;
 }
 
+// Creates a new StackAudioFile object from the supplied file
+StackAudioFile *stack_audio_file_create(const char *uri, bool for_playback)
+{
+	return stack_audio_file_open(uri, for_playback);
+}
+
+bool stack_audio_file_get_info(const char *uri, StackAudioFileInfo *info)
+{
+	// Try the media catalog first
+	GFile *file = stack_audio_file_new_gfile(uri);
+	const char *payload = NULL;
+	size_t payload_size = 0;
+	GMappedFile *mapped = stack_media_cache_map(file, "info", STACK_AUDIO_FILE_INFO_CACHE_VERSION, &payload, &payload_size);
+	if (mapped != NULL)
+	{
+		const bool valid = (payload_size == sizeof(StackAudioFileInfoCacheData));
+		if (valid)
+		{
+			StackAudioFileInfoCacheData data;
+			memcpy(&data, payload, sizeof(StackAudioFileInfoCacheData));
+			info->format = (StackAudioFileFormat)data.format;
+			info->channels = data.channels;
+			info->sample_rate = data.sample_rate;
+			info->frames = data.frames;
+			info->length = data.length;
+		}
+		g_mapped_file_unref(mapped);
+
+		if (valid)
+		{
+			g_object_unref(file);
+			return true;
+		}
+	}
+
+	// Otherwise we have to open the file
+	StackAudioFile *audio_file = stack_audio_file_create(uri);
+	if (audio_file == NULL)
+	{
+		g_object_unref(file);
+		return false;
+	}
+
+	info->format = audio_file->format;
+	info->channels = audio_file->channels;
+	info->sample_rate = audio_file->sample_rate;
+	info->frames = audio_file->frames;
+	info->length = audio_file->length;
+	stack_audio_file_destroy(audio_file);
+
+	// Add it to the catalog for next time
+	StackAudioFileInfoCacheData data;
+	data.format = (uint32_t)info->format;
+	data.channels = (uint32_t)info->channels;
+	data.sample_rate = (uint32_t)info->sample_rate;
+	data.frames = info->frames;
+	data.length = info->length;
+	stack_media_cache_write(file, "info", STACK_AUDIO_FILE_INFO_CACHE_VERSION, &data, sizeof(StackAudioFileInfoCacheData));
+	g_object_unref(file);
+
+	return true;
+}
+
+bool stack_audio_file_use_lazy_open()
+{
+	static const bool lazy_open = !(getenv("STACK_EAGER_MEDIA") != NULL && strcmp(getenv("STACK_EAGER_MEDIA"), "1") == 0);
+	return lazy_open;
+}
+
+StackAudioFilePrefetch *stack_audio_file_prefetch(const std::vector<std::string> &uris, StackAudioFilePrefetchProgressFunc progress, void *user_data)
+{
+	StackAudioFilePrefetch *prefetch = new StackAudioFilePrefetch;
+
+	// Group repeated URIs so that each file is only opened by one thread. The
+	// first open of a file populates the media cache so opening it again for
+	// the remaining cues is quick
+	std::map<std::string, size_t> uri_counts;
+	for (auto &uri : uris)
+	{
+		uri_counts[uri]++;
+	}
+	std::vector<std::pair<std::string, size_t>> jobs(uri_counts.begin(), uri_counts.end());
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t next_job = 0, opened = 0, finished_threads = 0;
+	const size_t thread_count = std::min(jobs.size(), (size_t)STACK_AUDIO_FILE_PREFETCH_THREADS);
+
+	auto worker = [&]()
+	{
+		pthread_setname_np(pthread_self(), "stack-prefetch");
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (next_job < jobs.size())
+		{
+			const std::pair<std::string, size_t> &job = jobs[next_job++];
+			lock.unlock();
+
+			if (stack_audio_file_use_lazy_open())
+			{
+				// When opening lazily, we only need the details of each file
+				StackAudioFileInfo info;
+				if (stack_audio_file_get_info(job.first.c_str(), &info))
+				{
+					std::unique_lock<std::mutex> prefetch_lock(prefetch->mutex);
+					prefetch->info[job.first] = info;
+				}
+			}
+			else
+			{
+				for (size_t i = 0; i < job.second; i++)
+				{
+					StackAudioFile *file = stack_audio_file_open(job.first.c_str(), true);
+					if (file == NULL)
+					{
+						// The cues will report the error when they try themselves
+						break;
+					}
+
+					std::unique_lock<std::mutex> prefetch_lock(prefetch->mutex);
+					prefetch->files.emplace(job.first, file);
+				}
+			}
+
+			lock.lock();
+			opened += job.second;
+			condition.notify_all();
+		}
+
+		finished_threads++;
+		condition.notify_all();
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads.push_back(std::thread(worker));
+	}
+
+	// Report progress from the calling thread
+	std::unique_lock<std::mutex> lock(mutex);
+	size_t reported = 0;
+	while (finished_threads < thread_count)
+	{
+		condition.wait(lock, [&]{ return finished_threads == thread_count || opened != reported; });
+		if (progress != NULL && opened != reported)
+		{
+			reported = opened;
+			lock.unlock();
+			progress(reported, uris.size(), user_data);
+			lock.lock();
+		}
+	}
+	lock.unlock();
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	return prefetch;
+}
+
+StackAudioFile *stack_audio_file_prefetch_take(StackAudioFilePrefetch *prefetch, const char *uri)
+{
+	std::unique_lock<std::mutex> lock(prefetch->mutex);
+	auto iter = prefetch->files.find(uri);
+	if (iter == prefetch->files.end())
+	{
+		return NULL;
+	}
+
+	StackAudioFile *result = iter->second;
+	prefetch->files.erase(iter);
+	return result;
+}
+
+bool stack_audio_file_prefetch_get_info(StackAudioFilePrefetch *prefetch, const char *uri, StackAudioFileInfo *info)
+{
+	std::unique_lock<std::mutex> lock(prefetch->mutex);
+	auto iter = prefetch->info.find(uri);
+	if (iter == prefetch->info.end())
+	{
+		return false;
+	}
+
+	*info = iter->second;
+	return true;
+}
+
+void stack_audio_file_prefetch_destroy(StackAudioFilePrefetch *prefetch)
+{
+	for (auto &iter : prefetch->files)
+	{
+		stack_audio_file_destroy(iter.second);
+	}
+	delete prefetch;
+}
+
 // Closes the audio file and destroys the object
 void stack_audio_file_destroy(StackAudioFile *audio_file)
 {
@@ -144,6 +510,22 @@ void stack_audio_file_seek(StackAudioFile *audio_file, stack_time_t pos)
 	}
 }
 
+// Returns whether the file can seek to an exact frame without scanning it
+bool stack_audio_file_has_fast_seek(StackAudioFile *audio_file)
+{
+	switch (audio_file->format)
+	{
+		case STACK_AUDIO_FILE_FORMAT_WAVE:
+			return true;
+#if HAVE_LIBFLAC == 1
+		case STACK_AUDIO_FILE_FORMAT_FLAC:
+			return stack_audio_file_has_fast_seek_flac((StackAudioFileFLAC*)audio_file);
+#endif
+		default:
+			return false;
+	}
+}
+
 // Read the requested number of frames from the file into buffer
 size_t stack_audio_file_read(StackAudioFile *audio_file, float *buffer, size_t frames)
 {
@@ -169,54 +551,562 @@ size_t stack_audio_file_read(StackAudioFile *audio_file, float *buffer, size_t f
 	}
 }
 
-// TODO: The following functions assume the endianness of the system and the
-// contents of the file are the same... and in the case of int24, assumes that
-// that *both* are Big Endian
-static bool stack_audio_file_convert_int24(const char *input, size_t samples, float *output)
+// Scalar conversions. These assemble each sample from its bytes so that they
+// are correct regardless of host endianness (the compiler turns these back in
+// to plain loads on little-endian hosts). They are also used for the head and
+// tail of buffers that the vectorised versions don't handle
+static void stack_audio_file_convert_int8_scalar(const uint8_t *input, size_t samples, float *output)
 {
 	for (size_t i = 0; i < samples; i++)
 	{
-		int32_t sample = (*(int32_t*)&input[i * 3] & 0x00ffffff);
-		if (sample & 0x00800000) { sample |= sample | 0xff000000; }
+		output[i] = (float)(int8_t)input[i] * INT8_SCALAR;
+	}
+}
+
+static void stack_audio_file_convert_int16_scalar(const uint8_t *input, size_t samples, float *output)
+{
+	for (size_t i = 0; i < samples; i++, input += 2)
+	{
+		output[i] = (float)(int16_t)((uint16_t)input[0] | ((uint16_t)input[1] << 8)) * INT16_SCALAR;
+	}
+}
+
+static void stack_audio_file_convert_int24_scalar(const uint8_t *input, size_t samples, float *output)
+{
+	for (size_t i = 0; i < samples; i++, input += 3)
+	{
+		// Build the sample in the top 24 bits and shift down to sign-extend
+		int32_t sample = (int32_t)(((uint32_t)input[0] << 8) | ((uint32_t)input[1] << 16) | ((uint32_t)input[2] << 24)) >> 8;
 		output[i] = (float)sample * INT24_SCALAR;
 	}
+}
 
-	return true;
+static void stack_audio_file_convert_int32_scalar(const uint8_t *input, size_t samples, float *output)
+{
+	for (size_t i = 0; i < samples; i++, input += 4)
+	{
+		int32_t sample = (int32_t)((uint32_t)input[0] | ((uint32_t)input[1] << 8) | ((uint32_t)input[2] << 16) | ((uint32_t)input[3] << 24));
+		output[i] = (float)sample * INT32_SCALAR;
+	}
 }
 
-template <typename T> bool stack_audio_file_convert_trivial(const T *input, const size_t samples, float *output, const float scalar)
+static void stack_audio_file_convert_float32_scalar(const uint8_t *input, size_t samples, float *output)
 {
-	for (size_t i = 0; i < samples; i++)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(output, input, sizeof(float) * samples);
+#else
+	for (size_t i = 0; i < samples; i++, input += 4)
+	{
+		uint32_t bits = (uint32_t)input[0] | ((uint32_t)input[1] << 8) | ((uint32_t)input[2] << 16) | ((uint32_t)input[3] << 24);
+		memcpy(&output[i], &bits, sizeof(float));
+	}
+#endif
+}
+
+static void stack_audio_file_convert_float64_scalar(const uint8_t *input, size_t samples, float *output)
+{
+	for (size_t i = 0; i < samples; i++, input += 8)
 	{
-		output[i] = (float)((T*)input)[i] * scalar;
+		uint64_t bits = 0;
+		for (size_t j = 0; j < 8; j++)
+		{
+			bits |= (uint64_t)input[j] << (8 * j);
+		}
+		double sample;
+		memcpy(&sample, &bits, sizeof(double));
+		output[i] = (float)sample;
 	}
+}
 
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+// SSE2 conversions. SSE2 is always available on x86-64. All loads and stores
+// are unaligned, so there's no alignment requirement on the head of the
+// buffers, and any tail that doesn't fill a whole vector is left to the scalar
+// versions
+static void stack_audio_file_convert_int8_sse2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m128 scale = _mm_set1_ps(INT8_SCALAR);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16)
+	{
+		// Widen by putting each byte in the top of a larger lane and
+		// arithmetic-shifting back down, which sign-extends
+		__m128i v = _mm_loadu_si128((const __m128i*)&input[i]);
+		__m128i lo16 = _mm_srai_epi16(_mm_unpacklo_epi8(zero, v), 8);
+		__m128i hi16 = _mm_srai_epi16(_mm_unpackhi_epi8(zero, v), 8);
+		_mm_storeu_ps(&output[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, lo16), 16)), scale));
+		_mm_storeu_ps(&output[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, lo16), 16)), scale));
+		_mm_storeu_ps(&output[i + 8], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, hi16), 16)), scale));
+		_mm_storeu_ps(&output[i + 12], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, hi16), 16)), scale));
+	}
+	stack_audio_file_convert_int8_scalar(&input[i], samples - i, &output[i]);
+}
+
+static void stack_audio_file_convert_int16_sse2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m128 scale = _mm_set1_ps(INT16_SCALAR);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)&input[i * 2]);
+		_mm_storeu_ps(&output[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16)), scale));
+		_mm_storeu_ps(&output[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16)), scale));
+	}
+	stack_audio_file_convert_int16_scalar(&input[i * 2], samples - i, &output[i]);
+}
+
+static void stack_audio_file_convert_int32_sse2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m128 scale = _mm_set1_ps(INT32_SCALAR);
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)&input[i * 4]);
+		_mm_storeu_ps(&output[i], _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	stack_audio_file_convert_int32_scalar(&input[i * 4], samples - i, &output[i]);
+}
+
+static void stack_audio_file_convert_float64_sse2(const uint8_t *input, size_t samples, float *output)
+{
+	const double *doubles = (const double*)input;
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4)
+	{
+		__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(&doubles[i]));
+		__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(&doubles[i + 2]));
+		_mm_storeu_ps(&output[i], _mm_movelh_ps(lo, hi));
+	}
+	stack_audio_file_convert_float64_scalar(&input[i * 8], samples - i, &output[i]);
+}
+
+// AVX2 conversions, only used if the CPU supports them
+__attribute__((target("avx2"))) static void stack_audio_file_convert_int8_avx2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m256 scale = _mm256_set1_ps(INT8_SCALAR);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		__m256i v = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)&input[i]));
+		_mm256_storeu_ps(&output[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	stack_audio_file_convert_int8_scalar(&input[i], samples - i, &output[i]);
+}
+
+__attribute__((target("avx2"))) static void stack_audio_file_convert_int16_avx2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m256 scale = _mm256_set1_ps(INT16_SCALAR);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&input[i * 2]));
+		_mm256_storeu_ps(&output[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	stack_audio_file_convert_int16_scalar(&input[i * 2], samples - i, &output[i]);
+}
+
+__attribute__((target("avx2"))) static void stack_audio_file_convert_int24_avx2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m256 scale = _mm256_set1_ps(INT24_SCALAR);
+
+	// Moves bytes 0-11 of the load to the low lane and 12-23 to the high lane
+	const __m256i permute = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+
+	// Places each 24-bit sample in the top three bytes of a 32-bit lane
+	const __m256i shuffle = _mm256_setr_epi8(
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+	// Each iteration converts eight samples (24 bytes) but loads 32 bytes, so
+	// stop whilst there's still enough input to not read past the end
+	size_t i = 0;
+	for (; i + 11 <= samples; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)&input[i * 3]);
+		v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, permute), shuffle);
+		_mm256_storeu_ps(&output[i], _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(v, 8)), scale));
+	}
+	stack_audio_file_convert_int24_scalar(&input[i * 3], samples - i, &output[i]);
+}
+
+__attribute__((target("avx2"))) static void stack_audio_file_convert_int32_avx2(const uint8_t *input, size_t samples, float *output)
+{
+	const __m256 scale = _mm256_set1_ps(INT32_SCALAR);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)&input[i * 4]);
+		_mm256_storeu_ps(&output[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	stack_audio_file_convert_int32_scalar(&input[i * 4], samples - i, &output[i]);
+}
+
+__attribute__((target("avx2"))) static void stack_audio_file_convert_float64_avx2(const uint8_t *input, size_t samples, float *output)
+{
+	const double *doubles = (const double*)input;
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+	{
+		__m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(&doubles[i]));
+		__m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(&doubles[i + 4]));
+		_mm256_storeu_ps(&output[i], _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+	}
+	stack_audio_file_convert_float64_scalar(&input[i * 8], samples - i, &output[i]);
+}
+#endif
+
+// A set of conversion functions, one per input format
+typedef void (*stack_audio_file_converter_t)(const uint8_t *input, size_t samples, float *output);
+struct StackAudioFileConverters
+{
+	stack_audio_file_converter_t int8;
+	stack_audio_file_converter_t int16;
+	stack_audio_file_converter_t int24;
+	stack_audio_file_converter_t int32;
+	stack_audio_file_converter_t float32;
+	stack_audio_file_converter_t float64;
+};
+
+// The sets of conversion functions for each path
+static const StackAudioFileConverters scalar_converters = { stack_audio_file_convert_int8_scalar, stack_audio_file_convert_int16_scalar, stack_audio_file_convert_int24_scalar, stack_audio_file_convert_int32_scalar, stack_audio_file_convert_float32_scalar, stack_audio_file_convert_float64_scalar };
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+// There's no worthwhile way to unpack 24-bit samples with just SSE2
+static const StackAudioFileConverters sse2_converters = { stack_audio_file_convert_int8_sse2, stack_audio_file_convert_int16_sse2, stack_audio_file_convert_int24_scalar, stack_audio_file_convert_int32_sse2, stack_audio_file_convert_float32_scalar, stack_audio_file_convert_float64_sse2 };
+static const StackAudioFileConverters avx2_converters = { stack_audio_file_convert_int8_avx2, stack_audio_file_convert_int16_avx2, stack_audio_file_convert_int24_avx2, stack_audio_file_convert_int32_avx2, stack_audio_file_convert_float32_scalar, stack_audio_file_convert_float64_avx2 };
+#endif
+
+// The conversion functions currently in use, chosen on first use
+static std::atomic<const StackAudioFileConverters*> converters(NULL);
+
+// Returns the set of conversion functions for the given path, or NULL if the
+// build or the CPU doesn't support it
+static const StackAudioFileConverters *stack_audio_file_get_converters(StackAudioFileConvertPath path)
+{
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+	__builtin_cpu_init();
+	const bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	switch (path)
+	{
+		case STACK_AUDIO_FILE_CONVERT_AUTO:
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+			return have_avx2 ? &avx2_converters : &sse2_converters;
+#else
+			return &scalar_converters;
+#endif
+		case STACK_AUDIO_FILE_CONVERT_SCALAR:
+			return &scalar_converters;
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+		case STACK_AUDIO_FILE_CONVERT_SSE2:
+			return &sse2_converters;
+		case STACK_AUDIO_FILE_CONVERT_AVX2:
+			return have_avx2 ? &avx2_converters : NULL;
+#endif
+		default:
+			return NULL;
+	}
+}
+
+// Returns the name of a conversion path for logging
+static const char *stack_audio_file_convert_path_name(StackAudioFileConvertPath path)
+{
+	switch (path)
+	{
+		case STACK_AUDIO_FILE_CONVERT_SCALAR:
+			return "scalar";
+		case STACK_AUDIO_FILE_CONVERT_SSE2:
+			return "SSE2";
+		case STACK_AUDIO_FILE_CONVERT_AVX2:
+			return "AVX2";
+		default:
+			return "automatic";
+	}
+}
+
+bool stack_audio_file_set_convert_path(StackAudioFileConvertPath path)
+{
+	const StackAudioFileConverters *new_converters = stack_audio_file_get_converters(path);
+	if (new_converters == NULL)
+	{
+		stack_log("stack_audio_file_set_convert_path(): %s sample conversion is not supported\n", stack_audio_file_convert_path_name(path));
+		return false;
+	}
+
+	converters = new_converters;
 	return true;
 }
 
-// Converts audio data to system-endian floating point
+// Chooses the conversion functions the first time we convert anything. This is
+// the fastest set the CPU supports, unless STACK_AUDIO_CONVERT is set to one of
+// "scalar", "sse2" or "avx2"
+static const StackAudioFileConverters *stack_audio_file_choose_converters()
+{
+	StackAudioFileConvertPath path = STACK_AUDIO_FILE_CONVERT_AUTO;
+	const char *forced = getenv("STACK_AUDIO_CONVERT");
+	if (forced != NULL)
+	{
+		if (strcmp(forced, "scalar") == 0)
+		{
+			path = STACK_AUDIO_FILE_CONVERT_SCALAR;
+		}
+		else if (strcmp(forced, "sse2") == 0)
+		{
+			path = STACK_AUDIO_FILE_CONVERT_SSE2;
+		}
+		else if (strcmp(forced, "avx2") == 0)
+		{
+			path = STACK_AUDIO_FILE_CONVERT_AVX2;
+		}
+	}
+
+	const StackAudioFileConverters *result = stack_audio_file_get_converters(path);
+	if (result == NULL)
+	{
+		stack_log("stack_audio_file_choose_converters(): %s sample conversion is not supported, choosing automatically\n", stack_audio_file_convert_path_name(path));
+		result = stack_audio_file_get_converters(STACK_AUDIO_FILE_CONVERT_AUTO);
+	}
+
+#if STACK_AUDIO_FILE_CONVERT_X86 == 1
+	if (result == &avx2_converters)
+	{
+		stack_log("stack_audio_file_choose_converters(): Using AVX2 sample conversion\n");
+	}
+	else if (result == &sse2_converters)
+	{
+		stack_log("stack_audio_file_choose_converters(): Using SSE2 sample conversion\n");
+	}
+	else
+#endif
+	{
+		stack_log("stack_audio_file_choose_converters(): Using scalar sample conversion\n");
+	}
+
+	return result;
+}
+
+// Converts little-endian audio data to system-endian floating point
 bool stack_audio_file_convert(StackSampleFormat format, const void *input, const size_t samples, float *output)
 {
+	// Pick our converters the first time we're called (unless they've been
+	// forced already). Racing threads will all choose the same set
+	const StackAudioFileConverters *current = converters.load(std::memory_order_relaxed);
+	if (current == NULL)
+	{
+		current = stack_audio_file_choose_converters();
+		converters = current;
+	}
+
+	const uint8_t *bytes = (const uint8_t*)input;
 	switch (format)
 	{
 		case STACK_SAMPLE_FORMAT_INT8:
-			return stack_audio_file_convert_trivial<int8_t>((int8_t*)input, samples, output, INT8_SCALAR);
+			current->int8(bytes, samples, output);
+			return true;
 		case STACK_SAMPLE_FORMAT_INT16:
-			return stack_audio_file_convert_trivial<int16_t>((int16_t*)input, samples, output, INT16_SCALAR);
+			current->int16(bytes, samples, output);
+			return true;
 		case STACK_SAMPLE_FORMAT_INT24:
-			return stack_audio_file_convert_int24((char*)input, samples, output);
+			current->int24(bytes, samples, output);
+			return true;
 		case STACK_SAMPLE_FORMAT_INT32:
-			return stack_audio_file_convert_trivial<int32_t>((int32_t*)input, samples, output, INT32_SCALAR);
+			current->int32(bytes, samples, output);
+			return true;
 		case STACK_SAMPLE_FORMAT_FLOAT32:
-			memcpy(output, input, sizeof(float) * samples);
+			current->float32(bytes, samples, output);
 			return true;
 		case STACK_SAMPLE_FORMAT_FLOAT64:
-			return stack_audio_file_convert_trivial<double>((double*)input, samples, output, 1.0f);
+			current->float64(bytes, samples, output);
+			return true;
 		default:
 			return false;
 	}
+}
 
-	return true;
+// The version of the generated seek table payload in the media cache
+static const uint32_t SEEK_TABLE_CACHE_VERSION = 1;
+
+bool stack_audio_file_load_seek_table(GFile *file, const char *type, StackAudioFileSeekTable *seek_table)
+{
+	const char *payload = NULL;
+	size_t payload_size = 0;
+	GMappedFile *mapped = stack_media_cache_map(file, type, SEEK_TABLE_CACHE_VERSION, &payload, &payload_size);
+	if (mapped == NULL)
+	{
+		return false;
+	}
+
+	// The payload is just the seek points
+	bool result = false;
+	if (payload_size > 0 && payload_size % sizeof(StackAudioFileSeekPoint) == 0)
+	{
+		const StackAudioFileSeekPoint *points = (const StackAudioFileSeekPoint*)payload;
+		seek_table->assign(points, points + payload_size / sizeof(StackAudioFileSeekPoint));
+		result = true;
+	}
+
+	g_mapped_file_unref(mapped);
+
+	return result;
+}
+
+bool stack_audio_file_save_seek_table(GFile *file, const char *type, const StackAudioFileSeekTable &seek_table)
+{
+	if (seek_table.empty())
+	{
+		return false;
+	}
+
+	return stack_media_cache_write(file, type, SEEK_TABLE_CACHE_VERSION, &seek_table[0], seek_table.size() * sizeof(StackAudioFileSeekPoint));
+}
+
+// Thread that builds the seek tables in the queue
+static void stack_audio_file_index_thread()
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-index");
+
+	// Run at a lower priority so as not to compete with playback or the UI
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+
+	while (true)
+	{
+		// Wait for a request
+		std::unique_lock<std::mutex> lock(index_service->mutex);
+		index_service->condition.wait(lock, []{ return index_service->kill_thread || !index_service->queue.empty(); });
+		if (index_service->kill_thread)
+		{
+			break;
+		}
+		StackAudioFileIndexJob job = index_service->queue.front();
+		index_service->queue.pop_front();
+		lock.unlock();
+
+		// Don't write to the cache if we were stopped part way through
+		StackAudioFileSeekTable seek_table;
+		if (job.builder(job.file, &seek_table, &index_service->kill_thread) && !seek_table.empty() && !index_service->kill_thread)
+		{
+			stack_audio_file_save_seek_table(job.file, job.type.c_str(), seek_table);
+			std::swap(job.seek_table->seek_table, seek_table);
+			job.seek_table->ready = true;
+		}
+		else
+		{
+			stack_log("stack_audio_file_index_thread(): Failed to build seek table\n");
+		}
+
+		g_object_unref(job.file);
+	}
+}
+
+// Creates the indexing service and starts its thread
+static void stack_audio_file_index_start()
+{
+	index_service = new StackAudioFileIndexService;
+	index_service->kill_thread = false;
+	index_service->thread = std::thread(stack_audio_file_index_thread);
+}
+
+void stack_audio_file_index_stop()
+{
+	// Nothing to do if we never started
+	if (index_service == NULL)
+	{
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(index_service->mutex);
+		index_service->kill_thread = true;
+	}
+	index_service->condition.notify_one();
+	index_service->thread.join();
+
+	// Abandon anything left in the queue. The service itself stays around, as
+	// open files still refer to their tables through it
+	std::unique_lock<std::mutex> lock(index_service->mutex);
+	for (auto &job : index_service->queue)
+	{
+		g_object_unref(job.file);
+	}
+	index_service->queue.clear();
+}
+
+std::shared_ptr<StackAudioFileSharedSeekTable> stack_audio_file_get_seek_table(GFile *file, const char *type, StackAudioFileSeekTableBuilder builder, bool build)
+{
+	std::call_once(index_service_once, stack_audio_file_index_start);
+
+	uint64_t file_size = 0, file_mtime = 0;
+	if (!stack_media_cache_get_key(file, &file_size, &file_mtime))
+	{
+		return NULL;
+	}
+
+	char *uri = g_file_get_uri(file);
+	const std::string key = std::string(type) + ":" + uri;
+	g_free(uri);
+
+	// Use the table another open copy of the file has, as long as the file
+	// hasn't changed since
+	std::unique_lock<std::mutex> lock(index_service->mutex);
+	std::shared_ptr<StackAudioFileSharedSeekTable> seek_table = index_service->seek_tables[key].lock();
+	if (!seek_table || seek_table->file_size != file_size || seek_table->file_mtime != file_mtime)
+	{
+		lock.unlock();
+
+		// Try the media cache (without holding the lock whilst we read it)
+		std::shared_ptr<StackAudioFileSharedSeekTable> new_seek_table = std::make_shared<StackAudioFileSharedSeekTable>();
+		new_seek_table->file_size = file_size;
+		new_seek_table->file_mtime = file_mtime;
+		new_seek_table->queued = false;
+		new_seek_table->ready = stack_audio_file_load_seek_table(file, type, &new_seek_table->seek_table);
+
+		// Someone else might have got there whilst we were reading
+		lock.lock();
+		seek_table = index_service->seek_tables[key].lock();
+		if (!seek_table || seek_table->file_size != file_size || seek_table->file_mtime != file_mtime)
+		{
+			seek_table = new_seek_table;
+			index_service->seek_tables[key] = seek_table;
+		}
+
+		// Forget about tables that are no longer in use
+		for (auto iter = index_service->seek_tables.begin(); iter != index_service->seek_tables.end(); )
+		{
+			if (iter->second.expired())
+			{
+				iter = index_service->seek_tables.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+
+	// Queue the table to be built if we need to (and we're not shutting down)
+	if (build && !seek_table->ready && !seek_table->queued && !index_service->kill_thread)
+	{
+		seek_table->queued = true;
+		index_service->queue.push_back(StackAudioFileIndexJob{ (GFile*)g_object_ref(file), type, builder, seek_table });
+		index_service->condition.notify_one();
+	}
+
+	return seek_table;
+}
+
+StackAudioFileSeekTable::const_iterator stack_audio_file_find_seek_point(const StackAudioFileSeekTable &seek_table, uint64_t sample)
+{
+	// Find the first point after our sample, the one before is what we want
+	StackAudioFileSeekTable::const_iterator point = std::upper_bound(seek_table.begin(), seek_table.end(), sample, [](uint64_t s, const StackAudioFileSeekPoint &p) { return s < p.sample_position; });
+	if (point == seek_table.begin())
+	{
+		return seek_table.end();
+	}
+
+	return --point;
 }
 
 uint64_t stack_time_to_samples(stack_time_t t, uint32_t sample_rate)
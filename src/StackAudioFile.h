@@ -4,6 +4,12 @@
 // Includes:
 #include "StackCue.h"
 #include <gtk/gtk.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 // Supported file formats
 enum StackAudioFileFormat
@@ -27,6 +33,15 @@ enum StackSampleFormat
 	STACK_SAMPLE_FORMAT_FLOAT64 = 6,
 };
 
+// The sets of sample conversion functions stack_audio_file_convert can use
+enum StackAudioFileConvertPath
+{
+	STACK_AUDIO_FILE_CONVERT_AUTO = 0,
+	STACK_AUDIO_FILE_CONVERT_SCALAR = 1,
+	STACK_AUDIO_FILE_CONVERT_SSE2 = 2,
+	STACK_AUDIO_FILE_CONVERT_AVX2 = 3,
+};
+
 struct StackAudioFile
 {
 	StackAudioFileFormat format;
@@ -38,10 +53,119 @@ struct StackAudioFile
     GFileInputStream *stream;
 };
 
+// The details of an audio file that can be found without decoding it
+struct StackAudioFileInfo
+{
+	StackAudioFileFormat format;
+	size_t channels;
+	size_t sample_rate;
+	stack_time_t length;
+	size_t frames;
+};
+
+// A point in a seek table generated for formats whose own seeking is slow,
+// mapping a sample to a location in the file where decoding can begin
+struct StackAudioFileSeekPoint
+{
+	uint64_t sample_position;
+	uint64_t byte_position;
+};
+typedef std::vector<StackAudioFileSeekPoint> StackAudioFileSeekTable;
+
+// A generated seek table that is shared between every open copy of a media
+// file, so that it is only loaded or built once. The seek points must only be
+// used once ready is set
+struct StackAudioFileSharedSeekTable
+{
+	// The size and modification time of the file the table is for
+	uint64_t file_size;
+	uint64_t file_mtime;
+
+	// Whether the table has been queued to be built (protected by the lock of
+	// the indexing thread)
+	bool queued;
+
+	StackAudioFileSeekTable seek_table;
+	std::atomic<bool> ready;
+};
+
+// Builds a seek table for a file by scanning it with its own stream. Returns
+// false if the table couldn't be built, or if cancel was set part way through
+typedef bool (*StackAudioFileSeekTableBuilder)(GFile *file, StackAudioFileSeekTable *seek_table, const std::atomic<bool> *cancel);
+
+// Returns a GFile for either an absolute path or a URI, as accepted by
+// stack_audio_file_create. Anything that caches data about an audio file
+// should use this so that it refers to the same file that was opened
+GFile *stack_audio_file_new_gfile(const char *uri);
+
 // Opens the audio file at path, and parses any headers. Returns NULL if no
 // supported audio-format could be found or returns something that extends
-// StackAudioFile otherwise
-StackAudioFile *stack_audio_file_create(const char *uri);
+// StackAudioFile otherwise. If for_playback is set, any seek table that the
+// format needs is built in the background if it doesn't exist yet. Other
+// opens (previews, peaks, analysis) use one if it exists, but don't start
+// scanning the file for one
+StackAudioFile *stack_audio_file_create(const char *uri, bool for_playback = false);
+
+// Callback to receive progress whilst files are being prefetched, called on
+// the thread that called stack_audio_file_prefetch
+// @param opened The number of files that have been opened (or failed to open)
+// @param total The total number of files to open
+// @param user_data The user data passed to stack_audio_file_prefetch
+typedef void (*StackAudioFilePrefetchProgressFunc)(size_t opened, size_t total, void *user_data);
+
+// A set of audio files opened (or the details of which were fetched) ahead of
+// them being needed by stack_audio_file_prefetch. Each set belongs to whoever
+// asked for it, so that separate loads never take each other's files
+struct StackAudioFilePrefetch
+{
+	std::mutex mutex;
+	std::multimap<std::string, StackAudioFile*> files;
+	std::map<std::string, StackAudioFileInfo> info;
+};
+
+// Opens a number of audio files in parallel ahead of them being needed, and
+// returns once they are all open. The files can then be taken from the set
+// with stack_audio_file_prefetch_take. If lazy opening is in use, only the
+// details of the files are fetched (for stack_audio_file_prefetch_get_info),
+// and the files are not kept open
+// @param uris The URIs of the files. A URI appearing more than once is opened
+// that many times
+// @param progress If not NULL, called as files are opened
+// @param user_data Passed to the progress callback
+// @returns A new prefetch set, to be destroyed with
+// stack_audio_file_prefetch_destroy
+StackAudioFilePrefetch *stack_audio_file_prefetch(const std::vector<std::string> &uris, StackAudioFilePrefetchProgressFunc progress = NULL, void *user_data = NULL);
+
+// Takes an open file from a prefetch set. The caller owns the returned file
+// @param prefetch The prefetch set
+// @param uri The URI of the file
+// @returns The file, or NULL if the set has no open file for the URI
+StackAudioFile *stack_audio_file_prefetch_take(StackAudioFilePrefetch *prefetch, const char *uri);
+
+// Gets the details of a file from a prefetch set
+// @param prefetch The prefetch set
+// @param uri The URI of the file
+// @param info Receives the details of the file
+// @returns Whether the set has details for the URI
+bool stack_audio_file_prefetch_get_info(StackAudioFilePrefetch *prefetch, const char *uri, StackAudioFileInfo *info);
+
+// Destroys any files in a prefetch set that were not taken, and then the set
+// itself
+void stack_audio_file_prefetch_destroy(StackAudioFilePrefetch *prefetch);
+
+// Gets the details of an audio file without keeping it open. These come from
+// the media catalog (the "info" entries in the media cache) where possible,
+// otherwise the file is opened and the catalog updated
+// @param uri The URI of the audio file
+// @param info Receives the details of the file
+// @returns Whether the file is a valid audio file
+bool stack_audio_file_get_info(const char *uri, StackAudioFileInfo *info);
+
+// Returns whether cues should defer opening their audio files until they are
+// selected, prepared or played, and close them again once they've been idle for
+// a while. This is the default, and can be turned off by setting
+// STACK_EAGER_MEDIA=1
+bool stack_audio_file_use_lazy_open();
 
 // Destroys a StackAudioFile (or extension)
 void stack_audio_file_destroy(StackAudioFile *audio_file);
@@ -49,14 +173,54 @@ void stack_audio_file_destroy(StackAudioFile *audio_file);
 // Seeks to a the given point (in nanoseconds) in the audio
 void stack_audio_file_seek(StackAudioFile *audio_file, stack_time_t pos);
 
+// Returns whether the file can seek to an exact frame cheaply (i.e. without
+// scanning or bisecting the file), so that it can be read from several places
+// at once efficiently
+bool stack_audio_file_has_fast_seek(StackAudioFile *audio_file);
+
 // Reads frames from the audio file and converts them to float
 size_t stack_audio_file_read(StackAudioFile *audio_file, float *buffer, size_t frames)
 	__attribute__((access (write_only, 2, 3)));
 
-// Converts audio data from a given input format to float
+// Converts little-endian audio data from a given input format to float. Uses
+// vectorised conversions where the CPU supports them
 bool stack_audio_file_convert(StackSampleFormat format, const void *input, const size_t samples, float *output)
 	__attribute__((access (write_only, 4, 3))) __attribute__((access (read_only, 2, 3)));
 
+// Forces stack_audio_file_convert to use the given set of conversions, or with
+// STACK_AUDIO_FILE_CONVERT_AUTO, the fastest set the CPU supports. Returns false
+// (leaving the conversions unchanged) if the build or the CPU doesn't support
+// them. Intended for testing and benchmarking each path
+bool stack_audio_file_set_convert_path(StackAudioFileConvertPath path);
+
+// Loads a generated seek table of the given type from the media cache
+bool stack_audio_file_load_seek_table(GFile *file, const char *type, StackAudioFileSeekTable *seek_table);
+
+// Saves a generated seek table of the given type to the media cache
+bool stack_audio_file_save_seek_table(GFile *file, const char *type, const StackAudioFileSeekTable &seek_table);
+
+// Gets the seek table of the given type for a file, which is shared with every
+// other open copy of the file. The table comes from memory or the media cache
+// where possible. Otherwise, if build is set, it is queued to be built by the
+// indexing thread (which works through one file at a time so that the scans
+// don't compete for I/O) and becomes ready later
+// @param file The media file
+// @param type The four-character cache type of the table
+// @param builder The function that builds the table
+// @param build Whether to build the table if it doesn't exist
+// @returns The shared table (which might never become ready), or NULL if the
+// details of the file couldn't be read
+std::shared_ptr<StackAudioFileSharedSeekTable> stack_audio_file_get_seek_table(GFile *file, const char *type, StackAudioFileSeekTableBuilder builder, bool build);
+
+// Stops the indexing thread, abandoning any tables it hasn't built yet, so
+// that it isn't still scanning files or writing to the media cache when we
+// exit. Called when the application shuts down
+void stack_audio_file_index_stop();
+
+// Returns the last point in a seek table at or before the given sample, or
+// the end of the table if there isn't one
+StackAudioFileSeekTable::const_iterator stack_audio_file_find_seek_point(const StackAudioFileSeekTable &seek_table, uint64_t sample);
+
 // Converts a stack_time_t (nanoseconds) to a sample/frame index
 uint64_t stack_time_to_samples(stack_time_t t, uint32_t sample_rate);
 
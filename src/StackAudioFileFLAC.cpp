@@ -2,12 +2,19 @@
 // Includes:
 #include "StackAudioFileFLAC.h"
 #include "StackLog.h"
+#include "StackMediaCache.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 static const float INT8_SCALAR = 7.8125e-3f ;
 static const float INT16_SCALAR = 3.051757812e-5f;
 static const float INT24_SCALAR = 1.192092896e-7f;
 static const float INT32_SCALAR = 4.656612873e-10;
 
+// The type of our generated seek table in the media cache
+static const char *FLAC_SEEK_TABLE_CACHE_TYPE = "flci";
+
 FLAC__StreamDecoderReadStatus flac_gfile_wrapper_read(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
 {
 	StackAudioFileFLAC* file = (StackAudioFileFLAC*)client_data;
@@ -68,6 +75,64 @@ FLAC__bool flac_gfile_wrapper_eof(const FLAC__StreamDecoder *decoder, void *clie
 	return file->eof;
 }
 
+// FLAC returns non-multiplexed data, one buffer per channel. It also always
+// returns 32-bit boxed samples regardless of the bit-depth, so we can't use our
+// normal stack_audio_file_convert functions. This scales and multiplexes
+// 'frames' frames starting at 'offset' in each channel buffer into 'output'
+static void stack_audio_file_flac_interleave(const FLAC__int32 *const input[], size_t channels, size_t offset, size_t frames, float scalar, float *output)
+{
+	size_t frame = 0;
+
+	if (channels == 1)
+	{
+		const FLAC__int32 *mono = &input[0][offset];
+#if defined(__SSE2__)
+		const __m128 scale = _mm_set1_ps(scalar);
+		for (; frame + 4 <= frames; frame += 4)
+		{
+			__m128 m = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&mono[frame]));
+			_mm_storeu_ps(&output[frame], _mm_mul_ps(m, scale));
+		}
+#endif
+		for (; frame < frames; frame++)
+		{
+			output[frame] = float(mono[frame]) * scalar;
+		}
+	}
+	else if (channels == 2)
+	{
+		const FLAC__int32 *left = &input[0][offset];
+		const FLAC__int32 *right = &input[1][offset];
+#if defined(__SSE2__)
+		const __m128 scale = _mm_set1_ps(scalar);
+		for (; frame + 4 <= frames; frame += 4)
+		{
+			__m128 l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&left[frame])), scale);
+			__m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&right[frame])), scale);
+			_mm_storeu_ps(&output[frame * 2], _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(&output[frame * 2 + 4], _mm_unpackhi_ps(l, r));
+		}
+#endif
+		for (; frame < frames; frame++)
+		{
+			output[frame * 2] = float(left[frame]) * scalar;
+			output[frame * 2 + 1] = float(right[frame]) * scalar;
+		}
+	}
+	else
+	{
+		for (size_t channel = 0; channel < channels; channel++)
+		{
+			const int32_t *channel_buffer = &input[channel][offset];
+			float *write_pointer = &output[channel];
+			for (frame = 0; frame < frames; frame++, write_pointer += channels)
+			{
+				*write_pointer = float(channel_buffer[frame]) * scalar;
+			}
+		}
+	}
+}
+
 FLAC__StreamDecoderWriteStatus flac_gfile_wrapper_frame(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data)
 {
 	StackAudioFileFLAC* file = (StackAudioFileFLAC*)client_data;
@@ -113,29 +178,57 @@ FLAC__StreamDecoderWriteStatus flac_gfile_wrapper_frame(const FLAC__StreamDecode
 
 	size_t channels = frame->header.channels;
 	size_t frames = frame->header.blocksize;
-	size_t samples = frames * channels;
 
-	// FLAC returns non-multiplexed data, so we need to convert the channels one at a time. It
-	// also always returns 32-bit boxed samples regardless of the bit-depth, so we can't use
-	// our normal stack_audio_file_convert functions
-	float *write_buffer = new float[samples];
-	for (size_t channel = 0; channel < channels; channel++)
+	// If we've seeked using our seek table, discard anything before the
+	// sample we seeked to
+	size_t offset = 0;
+	if (file->skip_frames > 0)
 	{
-		const int32_t *channel_buffer = buffer[channel];
-		for (size_t sample = channel, frame = 0; sample < samples; sample += channels, frame++)
-		{
-			write_buffer[sample] = float(channel_buffer[frame]) * scalar;
-		}
+		offset = frames < file->skip_frames ? frames : file->skip_frames;
+		file->skip_frames -= offset;
+	}
+
+	// If we're being read from, write as much as we can directly in to the
+	// caller's buffer
+	size_t direct_frames = 0;
+	if (file->direct_buffer != NULL && file->direct_frames > 0)
+	{
+		direct_frames = frames - offset < file->direct_frames ? frames - offset : file->direct_frames;
+		stack_audio_file_flac_interleave(buffer, channels, offset, direct_frames, scalar, file->direct_buffer);
+		file->direct_buffer += direct_frames * channels;
+		file->direct_frames -= direct_frames;
 	}
+	offset += direct_frames;
 
-	// Convert to float and add to our ring buffer
-	stack_ring_buffer_write(file->decoded_buffer, write_buffer, samples, 1);
+	// Anything left over goes in to our ring buffer for the next read
+	if (offset < frames)
+	{
+		size_t samples = (frames - offset) * channels;
 
-	delete [] write_buffer;
+		// Grow our scratch buffer if this frame is bigger than any before
+		if (samples > file->frame_buffer_samples)
+		{
+			delete [] file->frame_buffer;
+			file->frame_buffer = new float[samples];
+			file->frame_buffer_samples = samples;
+		}
+
+		stack_audio_file_flac_interleave(buffer, channels, offset, frames - offset, scalar, file->frame_buffer);
+		stack_ring_buffer_write(file->decoded_buffer, file->frame_buffer, samples, 1);
+	}
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
+void flac_gfile_wrapper_metadata(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
+{
+	StackAudioFileFLAC* file = (StackAudioFileFLAC*)client_data;
+	if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE && metadata->data.seek_table.num_points > 0)
+	{
+		file->has_file_seek_table = true;
+	}
+}
+
 void flac_gfile_wrapper_error(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
 {
 	StackAudioFileFLAC* file = (StackAudioFileFLAC*)client_data;
@@ -146,7 +239,65 @@ void flac_gfile_wrapper_error(const FLAC__StreamDecoder *decoder, FLAC__StreamDe
 	}
 }
 
-StackAudioFileFLAC *stack_audio_file_create_flac(GFileInputStream *stream)
+// Builds a seek table for the file by walking the frame headers (without
+// decoding the audio) using its own stream and decoder. This is run by the
+// indexing thread
+static bool stack_audio_file_flac_build_seek_table(GFile *file, StackAudioFileSeekTable *seek_table, const std::atomic<bool> *cancel)
+{
+	GFileInputStream *stream = g_file_read(file, NULL, NULL);
+	if (stream == NULL)
+	{
+		stack_log("stack_audio_file_flac_build_seek_table(): Failed to open file\n");
+		return false;
+	}
+
+	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
+	if (decoder == NULL)
+	{
+		g_object_unref(stream);
+		return false;
+	}
+
+	// Our I/O callbacks only need the stream and EOF flag, and as we're not
+	// marked ready, the write callback does nothing
+	StackAudioFileFLAC scanner;
+	scanner.super.stream = stream;
+	scanner.ready = false;
+	scanner.eof = false;
+
+	bool success = false;
+	if (FLAC__stream_decoder_init_stream(decoder, flac_gfile_wrapper_read, flac_gfile_wrapper_seek, flac_gfile_wrapper_tell, flac_gfile_wrapper_length, flac_gfile_wrapper_eof, flac_gfile_wrapper_frame, NULL, flac_gfile_wrapper_error, &scanner) == FLAC__STREAM_DECODER_INIT_STATUS_OK
+		&& FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+	{
+		uint64_t sample_position = 0;
+		while (!cancel->load())
+		{
+			// The decode position is the start of the next frame
+			FLAC__uint64 byte_position = 0;
+			if (!FLAC__stream_decoder_get_decode_position(decoder, &byte_position) || !FLAC__stream_decoder_skip_single_frame(decoder))
+			{
+				break;
+			}
+
+			if (FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+			{
+				success = true;
+				break;
+			}
+
+			seek_table->push_back(StackAudioFileSeekPoint{ sample_position, byte_position });
+			sample_position += FLAC__stream_decoder_get_blocksize(decoder);
+		}
+	}
+
+	// Tidy up
+	FLAC__stream_decoder_delete(decoder);
+	g_object_unref(stream);
+
+	return success;
+}
+
+StackAudioFileFLAC *stack_audio_file_create_flac(GFile *file, GFileInputStream *stream, bool for_playback)
 {
 	// Create the decoder
 	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
@@ -164,9 +315,19 @@ StackAudioFileFLAC *stack_audio_file_create_flac(GFileInputStream *stream)
 	result->decoder = decoder;
 	result->ready = false;
 	result->eof = false;
+	result->decoded_buffer = NULL;
+	result->frame_buffer = NULL;
+	result->frame_buffer_samples = 0;
+	result->direct_buffer = NULL;
+	result->direct_frames = 0;
+	result->skip_frames = 0;
+	result->has_file_seek_table = false;
+
+	// We want to know whether the file has a seek table
+	FLAC__stream_decoder_set_metadata_respond(decoder, FLAC__METADATA_TYPE_SEEKTABLE);
 
 	// Create the stream decoder
-	if (FLAC__stream_decoder_init_stream(decoder, flac_gfile_wrapper_read, flac_gfile_wrapper_seek, flac_gfile_wrapper_tell, flac_gfile_wrapper_length, flac_gfile_wrapper_eof, flac_gfile_wrapper_frame, NULL, flac_gfile_wrapper_error, result) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	if (FLAC__stream_decoder_init_stream(decoder, flac_gfile_wrapper_read, flac_gfile_wrapper_seek, flac_gfile_wrapper_tell, flac_gfile_wrapper_length, flac_gfile_wrapper_eof, flac_gfile_wrapper_frame, flac_gfile_wrapper_metadata, flac_gfile_wrapper_error, result) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
 	{
 		stack_log("stack_audio_file_create_flac(): Couldn't initialise stream decoder\n");
 		FLAC__stream_decoder_delete(decoder);
@@ -219,6 +380,10 @@ StackAudioFileFLAC *stack_audio_file_create_flac(GFileInputStream *stream)
 	// Mark as ready
 	result->ready = true;
 
+	// Use our previously generated seek table, or generate one if we're going
+	// to be played
+	result->seek_table = stack_audio_file_get_seek_table(file, FLAC_SEEK_TABLE_CACHE_TYPE, stack_audio_file_flac_build_seek_table, for_playback);
+
 	return result;
 }
 
@@ -229,6 +394,7 @@ void stack_audio_file_destroy_flac(StackAudioFileFLAC *audio_file)
 
 	// Tidy up out ring buffer
 	stack_ring_buffer_destroy(audio_file->decoded_buffer);
+	delete [] audio_file->frame_buffer;
 
 	// Tidy up ourselves
 	delete audio_file;
@@ -236,23 +402,54 @@ void stack_audio_file_destroy_flac(StackAudioFileFLAC *audio_file)
 
 void stack_audio_file_seek_flac(StackAudioFileFLAC *audio_file, stack_time_t pos)
 {
-	FLAC__StreamDecoderState pre_state = FLAC__stream_decoder_get_state(audio_file->decoder);
 	audio_file->eof = false;
+	audio_file->skip_frames = 0;
 	stack_ring_buffer_reset(audio_file->decoded_buffer);
 
-	if (!FLAC__stream_decoder_seek_absolute(audio_file->decoder, (pos * audio_file->super.sample_rate) / NANOSECS_PER_SEC))
+	uint64_t sample = stack_time_to_samples(pos, audio_file->super.sample_rate);
+
+	// If we've got a seek table, go straight to the frame containing our
+	// sample and discard the start of it as we decode
+	if (audio_file->seek_table && audio_file->seek_table->ready)
+	{
+		const StackAudioFileSeekTable &seek_table = audio_file->seek_table->seek_table;
+		StackAudioFileSeekTable::const_iterator seek_point = stack_audio_file_find_seek_point(seek_table, sample);
+		if (seek_point != seek_table.end())
+		{
+			if (FLAC__stream_decoder_flush(audio_file->decoder) && g_seekable_seek(G_SEEKABLE(audio_file->super.stream), seek_point->byte_position, G_SEEK_SET, NULL, NULL))
+			{
+				audio_file->skip_frames = sample - seek_point->sample_position;
+				return;
+			}
+
+			stack_log("stack_audio_file_seek_flac(): Seek using seek table failed\n");
+		}
+	}
+
+	if (!FLAC__stream_decoder_seek_absolute(audio_file->decoder, sample))
 	{
 		FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(audio_file->decoder);
 		stack_log("stack_audio_file_seek_flac(): FLAC__stream_decoder_seek_absolute failed: %d\n", state);
 	}
 }
 
+// Returns whether we can seek without libFLAC bisecting the file
+bool stack_audio_file_has_fast_seek_flac(StackAudioFileFLAC *audio_file)
+{
+	return audio_file->has_file_seek_table || (audio_file->seek_table && audio_file->seek_table->ready);
+}
+
 void stack_audio_file_flac_decode_more(StackAudioFileFLAC *audio_file)
 {
 	if (!FLAC__stream_decoder_process_single(audio_file->decoder))
 	{
 		FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(audio_file->decoder);
 		stack_log("stack_audio_file_flac_decode_more(): FLAC__stream_decoder_process_single failed: %d\n", state);
+		audio_file->eof = true;
+	}
+	else if (FLAC__stream_decoder_get_state(audio_file->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+	{
+		audio_file->eof = true;
 	}
 }
 
@@ -269,11 +466,17 @@ size_t stack_audio_file_read_flac(StackAudioFileFLAC *audio_file, float *buffer,
 			frames_out += stack_ring_buffer_read(audio_file->decoded_buffer, &buffer[frames_out * channels], (frames - frames_out) * channels, 1) / channels;
 		}
 
-		// Try to keep 1024 samples in our ring buffer
-		if (audio_file->decoded_buffer->used < 1024 * channels && !audio_file->eof)
+		// If we still need more, decode the next FLAC frame straight in to the
+		// remainder of the caller's buffer. Anything that doesn't fit is left
+		// in the ring buffer for next time
+		if (frames_out < frames && !audio_file->eof)
 		{
-			// Decode more FLAC data
+			audio_file->direct_buffer = &buffer[frames_out * channels];
+			audio_file->direct_frames = frames - frames_out;
 			stack_audio_file_flac_decode_more(audio_file);
+			frames_out = frames - audio_file->direct_frames;
+			audio_file->direct_buffer = NULL;
+			audio_file->direct_frames = 0;
 		}
 	}
 
@@ -6,6 +6,7 @@
 #include "StackAudioFile.h"
 #include "StackRingBuffer.h"
 #include <FLAC/stream_decoder.h>
+#include <memory>
 
 struct StackAudioFileFLAC
 {
@@ -16,11 +17,36 @@ struct StackAudioFileFLAC
 
 	// We read in blocks, so we need to buffer
 	StackRingBuffer *decoded_buffer;
+
+	// Scratch buffer for interleaving decoded frames that don't fit in to the
+	// caller's buffer. This is kept between frames so we don't allocate on
+	// every decode
+	float *frame_buffer;
+	size_t frame_buffer_samples;
+
+	// Whilst reading, the decoder writes directly in to the caller's buffer
+	// at this location for up to this many frames, bypassing the ring buffer
+	float *direct_buffer;
+	size_t direct_frames;
+
+	// The number of decoded frames to discard after seeking using our seek
+	// table, to reach the sample we were asked for
+	size_t skip_frames;
+
+	// A seek table with an entry for every FLAC frame, so that we don't have
+	// to rely on the seek table in the file (if there even is one). This is
+	// shared with other open copies of the file, and is only used once ready
+	std::shared_ptr<StackAudioFileSharedSeekTable> seek_table;
+
+	// Whether the file has its own seek table, which libFLAC uses to seek
+	// rather than bisecting the file
+	bool has_file_seek_table;
 };
 
-StackAudioFileFLAC *stack_audio_file_create_flac(GFileInputStream *file);
+StackAudioFileFLAC *stack_audio_file_create_flac(GFile *file, GFileInputStream *stream, bool for_playback);
 void stack_audio_file_destroy_flac(StackAudioFileFLAC *audio_file);
 void stack_audio_file_seek_flac(StackAudioFileFLAC* audio_file, stack_time_t pos);
+bool stack_audio_file_has_fast_seek_flac(StackAudioFileFLAC *audio_file);
 size_t stack_audio_file_read_flac(StackAudioFileFLAC *audio_file, float *buffer, size_t frames)
 	__attribute__((access (write_only, 2, 3)));
 
@@ -3,8 +3,36 @@
 #include "StackAudioFileMP3.h"
 #include "MPEGAudioFile.h"
 #include "StackLog.h"
+#include "StackMediaCache.h"
+#include <cstring>
 #include <vector>
 
+// The type and version of our frame index in the media cache
+static const char *MP3_INDEX_CACHE_TYPE = "mp3i";
+static const uint32_t MP3_INDEX_CACHE_VERSION = 1;
+
+// The size of our input buffer when decoding as a stream
+static const size_t MP3_STREAM_BUFFER_SIZE = 16384;
+
+#pragma pack(push, 1)
+struct MP3IndexCacheHeader
+{
+	uint32_t sample_rate;
+	uint16_t channels;
+	uint16_t delay;
+	uint16_t padding;
+	uint64_t samples;
+	uint64_t frame_count;
+};
+
+struct MP3IndexCacheEntry
+{
+	uint64_t byte_position;
+	uint16_t frame_size_bytes;
+	uint16_t frame_size_samples;
+};
+#pragma pack(pop)
+
 struct MP3Info
 {
 	uint32_t sample_rate;
@@ -15,7 +43,7 @@ struct MP3Info
 	std::vector<MP3FrameInfo> frames;
 };
 
-static bool stack_audio_file_mp3_process(GInputStream *stream, MP3Info *mp3_info)
+static bool stack_audio_file_mp3_process(GInputStream *stream, MP3Info *mp3_info, const std::atomic<bool> *cancel = NULL)
 {
 	// Initialise the structure
 	mp3_info->sample_rate = 0;
@@ -25,7 +53,7 @@ static bool stack_audio_file_mp3_process(GInputStream *stream, MP3Info *mp3_info
 	mp3_info->padding = 0;
 	uint32_t frames = 0;
 
-	if (!mpeg_audio_file_find_frames(stream, &mp3_info->num_channels, &mp3_info->sample_rate, &frames, &mp3_info->num_samples_per_channel, &mp3_info->frames, &mp3_info->delay, &mp3_info->padding))
+	if (!mpeg_audio_file_find_frames(stream, &mp3_info->num_channels, &mp3_info->sample_rate, &frames, &mp3_info->num_samples_per_channel, &mp3_info->frames, &mp3_info->delay, &mp3_info->padding, cancel))
 	{
 		stack_log("stack_audio_file_mp3_process(): Processing failed\n");
 		return false;
@@ -52,29 +80,176 @@ static bool stack_audio_file_mp3_process(GInputStream *stream, MP3Info *mp3_info
 	return (float)(sample >> (MAD_F_FRACBITS + 1 - 16)) * INT16_SCALAR;
 }*/
 
-StackAudioFileMP3 *stack_audio_file_create_mp3(GFileInputStream *stream)
+// Loads a previously-built frame index from the media cache
+static bool stack_audio_file_mp3_load_index(GFile *file, MP3Info *mp3_info)
+{
+	const char *payload = NULL;
+	size_t payload_size = 0;
+	GMappedFile *mapped = stack_media_cache_map(file, MP3_INDEX_CACHE_TYPE, MP3_INDEX_CACHE_VERSION, &payload, &payload_size);
+	if (mapped == NULL)
+	{
+		return false;
+	}
+
+	// Validate the size of the payload
+	const MP3IndexCacheHeader *header = (const MP3IndexCacheHeader*)payload;
+	if (payload_size < sizeof(MP3IndexCacheHeader) || header->frame_count == 0 || payload_size != sizeof(MP3IndexCacheHeader) + header->frame_count * sizeof(MP3IndexCacheEntry))
+	{
+		stack_log("stack_audio_file_mp3_load_index(): Ignoring invalid index\n");
+		g_mapped_file_unref(mapped);
+		return false;
+	}
+
+	mp3_info->sample_rate = header->sample_rate;
+	mp3_info->num_channels = header->channels;
+	mp3_info->num_samples_per_channel = header->samples;
+	mp3_info->delay = header->delay;
+	mp3_info->padding = header->padding;
+
+	// Sample positions aren't stored as they're implied by the frame sizes
+	const MP3IndexCacheEntry *entries = (const MP3IndexCacheEntry*)(payload + sizeof(MP3IndexCacheHeader));
+	size_t sample_position = 0;
+	mp3_info->frames.clear();
+	mp3_info->frames.reserve(header->frame_count);
+	for (size_t i = 0; i < header->frame_count; i++)
+	{
+		mp3_info->frames.push_back(MP3FrameInfo{ (size_t)entries[i].byte_position, entries[i].frame_size_bytes, sample_position, entries[i].frame_size_samples });
+		sample_position += entries[i].frame_size_samples;
+	}
+
+	g_mapped_file_unref(mapped);
+
+	return true;
+}
+
+// Writes a frame index to the media cache
+static void stack_audio_file_mp3_save_index(GFile *file, const MP3Info *mp3_info)
+{
+	std::vector<char> payload(sizeof(MP3IndexCacheHeader) + mp3_info->frames.size() * sizeof(MP3IndexCacheEntry));
+
+	MP3IndexCacheHeader *header = (MP3IndexCacheHeader*)&payload[0];
+	header->sample_rate = mp3_info->sample_rate;
+	header->channels = mp3_info->num_channels;
+	header->delay = mp3_info->delay;
+	header->padding = mp3_info->padding;
+	header->samples = mp3_info->num_samples_per_channel;
+	header->frame_count = mp3_info->frames.size();
+
+	MP3IndexCacheEntry *entries = (MP3IndexCacheEntry*)&payload[sizeof(MP3IndexCacheHeader)];
+	for (size_t i = 0; i < mp3_info->frames.size(); i++)
+	{
+		entries[i].byte_position = mp3_info->frames[i].byte_position;
+		entries[i].frame_size_bytes = (uint16_t)mp3_info->frames[i].frame_size_bytes;
+		entries[i].frame_size_samples = mp3_info->frames[i].frame_size_samples;
+	}
+
+	stack_media_cache_write(file, MP3_INDEX_CACHE_TYPE, MP3_INDEX_CACHE_VERSION, &payload[0], payload.size());
+}
+
+// Builds the frame index on a background thread (using its own stream so as
+// not to disturb decoding), saves it to the cache and hands it over to be
+// picked up by the next seek
+static void stack_audio_file_mp3_index_thread(StackAudioFileMP3 *audio_file)
+{
+	GFileInputStream *stream = g_file_read(audio_file->index_file, NULL, NULL);
+	if (stream == NULL)
+	{
+		stack_log("stack_audio_file_mp3_index_thread(): Failed to open file\n");
+		return;
+	}
+
+	MP3Info mp3_info;
+	bool success = stack_audio_file_mp3_process(G_INPUT_STREAM(stream), &mp3_info, &audio_file->index_cancel);
+	g_object_unref(stream);
+	if (!success || mp3_info.frames.empty())
+	{
+		return;
+	}
+
+	stack_audio_file_mp3_save_index(audio_file->index_file, &mp3_info);
+
+	// Only switch over if the index agrees with what we found when opening
+	if (mp3_info.sample_rate != audio_file->super.sample_rate || mp3_info.num_channels != audio_file->super.channels)
+	{
+		stack_log("stack_audio_file_mp3_index_thread(): Index doesn't match file header, not using\n");
+		return;
+	}
+
+	std::swap(audio_file->index_frames, mp3_info.frames);
+	audio_file->index_ready = true;
+}
+
+// Switches over to using the frame index if the background thread has
+// finished building it
+static void stack_audio_file_mp3_use_index(StackAudioFileMP3 *audio_file)
+{
+	if (audio_file->indexed || !audio_file->index_ready)
+	{
+		return;
+	}
+
+	// The thread will have finished by now
+	audio_file->index_thread.join();
+
+	std::swap(audio_file->frames, audio_file->index_frames);
+	audio_file->frame_iterator = audio_file->frames.begin();
+	audio_file->indexed = true;
+
+	// We don't change the length here, as the file may already be playing
+	// and others may have read it. Decoding stops at the length we settled on
+	// when the file was opened, even if the index is longer
+	stack_log("stack_audio_file_mp3_use_index(): Switched to frame index (%lu frames)\n", audio_file->frames.size());
+}
+
+static void stack_audio_file_mp3_seek_stream(StackAudioFileMP3 *audio_file, uint64_t start_sample);
+
+StackAudioFileMP3 *stack_audio_file_create_mp3(GFile *file, GFileInputStream *stream, bool for_playback)
 {
 	// Rewind back to the start of the file (as another file format might have read)
 	g_seekable_seek(G_SEEKABLE(stream), 0, G_SEEK_SET, NULL, NULL);
 
+	// If we have a cached frame index we can use that, otherwise just read
+	// the header of the file so we can start playing immediately
 	MP3Info mp3_info;
-	bool is_mp3_file = stack_audio_file_mp3_process(G_INPUT_STREAM(stream), &mp3_info);
-	if (!is_mp3_file)
+	MP3QuickInfo quick_info;
+	bool indexed = stack_audio_file_mp3_load_index(file, &mp3_info);
+	if (!indexed)
 	{
-		return NULL;
+		if (!mpeg_audio_file_read_quick_info(G_INPUT_STREAM(stream), &quick_info))
+		{
+			return NULL;
+		}
+
+		// Match what we'd expect from mpeg_audio_file_find_frames
+		mp3_info.sample_rate = quick_info.sample_rate;
+		mp3_info.num_channels = quick_info.channels;
+		mp3_info.delay = quick_info.delay;
+		mp3_info.padding = quick_info.padding;
+		mp3_info.num_samples_per_channel = (uint64_t)quick_info.frames * quick_info.frame_size_samples - quick_info.delay;
 	}
 
-	// Rewind back to the first MP3 frame as we've read the entire file
-	g_seekable_seek(G_SEEKABLE(stream), mp3_info.frames[0].byte_position, G_SEEK_SET, NULL, NULL);
+	// The sample count already excludes the encoder delay, so we only need to
+	// take off the padding. This is the length for as long as the file is open
+	const uint64_t total_frames = mp3_info.num_samples_per_channel > mp3_info.padding ? mp3_info.num_samples_per_channel - mp3_info.padding : 0;
 
 	StackAudioFileMP3 *result = new StackAudioFileMP3;
 	result->super.format = STACK_AUDIO_FILE_FORMAT_MP3;
 	result->super.channels = mp3_info.num_channels;
 	result->super.sample_rate = mp3_info.sample_rate;
-	result->super.frames = mp3_info.num_samples_per_channel - mp3_info.delay - mp3_info.padding;
-	result->super.length = (stack_time_t)(double(mp3_info.num_samples_per_channel - mp3_info.delay - mp3_info.padding) / double(mp3_info.sample_rate) * NANOSECS_PER_SEC_F);
+	result->super.frames = total_frames;
+	result->super.length = (stack_time_t)(double(total_frames) / double(mp3_info.sample_rate) * NANOSECS_PER_SEC_F);
 	std::swap(result->frames, mp3_info.frames);
 	result->frames_buffer = NULL;
+	result->indexed = indexed;
+	result->stream_buffer = NULL;
+	result->stream_eof = false;
+	result->stream_finished = false;
+	result->stream_skip = 0;
+	result->stream_position = 0;
+	result->stream_total = 0;
+	result->index_cancel = false;
+	result->index_ready = false;
+	result->index_file = NULL;
 
 	// Initialise MP3 decoding
 	mad_stream_init(&result->mp3_stream);
@@ -89,11 +264,43 @@ StackAudioFileMP3 *stack_audio_file_create_mp3(GFileInputStream *stream)
 	// of two channels
 	result->decoded_buffer = stack_ring_buffer_create(1152 * 4);
 
+	if (indexed)
+	{
+		// Rewind back to the first MP3 frame
+		g_seekable_seek(G_SEEKABLE(stream), result->frames[0].byte_position, G_SEEK_SET, NULL, NULL);
+	}
+	else
+	{
+		std::swap(result->seek_points, quick_info.seek_points);
+		result->stream_buffer = new unsigned char[MP3_STREAM_BUFFER_SIZE + MAD_BUFFER_GUARD];
+		result->stream_total = total_frames;
+		stack_audio_file_mp3_seek_stream(result, 0);
+
+		// Build the frame index in the background if we're going to be played
+		// (other opens only need to stream the file once)
+		if (for_playback)
+		{
+			result->index_file = (GFile*)g_object_ref(file);
+			result->index_thread = std::thread(stack_audio_file_mp3_index_thread, result);
+		}
+	}
+
 	return result;
 }
 
 void stack_audio_file_destroy_mp3(StackAudioFileMP3 *audio_file)
 {
+	// Stop building the index
+	audio_file->index_cancel = true;
+	if (audio_file->index_thread.joinable())
+	{
+		audio_file->index_thread.join();
+	}
+	if (audio_file->index_file != NULL)
+	{
+		g_object_unref(audio_file->index_file);
+	}
+
 	// Tidy up MP3 decoder
 	mad_synth_finish(&audio_file->mp3_synth);
 	mad_frame_finish(&audio_file->mp3_frame);
@@ -105,11 +312,48 @@ void stack_audio_file_destroy_mp3(StackAudioFileMP3 *audio_file)
 	{
 		delete [] audio_file->frames_buffer;
 	}
+	if (audio_file->stream_buffer != NULL)
+	{
+		delete [] audio_file->stream_buffer;
+	}
 
 	// Tidy up ourselves
 	delete audio_file;
 }
 
+// Converts 'frames' frames of the decoded PCM, starting at 'start_idx', to
+// float and writes them to the ring buffer
+static void stack_audio_file_mp3_output_pcm(StackAudioFileMP3 *audio_file, size_t start_idx, size_t frames)
+{
+	// This is the maximum size of a mad_pcm frame, 1152 frames of two channels
+	float scale_buffer[1152 * 2];
+
+	// Perform the scaling from 24-bit int to float
+	const mad_pcm *pcm = &audio_file->mp3_synth.pcm;
+	if (pcm->channels == 1)
+	{
+		const mad_fixed_t *pcm_samples = &pcm->samples[0][start_idx];
+		for (size_t i = 0; i < frames; i++)
+		{
+			scale_buffer[i] = (float)mad_f_todouble(pcm_samples[i]);
+		}
+	}
+	else if (pcm->channels == 2)
+	{
+		float *obp = scale_buffer;
+		const mad_fixed_t *l_pcm_samples = &pcm->samples[0][start_idx];
+		const mad_fixed_t *r_pcm_samples = &pcm->samples[1][start_idx];
+		for (size_t i = 0; i < frames; i++)
+		{
+			*obp++ = (float)mad_f_todouble(l_pcm_samples[i]);
+			*obp++ = (float)mad_f_todouble(r_pcm_samples[i]);
+		}
+	}
+
+	// Write multiplexed data to the ring buffer
+	stack_ring_buffer_write(audio_file->decoded_buffer, scale_buffer, frames * pcm->channels, 1);
+}
+
 static size_t stack_audio_file_mp3_decode_next_mpeg_frame(StackAudioFileMP3 *audio_file)
 {
 	size_t bytes_in_buffer = 0;
@@ -192,34 +436,10 @@ static size_t stack_audio_file_mp3_decode_next_mpeg_frame(StackAudioFileMP3 *aud
 	mad_frame_decode(&audio_file->mp3_frame, &audio_file->mp3_stream);
 	mad_synth_frame(&audio_file->mp3_synth, &audio_file->mp3_frame);
 
-	// This is the maximum size of a mad_pcm frame, 1152 frames of two channels
-	float scale_buffer[1152 * 2];
-
-	// Perform the scaling from 24-bit int to float
 	size_t frames_to_add = audio_file->mp3_synth.pcm.length;
 	size_t start_idx = current_is_first_frame ? audio_file->delay : 0;
 	if (frames_to_add > 0)
 	{
-		if (audio_file->mp3_synth.pcm.channels == 1)
-		{
-			const mad_fixed_t *pcm_samples = audio_file->mp3_synth.pcm.samples[0];
-			for (size_t i = start_idx; i < frames_to_add; i++)
-			{
-				scale_buffer[i] = (float)mad_f_todouble(pcm_samples[i]);
-			}
-		}
-		else if (audio_file->mp3_synth.pcm.channels == 2)
-		{
-			float *obp = &scale_buffer[start_idx * 2];
-			const mad_fixed_t *l_pcm_samples = audio_file->mp3_synth.pcm.samples[0];
-			const mad_fixed_t *r_pcm_samples = audio_file->mp3_synth.pcm.samples[1];
-			for (size_t i = start_idx; i < frames_to_add; i++)
-			{
-				*obp++ = (float)mad_f_todouble(l_pcm_samples[i]);
-				*obp++ = (float)mad_f_todouble(r_pcm_samples[i]);
-			}
-		}
-
 		// If we've got a delay, which could be true in the first audio frame,
 		// then we need to skip it, so we need to add fewer samples
 		if (current_is_first_frame)
@@ -234,16 +454,147 @@ static size_t stack_audio_file_mp3_decode_next_mpeg_frame(StackAudioFileMP3 *aud
 			frames_to_add -= audio_file->padding;
 		}
 
-		// Write multiplexed data to the ring buffer
-		stack_ring_buffer_write(audio_file->decoded_buffer, &scale_buffer[start_idx * audio_file->mp3_synth.pcm.channels], frames_to_add * audio_file->mp3_synth.pcm.channels, 1);
+		// Don't output past the length we settled on when the file was opened
+		if (current_frame->sample_position + frames_to_add >= audio_file->super.frames)
+		{
+			frames_to_add = audio_file->super.frames > current_frame->sample_position ? audio_file->super.frames - current_frame->sample_position : 0;
+			audio_file->frame_iterator = audio_file->frames.end();
+		}
+
+		stack_audio_file_mp3_output_pcm(audio_file, start_idx, frames_to_add);
 	}
 
 	// Return how many samples we decoded
 	return frames_to_add;
 }
 
+// Decodes the next frame when we're decoding the file as a stream (i.e. we
+// don't yet have a frame index)
+static size_t stack_audio_file_mp3_decode_next_stream_frame(StackAudioFileMP3 *audio_file)
+{
+	mad_stream *mp3_stream = &audio_file->mp3_stream;
+
+	while (true)
+	{
+		// Top up the input buffer if libmad has run out of data
+		if (mp3_stream->buffer == NULL || mp3_stream->error == MAD_ERROR_BUFLEN)
+		{
+			if (audio_file->stream_eof)
+			{
+				audio_file->stream_finished = true;
+				return 0;
+			}
+
+			// Keep hold of any partial frame left at the end of the buffer
+			size_t remaining = 0;
+			if (mp3_stream->next_frame != NULL)
+			{
+				remaining = mp3_stream->bufend - mp3_stream->next_frame;
+				if (remaining >= MP3_STREAM_BUFFER_SIZE)
+				{
+					remaining = 0;
+				}
+				memmove(audio_file->stream_buffer, mp3_stream->next_frame, remaining);
+			}
+
+			gssize bytes_read = g_input_stream_read(G_INPUT_STREAM(audio_file->super.stream), &audio_file->stream_buffer[remaining], MP3_STREAM_BUFFER_SIZE - remaining, NULL, NULL);
+			if (bytes_read <= 0)
+			{
+				// At the end of the file, we need to add MAD_BUFFER_GUARD
+				// zeroes to ensure the last frame isn't truncated
+				memset(&audio_file->stream_buffer[remaining], 0, MAD_BUFFER_GUARD);
+				bytes_read = MAD_BUFFER_GUARD;
+				audio_file->stream_eof = true;
+			}
+
+			mad_stream_buffer(mp3_stream, audio_file->stream_buffer, remaining + bytes_read);
+			mp3_stream->error = MAD_ERROR_NONE;
+		}
+
+		if (mad_frame_decode(&audio_file->mp3_frame, mp3_stream) == 0)
+		{
+			break;
+		}
+
+		if (mp3_stream->error == MAD_ERROR_BUFLEN)
+		{
+			continue;
+		}
+		else if (MAD_RECOVERABLE(mp3_stream->error))
+		{
+			// Straight after a seek we won't have the bit reservoir for the
+			// first frame, but it still counts towards our position
+			if (mp3_stream->error == MAD_ERROR_BADDATAPTR)
+			{
+				size_t lost_samples = 32 * MAD_NSBSAMPLES(&audio_file->mp3_frame.header);
+				audio_file->stream_skip = audio_file->stream_skip > lost_samples ? audio_file->stream_skip - lost_samples : 0;
+			}
+			continue;
+		}
+		else
+		{
+			stack_log("stack_audio_file_mp3_decode_next_stream_frame(): Unrecoverable decode error: 0x%04x\n", mp3_stream->error);
+			audio_file->stream_finished = true;
+			return 0;
+		}
+	}
+
+	mad_synth_frame(&audio_file->mp3_synth, &audio_file->mp3_frame);
+
+	// Discard anything before our start position
+	size_t start_idx = 0;
+	size_t frames_to_add = audio_file->mp3_synth.pcm.length;
+	if (audio_file->stream_skip > 0)
+	{
+		start_idx = std::min(audio_file->stream_skip, frames_to_add);
+		frames_to_add -= start_idx;
+		audio_file->stream_skip -= start_idx;
+	}
+
+	// Don't output any padding at the end of the file
+	if (audio_file->stream_position + frames_to_add >= audio_file->stream_total)
+	{
+		frames_to_add = audio_file->stream_total > audio_file->stream_position ? audio_file->stream_total - audio_file->stream_position : 0;
+		audio_file->stream_finished = true;
+	}
+
+	if (frames_to_add > 0)
+	{
+		stack_audio_file_mp3_output_pcm(audio_file, start_idx, frames_to_add);
+		audio_file->stream_position += frames_to_add;
+	}
+
+	return frames_to_add;
+}
+
+// Seeks approximately using the seek table when we're decoding the file as a
+// stream
+static void stack_audio_file_mp3_seek_stream(StackAudioFileMP3 *audio_file, uint64_t start_sample)
+{
+	// Our sample positions don't include the encoder delay, whereas the seek
+	// table does
+	uint64_t target_sample = start_sample + audio_file->delay;
+
+	// Find the last seek point before our target
+	MP3SeekPointVector::iterator seek_point = audio_file->seek_points.begin();
+	for (MP3SeekPointVector::iterator it = audio_file->seek_points.begin(); it != audio_file->seek_points.end() && it->sample_position <= target_sample; it++)
+	{
+		seek_point = it;
+	}
+
+	g_seekable_seek(G_SEEKABLE(audio_file->super.stream), seek_point->byte_position, G_SEEK_SET, NULL, NULL);
+	audio_file->stream_skip = target_sample - seek_point->sample_position;
+	audio_file->stream_position = start_sample;
+	audio_file->stream_eof = false;
+	audio_file->stream_finished = (start_sample >= audio_file->stream_total);
+
+	stack_log("stack_audio_file_mp3_seek_stream(): sample %lu - seek to byte %lu, skipping %lu samples\n", start_sample, seek_point->byte_position, audio_file->stream_skip);
+}
+
 void stack_audio_file_seek_mp3(StackAudioFileMP3 *audio_file, stack_time_t pos)
 {
+	// Pick up the frame index if it's been built since we last seeked
+	stack_audio_file_mp3_use_index(audio_file);
 	// Reset synth/frame/stream so we're ready to decode from the start again
 	mad_synth_finish(&audio_file->mp3_synth);
 	mad_frame_finish(&audio_file->mp3_frame);
@@ -266,6 +617,12 @@ void stack_audio_file_seek_mp3(StackAudioFileMP3 *audio_file, stack_time_t pos)
 	// Determine which sample we're looking for
 	uint64_t start_sample = stack_time_to_samples(pos, audio_file->super.sample_rate);
 
+	if (!audio_file->indexed)
+	{
+		stack_audio_file_mp3_seek_stream(audio_file, start_sample);
+		return;
+	}
+
 	// Iterate through the known frames, and search for the frame that contains
 	// data for our given position
 	size_t previous_frame_position = audio_file->frames.begin()->byte_position;
@@ -309,12 +666,25 @@ void stack_audio_file_seek_mp3(StackAudioFileMP3 *audio_file, stack_time_t pos)
 	stack_ring_buffer_skip(audio_file->decoded_buffer, skip_frames * audio_file->super.channels);
 }
 
+// Returns whether there is more of the file left to decode
+static bool stack_audio_file_mp3_more_to_decode(StackAudioFileMP3 *audio_file)
+{
+	if (audio_file->indexed)
+	{
+		return audio_file->frame_iterator != audio_file->frames.end();
+	}
+	else
+	{
+		return !audio_file->stream_finished;
+	}
+}
+
 size_t stack_audio_file_read_mp3(StackAudioFileMP3 *audio_file, float *buffer, size_t frames)
 {
 	const size_t channels = audio_file->super.channels;
 
 	size_t frames_out = 0;
-	while (frames_out < frames && (audio_file->frame_iterator != audio_file->frames.end() || audio_file->decoded_buffer->used > 0))
+	while (frames_out < frames && (stack_audio_file_mp3_more_to_decode(audio_file) || audio_file->decoded_buffer->used > 0))
 	{
 		// Take an appropriate amount of data from the ring buffer
 		if (audio_file->decoded_buffer->used > 0)
@@ -324,10 +694,17 @@ size_t stack_audio_file_read_mp3(StackAudioFileMP3 *audio_file, float *buffer, s
 
 		// If there's less than a full MP3 frame in the decoded buffer, and
 		// we're not at the end of the file, decode another frame
-		if (audio_file->decoded_buffer->used < 1152 * channels && audio_file->frame_iterator != audio_file->frames.end())
+		if (audio_file->decoded_buffer->used < 1152 * channels && stack_audio_file_mp3_more_to_decode(audio_file))
 		{
 			// Decode more MP3 data
-			stack_audio_file_mp3_decode_next_mpeg_frame(audio_file);
+			if (audio_file->indexed)
+			{
+				stack_audio_file_mp3_decode_next_mpeg_frame(audio_file);
+			}
+			else
+			{
+				stack_audio_file_mp3_decode_next_stream_frame(audio_file);
+			}
 		}
 	}
 
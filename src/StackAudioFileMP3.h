@@ -6,10 +6,13 @@
 #include "StackAudioFile.h"
 #include "StackRingBuffer.h"
 #include "MPEGAudioFile.h"
+#include <atomic>
 #include <mad.h>
+#include <thread>
 #include <vector>
 
 typedef std::vector<MP3FrameInfo> MP3FrameInfoVector;
+typedef std::vector<MP3SeekPoint> MP3SeekPointVector;
 
 struct StackAudioFileMP3
 {
@@ -37,9 +40,43 @@ struct StackAudioFileMP3
 
 	// Padding added in last frame
 	uint16_t padding;
+
+	// Whether we have a frame index in 'frames'. If we don't (because there
+	// was no cached index when the file was opened), we decode the file as a
+	// stream and seek approximately using 'seek_points' until the index has
+	// been built in the background
+	bool indexed;
+
+	// Approximate seek table (from a Xing/VBRI header or estimated)
+	MP3SeekPointVector seek_points;
+
+	// Input buffer whilst decoding as a stream
+	unsigned char *stream_buffer;
+
+	// Whether we've run out of input (stream_eof) or output (stream_finished)
+	// whilst decoding as a stream
+	bool stream_eof;
+	bool stream_finished;
+
+	// The number of decoded samples to discard before we output anything
+	size_t stream_skip;
+
+	// The number of samples we've output, and the number we expect to output,
+	// whilst decoding as a stream
+	uint64_t stream_position;
+	uint64_t stream_total;
+
+	// Background thread that builds the frame index and writes it to the cache
+	std::thread index_thread;
+	std::atomic<bool> index_cancel;
+	std::atomic<bool> index_ready;
+	GFile *index_file;
+
+	// The index built by the background thread, picked up on the next seek
+	MP3FrameInfoVector index_frames;
 };
 
-StackAudioFileMP3 *stack_audio_file_create_mp3(GFileInputStream *file);
+StackAudioFileMP3 *stack_audio_file_create_mp3(GFile *file, GFileInputStream *stream, bool for_playback);
 void stack_audio_file_destroy_mp3(StackAudioFileMP3 *audio_file);
 void stack_audio_file_seek_mp3(StackAudioFileMP3* audio_file, stack_time_t pos);
 size_t stack_audio_file_read_mp3(StackAudioFileMP3 *audio_file, float *buffer, size_t frames)
@@ -4,9 +4,13 @@
 #include <vorbis/vorbisfile.h>
 #include "StackAudioFileOgg.h"
 #include "StackLog.h"
+#include <cstring>
 
 #define OGG_DECODE_CHUNK_SIZE_SAMPLES 2048
 
+// The type of our generated seek table in the media cache
+static const char *OGG_SEEK_TABLE_CACHE_TYPE = "oggi";
+
 // Wrapper for vorbisfile so it can use GFile for read
 size_t ogg_gfile_wrapper_read(void *ptr, size_t size, size_t nmemb, void *datasource)
 {
@@ -57,7 +61,92 @@ long ogg_gfile_wrapper_tell(void *datasource)
 	return (long)g_seekable_tell(G_SEEKABLE(datasource));
 }
 
-StackAudioFileOgg *stack_audio_file_create_ogg(GFileInputStream *stream)
+// Builds a seek table for the file by walking the Ogg page headers using its
+// own stream. This is run by the indexing thread
+static bool stack_audio_file_ogg_build_seek_table(GFile *file, StackAudioFileSeekTable *seek_table, const std::atomic<bool> *cancel)
+{
+	GFileInputStream *stream = g_file_read(file, NULL, NULL);
+	if (stream == NULL)
+	{
+		stack_log("stack_audio_file_ogg_build_seek_table(): Failed to open file\n");
+		return false;
+	}
+
+	uint64_t byte_position = 0;
+	uint64_t page_start_sample = 0;
+	uint32_t serial = 0;
+	bool success = false;
+	while (!cancel->load())
+	{
+		// Read the fixed part of the page header
+		unsigned char header[27];
+		gsize bytes_read = 0;
+		g_input_stream_read_all(G_INPUT_STREAM(stream), header, sizeof(header), &bytes_read, NULL, NULL);
+		if (bytes_read == 0)
+		{
+			// Clean end of file
+			success = true;
+			break;
+		}
+		if (bytes_read < sizeof(header) || memcmp(header, "OggS", 4) != 0)
+		{
+			break;
+		}
+
+		// Read the segment table to determine the size of the page
+		const uint8_t segment_count = header[26];
+		unsigned char segments[255];
+		g_input_stream_read_all(G_INPUT_STREAM(stream), segments, segment_count, &bytes_read, NULL, NULL);
+		if (bytes_read < segment_count)
+		{
+			break;
+		}
+		size_t body_size = 0;
+		for (size_t i = 0; i < segment_count; i++)
+		{
+			body_size += segments[i];
+		}
+
+		// We only index files with a single logical bitstream, as the sample
+		// positions of chained files don't start from zero
+		uint32_t page_serial = (uint32_t)header[14] | ((uint32_t)header[15] << 8) | ((uint32_t)header[16] << 16) | ((uint32_t)header[17] << 24);
+		if (byte_position == 0)
+		{
+			serial = page_serial;
+		}
+		else if (page_serial != serial)
+		{
+			stack_log("stack_audio_file_ogg_build_seek_table(): Multiple logical bitstreams, not indexing\n");
+			break;
+		}
+
+		// The granule position is the sample at the end of the last packet
+		// completed on this page (or -1 if none is)
+		int64_t granule_position = 0;
+		for (size_t i = 0; i < 8; i++)
+		{
+			granule_position |= (int64_t)header[6 + i] << (8 * i);
+		}
+		if (granule_position != -1)
+		{
+			seek_table->push_back(StackAudioFileSeekPoint{ page_start_sample, byte_position });
+			page_start_sample = (uint64_t)granule_position;
+		}
+
+		// Move on to the next page
+		if (!g_seekable_seek(G_SEEKABLE(stream), body_size, G_SEEK_CUR, NULL, NULL))
+		{
+			break;
+		}
+		byte_position += sizeof(header) + segment_count + body_size;
+	}
+
+	g_object_unref(stream);
+
+	return success;
+}
+
+StackAudioFileOgg *stack_audio_file_create_ogg(GFile *file, GFileInputStream *stream, bool for_playback)
 {
 	// Define our functions for libvorbisfile to use for GFile operations as it
 	// only deals with stdio FILE* normally
@@ -93,6 +182,10 @@ StackAudioFileOgg *stack_audio_file_create_ogg(GFileInputStream *stream)
 	// Create a buffer of decoded frames
 	result->decoded_buffer = stack_ring_buffer_create(4096 * result->super.channels);
 
+	// Use our previously generated seek table, or generate one if we're going
+	// to be played
+	result->seek_table = stack_audio_file_get_seek_table(file, OGG_SEEK_TABLE_CACHE_TYPE, stack_audio_file_ogg_build_seek_table, for_playback);
+
 	return result;
 }
 
@@ -108,11 +201,62 @@ void stack_audio_file_destroy_ogg(StackAudioFileOgg *audio_file)
 	delete audio_file;
 }
 
+// Seeks using our seek table. Returns false if this isn't possible, in which
+// case the caller should fall back to seeking with libvorbisfile
+static bool stack_audio_file_ogg_seek_indexed(StackAudioFileOgg *audio_file, uint64_t sample)
+{
+	const StackAudioFileSeekTable &seek_table = audio_file->seek_table->seek_table;
+	StackAudioFileSeekTable::const_iterator seek_point = stack_audio_file_find_seek_point(seek_table, sample);
+	if (seek_point == seek_table.end())
+	{
+		return false;
+	}
+
+	// The first packet after a raw seek only primes the decoder, so start a
+	// page earlier to make sure we land before our sample
+	if (seek_point != seek_table.begin())
+	{
+		seek_point--;
+	}
+
+	if (ov_raw_seek(&audio_file->file, seek_point->byte_position) != 0)
+	{
+		return false;
+	}
+
+	// Find out exactly where we've landed
+	ogg_int64_t position = ov_pcm_tell(&audio_file->file);
+	if (position < 0 || (uint64_t)position > sample)
+	{
+		return false;
+	}
+
+	// Decode and discard up to our sample
+	int16_t discard_buffer[OGG_DECODE_CHUNK_SIZE_SAMPLES];
+	size_t samples_to_discard = (sample - (uint64_t)position) * audio_file->super.channels;
+	while (samples_to_discard > 0)
+	{
+		size_t samples_to_read = samples_to_discard < OGG_DECODE_CHUNK_SIZE_SAMPLES ? samples_to_discard : OGG_DECODE_CHUNK_SIZE_SAMPLES;
+		long bytes_read = ov_read(&audio_file->file, (char*)discard_buffer, samples_to_read * sizeof(int16_t), 0, sizeof(int16_t), 1, &audio_file->bitstream);
+		if (bytes_read <= 0)
+		{
+			return false;
+		}
+		samples_to_discard -= bytes_read / sizeof(int16_t);
+	}
+
+	return true;
+}
+
 void stack_audio_file_seek_ogg(StackAudioFileOgg *audio_file, stack_time_t pos)
 {
-	if (ov_time_seek(&audio_file->file, (double)pos / NANOSECS_PER_SEC_F) < 0)
+	uint64_t sample = stack_time_to_samples(pos, audio_file->super.sample_rate);
+	if (!(audio_file->seek_table && audio_file->seek_table->ready && stack_audio_file_ogg_seek_indexed(audio_file, sample)))
 	{
-		stack_log("stack_audio_file_seek_ogg(): Failed to seek\n");
+		if (ov_pcm_seek(&audio_file->file, sample) < 0)
+		{
+			stack_log("stack_audio_file_seek_ogg(): Failed to seek\n");
+		}
 	}
 
 	audio_file->eof = false;
@@ -6,6 +6,7 @@
 #include "StackAudioFile.h"
 #include <vorbis/vorbisfile.h>
 #include "StackRingBuffer.h"
+#include <memory>
 
 struct StackAudioFileOgg
 {
@@ -16,9 +17,14 @@ struct StackAudioFileOgg
 
 	// We read in blocks, so we need to buffer
 	StackRingBuffer *decoded_buffer;
+
+	// A seek table with an entry for every Ogg page that completes a packet,
+	// so that we don't need to bisect the file to seek. This is shared with
+	// other open copies of the file, and is only used once ready
+	std::shared_ptr<StackAudioFileSharedSeekTable> seek_table;
 };
 
-StackAudioFileOgg *stack_audio_file_create_ogg(GFileInputStream *file);
+StackAudioFileOgg *stack_audio_file_create_ogg(GFile *file, GFileInputStream *stream, bool for_playback);
 void stack_audio_file_destroy_ogg(StackAudioFileOgg *audio_file);
 void stack_audio_file_seek_ogg(StackAudioFileOgg* audio_file, stack_time_t pos);
 size_t stack_audio_file_read_ogg(StackAudioFileOgg *audio_file, float *buffer, size_t frames)
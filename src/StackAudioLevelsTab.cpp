@@ -248,9 +248,27 @@ static gboolean stack_audio_levels_tab_crosspoint_entry_changed(GtkWidget *widge
 
 	if (property != NULL)
 	{
-		bool is_null = false;
-		double vol_db = stack_audio_levels_tab_entry_to_property(GTK_ENTRY(widget), property, &is_null);
-		stack_audio_levels_tab_set_level(NULL, widget, vol_db, is_null, !stack_property_get_nullable(property));
+		const gchar *text = gtk_entry_get_text(GTK_ENTRY(widget));
+		bool is_nullable = stack_property_get_nullable(property);
+
+		// Crosspoints are null (NaN) when nullable and no text is entered
+		double vol_db = -INFINITY;
+		if (strlen(text) == 0)
+		{
+			if (is_nullable)
+			{
+				vol_db = NAN;
+			}
+		}
+		else
+		{
+			vol_db = atof(text);
+		}
+
+		// Update the crosspoint and get the validated version
+		stack_property_matrix_set(property, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, vol_db);
+		stack_property_matrix_get(property, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, &vol_db);
+		stack_audio_levels_tab_set_level(NULL, widget, vol_db, std::isnan(vol_db), !is_nullable);
 	}
 
 	return FALSE;
@@ -391,14 +409,14 @@ void stack_audio_levels_tab_populate(StackAudioLevelsTab *tab, size_t input_chan
 
 					// Set value
 					StackProperty *property = tab->get_crosspoint_property(tab->cue, row, column, true);
-					if (stack_property_get_null(property, STACK_PROPERTY_VERSION_DEFINED))
+					double cp_value = NAN;
+					stack_property_matrix_get(property, STACK_PROPERTY_VERSION_DEFINED, column, row, &cp_value);
+					if (std::isnan(cp_value))
 					{
 						buffer[0] = '\0';
 					}
 					else
 					{
-						double cp_value = 0.0;
-						stack_property_get_double(property, STACK_PROPERTY_VERSION_DEFINED, &cp_value);
 						stack_audio_levels_tab_format_volume(buffer, 64, cp_value, !stack_property_get_nullable(property));
 					}
 					gtk_entry_set_text(GTK_ENTRY(crosspoint), buffer);
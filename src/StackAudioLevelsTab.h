@@ -7,6 +7,8 @@
 
 // Typedefs:
 typedef StackProperty*(*salt_get_volume_property_t)(StackCue*, size_t, bool);
+// Returns the crosspoint matrix property (with a row for each output channel
+// and a column for each input channel) if the given crosspoint is set
 typedef StackProperty*(*salt_get_crosspoint_property_t)(StackCue*, size_t, size_t, bool);
 
 typedef struct StackAudioLevelsTab
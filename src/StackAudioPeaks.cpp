@@ -0,0 +1,664 @@
+// Includes:
+#include "StackAudioPeaks.h"
+#include "StackMediaCache.h"
+#include "StackLog.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The version of the "peak" cache payload. Bump this if the format of the
+// payload or the way the peaks are calculated changes
+#define STACK_AUDIO_PEAKS_CACHE_VERSION 1
+
+// The number of frames to decode at a time whilst generating
+#define STACK_AUDIO_PEAKS_READ_FRAMES 65536
+
+// The number of frames in each chunk of a file analysed in parallel. This is a
+// multiple of the bucket size of every level so that chunks never share a
+// bucket
+#define STACK_AUDIO_PEAKS_CHUNK_FRAMES (16 * 65536)
+
+// The maximum number of threads to analyse a file with
+#define STACK_AUDIO_PEAKS_MAX_THREADS 8
+
+// Layout of the start of the cache payload. This is followed by one
+// StackAudioPeaksCacheLevel per level, followed by the buckets of each level in
+// turn (finest first)
+#pragma pack(push, 1)
+struct StackAudioPeaksCacheHeader
+{
+	uint32_t sample_rate;
+	uint32_t levels;
+	uint64_t frames;
+	int64_t length;
+};
+
+struct StackAudioPeaksCacheLevel
+{
+	uint32_t frames_per_bucket;
+	uint32_t reserved;
+	uint64_t buckets;
+};
+#pragma pack(pop)
+
+// Running totals for the bucket currently being generated
+struct StackAudioPeaksAccumulator
+{
+	float min;
+	float max;
+	double sum_squares;
+	uint32_t frames;
+};
+
+// State shared between the threads analysing a file in parallel
+struct StackAudioPeaksJob
+{
+	const char *uri;
+	StackAudioPeaks *peaks;
+	uint64_t chunks;
+	std::atomic<uint64_t> next_chunk;
+	std::atomic<bool> failed;
+	const std::atomic<bool> *cancel;
+	StackAudioPeaksProgressFunc progress;
+	void *user_data;
+};
+
+// Points the levels of a pyramid at the bucket data that follows the level
+// headers, validating that everything fits within the given size
+static bool stack_audio_peaks_set_levels(StackAudioPeaks *peaks, const char *payload, size_t payload_size)
+{
+	if (payload_size < sizeof(StackAudioPeaksCacheHeader))
+	{
+		return false;
+	}
+
+	const StackAudioPeaksCacheHeader *header = (const StackAudioPeaksCacheHeader*)payload;
+	if (header->levels != STACK_AUDIO_PEAKS_LEVELS || header->sample_rate == 0)
+	{
+		return false;
+	}
+
+	peaks->sample_rate = header->sample_rate;
+	peaks->frames = header->frames;
+	peaks->length = header->length;
+
+	const StackAudioPeaksCacheLevel *cache_levels = (const StackAudioPeaksCacheLevel*)(payload + sizeof(StackAudioPeaksCacheHeader));
+	size_t offset = sizeof(StackAudioPeaksCacheHeader) + STACK_AUDIO_PEAKS_LEVELS * sizeof(StackAudioPeaksCacheLevel);
+	if (payload_size < offset)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < STACK_AUDIO_PEAKS_LEVELS; i++)
+	{
+		// Make sure the level is what we expect it to be
+		if (cache_levels[i].frames_per_bucket != stack_audio_peaks_frames_per_bucket[i] || cache_levels[i].buckets > (payload_size - offset) / sizeof(StackAudioPeakBucket))
+		{
+			return false;
+		}
+
+		peaks->levels[i].frames_per_bucket = cache_levels[i].frames_per_bucket;
+		peaks->levels[i].buckets = cache_levels[i].buckets;
+		peaks->levels[i].data = (const StackAudioPeakBucket*)(payload + offset);
+		offset += cache_levels[i].buckets * sizeof(StackAudioPeakBucket);
+	}
+
+	return true;
+}
+
+StackAudioPeaks *stack_audio_peaks_load(const char *uri)
+{
+	GFile *file = stack_audio_file_new_gfile(uri);
+	const char *payload = NULL;
+	size_t payload_size = 0;
+	GMappedFile *mapped = stack_media_cache_map(file, "peak", STACK_AUDIO_PEAKS_CACHE_VERSION, &payload, &payload_size);
+	g_object_unref(file);
+
+	if (mapped == NULL)
+	{
+		return NULL;
+	}
+
+	StackAudioPeaks *peaks = new StackAudioPeaks;
+	peaks->mapped = mapped;
+	peaks->complete = true;
+	peaks->chunk_frames = 0;
+	peaks->chunk_count = 0;
+	if (!stack_audio_peaks_set_levels(peaks, payload, payload_size))
+	{
+		stack_log("stack_audio_peaks_load(): Ignoring invalid peak cache for %s\n", uri);
+		stack_audio_peaks_destroy(peaks);
+		return NULL;
+	}
+
+	return peaks;
+}
+
+// Writes a complete pyramid to the media cache
+static void stack_audio_peaks_save(const char *uri, const StackAudioPeaks *peaks)
+{
+	// Build the cache payload
+	size_t total_buckets = 0;
+	for (size_t i = 0; i < STACK_AUDIO_PEAKS_LEVELS; i++)
+	{
+		total_buckets += peaks->levels[i].buckets;
+	}
+	std::vector<char> payload(sizeof(StackAudioPeaksCacheHeader) + STACK_AUDIO_PEAKS_LEVELS * sizeof(StackAudioPeaksCacheLevel) + total_buckets * sizeof(StackAudioPeakBucket));
+	StackAudioPeaksCacheHeader *header = (StackAudioPeaksCacheHeader*)&payload[0];
+	header->sample_rate = peaks->sample_rate;
+	header->levels = STACK_AUDIO_PEAKS_LEVELS;
+	header->frames = peaks->frames;
+	header->length = peaks->length;
+
+	StackAudioPeaksCacheLevel *cache_levels = (StackAudioPeaksCacheLevel*)&payload[sizeof(StackAudioPeaksCacheHeader)];
+	size_t offset = sizeof(StackAudioPeaksCacheHeader) + STACK_AUDIO_PEAKS_LEVELS * sizeof(StackAudioPeaksCacheLevel);
+	for (size_t i = 0; i < STACK_AUDIO_PEAKS_LEVELS; i++)
+	{
+		cache_levels[i].frames_per_bucket = peaks->levels[i].frames_per_bucket;
+		cache_levels[i].reserved = 0;
+		cache_levels[i].buckets = peaks->levels[i].buckets;
+		if (peaks->levels[i].buckets > 0)
+		{
+			memcpy(&payload[offset], peaks->levels[i].data, peaks->levels[i].buckets * sizeof(StackAudioPeakBucket));
+		}
+		offset += peaks->levels[i].buckets * sizeof(StackAudioPeakBucket);
+	}
+
+	// Save it so we don't have to do this again
+	GFile *file = stack_audio_file_new_gfile(uri);
+	stack_media_cache_write(file, "peak", STACK_AUDIO_PEAKS_CACHE_VERSION, &payload[0], payload.size());
+	g_object_unref(file);
+}
+
+// Creates a pyramid with storage for the given number of frames. The buckets of
+// the finest level are marked as not yet analysed
+static StackAudioPeaks *stack_audio_peaks_create(uint32_t sample_rate, uint64_t frames, stack_time_t length)
+{
+	StackAudioPeaks *peaks = new StackAudioPeaks;
+	peaks->mapped = NULL;
+	peaks->complete = false;
+	peaks->sample_rate = sample_rate;
+	peaks->frames = frames;
+	peaks->length = length;
+	peaks->chunk_frames = STACK_AUDIO_PEAKS_CHUNK_FRAMES;
+	peaks->chunk_count = (frames + STACK_AUDIO_PEAKS_CHUNK_FRAMES - 1) / STACK_AUDIO_PEAKS_CHUNK_FRAMES;
+	peaks->chunks_ready.reset(new std::atomic<bool>[peaks->chunk_count]);
+	for (uint64_t i = 0; i < peaks->chunk_count; i++)
+	{
+		peaks->chunks_ready[i] = false;
+	}
+
+	// Allocate storage for all the levels together
+	size_t total_buckets = 0;
+	for (size_t i = 0; i < STACK_AUDIO_PEAKS_LEVELS; i++)
+	{
+		total_buckets += (frames + stack_audio_peaks_frames_per_bucket[i] - 1) / stack_audio_peaks_frames_per_bucket[i];
+	}
+	peaks->storage.resize(total_buckets, { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f });
+
+	size_t first_bucket = 0;
+	for (size_t i = 0; i < STACK_AUDIO_PEAKS_LEVELS; i++)
+	{
+		peaks->levels[i].frames_per_bucket = stack_audio_peaks_frames_per_bucket[i];
+		peaks->levels[i].buckets = (frames + stack_audio_peaks_frames_per_bucket[i] - 1) / stack_audio_peaks_frames_per_bucket[i];
+		peaks->levels[i].data = peaks->storage.data() + first_bucket;
+		first_bucket += peaks->levels[i].buckets;
+	}
+
+	return peaks;
+}
+
+// Builds the coarser levels of a pyramid from the finest level and marks the
+// pyramid as complete
+static void stack_audio_peaks_finish(StackAudioPeaks *peaks)
+{
+	for (size_t level = 1; level < STACK_AUDIO_PEAKS_LEVELS; level++)
+	{
+		const StackAudioPeakLevel &source = peaks->levels[level - 1];
+		StackAudioPeakBucket *dest = (StackAudioPeakBucket*)peaks->levels[level].data;
+		const size_t ratio = peaks->levels[level].frames_per_bucket / source.frames_per_bucket;
+
+		for (uint64_t bucket = 0; bucket < peaks->levels[level].buckets; bucket++)
+		{
+			const uint64_t first = bucket * ratio;
+			const uint64_t last = std::min(first + ratio, source.buckets);
+			StackAudioPeakBucket result = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f };
+			double sum_squares = 0.0;
+			uint64_t result_frames = 0;
+
+			for (uint64_t i = first; i < last; i++)
+			{
+				// Only the final bucket of a level can be partial
+				const uint64_t source_frames = (i == source.buckets - 1) ? peaks->frames - i * source.frames_per_bucket : source.frames_per_bucket;
+				result.min = std::min(result.min, source.data[i].min);
+				result.max = std::max(result.max, source.data[i].max);
+				sum_squares += (double)source.data[i].rms * (double)source.data[i].rms * (double)source_frames;
+				result_frames += source_frames;
+			}
+
+			result.rms = result_frames > 0 ? (float)sqrt(sum_squares / (double)result_frames) : 0.0f;
+			dest[bucket] = result;
+		}
+	}
+
+	peaks->complete = true;
+}
+
+// Averages the channels of interleaved audio, as the preview draws a single
+// waveform
+static void stack_audio_peaks_mix(const float *input, size_t frames, size_t channels, float *output)
+{
+	if (channels == 1)
+	{
+		memcpy(output, input, frames * sizeof(float));
+		return;
+	}
+
+	size_t i = 0;
+	const float scalar = 1.0f / (float)channels;
+#if defined(__SSE2__)
+	if (channels == 2)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		for (; i + 4 <= frames; i += 4)
+		{
+			// Separate the left and right channels of four frames and add them
+			const __m128 a = _mm_loadu_ps(&input[i * 2]);
+			const __m128 b = _mm_loadu_ps(&input[i * 2 + 4]);
+			const __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(&output[i], _mm_mul_ps(_mm_add_ps(left, right), half));
+		}
+	}
+#endif
+	for (; i < frames; i++)
+	{
+		float y = 0.0f;
+		for (size_t channel = 0; channel < channels; channel++)
+		{
+			y += input[i * channels + channel];
+		}
+		output[i] = y * scalar;
+	}
+}
+
+// Adds the minimum, maximum and sum of squares of a block of samples to an
+// accumulator
+static void stack_audio_peaks_summarise(const float *data, size_t count, StackAudioPeaksAccumulator *acc)
+{
+	size_t i = 0;
+	float min = acc->min, max = acc->max;
+#if defined(__SSE2__)
+	if (count >= 4)
+	{
+		__m128 vmin = _mm_set1_ps(min), vmax = _mm_set1_ps(max), vsum = _mm_setzero_ps();
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 v = _mm_loadu_ps(&data[i]);
+			vmin = _mm_min_ps(vmin, v);
+			vmax = _mm_max_ps(vmax, v);
+			vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+		}
+
+		// Reduce the four lanes
+		float lanes[4];
+		_mm_storeu_ps(lanes, vmin);
+		min = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, vmax);
+		max = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, vsum);
+		acc->sum_squares += (double)lanes[0] + (double)lanes[1] + (double)lanes[2] + (double)lanes[3];
+	}
+#endif
+	for (; i < count; i++)
+	{
+		if (data[i] < min) { min = data[i]; }
+		if (data[i] > max) { max = data[i]; }
+		acc->sum_squares += (double)data[i] * (double)data[i];
+	}
+
+	acc->min = min;
+	acc->max = max;
+	acc->frames += count;
+}
+
+// Resets an accumulator ready for the next bucket
+static void stack_audio_peaks_reset(StackAudioPeaksAccumulator *acc)
+{
+	acc->min = std::numeric_limits<float>::max();
+	acc->max = -std::numeric_limits<float>::max();
+	acc->sum_squares = 0.0;
+	acc->frames = 0;
+}
+
+// Stores the contents of an accumulator as a bucket
+static StackAudioPeakBucket stack_audio_peaks_bucket(const StackAudioPeaksAccumulator *acc)
+{
+	return { acc->min, acc->max, (float)sqrt(acc->sum_squares / (double)acc->frames) };
+}
+
+// Adds mono audio to an accumulator, writing out each bucket as it fills
+// @returns The number of buckets written to output
+static size_t stack_audio_peaks_accumulate(StackAudioPeaksAccumulator *acc, const float *data, size_t count, StackAudioPeakBucket *output)
+{
+	const uint32_t frames_per_bucket = stack_audio_peaks_frames_per_bucket[0];
+	size_t buckets = 0;
+
+	while (count > 0)
+	{
+		const size_t block = std::min(count, (size_t)(frames_per_bucket - acc->frames));
+		stack_audio_peaks_summarise(data, block, acc);
+		data += block;
+		count -= block;
+
+		if (acc->frames == frames_per_bucket)
+		{
+			output[buckets++] = stack_audio_peaks_bucket(acc);
+			stack_audio_peaks_reset(acc);
+		}
+	}
+
+	return buckets;
+}
+
+// Returns the earliest time that stack_time_to_samples converts to the given
+// frame, so that we can seek to exactly that frame
+static stack_time_t stack_audio_peaks_frame_to_time(uint64_t frame, uint32_t sample_rate)
+{
+	return (stack_time_t)((frame / sample_rate) * NANOSECS_PER_SEC + ((frame % sample_rate) * NANOSECS_PER_SEC + sample_rate - 1) / sample_rate);
+}
+
+// Thread that analyses chunks of a file until there are none left
+static void stack_audio_peaks_worker_thread(StackAudioPeaksJob *job)
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-peaks");
+
+	// Each thread has the file open separately so they can all seek
+	StackAudioFile *file = stack_audio_file_create(job->uri);
+	if (file == NULL)
+	{
+		job->failed = true;
+		return;
+	}
+
+	StackAudioPeaks *peaks = job->peaks;
+	StackAudioPeakBucket *buckets = (StackAudioPeakBucket*)peaks->levels[0].data;
+	float *read_buffer = new float[STACK_AUDIO_PEAKS_READ_FRAMES * file->channels];
+	float *mono_buffer = new float[STACK_AUDIO_PEAKS_READ_FRAMES];
+	StackAudioPeaksAccumulator acc;
+	uint64_t position = 0;
+
+	while (!*job->cancel)
+	{
+		// Get the next chunk to work on
+		const uint64_t chunk = job->next_chunk++;
+		if (chunk >= job->chunks)
+		{
+			break;
+		}
+		const uint64_t first_frame = chunk * STACK_AUDIO_PEAKS_CHUNK_FRAMES;
+		const uint64_t end_frame = std::min(first_frame + STACK_AUDIO_PEAKS_CHUNK_FRAMES, peaks->frames);
+
+		// Only seek if we're not already there (which we always are if there
+		// is only one of us)
+		if (first_frame != position)
+		{
+			stack_audio_file_seek(file, stack_audio_peaks_frame_to_time(first_frame, peaks->sample_rate));
+		}
+		stack_audio_peaks_reset(&acc);
+		uint64_t bucket = first_frame / stack_audio_peaks_frames_per_bucket[0];
+		uint64_t frame = first_frame;
+		while (frame < end_frame && !*job->cancel)
+		{
+			size_t frames_read = stack_audio_file_read(file, read_buffer, std::min((uint64_t)STACK_AUDIO_PEAKS_READ_FRAMES, end_frame - frame));
+			if (frames_read == 0)
+			{
+				stack_log("stack_audio_peaks_worker_thread(): Unexpected end of file at frame %lu\n", frame);
+				job->failed = true;
+				break;
+			}
+
+			stack_audio_peaks_mix(read_buffer, frames_read, file->channels, mono_buffer);
+			bucket += stack_audio_peaks_accumulate(&acc, mono_buffer, frames_read, &buckets[bucket]);
+			frame += frames_read;
+		}
+		position = frame;
+
+		// The last chunk of the file may end with a partial bucket
+		if (acc.frames > 0 && bucket < peaks->levels[0].buckets)
+		{
+			buckets[bucket] = stack_audio_peaks_bucket(&acc);
+		}
+
+		// Let readers at the buckets, unless we stopped part way through
+		if (frame == end_frame)
+		{
+			peaks->chunks_ready[chunk].store(true, std::memory_order_release);
+		}
+
+		if (job->progress != NULL)
+		{
+			job->progress(peaks, first_frame, frame, job->user_data);
+		}
+	}
+
+	// Tidy up
+	delete [] mono_buffer;
+	delete [] read_buffer;
+	stack_audio_file_destroy(file);
+}
+
+// Generates a pyramid by splitting the file in to chunks and analysing them
+// across a number of threads. Only suitable for formats that know exactly how
+// long they are and can seek accurately
+static StackAudioPeaks *stack_audio_peaks_generate_parallel(const char *uri, StackAudioFile *file, const std::atomic<bool> *cancel, StackAudioPeaksProgressFunc progress, void *user_data)
+{
+	StackAudioPeaksJob job;
+	job.uri = uri;
+	job.peaks = stack_audio_peaks_create(file->sample_rate, file->frames, file->length);
+	job.chunks = (file->frames + STACK_AUDIO_PEAKS_CHUNK_FRAMES - 1) / STACK_AUDIO_PEAKS_CHUNK_FRAMES;
+	job.next_chunk = 0;
+	job.failed = false;
+	job.cancel = cancel;
+	job.progress = progress;
+	job.user_data = user_data;
+
+	// Start the workers. If the file can't seek cheaply (e.g. a FLAC file
+	// without a seek table) then use a single worker, which reads the chunks
+	// in order without seeking
+	size_t thread_count = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), (size_t)STACK_AUDIO_PEAKS_MAX_THREADS);
+	thread_count = std::min(thread_count, (size_t)job.chunks);
+	if (!stack_audio_file_has_fast_seek(file))
+	{
+		thread_count = 1;
+	}
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads.push_back(std::thread(stack_audio_peaks_worker_thread, &job));
+	}
+
+	// Wait for them to finish
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	if (*cancel)
+	{
+		stack_audio_peaks_destroy(job.peaks);
+		return NULL;
+	}
+
+	stack_audio_peaks_finish(job.peaks);
+
+	// Don't cache an incomplete pyramid
+	if (!job.failed)
+	{
+		stack_audio_peaks_save(uri, job.peaks);
+	}
+
+	return job.peaks;
+}
+
+// Generates a pyramid by decoding the file from start to end
+static StackAudioPeaks *stack_audio_peaks_generate_sequential(const char *uri, StackAudioFile *file, const std::atomic<bool> *cancel)
+{
+	const uint32_t frames_per_bucket = stack_audio_peaks_frames_per_bucket[0];
+	std::vector<StackAudioPeakBucket> buckets;
+	buckets.reserve(file->frames / frames_per_bucket + 1);
+
+	float *read_buffer = new float[STACK_AUDIO_PEAKS_READ_FRAMES * file->channels];
+	float *mono_buffer = new float[STACK_AUDIO_PEAKS_READ_FRAMES];
+	StackAudioPeakBucket *bucket_buffer = new StackAudioPeakBucket[STACK_AUDIO_PEAKS_READ_FRAMES / frames_per_bucket + 1];
+	StackAudioPeaksAccumulator acc;
+	stack_audio_peaks_reset(&acc);
+	uint64_t frames = 0;
+	size_t frames_read = 0;
+
+	while (!*cancel && (frames_read = stack_audio_file_read(file, read_buffer, STACK_AUDIO_PEAKS_READ_FRAMES)) > 0)
+	{
+		stack_audio_peaks_mix(read_buffer, frames_read, file->channels, mono_buffer);
+		size_t new_buckets = stack_audio_peaks_accumulate(&acc, mono_buffer, frames_read, bucket_buffer);
+		buckets.insert(buckets.end(), bucket_buffer, bucket_buffer + new_buckets);
+		frames += frames_read;
+	}
+
+	// Store any partial bucket at the end
+	if (acc.frames > 0)
+	{
+		buckets.push_back(stack_audio_peaks_bucket(&acc));
+	}
+
+	// Tidy up
+	delete [] bucket_buffer;
+	delete [] mono_buffer;
+	delete [] read_buffer;
+
+	if (*cancel)
+	{
+		return NULL;
+	}
+
+	// Now that we know exactly how long the file is, build the pyramid
+	StackAudioPeaks *peaks = stack_audio_peaks_create(file->sample_rate, frames, file->length);
+	if (buckets.size() > 0)
+	{
+		memcpy((void*)peaks->levels[0].data, &buckets[0], buckets.size() * sizeof(StackAudioPeakBucket));
+	}
+	stack_audio_peaks_finish(peaks);
+	stack_audio_peaks_save(uri, peaks);
+
+	return peaks;
+}
+
+StackAudioPeaks *stack_audio_peaks_generate(const char *uri, const std::atomic<bool> *cancel, StackAudioPeaksProgressFunc progress, void *user_data)
+{
+	std::atomic<bool> never_cancel(false);
+	if (cancel == NULL)
+	{
+		cancel = &never_cancel;
+	}
+
+	StackAudioFile *file = stack_audio_file_create(uri);
+	if (file == NULL)
+	{
+		stack_log("stack_audio_peaks_generate(): File open failed\n");
+		return NULL;
+	}
+
+	// WAV and FLAC files know exactly how many frames they contain and can
+	// seek to an exact frame, so longer files can be split up
+	StackAudioPeaks *peaks = NULL;
+	if ((file->format == STACK_AUDIO_FILE_FORMAT_WAVE || file->format == STACK_AUDIO_FILE_FORMAT_FLAC) && file->frames > STACK_AUDIO_PEAKS_CHUNK_FRAMES)
+	{
+		peaks = stack_audio_peaks_generate_parallel(uri, file, cancel, progress, user_data);
+	}
+	else
+	{
+		peaks = stack_audio_peaks_generate_sequential(uri, file, cancel);
+	}
+
+	stack_audio_file_destroy(file);
+
+	return peaks;
+}
+
+void stack_audio_peaks_destroy(StackAudioPeaks *peaks)
+{
+	if (peaks->mapped != NULL)
+	{
+		g_mapped_file_unref(peaks->mapped);
+	}
+
+	delete peaks;
+}
+
+const StackAudioPeakLevel *stack_audio_peaks_choose_level(const StackAudioPeaks *peaks, double frames_per_pixel)
+{
+	// Only the finest level is available until the pyramid is complete
+	const ssize_t coarsest = peaks->complete ? STACK_AUDIO_PEAKS_LEVELS - 1 : 0;
+	for (ssize_t i = coarsest; i >= 0; i--)
+	{
+		if ((double)peaks->levels[i].frames_per_bucket <= frames_per_pixel)
+		{
+			return &peaks->levels[i];
+		}
+	}
+
+	return NULL;
+}
+
+bool stack_audio_peaks_range_ready(const StackAudioPeaks *peaks, uint64_t start_frame, uint64_t end_frame)
+{
+	if (peaks->complete)
+	{
+		return true;
+	}
+
+	// Check every chunk that the range covers
+	const uint64_t first = start_frame / peaks->chunk_frames;
+	const uint64_t last = std::min((end_frame + peaks->chunk_frames - 1) / peaks->chunk_frames, peaks->chunk_count);
+	for (uint64_t chunk = first; chunk < last; chunk++)
+	{
+		if (!peaks->chunks_ready[chunk].load(std::memory_order_acquire))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool stack_audio_peaks_get_range(const StackAudioPeakLevel *level, uint64_t start_frame, uint64_t end_frame, StackAudioPeakBucket *result)
+{
+	uint64_t first = start_frame / level->frames_per_bucket;
+	uint64_t last = (end_frame + level->frames_per_bucket - 1) / level->frames_per_bucket;
+	if (last > level->buckets)
+	{
+		last = level->buckets;
+	}
+	if (first >= last)
+	{
+		return false;
+	}
+
+	result->min = std::numeric_limits<float>::max();
+	result->max = -std::numeric_limits<float>::max();
+	double sum_squares = 0.0;
+	for (uint64_t i = first; i < last; i++)
+	{
+		const StackAudioPeakBucket &bucket = level->data[i];
+		if (bucket.min < result->min) { result->min = bucket.min; }
+		if (bucket.max > result->max) { result->max = bucket.max; }
+		sum_squares += (double)bucket.rms * (double)bucket.rms;
+	}
+	result->rms = (float)sqrt(sum_squares / (double)(last - first));
+
+	return true;
+}
@@ -0,0 +1,119 @@
+#ifndef _STACKAUDIOPEAKS_H_INCLUDED
+#define _STACKAUDIOPEAKS_H_INCLUDED
+
+// Includes:
+#include "StackAudioFile.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// A peak pyramid summarises an entire audio file at a number of fixed
+// resolutions so that a waveform can be drawn at any zoom level without
+// decoding the file. Each level holds one bucket per frames_per_bucket frames
+// of the (channel-averaged) audio. Pyramids are persisted in the media cache
+// and memory-mapped when loaded
+
+// The number of levels in the pyramid, and their resolutions
+#define STACK_AUDIO_PEAKS_LEVELS 3
+static const uint32_t stack_audio_peaks_frames_per_bucket[STACK_AUDIO_PEAKS_LEVELS] = { 256, 4096, 65536 };
+
+// The summary of a block of audio
+struct StackAudioPeakBucket
+{
+	float min;
+	float max;
+	float rms;
+};
+
+// A single resolution of the pyramid
+struct StackAudioPeakLevel
+{
+	uint32_t frames_per_bucket;
+	uint64_t buckets;
+	const StackAudioPeakBucket *data;
+};
+
+struct StackAudioPeaks
+{
+	// Details of the audio that was analysed
+	uint32_t sample_rate;
+	uint64_t frames;
+	stack_time_t length;
+
+	// The levels of the pyramid, finest first
+	StackAudioPeakLevel levels[STACK_AUDIO_PEAKS_LEVELS];
+
+	// Whether all the levels have been generated. Whilst a pyramid is being
+	// generated in parallel only the finest level is usable, and only the
+	// parts of it that stack_audio_peaks_range_ready says have been analysed
+	std::atomic<bool> complete;
+
+	// Whilst a pyramid is being generated in parallel, whether each chunk of
+	// the finest level has been analysed. Each flag is set once the buckets of
+	// its chunk have been written, and the buckets are never written again
+	uint64_t chunk_frames;
+	uint64_t chunk_count;
+	std::unique_ptr<std::atomic<bool>[]> chunks_ready;
+
+	// The cache file the levels point in to (if loaded from the cache)...
+	GMappedFile *mapped;
+
+	// ...or the memory the levels point in to (if generated)
+	std::vector<StackAudioPeakBucket> storage;
+};
+
+// Callback to receive progress whilst a pyramid is being generated
+// @param peaks The partially generated pyramid
+// @param start_frame The first frame of the audio that has been analysed
+// @param end_frame The frame after the last frame that has been analysed
+// @param user_data The user data passed to stack_audio_peaks_generate
+typedef void (*StackAudioPeaksProgressFunc)(StackAudioPeaks *peaks, uint64_t start_frame, uint64_t end_frame, void *user_data);
+
+// Functions:
+
+// Loads the peak pyramid for an audio file from the media cache
+// @param uri The URI of the audio file
+// @returns The pyramid, or NULL if there is no valid cache
+StackAudioPeaks *stack_audio_peaks_load(const char *uri);
+
+// Decodes an audio file and generates its peak pyramid, saving it to the media
+// cache. This can take some time, so should be called from a background thread.
+// Formats that can seek accurately are split in to chunks which are analysed
+// in parallel (or in order by a single thread if seeking would be slow), and
+// for these progress is reported as each chunk completes
+// @param uri The URI of the audio file
+// @param cancel If not NULL, generation stops early when this becomes true
+// @param progress If not NULL, called (from any thread) as chunks complete. The
+// pyramid given to the callback is the one that will be returned, but it is
+// destroyed if the generation is cancelled
+// @param user_data Passed to the progress callback
+// @returns The pyramid, or NULL if the file could not be read or the generation
+// was cancelled
+StackAudioPeaks *stack_audio_peaks_generate(const char *uri, const std::atomic<bool> *cancel = NULL, StackAudioPeaksProgressFunc progress = NULL, void *user_data = NULL);
+
+// Destroys a peak pyramid
+void stack_audio_peaks_destroy(StackAudioPeaks *peaks);
+
+// Returns the coarsest level of the pyramid that still has at least one bucket
+// per pixel at the given zoom, or NULL if even the finest level is too coarse
+// (in which case the audio must be decoded)
+// @param peaks The pyramid
+// @param frames_per_pixel The number of audio frames covered by one pixel
+const StackAudioPeakLevel *stack_audio_peaks_choose_level(const StackAudioPeaks *peaks, double frames_per_pixel);
+
+// Returns whether the buckets covering a range of frames have been analysed and
+// can be read. This is always the case once the pyramid is complete
+// @param peaks The pyramid
+// @param start_frame The first frame of the range
+// @param end_frame The frame after the last frame of the range
+bool stack_audio_peaks_range_ready(const StackAudioPeaks *peaks, uint64_t start_frame, uint64_t end_frame);
+
+// Summarises the buckets of a level covering a range of frames
+// @param level The level of the pyramid
+// @param start_frame The first frame of the range
+// @param end_frame The frame after the last frame of the range
+// @param result Receives the combined min, max and RMS
+// @returns Whether any buckets covered the range
+bool stack_audio_peaks_get_range(const StackAudioPeakLevel *level, uint64_t start_frame, uint64_t end_frame, StackAudioPeakBucket *result);
+
+#endif
@@ -2,7 +2,9 @@
 #include "StackAudioFile.h"
 #include "StackAudioPreview.h"
 #include "StackLog.h"
+#include <algorithm>
 #include <cmath>
+#include <new>
 
 // Provides an implementation of stack_audio_preview_get_type
 G_DEFINE_TYPE(StackAudioPreview, stack_audio_preview, GTK_TYPE_WIDGET)
@@ -18,7 +20,7 @@ GtkWidget *stack_audio_preview_new()
 	return widget;
 }
 
-// Tidy up the preview
+// Stops the render thread and discards all the cached tiles
 static void stack_audio_preview_tidy_buffer(StackAudioPreview *preview)
 {
 	// Tell the thread to stop
@@ -31,224 +33,490 @@ static void stack_audio_preview_tidy_buffer(StackAudioPreview *preview)
 	}
 
 	// Tidy up
-	if (preview->buffer_surface)
+	std::unique_lock<std::mutex> lock(preview->tiles_mutex);
+	for (auto &tile : preview->tiles)
 	{
-		cairo_surface_destroy(preview->buffer_surface);
-		preview->buffer_surface = NULL;
-	}
-	if (preview->buffer_cr)
-	{
-		cairo_destroy(preview->buffer_cr);
-		preview->buffer_cr = NULL;
+		if (tile.second.surface != NULL)
+		{
+			cairo_surface_destroy(tile.second.surface);
+		}
 	}
-
-	// Reset variables
-	preview->start_time = 0;
-	preview->end_time = 0;
+	preview->tiles.clear();
 }
 
 // Queues a redraw of the preview widget. Designed to be called from
-// gdk_threads_add_idle so as to be UI-thread-safe
+// stack_audio_preview_add_idle so as to be UI-thread-safe
 static gboolean stack_audio_preview_idle_redraw(gpointer user_data)
 {
 	gtk_widget_queue_draw(GTK_WIDGET(user_data));
 	return G_SOURCE_REMOVE;
 }
 
-static uint64_t stack_audio_preview_render_points(const StackAudioPreview *preview, const StackAudioFile *file, const float *data, uint32_t frames, uint64_t preview_start_samples, uint64_t data_start_frames, bool downsample)
+// Queues a redraw of just the columns of the preview widget covering where the
+// playback marker was last drawn and where it should be now. Designed to be
+// called from stack_audio_preview_add_idle so as to be UI-thread-safe
+static gboolean stack_audio_preview_idle_redraw_marker(gpointer user_data)
 {
-	uint64_t frame = data_start_frames;
+	StackAudioPreview *preview = STACK_AUDIO_PREVIEW(user_data);
+	GtkWidget *widget = GTK_WIDGET(user_data);
+	int width = gtk_widget_get_allocated_width(widget);
+	int height = gtk_widget_get_allocated_height(widget);
 
-	// Calculate the preview width in samples
-	float preview_width_samples = (float)file->sample_rate * (float)(preview->end_time - preview->start_time) / NANOSECS_PER_SEC_F;
-	double sample_width = preview->surface_width / (double)preview_width_samples;
-	double half_preview_height = preview->surface_height / 2.0;
+	if (preview->end_time > preview->start_time)
+	{
+		int playback_x = (int)floor((double)width * (double)(preview->playback_time - preview->start_time) / (double)(preview->end_time - preview->start_time));
+		gtk_widget_queue_draw_area(widget, playback_x - 1, 0, 3, height);
+	}
+	if (preview->playback_drawn_x >= 0)
+	{
+		gtk_widget_queue_draw_area(widget, preview->playback_drawn_x - 1, 0, 3, height);
+	}
 
-	// Calculate the highest value given floating point (-1.0 < x < 1.0)
-	// and the number of channels
-	float scalar = 1.0 / (float)file->channels;
+	return G_SOURCE_REMOVE;
+}
 
-	// Setup for min/max calculation
-	float min = std::numeric_limits<float>::max();
-	float max = std::numeric_limits<float>::min();
+// Runs one of the idle functions below on the UI thread. Holds a reference to
+// the preview until it has run, as the worker threads can queue these at any
+// time
+static void stack_audio_preview_add_idle(StackAudioPreview *preview, GSourceFunc function)
+{
+	gdk_threads_add_idle_full(G_PRIORITY_DEFAULT_IDLE, function, g_object_ref(preview), g_object_unref);
+}
 
-	// Draw the audio data. We sum all the channels together to draw a single waveform
-	for (size_t i = 0; i < frames; i++, frame++)
+// Draws a summary of the audio, with each pixel column drawn as a vertical span
+// from the minimum to the maximum of the audio it covers, with a brighter span
+// showing the RMS level
+static void stack_audio_preview_render_columns(cairo_t *cr, const StackAudioPeakBucket *columns, size_t count, double half_height)
+{
+	// Draw the peaks
+	cairo_set_source_rgb(cr, 0.0, 0.6, 0.0);
+	for (size_t x = 0; x < count; x++)
 	{
-		// Sum all the channels
-		float y = 0;
-		for (size_t channel = 0; channel < file->channels; channel++)
+		if (columns[x].max >= columns[x].min)
 		{
-			y += *(data++);
+			cairo_move_to(cr, (double)x + 0.5, half_height * (1.0 - columns[x].min));
+			cairo_line_to(cr, (double)x + 0.5, half_height * (1.0 - columns[x].max));
 		}
+	}
+	cairo_stroke(cr);
 
-		// Scale y back in to -1.0 < y < 1.0
-		y *= scalar;
+	// Draw the RMS, keeping it within the peaks
+	cairo_set_source_rgb(cr, 0.0, 0.8, 0.0);
+	for (size_t x = 0; x < count; x++)
+	{
+		float low = std::max(-columns[x].rms, columns[x].min);
+		float high = std::min(columns[x].rms, columns[x].max);
+		if (high > low)
+		{
+			cairo_move_to(cr, (double)x + 0.5, half_height * (1.0 - low));
+			cairo_line_to(cr, (double)x + 0.5, half_height * (1.0 - high));
+		}
+	}
+	cairo_stroke(cr);
+}
+
+// Renders a tile from a level of the peak pyramid
+static void stack_audio_preview_render_tile_peaks(cairo_t *cr, const StackAudioPeaks *peaks, const StackAudioPeakLevel *level, stack_time_t tile_start_time, stack_time_t nanosecs_per_pixel, double half_height)
+{
+	StackAudioPeakBucket columns[STACK_AUDIO_PREVIEW_TILE_WIDTH];
+	size_t count = 0;
 
-		if (!downsample)
+	// Summarise the audio under each pixel column
+	for (; count < STACK_AUDIO_PREVIEW_TILE_WIDTH; count++)
+	{
+		uint64_t start_frame = stack_time_to_samples(tile_start_time + count * nanosecs_per_pixel, peaks->sample_rate);
+		uint64_t end_frame = stack_time_to_samples(tile_start_time + (count + 1) * nanosecs_per_pixel, peaks->sample_rate);
+
+		// Leave the parts of a partial pyramid that are still being analysed
+		// blank (the tile is redrawn when they're done)
+		if (!stack_audio_peaks_range_ready(peaks, start_frame, end_frame))
 		{
-			// If we're not downsampling, draw the line
-			cairo_line_to(preview->buffer_cr, (double)(frame - preview_start_samples) * sample_width, half_preview_height * (1.0 - y));
+			columns[count] = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f };
+			continue;
 		}
-		else
+
+		if (!stack_audio_peaks_get_range(level, start_frame, end_frame, &columns[count]))
 		{
-			// If we're downsampling, just calculate the min and max for the block
-			if (y > max) { max = y; }
-			if (y < min) { min = y; }
+			break;
 		}
 	}
 
-	// If we're downsampling, we just draw a single vertical line from min to max
-	if (downsample)
+	stack_audio_preview_render_columns(cr, columns, count, half_height);
+}
+
+// Renders a tile by decoding the audio file. When there are lots of frames per
+// pixel we draw min/max spans, otherwise we draw a line through every frame
+static void stack_audio_preview_render_tile_file(cairo_t *cr, StackAudioFile *file, stack_time_t tile_start_time, stack_time_t nanosecs_per_pixel, double half_height)
+{
+	const double frames_per_pixel = (double)nanosecs_per_pixel * (double)file->sample_rate / NANOSECS_PER_SEC_F;
+	const double tile_start_frame = (double)tile_start_time * (double)file->sample_rate / NANOSECS_PER_SEC_F;
+	const bool downsample = frames_per_pixel > 10.0;
+
+	// Start decoding a pixel before the tile, and finish a pixel after it, so
+	// that the line joins up with the neighbouring tiles
+	stack_time_t decode_start_time = std::max((stack_time_t)0, tile_start_time - nanosecs_per_pixel);
+	stack_audio_file_seek(file, decode_start_time);
+	uint64_t frame = stack_time_to_samples(decode_start_time, file->sample_rate);
+	const uint64_t end_frame = (uint64_t)ceil(tile_start_frame + frames_per_pixel * (double)(STACK_AUDIO_PREVIEW_TILE_WIDTH + 1));
+
+	// Calculate the highest value given floating point (-1.0 < x < 1.0)
+	// and the number of channels
+	const float scalar = 1.0 / (float)file->channels;
+
+	// Setup for min/max calculation
+	StackAudioPeakBucket columns[STACK_AUDIO_PREVIEW_TILE_WIDTH];
+	double sum_squares[STACK_AUDIO_PREVIEW_TILE_WIDTH];
+	uint32_t column_frames[STACK_AUDIO_PREVIEW_TILE_WIDTH];
+	for (size_t x = 0; x < STACK_AUDIO_PREVIEW_TILE_WIDTH; x++)
+	{
+		columns[x] = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f };
+		sum_squares[x] = 0.0;
+		column_frames[x] = 0;
+	}
+
+	const size_t read_frames = 1024;
+	float *read_buffer = new float[read_frames * file->channels];
+	bool first_point = true;
+	while (frame < end_frame)
 	{
-		// Our x position is the position of the sample in the middle of our frame
-		const double x = (double)(data_start_frames + (frames / 2) - preview_start_samples) * sample_width;
+		size_t frames_read = stack_audio_file_read(file, read_buffer, read_frames);
+		if (frames_read == 0)
+		{
+			break;
+		}
+
+		// Draw the audio data. We sum all the channels together to draw a
+		// single waveform
+		const float *data = read_buffer;
+		for (size_t i = 0; i < frames_read; i++, frame++)
+		{
+			float y = 0;
+			for (size_t channel = 0; channel < file->channels; channel++)
+			{
+				y += *(data++);
+			}
+			y *= scalar;
 
-		// Draw the line
-		cairo_move_to(preview->buffer_cr, x, half_preview_height * (1.0 - min));
-		cairo_line_to(preview->buffer_cr, x, half_preview_height * (1.0 - max));
+			const double x = ((double)frame - tile_start_frame) / frames_per_pixel;
+			if (!downsample)
+			{
+				if (first_point)
+				{
+					cairo_move_to(cr, x, half_height * (1.0 - y));
+					first_point = false;
+				}
+				else
+				{
+					cairo_line_to(cr, x, half_height * (1.0 - y));
+				}
+			}
+			else if (x >= 0.0 && x < STACK_AUDIO_PREVIEW_TILE_WIDTH)
+			{
+				StackAudioPeakBucket &column = columns[(size_t)x];
+				if (y < column.min) { column.min = y; }
+				if (y > column.max) { column.max = y; }
+				sum_squares[(size_t)x] += (double)y * (double)y;
+				column_frames[(size_t)x]++;
+			}
+		}
 	}
+	delete [] read_buffer;
 
-	return frame;
+	if (downsample)
+	{
+		for (size_t x = 0; x < STACK_AUDIO_PREVIEW_TILE_WIDTH; x++)
+		{
+			if (column_frames[x] > 0)
+			{
+				columns[x].rms = (float)sqrt(sum_squares[x] / (double)column_frames[x]);
+			}
+		}
+		stack_audio_preview_render_columns(cr, columns, STACK_AUDIO_PREVIEW_TILE_WIDTH, half_height);
+	}
+	else
+	{
+		cairo_set_source_rgb(cr, 0.0, 0.8, 0.0);
+		cairo_stroke(cr);
+	}
 }
 
-// Thread to generate the code preview
-static void stack_audio_preview_render_thread(StackAudioPreview *preview)
+// Renders a single tile of the preview
+// @param preview The preview widget
+// @param file The audio file, which is opened if it's needed and not already open
+// @param key The zoom level and index of the tile to render
+static cairo_surface_t *stack_audio_preview_render_tile(StackAudioPreview *preview, StackAudioFile **file, const StackAudioPreviewTileKey &key, int height)
 {
-	// Set the thread name
-	pthread_setname_np(pthread_self(), "stack-preview");
+	const stack_time_t nanosecs_per_pixel = key.first;
+	const stack_time_t tile_start_time = key.second * STACK_AUDIO_PREVIEW_TILE_WIDTH * nanosecs_per_pixel;
+	const double half_height = height / 2.0;
 
-	// Open the file
-	StackAudioFile *file = stack_audio_file_create(preview->file);
-	if (file == NULL)
+	// Initialise drawing: fill the background
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, STACK_AUDIO_PREVIEW_TILE_WIDTH, height);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+	cairo_paint(cr);
+	cairo_set_line_width(cr, 1.0);
+
+	// If we have the peak pyramid and we're zoomed out far enough to use it,
+	// draw from that rather than decoding the file
+	const StackAudioPeaks *peaks = preview->peaks;
+	if (peaks == NULL)
 	{
-		stack_log("stack_audio_preview_preview_thread(): file open failed\n");
-		return;
+		peaks = preview->partial_peaks;
+	}
+	const StackAudioPeakLevel *level = NULL;
+	if (peaks != NULL)
+	{
+		level = stack_audio_peaks_choose_level(peaks, (double)nanosecs_per_pixel * (double)peaks->sample_rate / NANOSECS_PER_SEC_F);
 	}
 
-	// Flag that the thread is running
-	preview->thread_running = true;
+	if (level != NULL)
+	{
+		cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+		stack_audio_preview_render_tile_peaks(cr, peaks, level, tile_start_time, nanosecs_per_pixel, half_height);
+	}
+	else
+	{
+		// Open the file
+		if (*file == NULL)
+		{
+			*file = stack_audio_file_create(preview->file);
+			if (*file == NULL)
+			{
+				stack_log("stack_audio_preview_render_tile(): file open failed\n");
+			}
+			else
+			{
+				// Store the length as soon as we have it
+				preview->file_length_time = (*file)->length;
+			}
+		}
 
-	// Store the length as soon as we have it
-	preview->file_length_time = file->length;
+		if (*file != NULL)
+		{
+			cairo_set_antialias(cr, CAIRO_ANTIALIAS_FAST);
+			stack_audio_preview_render_tile_file(cr, *file, tile_start_time, nanosecs_per_pixel, half_height);
+		}
+	}
 
-	// Initialise drawing: fill the background
-	cairo_set_source_rgb(preview->buffer_cr, 0.1, 0.1, 0.1);
-	cairo_paint(preview->buffer_cr);
+	cairo_destroy(cr);
 
-	// Initialise drawing: prepare for lines
-	cairo_set_antialias(preview->buffer_cr, CAIRO_ANTIALIAS_FAST);
-	cairo_set_source_rgb(preview->buffer_cr, 0.0, 0.8, 0.0);
+	return surface;
+}
 
-	// We force a redraw periodically, get the current time
-	stack_time_t last_redraw_time = stack_get_clock_time();
+// Thread to render tiles of the preview. Renders tiles at the current zoom
+// level that have been requested by the draw function, and stops when there
+// are none left
+static void stack_audio_preview_render_thread(StackAudioPreview *preview)
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-preview");
 
-	// Seek to the right time in the file
-	stack_audio_file_seek(file, preview->start_time);
+	// We open the file only if we need to decode it
+	StackAudioFile *file = NULL;
 
-	// Convert out start and end times from seconds to samples
-	uint64_t preview_start_samples = stack_time_to_samples(preview->start_time, file->sample_rate);
-	uint64_t preview_end_samples = stack_time_to_samples(preview->end_time, file->sample_rate);
-	uint64_t preview_length_samples = preview_end_samples - preview_start_samples;
+	while (preview->thread_running)
+	{
+		// Find the next tile that needs rendering
+		StackAudioPreviewTileKey key;
+		int height = 0;
+		bool found = false;
+		std::unique_lock<std::mutex> lock(preview->tiles_mutex);
+		for (auto &tile : preview->tiles)
+		{
+			if (tile.second.surface == NULL && tile.first.first == preview->nanosecs_per_pixel)
+			{
+				key = tile.first;
+				height = preview->surface_height;
+				found = true;
+				break;
+			}
+		}
 
-	// Calculate how many audio frames fit in to one pixel on the preview
-	size_t frames_per_pixel = preview_length_samples / preview->surface_width;
+		// Stop if there's nothing left to do. We do this whilst holding the
+		// lock so that the draw function knows to start a new thread if it
+		// requests any more tiles
+		if (!found)
+		{
+			preview->thread_running = false;
+			break;
+		}
+		lock.unlock();
 
-	// Default to not downsampling (render every frame)
-	bool downsample = false;
-	size_t frames = 1024;
+		cairo_surface_t *surface = stack_audio_preview_render_tile(preview, &file, key, height);
 
-	// Determine if we should downsample
-	if (frames_per_pixel > 10)
-	{
-		frames = frames_per_pixel;
-		downsample = true;
+		// Store the tile, provided it's still wanted
+		lock.lock();
+		auto tile = preview->tiles.find(key);
+		if (tile != preview->tiles.end() && tile->second.surface == NULL && height == preview->surface_height)
+		{
+			tile->second.surface = surface;
+		}
+		else
+		{
+			cairo_surface_destroy(surface);
+		}
+		lock.unlock();
 
-		// Bump up the line width a smidge to prevent tiny gaps in the
-		// waveform caused by rounding errors of it not being _exactly_
-		// one pixel between blocks of frames
-		cairo_set_line_width(preview->buffer_cr, 1.1);
+		stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw);
 	}
-	else
+
+	// Tidy up
+	if (file != NULL)
 	{
-		cairo_set_line_width(preview->buffer_cr, 1.0);
-		cairo_move_to(preview->buffer_cr, 0.0, preview->surface_height / 2.0);
+		stack_audio_file_destroy(file);
 	}
+}
 
-	// Calculate how many samples we need to read
-	size_t samples = frames * file->channels;
+// Receives partial results whilst the peak pyramid is being generated. Called
+// from the threads generating the pyramid
+static void stack_audio_preview_peaks_progress(StackAudioPeaks *peaks, uint64_t start_frame, uint64_t end_frame, void *user_data)
+{
+	StackAudioPreview *preview = STACK_AUDIO_PREVIEW(user_data);
 
-	// Allocate buffers
-	float *read_buffer = new float[samples];
-	bool no_more_data = false;
-	uint64_t sample = preview_start_samples;
+	// Render new tiles from what we have so far
+	preview->partial_peaks = peaks;
 
-	while (preview->thread_running && !no_more_data && sample < preview_end_samples)
+	// Discard any tiles covering the audio that has just been analysed so
+	// that they're redrawn
+	const stack_time_t start_time = (stack_time_t)((double)start_frame * NANOSECS_PER_SEC_F / (double)peaks->sample_rate);
+	const stack_time_t end_time = (stack_time_t)((double)end_frame * NANOSECS_PER_SEC_F / (double)peaks->sample_rate);
+	std::unique_lock<std::mutex> lock(preview->tiles_mutex);
+	for (auto tile = preview->tiles.begin(); tile != preview->tiles.end(); )
 	{
-		// Get some more data
-		size_t frames_read = stack_audio_file_read(file, read_buffer, frames);
-
-		// If we've read data
-		if (frames_read > 0)
+		const stack_time_t tile_length = tile->first.first * STACK_AUDIO_PREVIEW_TILE_WIDTH;
+		const stack_time_t tile_start_time = tile->first.second * tile_length;
+		if (tile_start_time < end_time && tile_start_time + tile_length > start_time)
 		{
-			// Render the samples
-			sample = stack_audio_preview_render_points(preview, file, read_buffer, frames_read, preview_start_samples, sample, downsample);
-
-			// Redraw a few times per second
-			if (stack_get_clock_time() - last_redraw_time > NANOSECS_PER_SEC / 25)
+			if (tile->second.surface != NULL)
 			{
-				cairo_stroke(preview->buffer_cr);
-				gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
-				last_redraw_time = stack_get_clock_time();
+				cairo_surface_destroy(tile->second.surface);
 			}
+			tile = preview->tiles.erase(tile);
 		}
 		else
 		{
-			no_more_data = true;
+			tile++;
 		}
 	}
+	lock.unlock();
 
-	// Tidy up
-	delete [] read_buffer;
-	stack_audio_file_destroy(file);
+	stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw);
+}
 
-	// We've finished - force a redraw
-	cairo_stroke(preview->buffer_cr);
-	gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
+// Thread to generate the peak pyramid of the file when it isn't in the cache
+static void stack_audio_preview_peaks_thread(StackAudioPreview *preview, char *uri)
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-peaks");
 
-	// Finished
-	preview->thread_running = false;
+	StackAudioPeaks *peaks = stack_audio_peaks_generate(uri, &preview->peaks_cancel, stack_audio_preview_peaks_progress, preview);
+	free(uri);
 
-	return;
+	if (peaks != NULL)
+	{
+		// Any tiles rendered from now on can use the pyramid
+		preview->file_length_time = peaks->length;
+		preview->peaks = peaks;
+	}
 }
 
-// Generates a new audio preview
-// @param preview The cue to preview
-// @param start The starting time of the preview (on the left hand side of the image)
-// @param end The ending time of the preview (on the right hand side of the image)
-// @param width The width of the preview image
-// @param height The height of the preview image
-static void stack_audio_preview_generate(StackAudioPreview *preview, stack_time_t start, stack_time_t end, int width, int height)
+// Stops any peak pyramid generation and releases the pyramid
+static void stack_audio_preview_tidy_peaks(StackAudioPreview *preview)
 {
-	stack_audio_preview_tidy_buffer(preview);
+	preview->peaks_cancel = true;
+	if (preview->peaks_thread.joinable())
+	{
+		preview->peaks_thread.join();
+	}
+	preview->peaks_cancel = false;
 
-	// Don't keep regenerating
-	preview->force_regenerate = false;
+	// The partial pyramid is either the same as the complete one, or was
+	// destroyed when the generation was cancelled
+	preview->partial_peaks = NULL;
 
-	// Store details
-	preview->start_time = start;
-	preview->end_time = end;
-	preview->surface_width = width;
-	preview->surface_height = height;
+	StackAudioPeaks *peaks = preview->peaks.exchange(NULL);
+	if (peaks != NULL)
+	{
+		stack_audio_peaks_destroy(peaks);
+	}
+}
 
-	// Create a new surface
-	preview->buffer_surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-	preview->buffer_cr = cairo_create(preview->buffer_surface);
-	cairo_set_source_rgb(preview->buffer_cr, 0.1, 0.1, 0.1);
-	cairo_paint(preview->buffer_cr);
+// Draws the waveform from the cached tiles, requesting any visible tiles that
+// haven't been rendered and discarding the least recently used tiles if we have
+// too many
+// @param preview The preview widget
+// @param cr The Cairo context to draw to
+// @param top The vertical position of the top of the graph
+static void stack_audio_preview_draw_tiles(StackAudioPreview *preview, cairo_t *cr, int top)
+{
+	std::unique_lock<std::mutex> lock(preview->tiles_mutex);
+
+	// Work out the zoom level. We use a whole number of nanoseconds per pixel
+	// so that tiles line up exactly when scrolling
+	preview->nanosecs_per_pixel = std::max((stack_time_t)1, (preview->end_time - preview->start_time) / preview->surface_width);
+	const stack_time_t tile_length = preview->nanosecs_per_pixel * STACK_AUDIO_PREVIEW_TILE_WIDTH;
+	const int64_t first_tile = preview->start_time / tile_length;
+	const int64_t last_tile = (preview->start_time + preview->nanosecs_per_pixel * preview->surface_width) / tile_length;
+	const int64_t start_x = preview->start_time / preview->nanosecs_per_pixel;
+
+	// Draw the visible tiles
+	const uint64_t first_use = preview->tile_use_count + 1;
+	bool need_render = false;
+	for (int64_t index = first_tile; index <= last_tile; index++)
+	{
+		auto tile = preview->tiles.find(StackAudioPreviewTileKey(preview->nanosecs_per_pixel, index));
+		if (tile == preview->tiles.end())
+		{
+			tile = preview->tiles.insert(std::make_pair(StackAudioPreviewTileKey(preview->nanosecs_per_pixel, index), StackAudioPreviewTile{NULL, 0})).first;
+		}
+		tile->second.last_used = ++preview->tile_use_count;
+
+		if (tile->second.surface != NULL)
+		{
+			const double x = (double)(index * STACK_AUDIO_PREVIEW_TILE_WIDTH - start_x);
+			cairo_set_source_surface(cr, tile->second.surface, x, top);
+			cairo_rectangle(cr, x, top, STACK_AUDIO_PREVIEW_TILE_WIDTH, preview->surface_height);
+			cairo_fill(cr);
+		}
+		else
+		{
+			need_render = true;
+		}
+	}
+
+	// Discard the least recently used tiles that weren't drawn this time
+	while (preview->tiles.size() > STACK_AUDIO_PREVIEW_MAX_TILES)
+	{
+		auto oldest = preview->tiles.end();
+		for (auto tile = preview->tiles.begin(); tile != preview->tiles.end(); tile++)
+		{
+			if (tile->second.last_used < first_use && (oldest == preview->tiles.end() || tile->second.last_used < oldest->second.last_used))
+			{
+				oldest = tile;
+			}
+		}
+		if (oldest == preview->tiles.end())
+		{
+			break;
+		}
+		if (oldest->second.surface != NULL)
+		{
+			cairo_surface_destroy(oldest->second.surface);
+		}
+		preview->tiles.erase(oldest);
+	}
 
-	// Start a new thead for the rendering
-	preview->render_thread = std::thread(stack_audio_preview_render_thread, preview);
+	// Start rendering any tiles we're missing
+	if (need_render && !preview->thread_running)
+	{
+		if (preview->render_thread.joinable())
+		{
+			preview->render_thread.join();
+		}
+		preview->thread_running = true;
+		preview->render_thread = std::thread(stack_audio_preview_render_thread, preview);
+	}
 }
 
 static gboolean stack_audio_preview_draw(GtkWidget *widget, cairo_t *cr)
@@ -289,37 +557,18 @@ static gboolean stack_audio_preview_draw(GtkWidget *widget, cairo_t *cr)
 	guint graph_height = height - top_bar_height;
 	guint half_graph_height = graph_height / 2;
 
-	if (preview->file != NULL || preview->force_regenerate)
+	if (preview->file != NULL && preview->end_time > preview->start_time && width > 0 && graph_height > 0)
 	{
-		// Decide if we need to (re)generate a preview
-		bool generate_preview = false;
-		if (preview->buffer_cr == NULL || preview->buffer_surface == NULL || preview->force_regenerate)
-		{
-			generate_preview = true;
-		}
-		else if (preview->buffer_cr != NULL && preview->buffer_surface != NULL)
+		// The tiles are the height of the graph, so if that has changed, we
+		// need to start again
+		if (preview->surface_height != (int)graph_height)
 		{
-			if (preview->surface_width != width || preview->surface_height != graph_height)
-			{
-				generate_preview = true;
-			}
+			stack_audio_preview_tidy_buffer(preview);
 		}
+		preview->surface_width = width;
+		preview->surface_height = graph_height;
 
-		// Generate a preview if required
-		if (generate_preview)
-		{
-			stack_audio_preview_generate(preview, preview->start_time, preview->end_time, width, graph_height);
-		}
-		else
-		{
-			// If we have a surface, draw it
-			if (preview->buffer_cr != NULL && preview->buffer_surface != NULL)
-			{
-				cairo_set_source_surface(cr, preview->buffer_surface, 0, top_bar_height);
-				cairo_rectangle(cr, 0.0, top_bar_height, width, graph_height);
-				cairo_fill(cr);
-			}
-		}
+		stack_audio_preview_draw_tiles(preview, cr, top_bar_height);
 	}
 
 	// Draw the zero line
@@ -411,11 +660,13 @@ static gboolean stack_audio_preview_draw(GtkWidget *widget, cairo_t *cr)
 	}
 
 	// Whilst in playback, draw a playback marker
+	preview->playback_drawn_x = -1;
 	if (preview->show_playback_marker)
 	{
 		double playback_x = fp_width * (double)(preview->playback_time - preview->start_time) / preview_length;
 		if (playback_x > 0.0 && playback_x < width)
 		{
+			preview->playback_drawn_x = (int)floor(playback_x);
 			cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
 			cairo_set_source_rgb(cr, 1.0, 1.0, 0.0);
 			cairo_move_to(cr, playback_x, 0);
@@ -630,9 +881,15 @@ static void stack_audio_preview_init(StackAudioPreview *preview)
 	preview->window = NULL;
 	preview->file = NULL;
 	preview->thread_running = false;
-	preview->force_regenerate = false;
-	preview->buffer_cr = NULL;
-	preview->buffer_surface = NULL;
+	preview->peaks = NULL;
+	preview->partial_peaks = NULL;
+	preview->peaks_cancel = false;
+	new (&preview->tiles) StackAudioPreviewTileMap();
+	new (&preview->tiles_mutex) std::mutex();
+	new (&preview->render_thread) std::thread();
+	new (&preview->peaks_thread) std::thread();
+	preview->tile_use_count = 0;
+	preview->nanosecs_per_pixel = 1;
 	preview->surface_width = 0;
 	preview->surface_height = 0;
 	preview->start_time = 0;
@@ -642,6 +899,7 @@ static void stack_audio_preview_init(StackAudioPreview *preview)
 	preview->sel_end_time = 0;
 	preview->show_playback_marker = false;
 	preview->playback_time = 0;
+	preview->playback_drawn_x = -1;
 	preview->last_redraw_time = 0;
 	preview->dragging = STACK_AUDIO_PREVIEW_DRAG_NONE;
 
@@ -719,7 +977,23 @@ void stack_audio_preview_set_file(StackAudioPreview *preview, const char *file)
 
 	// Wipe our buffers to force a redraw
 	stack_audio_preview_tidy_buffer(preview);
-	gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
+	preview->start_time = 0;
+	preview->end_time = 0;
+
+	// Use the cached peak pyramid of the file if there is one, otherwise
+	// generate one in the background. The preview decodes the file until it's
+	// ready
+	stack_audio_preview_tidy_peaks(preview);
+	preview->peaks = stack_audio_peaks_load(file);
+	if (preview->peaks != NULL)
+	{
+		preview->file_length_time = preview->peaks.load()->length;
+	}
+	else
+	{
+		preview->peaks_thread = std::thread(stack_audio_preview_peaks_thread, preview, strdup(file));
+	}
+	stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw);
 }
 
 void stack_audio_preview_set_view_range(StackAudioPreview *preview, stack_time_t start, stack_time_t end)
@@ -755,11 +1029,11 @@ void stack_audio_preview_set_view_range(StackAudioPreview *preview, stack_time_t
 		preview->end_time = end;
 	}
 
-	// Redraw if something changed
+	// Redraw if something changed. Any tiles we already have for the new range
+	// will be re-used
 	if (changed)
 	{
-		preview->force_regenerate = true;
-		gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
+		stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw);
 	}
 }
 
@@ -774,13 +1048,14 @@ void stack_audio_preview_set_playback(StackAudioPreview *preview, stack_time_t p
 		// Determine the previous and current position of the marker on the
 		// actual widget in pixels
 		double fp_width = (float)gtk_widget_get_allocated_width(GTK_WIDGET(preview));
-		double last_playback_x = round(fp_width * (double)(previous_playback_time - preview->start_time) / (double)(preview->end_time - preview->start_time));
-		double new_playback_x = round(fp_width * (double)(preview->playback_time - preview->start_time) / (double)(preview->end_time - preview->start_time));
+		double last_playback_x = floor(fp_width * (double)(previous_playback_time - preview->start_time) / (double)(preview->end_time - preview->start_time));
+		double new_playback_x = floor(fp_width * (double)(preview->playback_time - preview->start_time) / (double)(preview->end_time - preview->start_time));
 
-		// Only redraw if it wasn't the same
+		// Only redraw if it wasn't the same, and then only the columns
+		// around the marker
 		if (last_playback_x != new_playback_x)
 		{
-			gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
+			stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw_marker);
 		}
 	}
 }
@@ -790,7 +1065,7 @@ void stack_audio_preview_show_playback(StackAudioPreview *preview, bool show_pla
 	if (preview->show_playback_marker != show_playback)
 	{
 		preview->show_playback_marker = show_playback;
-		gdk_threads_add_idle(stack_audio_preview_idle_redraw, preview);
+		stack_audio_preview_add_idle(preview, stack_audio_preview_idle_redraw);
 	}
 }
 
@@ -799,7 +1074,7 @@ void stack_audio_preview_set_selection(StackAudioPreview *preview, stack_time_t
 	preview->sel_start_time = (start > 0 ? start : 0);
 	if (preview->file != NULL && preview->file_length_time != 0)
 	{
-		preview->sel_end_time = (end <= preview->file_length_time ? end : preview->file_length_time);
+		preview->sel_end_time = std::min(end, preview->file_length_time.load());
 	}
 	else
 	{
@@ -815,6 +1090,7 @@ static void stack_audio_preview_finalize(GObject *obj)
 
 	// Stop any render thread and tidy up
 	stack_audio_preview_tidy_buffer(preview);
+	stack_audio_preview_tidy_peaks(preview);
 
 	// Destroy our audio file
 	if (preview->file != NULL)
@@ -822,6 +1098,12 @@ static void stack_audio_preview_finalize(GObject *obj)
 		free(preview->file);
 	}
 
+	// Destruct the members we constructed in init
+	preview->tiles.~StackAudioPreviewTileMap();
+	preview->tiles_mutex.~mutex();
+	preview->render_thread.~thread();
+	preview->peaks_thread.~thread();
+
 	// Chain up
 	G_OBJECT_CLASS(stack_audio_preview_parent_class)->finalize(obj);
 }
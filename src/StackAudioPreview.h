@@ -2,7 +2,18 @@
 #define _STACKAUDIOPREVIEW_H_INCLUDED
 
 // Includes:
+#include "StackAudioPeaks.h"
 #include <gtk/gtk.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// The width in pixels of each cached tile of the waveform
+#define STACK_AUDIO_PREVIEW_TILE_WIDTH 256
+
+// The maximum number of tiles to keep cached
+#define STACK_AUDIO_PREVIEW_MAX_TILES 64
 
 enum StackAudioPreviewDrag
 {
@@ -11,6 +22,21 @@ enum StackAudioPreviewDrag
 	STACK_AUDIO_PREVIEW_DRAG_END,
 };
 
+// Identifies a tile of the waveform: the zoom level (in nanoseconds per pixel)
+// and the index of the tile at that zoom level
+typedef std::pair<stack_time_t, int64_t> StackAudioPreviewTileKey;
+
+struct StackAudioPreviewTile
+{
+	// The rendered tile, or NULL if it's waiting to be rendered
+	cairo_surface_t *surface;
+
+	// When the tile was last drawn (used to discard old tiles)
+	uint64_t last_used;
+};
+
+typedef std::map<StackAudioPreviewTileKey, StackAudioPreviewTile> StackAudioPreviewTileMap;
+
 struct StackAudioPreview
 {
 	GtkWidget super;
@@ -21,24 +47,28 @@ struct StackAudioPreview
 	// The URI of the file
 	char *file;
 
-	// Is the thread for drawing to the off-screen surface running?
-	bool thread_running;
+	// Is the thread for rendering tiles running?
+	std::atomic<bool> thread_running;
 
-	// Whether we need to force a regeneration of the buffer on the next redraw
-	bool force_regenerate;
+	// The cached tiles of the waveform. Protected by tiles_mutex. As GObject
+	// doesn't run constructors, these are constructed in init and destructed
+	// in finalize
+	StackAudioPreviewTileMap tiles;
+	std::mutex tiles_mutex;
 
-	// Cairo handle for off-screen surface
-	cairo_t *buffer_cr;
+	// Counter used to track when tiles were last drawn
+	uint64_t tile_use_count;
 
-	// Off-screen cairo surface
-	cairo_surface_t *buffer_surface;
+	// The zoom level of the tiles currently being drawn
+	stack_time_t nanosecs_per_pixel;
 
-	// The size of the current off-screen surface
+	// The size of the graph area (and the height of the tiles)
 	int surface_width;
 	int surface_height;
 
-	// The known length of the file
-	stack_time_t file_length_time;
+	// The known length of the file. Set by the render and peak threads as
+	// soon as they find out
+	std::atomic<stack_time_t> file_length_time;
 
 	// The start and end times of the audio visible in the preview
 	stack_time_t start_time;
@@ -54,9 +84,25 @@ struct StackAudioPreview
 	// The time of the playback_marker
 	stack_time_t playback_time;
 
-	// The thread generating the preview image
+	// The column the playback marker was last drawn in, or -1 if it wasn't
+	int playback_drawn_x;
+
+	// The thread generating the preview image (constructed in init)
 	std::thread render_thread;
 
+	// The peak pyramid of the file, or NULL if it's not yet available
+	std::atomic<StackAudioPeaks*> peaks;
+
+	// The peak pyramid whilst it is being generated (owned by the generator)
+	std::atomic<StackAudioPeaks*> partial_peaks;
+
+	// The thread generating the peak pyramid when it isn't in the cache
+	// (constructed in init)
+	std::thread peaks_thread;
+
+	// Set to stop the peak pyramid thread early
+	std::atomic<bool> peaks_cancel;
+
 	// Time of last redraw of audio preview during playback
 	stack_time_t last_redraw_time;
 
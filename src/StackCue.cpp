@@ -4,6 +4,10 @@
 #include "StackLog.h"
 #include "StackJson.h"
 #include <map>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <random>
 #include <cstring>
 #include <time.h>
 #include <cmath>
@@ -12,39 +16,49 @@ using namespace std;
 // Map of classes
 static StackCueClassMap cue_class_map;
 
-// Map of UIDs
-static map<cue_uid_t, StackCue*> cue_uid_map;
+// Registry of cues by UID. This is read from the UI, RPC, trigger and loading
+// threads, so it is split in to shards (by the low bits of the UID, which are
+// well mixed) each with its own lock, so that lookups rarely contend with each
+// other or with cues being created and destroyed
+#define STACK_CUE_UID_SHARDS 64
+struct StackCueUIDShard
+{
+	std::mutex lock;
+	std::unordered_map<cue_uid_t, StackCue*> cues;
+};
+static StackCueUIDShard cue_uid_shards[STACK_CUE_UID_SHARDS];
+
+// Returns the shard of the UID registry that a UID belongs in
+static inline StackCueUIDShard &stack_cue_uid_shard(cue_uid_t uid)
+{
+	return cue_uid_shards[uid % STACK_CUE_UID_SHARDS];
+}
 
-// Generates a UID
+// Generates a UID. Rather than generating random numbers until we find one
+// that isn't in use, we count up from a random starting point and mix the
+// counter with a bijective function, so that every UID is unique (and still
+// looks random) without having to look in the registry
 static cue_uid_t stack_cue_generate_uid()
 {
-	static bool seeded = false;
-	if (!seeded)
-	{
-		seeded = true;
+	static const uint64_t base = []() {
+		// Group cues rely on rand() having been seeded
 		srand(time(NULL));
-	}
 
-	cue_uid_t uid = STACK_CUE_UID_NONE;
+		std::random_device device;
+		return ((uint64_t)device() << 32) ^ (uint64_t)device() ^ (uint64_t)time(NULL);
+	}();
+	static std::atomic<uint64_t> counter(0);
 
-	// Repeatedly generate UUIDs until we find a free one
+	cue_uid_t uid = STACK_CUE_UID_NONE;
 	do
 	{
-#if RAND_MAX < 255
-#    error RAND_MAX too small, must be at least 2^8 - 1 (8-bit) for UUID generation
-#elif RAND_MAX < 65535
-#    warning RAND_MAX is less than 2^16 - 1 (16-bit), falling back to 8-bit UUID generation method
-		for (size_t i = 0; i < 8; i++)
-		{
-			uid = (uid << 8) | (cue_uid_t)(rand() % 0xff);
-		}
-#else
-	for (size_t i = 0; i < 4; i++)
-	{
-		uid = (uid << 16) | (cue_uid_t)(rand() % 0xffff);
-	}
-#endif
-	} while (cue_uid_map.find(uid) != cue_uid_map.end() && uid != STACK_CUE_UID_NONE);
+		// The splitmix64 finaliser (which is invertible, so distinct inputs
+		// give distinct outputs)
+		uint64_t x = base + counter.fetch_add(1, std::memory_order_relaxed);
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		uid = x ^ (x >> 31);
+	} while (uid == STACK_CUE_UID_NONE);
 
 	return uid;
 }
@@ -75,52 +89,60 @@ void stack_cue_init(StackCue *cue, StackCueList *cue_list)
 	cue->paused_time = 0;
 	cue->pause_paused_time = 0;
 	cue->properties = new StackPropertyMap();
+	for (size_t i = 0; i < STACK_PROPERTY_KEY_SLOT_COUNT; i++)
+	{
+		cue->property_slots[i] = NULL;
+	}
 	cue->triggers = new StackTriggerVector();
 
-	// Store the UID in our map
-	cue_uid_map[cue->uid] = cue;
+	// Store the UID in our registry
+	{
+		StackCueUIDShard &shard = stack_cue_uid_shard(cue->uid);
+		std::unique_lock<std::mutex> lock(shard.lock);
+		shard.cues[cue->uid] = cue;
+	}
 
 	// Add our properties
-	StackProperty *name = stack_property_create("name", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *name = stack_property_create_keyed(STACK_PROPERTY_KEY_NAME, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(cue, name);
 	stack_property_set_changed_callback(name, stack_cue_ccb, cue);
 
-	StackProperty *script_ref = stack_property_create("script_ref", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *script_ref = stack_property_create_keyed(STACK_PROPERTY_KEY_SCRIPT_REF, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(cue, script_ref);
 	stack_property_set_changed_callback(name, stack_cue_ccb, cue);
 
-	StackProperty *notes = stack_property_create("notes", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *notes = stack_property_create_keyed(STACK_PROPERTY_KEY_NOTES, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(cue, notes);
 	stack_property_set_changed_callback(notes, stack_cue_ccb, cue);
 
-	StackProperty *r = stack_property_create("r", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *r = stack_property_create_keyed(STACK_PROPERTY_KEY_R, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(cue, r);
 	stack_property_set_uint8(stack_cue_get_property(cue, "r"), STACK_PROPERTY_VERSION_DEFINED, 0);
 	stack_property_set_changed_callback(r, stack_cue_ccb, cue);
 
-	StackProperty *g = stack_property_create("g", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *g = stack_property_create_keyed(STACK_PROPERTY_KEY_G, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(cue, g);
 	stack_property_set_uint8(stack_cue_get_property(cue, "g"), STACK_PROPERTY_VERSION_DEFINED, 0);
 	stack_property_set_changed_callback(g, stack_cue_ccb, cue);
 
-	StackProperty *b = stack_property_create("b", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *b = stack_property_create_keyed(STACK_PROPERTY_KEY_B, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(cue, b);
 	stack_property_set_uint8(stack_cue_get_property(cue, "b"), STACK_PROPERTY_VERSION_DEFINED, 0);
 	stack_property_set_changed_callback(b, stack_cue_ccb, cue);
 
-	StackProperty *pre_time = stack_property_create("pre_time", STACK_PROPERTY_TYPE_INT64);
+	StackProperty *pre_time = stack_property_create_keyed(STACK_PROPERTY_KEY_PRE_TIME, STACK_PROPERTY_TYPE_INT64);
 	stack_cue_add_property(cue, pre_time);
 	stack_property_set_changed_callback(pre_time, stack_cue_ccb, cue);
 
-	StackProperty *action_time = stack_property_create("action_time", STACK_PROPERTY_TYPE_INT64);
+	StackProperty *action_time = stack_property_create_keyed(STACK_PROPERTY_KEY_ACTION_TIME, STACK_PROPERTY_TYPE_INT64);
 	stack_cue_add_property(cue, action_time);
 	stack_property_set_changed_callback(action_time, stack_cue_ccb, cue);
 
-	StackProperty *post_time = stack_property_create("post_time", STACK_PROPERTY_TYPE_INT64);
+	StackProperty *post_time = stack_property_create_keyed(STACK_PROPERTY_KEY_POST_TIME, STACK_PROPERTY_TYPE_INT64);
 	stack_cue_add_property(cue, post_time);
 	stack_property_set_changed_callback(post_time, stack_cue_ccb, cue);
 
-	StackProperty *post_trigger = stack_property_create("post_trigger", STACK_PROPERTY_TYPE_INT32);
+	StackProperty *post_trigger = stack_property_create_keyed(STACK_PROPERTY_KEY_POST_TRIGGER, STACK_PROPERTY_TYPE_INT32);
 	stack_cue_add_property(cue, post_trigger);
 	stack_property_set_changed_callback(post_trigger, stack_cue_ccb, cue);
 
@@ -132,11 +154,29 @@ void stack_cue_init(StackCue *cue, StackCueList *cue_list)
 void stack_cue_add_property(StackCue *cue, StackProperty *property)
 {
 	(*cue->properties)[string(property->name)] = property;
+
+	// Keep a direct pointer to properties with a fixed or registered key
+	if (property->key < STACK_PROPERTY_KEY_SLOT_COUNT)
+	{
+		cue->property_slots[property->key] = property;
+	}
 }
 
 void stack_cue_remove_property(StackCue *cue, const char *property)
 {
-	cue->properties->erase(string(property));
+	auto property_iter = cue->properties->find(property);
+	if (property_iter == cue->properties->end())
+	{
+		return;
+	}
+
+	stack_property_key_t key = property_iter->second->key;
+	if (key < STACK_PROPERTY_KEY_SLOT_COUNT && cue->property_slots[key] == property_iter->second)
+	{
+		cue->property_slots[key] = NULL;
+	}
+
+	cue->properties->erase(property_iter);
 }
 
 StackProperty *stack_cue_get_property(StackCue *cue, const char *property)
@@ -152,13 +192,37 @@ StackProperty *stack_cue_get_property(StackCue *cue, const char *property)
 	return property_iter->second;
 }
 
+// Finds a property by its key. This avoids the string lookup of
+// stack_cue_get_property for the fixed and registered keys, so should be used
+// on hot paths. Neither path takes a lock
+// @param cue The cue
+// @param key The key of the property (see stack_property_key)
+// @returns The property, or NULL if the cue does not have it
+StackProperty *stack_cue_get_property_by_key(StackCue *cue, stack_property_key_t key)
+{
+	if (key < STACK_PROPERTY_KEY_SLOT_COUNT)
+	{
+		return cue->property_slots[key];
+	}
+
+	const char *name = stack_property_key_name(key);
+	if (name == NULL)
+	{
+		return NULL;
+	}
+
+	return stack_cue_get_property(cue, name);
+}
+
 // Finds the cue by the given UID and returns it
 // @param uid The UID of the cue to look for
 // @returns A pointer to the cue or NULL if not found
 StackCue *stack_cue_get_by_uid(cue_uid_t uid)
 {
-	auto iter = cue_uid_map.find(uid);
-	if (iter == cue_uid_map.end())
+	StackCueUIDShard &shard = stack_cue_uid_shard(uid);
+	std::unique_lock<std::mutex> lock(shard.lock);
+	auto iter = shard.cues.find(uid);
+	if (iter == shard.cues.end())
 	{
 		return NULL;
 	}
@@ -171,9 +235,9 @@ void stack_cue_get_running_times(StackCue *cue, stack_time_t clocktime, stack_ti
 {
 	// Get the _live_ version of these properties
 	stack_time_t cue_pre_time = 0, cue_action_time = 0, cue_post_time = 0;
-	stack_property_get_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
 
 	// If we're paused, re-calculate the paused time
 	if (cue->state == STACK_CUE_STATE_PAUSED)
@@ -250,7 +314,7 @@ void stack_cue_get_running_times(StackCue *cue, stack_time_t clocktime, stack_ti
 	if (post != NULL)
 	{
 		int32_t cue_post_trigger = STACK_CUE_WAIT_TRIGGER_NONE;
-		stack_property_get_int32(stack_cue_get_property(cue, "post_trigger"), STACK_PROPERTY_VERSION_LIVE, &cue_post_trigger);
+		stack_property_get_int32(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TRIGGER), STACK_PROPERTY_VERSION_LIVE, &cue_post_trigger);
 
 		// Post wait time depends on the post-wait trigger
 		switch (cue_post_trigger)
@@ -407,8 +471,16 @@ void stack_cue_destroy(StackCue *cue)
 		return;
 	}
 
-	// Save the UID - we need to remove it from the map once the cue is deleted
-	cue_uid_t uid = cue->uid;
+	// Remove the cue from our UID registry first, so that other threads can't
+	// find it whilst it's being torn down
+	{
+		StackCueUIDShard &shard = stack_cue_uid_shard(cue->uid);
+		std::unique_lock<std::mutex> lock(shard.lock);
+		if (shard.cues.erase(cue->uid) == 0)
+		{
+			stack_log("stack_cue_destroy(): Assertion warning: Cue UID %016lx not in map!\n", cue->uid);
+		}
+	}
 
 	// Tidy up properties
 	for (auto iter = cue->properties->begin(); iter != cue->properties->end(); iter++)
@@ -426,18 +498,6 @@ void stack_cue_destroy(StackCue *cue)
 
 	// No need to iterate up through superclasses - we can't be NULL
 	iter->second->destroy_func(cue);
-
-	// Remove the cue from our UID map
-	auto uid_iter = cue_uid_map.find(uid);
-	if (uid_iter == cue_uid_map.end())
-	{
-		stack_log("stack_cue_destroy(): Assertion warning: Cue UID %016lx not in map!\n", uid);
-		return;
-	}
-	else
-	{
-		cue_uid_map.erase(uid_iter);
-	}
 }
 
 // Starts cue playback
@@ -453,7 +513,20 @@ bool stack_cue_play(StackCue *cue)
 	}
 
 	// Call the function
-	return cue_class_map[string(class_name)]->play_func(cue);
+	const bool result = cue_class_map[string(class_name)]->play_func(cue);
+
+	// The cue after this one is likely to be played soon, either by our
+	// post-wait or by the next GO, so let it get ready
+	if (result && cue->parent != NULL)
+	{
+		StackCue *next_cue = stack_cue_list_get_cue_after(cue->parent, cue);
+		if (next_cue != NULL)
+		{
+			stack_cue_prepare(next_cue);
+		}
+	}
+
+	return result;
 }
 
 // Pauses cue playback
@@ -552,27 +625,35 @@ bool stack_cue_get_error(StackCue *cue, char *message, size_t size)
 	return cue_class_map[string(class_name)]->get_error_func(cue, message, size);
 }
 
-char *stack_cue_to_json(StackCue *cue)
+// Writes the cue to a JSON value
+void stack_cue_to_json_value(StackCue *cue, Json::Value &cue_root)
 {
 	// Get the class name
 	const char *class_name = cue->_class_name;
 
 	// Start a JSON response value
-	Json::Value cue_root;
 	cue_root["class"] = cue->_class_name;
 
 	// Iterate up through all the classes
 	while (class_name != NULL)
 	{
 		// Start a node
-		cue_root[class_name] = Json::Value();
+		Json::Value &class_root = cue_root[class_name];
+		class_root = Json::Value();
 
-		if (cue_class_map[class_name]->to_json_func)
+		const StackCueClass *cue_class = cue_class_map[class_name];
+		if (cue_class->to_json_value_func)
 		{
-			if (cue_class_map[class_name]->free_json_func)
+			cue_class->to_json_value_func(cue, class_root);
+		}
+		else if (cue_class->to_json_func)
+		{
+			// Fall back to the string interface
+			if (cue_class->free_json_func)
 			{
-				char *json_data = cue_class_map[class_name]->to_json_func(cue);
-				stack_json_read_string(json_data, &cue_root[class_name]);
+				char *json_data = cue_class->to_json_func(cue);
+				stack_json_read_string(json_data, &class_root);
+				cue_class->free_json_func(cue, json_data);
 			}
 			else
 			{
@@ -585,8 +666,14 @@ char *stack_cue_to_json(StackCue *cue)
 		}
 
 		// Iterate up to superclass
-		class_name = cue_class_map[class_name]->super_class_name;
+		class_name = cue_class->super_class_name;
 	}
+}
+
+char *stack_cue_to_json(StackCue *cue)
+{
+	Json::Value cue_root;
+	stack_cue_to_json_value(cue, cue_root);
 
 	// Generate JSON string and return it (to be free'd by stack_cue_free_json)
 	Json::StreamWriterBuilder builder;
@@ -608,8 +695,8 @@ void stack_cue_free_json(StackCue *cue, char *json_data)
 	return cue_class_map[string(class_name)]->free_json_func(cue, json_data);
 }
 
-// Generates the cue from JSON data
-void stack_cue_from_json(StackCue *cue, const char *json_data)
+// Generates the cue from a JSON value
+void stack_cue_from_json_value(StackCue *cue, const Json::Value &cue_root)
 {
 	if (cue == NULL)
 	{
@@ -621,13 +708,29 @@ void stack_cue_from_json(StackCue *cue, const char *json_data)
 	const char *class_name = cue->_class_name;
 
 	// Look for a from_json function. Iterate through superclasses if we don't have one
-	while (class_name != NULL && cue_class_map[class_name]->from_json_func == NULL)
+	while (class_name != NULL && cue_class_map[class_name]->from_json_value_func == NULL && cue_class_map[class_name]->from_json_func == NULL)
 	{
 		class_name = cue_class_map[class_name]->super_class_name;
 	}
 
-	// Call the function
-	cue_class_map[string(class_name)]->from_json_func(cue, json_data);
+	// Call the function, falling back to the string interface
+	const StackCueClass *cue_class = cue_class_map[string(class_name)];
+	if (cue_class->from_json_value_func)
+	{
+		cue_class->from_json_value_func(cue, cue_root);
+	}
+	else
+	{
+		cue_class->from_json_func(cue, cue_root.toStyledString().c_str());
+	}
+}
+
+// Generates the cue from JSON data
+void stack_cue_from_json(StackCue *cue, const char *json_data)
+{
+	Json::Value cue_root;
+	stack_json_read_string(json_data, &cue_root);
+	stack_cue_from_json_value(cue, cue_root);
 }
 
 static void stack_cue_from_json_void(StackCue *cue, const char *json_data)
@@ -635,6 +738,11 @@ static void stack_cue_from_json_void(StackCue *cue, const char *json_data)
 	// Does nothing in the base implementation
 }
 
+static void stack_cue_from_json_value_void(StackCue *cue, const Json::Value &cue_root)
+{
+	// Does nothing in the base implementation
+}
+
 // Get the active channels for a cue
 size_t stack_cue_get_active_channels(StackCue *cue, bool *active, bool live)
 {
@@ -799,10 +907,32 @@ StackCue *stack_cue_get_next_cue(StackCue *cue)
 	return cue_class_map[string(class_name)]->get_next_cue_func(cue);
 }
 
+// Lets a cue get ready to be played, if its class needs to
+void stack_cue_prepare(StackCue *cue)
+{
+	// Get the class name
+	const char *class_name = cue->_class_name;
+
+	// Look for a prepare function. Iterate through superclasses if we don't have one
+	while (class_name != NULL && cue_class_map[class_name]->prepare_func == NULL)
+	{
+		class_name = cue_class_map[class_name]->super_class_name;
+	}
+
+	// Call the function (there isn't a base one, as most cues don't need it)
+	if (class_name != NULL)
+	{
+		cue_class_map[string(class_name)]->prepare_func(cue);
+	}
+}
+
 // Add a trigger to the list of triggers
 void stack_cue_add_trigger(StackCue *cue, StackTrigger *trigger)
 {
 	cue->triggers->push_back(trigger);
+
+	// The cue could now be played at any time
+	stack_cue_prepare(cue);
 }
 
 // Remove a trigger from the list of triggers and destroys it
@@ -836,7 +966,7 @@ void stack_cue_clear_triggers(StackCue *cue)
 void stack_cue_initsystem()
 {
 	// Register base cue type
-	StackCueClass* stack_cue_class = new StackCueClass{ "StackCue", NULL, "Abstract Base Cue", stack_cue_create_base, stack_cue_destroy_base, stack_cue_play_base, stack_cue_pause_base, stack_cue_stop_base, stack_cue_pulse_base, stack_cue_set_tabs_base, stack_cue_unset_tabs_base, stack_cue_to_json_base, stack_cue_free_json_base, stack_cue_from_json_void, stack_cue_get_error_base, stack_cue_get_active_channels_base, stack_cue_get_audio_base, stack_cue_get_field_base, stack_cue_get_icon_base, stack_cue_get_children_base, stack_cue_get_next_cue_base };
+	StackCueClass* stack_cue_class = new StackCueClass{ "StackCue", NULL, "Abstract Base Cue", stack_cue_create_base, stack_cue_destroy_base, stack_cue_play_base, stack_cue_pause_base, stack_cue_stop_base, stack_cue_pulse_base, stack_cue_set_tabs_base, stack_cue_unset_tabs_base, stack_cue_to_json_base, stack_cue_free_json_base, stack_cue_from_json_void, stack_cue_get_error_base, stack_cue_get_active_channels_base, stack_cue_get_audio_base, stack_cue_get_field_base, stack_cue_get_icon_base, stack_cue_get_children_base, stack_cue_get_next_cue_base, stack_cue_to_json_value_base, stack_cue_from_json_value_void };
 	stack_register_cue_class(stack_cue_class);
 
 	// Group cues are built-in, not plugins
@@ -115,6 +115,12 @@ struct StackCue
 	// properties stored in here will automatically be written to JSON
 	StackPropertyMap *properties;
 
+	// Direct pointers to the properties in the map that have a fixed or
+	// registered key (see StackProperty.h), indexed by key, so that they can be
+	// found without a string lookup. Entries are NULL for properties the cue
+	// doesn't have
+	StackProperty *property_slots[STACK_PROPERTY_KEY_SLOT_COUNT];
+
 	// The additional triggers for the cue (this is a std::vector internally)
 	StackTriggerVector *triggers;
 };
@@ -131,6 +137,8 @@ typedef void(*stack_unset_tabs_t)(StackCue*, GtkNotebook*);
 typedef char*(*stack_to_json_t)(StackCue*);
 typedef void(*stack_free_json_t)(StackCue*, char*);
 typedef void(*stack_from_json_t)(StackCue*, const char*);
+typedef void(*stack_to_json_value_t)(StackCue*, Json::Value&);
+typedef void(*stack_from_json_value_t)(StackCue*, const Json::Value&);
 typedef bool(*stack_cue_get_error_t)(StackCue*, char*, size_t);
 typedef size_t(*stack_cue_get_active_channels_t)(StackCue*, bool*, bool);
 typedef size_t(*stack_cue_get_audio_t)(StackCue*, float*, size_t);
@@ -138,6 +146,7 @@ typedef const char*(*stack_cue_get_field_t)(StackCue*, const char *);
 typedef GdkPixbuf*(*stack_cue_get_icon_t)(StackCue*);
 typedef StackCueStdList*(*stack_cue_get_children_t)(StackCue*);
 typedef StackCue*(*stack_cue_get_next_cue_t)(StackCue*);
+typedef void(*stack_prepare_cue_t)(StackCue*);
 
 // Defines information about a class
 struct StackCueClass
@@ -163,6 +172,19 @@ struct StackCueClass
 	stack_cue_get_icon_t get_icon_func;
 	stack_cue_get_children_t get_children_func;
 	stack_cue_get_next_cue_t get_next_cue_func;
+
+	// Structured alternatives to to_json_func and from_json_func. Where a
+	// class provides these they are used in preference, which saves
+	// formatting and re-parsing JSON text for every cue on load and save.
+	// to_json_value_func writes the data for its own class only, whereas
+	// from_json_value_func is given the JSON of the whole cue
+	stack_to_json_value_t to_json_value_func;
+	stack_from_json_value_t from_json_value_func;
+
+	// Called when the cue is likely to be played soon (it has been armed by a
+	// trigger, or follows a cue that has just started), so that it can get
+	// ready without holding up playback. May be NULL
+	stack_prepare_cue_t prepare_func;
 };
 
 // Functions: Helpers
@@ -190,6 +212,7 @@ void stack_cue_init(StackCue *cue, StackCueList *cue_list);
 void stack_cue_add_property(StackCue *cue, StackProperty *property);
 void stack_cue_remove_property(StackCue *cue, const char *property);
 StackProperty *stack_cue_get_property(StackCue *cue, const char *property);
+StackProperty *stack_cue_get_property_by_key(StackCue *cue, stack_property_key_t key);
 void stack_cue_set_id(StackCue *cue, cue_id_t id);
 void stack_cue_set_name(StackCue *cue, const char *name);
 void stack_cue_set_script_ref(StackCue *cue, const char *script_ref);
@@ -210,6 +233,8 @@ void stack_cue_get_running_times(StackCue *cue, stack_time_t clocktime, stack_ti
 char *stack_cue_to_json(StackCue *cue);
 void stack_cue_free_json(StackCue *cue, char *json_data);
 void stack_cue_from_json(StackCue *cue, const char *json_data);
+void stack_cue_to_json_value(StackCue *cue, Json::Value &cue_root);
+void stack_cue_from_json_value(StackCue *cue, const Json::Value &cue_root);
 bool stack_cue_get_error(StackCue *cue, char *message, size_t size)
 	__attribute__((access (write_only, 2, 3)));
 const char* stack_cue_get_rendered_name(StackCue *cue);
@@ -223,6 +248,7 @@ void stack_cue_clear_triggers(StackCue *cue);
 const char* stack_cue_get_field(StackCue *cue, const char *field);
 StackCueStdList *stack_cue_get_children(StackCue *cue);
 StackCue *stack_cue_get_next_cue(StackCue *cue);
+void stack_cue_prepare(StackCue *cue);
 
 // Base stack cue operations. These should not be called directly except from
 // within subclasses of StackCue
@@ -237,6 +263,8 @@ void stack_cue_unset_tabs_base(StackCue *cue, GtkNotebook *notebook);
 char *stack_cue_to_json_base(StackCue *cue);
 void stack_cue_free_json_base(StackCue *cue, char *json_data);
 void stack_cue_from_json_base(StackCue *cue, const char *json_data);
+void stack_cue_to_json_value_base(StackCue *cue, Json::Value &cue_root);
+void stack_cue_from_json_value_base(StackCue *cue, const Json::Value &cue_root);
 bool stack_cue_get_error_base(StackCue *cue, char *message, size_t size)
 	__attribute__((access (write_only, 2, 3)));
 size_t stack_cue_get_active_channels_base(StackCue *cue, bool *active, bool live);
@@ -45,9 +45,9 @@ bool stack_cue_play_base(StackCue *cue)
 	{
 		// Get the _live_ version of these properties
 		stack_time_t cue_pre_time = 0, cue_action_time = 0, cue_post_time = 0;
-		stack_property_get_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
-		stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
-		stack_property_get_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
 
 		// Calculate how long we've been paused on this instance of us being
 		// paused
@@ -81,16 +81,16 @@ bool stack_cue_play_base(StackCue *cue)
 		// Get the _defined_ version of these properties
 		int32_t cue_post_trigger = STACK_CUE_WAIT_TRIGGER_NONE;
 		stack_time_t cue_pre_time = 0, cue_action_time = 0, cue_post_time = 0;
-		stack_property_get_int32(stack_cue_get_property(cue, "post_trigger"), STACK_PROPERTY_VERSION_DEFINED, &cue_post_trigger);
-		stack_property_get_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_pre_time);
-		stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_action_time);
-		stack_property_get_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_post_time);
+		stack_property_get_int32(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TRIGGER), STACK_PROPERTY_VERSION_DEFINED, &cue_post_trigger);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_DEFINED, &cue_pre_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_DEFINED, &cue_action_time);
+		stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_DEFINED, &cue_post_time);
 
 		// Copy htem to the _live_ version of these properties
-		stack_property_set_int32(stack_cue_get_property(cue, "post_trigger"), STACK_PROPERTY_VERSION_LIVE, cue_post_trigger);
-		stack_property_set_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_LIVE, cue_pre_time);
-		stack_property_set_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_LIVE, cue_action_time);
-		stack_property_set_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_LIVE, cue_post_time);
+		stack_property_set_int32(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TRIGGER), STACK_PROPERTY_VERSION_LIVE, cue_post_trigger);
+		stack_property_set_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_LIVE, cue_pre_time);
+		stack_property_set_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_LIVE, cue_action_time);
+		stack_property_set_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_LIVE, cue_post_time);
 
 		// Cue is stopped (and possibly prepared), start the cue
 		cue->start_time = clocktime;
@@ -153,10 +153,10 @@ void stack_cue_pulse_base(StackCue *cue, stack_time_t clocktime)
 	// Get the _live_ version of these properties
 	int32_t cue_post_trigger = STACK_CUE_WAIT_TRIGGER_NONE;
 	stack_time_t cue_pre_time = 0, cue_action_time = 0, cue_post_time = 0;
-	stack_property_get_int32(stack_cue_get_property(cue, "post_trigger"), STACK_PROPERTY_VERSION_LIVE, &cue_post_trigger);
-	stack_property_get_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
+	stack_property_get_int32(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TRIGGER), STACK_PROPERTY_VERSION_LIVE, &cue_post_trigger);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_pre_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_action_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_LIVE, &cue_post_time);
 
 	// Get the current cue action times
 	stack_time_t run_pre_time, run_action_time, run_post_time;
@@ -274,12 +274,9 @@ void stack_cue_unset_tabs_base(StackCue *cue, GtkNotebook *notebook)
 	return;
 }
 
-// Returns a JSON string that represents the data contained within the base
-// class
-char *stack_cue_to_json_base(StackCue *cue)
+// Writes the data contained within the base class to a JSON value
+void stack_cue_to_json_value_base(StackCue *cue, Json::Value &cue_root)
 {
-	Json::Value cue_root;
-
 	// Write out all the properties
 	stack_property_write_json(stack_cue_get_property(cue, "name"), &cue_root);
 	stack_property_write_json(stack_cue_get_property(cue, "script_ref"), &cue_root);
@@ -300,13 +297,19 @@ char *stack_cue_to_json_base(StackCue *cue)
 	for (auto trigger : *cue->triggers)
 	{
 		Json::Value trigger_root;
-		char *trigger_json_data = stack_trigger_to_json(trigger);
-		stack_json_read_string(trigger_json_data, &trigger_root);
-		stack_trigger_free_json(trigger, trigger_json_data);
+		stack_trigger_to_json_value(trigger, trigger_root);
 
 		// Add it to the entry
 		cue_root["triggers"].append(trigger_root);
 	}
+}
+
+// Returns a JSON string that represents the data contained within the base
+// class
+char *stack_cue_to_json_base(StackCue *cue)
+{
+	Json::Value cue_root;
+	stack_cue_to_json_value_base(cue, cue_root);
 
 	// Write out the JSON string and return it (to be free'd by
 	// stack_cue_free_json_base)
@@ -328,8 +331,14 @@ void stack_cue_from_json_base(StackCue *cue, const char *json_data)
 	// Parse JSON data
 	stack_json_read_string(json_data, &cue_root);
 
+	stack_cue_from_json_value_base(cue, cue_root);
+}
+
+// Re-initialises this cue from a JSON value of the whole cue
+void stack_cue_from_json_value_base(StackCue *cue, const Json::Value &cue_root)
+{
 	// Get the data that's pertinent to us
-	Json::Value& stack_cue_data = cue_root["StackCue"];
+	const Json::Value& stack_cue_data = cue_root["StackCue"];
 
 	// Copy the data in to the cue
 	stack_cue_set_color(cue, stack_cue_data["r"].asDouble(), stack_cue_data["g"].asDouble(), stack_cue_data["b"].asDouble());
@@ -348,13 +357,13 @@ void stack_cue_from_json_base(StackCue *cue, const char *json_data)
 	// If we have some triggers...
 	if (stack_cue_data.isMember("triggers"))
 	{
-		Json::Value& triggers_root = stack_cue_data["triggers"];
+		const Json::Value& triggers_root = stack_cue_data["triggers"];
 
 		if (triggers_root.isArray())
 		{
 			for (auto iter = triggers_root.begin(); iter != triggers_root.end(); ++iter)
 			{
-				Json::Value& trigger_json = *iter;
+				const Json::Value& trigger_json = *iter;
 
 				// Make sure we hae a class parameter
 				if (!trigger_json.isMember("class"))
@@ -387,7 +396,7 @@ void stack_cue_from_json_base(StackCue *cue, const char *json_data)
 
 				// Call constructor
 				free(class_name);
-				stack_trigger_from_json(trigger, trigger_json.toStyledString().c_str());
+				stack_trigger_from_json_value(trigger, trigger_json);
 
 				// Append the trigger to the cue
 				stack_cue_add_trigger(cue, trigger);
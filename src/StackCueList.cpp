@@ -2,14 +2,23 @@
 #include "StackCue.h"
 #include "StackLog.h"
 #include "StackJson.h"
+#include "StackAudioFile.h"
+#include "StackShowBinary.h"
+#include "StackCueListJournal.h"
+#include "StackCueListSnapshot.h"
 #include <list>
 #include <map>
+#include <algorithm>
 #include <cstring>
 #include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 // Pre-definitions:
 static void stack_cue_list_pulse_thread(StackCueList *cue_list);
+static void stack_cue_list_forget_saved_cue(StackCueList *cue_list, StackCue *cue);
 
 /// Creates a new cue list
 /// @param channels The number of audio channels to support
@@ -20,6 +29,14 @@ StackCueList *stack_cue_list_new(uint16_t channels)
 	// Empty variables
 	cue_list->audio_device = NULL;
 	cue_list->changed = false;
+	cue_list->change_batch_depth = 0;
+	cue_list->journal = NULL;
+	cue_list->events = stack_event_queue_create(STACK_CUE_LIST_EVENT_QUEUE_SIZE);
+	cue_list->meter_event_time = 0;
+	cue_list->save_state = STACK_CUE_LIST_SAVE_IDLE;
+	cue_list->save_progress = 0.0;
+	cue_list->save_uri = NULL;
+	cue_list->change_count = 0;
 	cue_list->uri = NULL;
 	cue_list->state_change_func = NULL;
 	cue_list->state_change_func_data = NULL;
@@ -32,6 +49,9 @@ StackCueList *stack_cue_list_new(uint16_t channels)
 
 	// Initialise a list
 	cue_list->cues = new StackCueStdList();
+	stack_cue_order_tree_init(&cue_list->cue_index.order);
+	cue_list->flat_cues_valid = true;
+	cue_list->structure_version = 0;
 
 	// Initialise the ring buffers
 	cue_list->buffers = new StackRingBuffer*[channels];
@@ -42,6 +62,7 @@ StackCueList *stack_cue_list_new(uint16_t channels)
 
 	// Initialise a remap map
 	cue_list->uid_remap = new map<cue_uid_t, cue_uid_t>();
+	cue_list->media_prefetch = NULL;
 
 	// Initialise a map for storing RMS data
 	cue_list->rms_data = new map<cue_uid_t, StackChannelRMSData*>();
@@ -55,7 +76,8 @@ StackCueList *stack_cue_list_new(uint16_t channels)
 		cue_list->master_rms_data[i].peak_time = 0;
 	}
 
-	// Start the cue list pulsing thread
+	// Start copying the cues for snapshots, then the cue list pulsing thread
+	stack_cue_list_snapshot_start(cue_list);
 	cue_list->kill_thread = false;
 	cue_list->pulse_thread = std::thread(stack_cue_list_pulse_thread, cue_list);
 
@@ -88,6 +110,22 @@ void stack_cue_list_destroy(StackCueList *cue_list)
 	// Stop the pulse thread
 	cue_list->kill_thread = true;
 	cue_list->pulse_thread.join();
+	stack_cue_list_snapshot_stop(cue_list);
+
+	// Let any save in progress finish writing the file
+	if (cue_list->save_thread.joinable())
+	{
+		cue_list->save_thread.join();
+	}
+	free(cue_list->save_uri);
+	cue_list->save_uri = NULL;
+
+	// We're closing the show, so we no longer need to be able to recover it
+	if (cue_list->journal)
+	{
+		stack_cue_list_journal_destroy(cue_list->journal);
+		cue_list->journal = NULL;
+	}
 
 	// Lock the cue list
 	stack_cue_list_lock(cue_list);
@@ -166,6 +204,7 @@ void stack_cue_list_destroy(StackCueList *cue_list)
 	delete [] cue_list->active_channels_cache;
 	delete [] cue_list->rms_cache;
 	delete [] cue_list->master_rms_data;
+	stack_event_queue_destroy(cue_list->events);
 
 	// Unlock the cue list
 	stack_cue_list_unlock(cue_list);
@@ -250,6 +289,201 @@ void stack_cue_list_set_audio_device(StackCueList *cue_list, StackAudioDevice *a
 	stack_cue_list_unlock(cue_list);
 }
 
+// Adds a cue and its children to the lookup tables if they're not already in
+// them. The cue_index_lock should be held whilst calling this
+// @returns Whether anything was added
+static bool stack_cue_list_index_add(StackCueList *cue_list, StackCue *cue)
+{
+	StackCueListIndex &cue_index = cue_list->cue_index;
+	bool added = false;
+
+	if (cue_index.by_uid.find(cue->uid) == cue_index.by_uid.end())
+	{
+		StackCueListIndexEntry &entry = cue_index.by_uid[cue->uid];
+		entry.cue = cue;
+		entry.id = cue->id;
+		entry.parent_cue = NULL;
+		entry.node = NULL;
+		cue_index.by_id.emplace(cue->id, cue);
+		added = true;
+	}
+
+	if (cue->can_have_children)
+	{
+		for (auto child_cue : *stack_cue_get_children(cue))
+		{
+			added = stack_cue_list_index_add(cue_list, child_cue) || added;
+		}
+	}
+
+	return added;
+}
+
+// Removes a cue from amongst those with its number in the lookup tables. The
+// cue_index_lock should be held whilst calling this
+static void stack_cue_list_index_remove_id(StackCueList *cue_list, StackCue *cue, cue_id_t id)
+{
+	auto range = cue_list->cue_index.by_id.equal_range(id);
+	for (auto id_iter = range.first; id_iter != range.second; ++id_iter)
+	{
+		if (id_iter->second == cue)
+		{
+			cue_list->cue_index.by_id.erase(id_iter);
+			return;
+		}
+	}
+}
+
+// Removes a cue and its children from the lookup tables. The cue_index_lock
+// should be held whilst calling this
+static void stack_cue_list_index_remove(StackCueList *cue_list, StackCue *cue)
+{
+	StackCueListIndex &cue_index = cue_list->cue_index;
+
+	auto entry = cue_index.by_uid.find(cue->uid);
+	if (entry != cue_index.by_uid.end())
+	{
+		stack_cue_list_index_remove_id(cue_list, cue, entry->second.id);
+		if (entry->second.node != NULL)
+		{
+			stack_cue_order_tree_erase(&cue_index.order, entry->second.node);
+		}
+		cue_index.by_uid.erase(entry);
+	}
+
+	if (cue->can_have_children)
+	{
+		for (auto child_cue : *stack_cue_get_children(cue))
+		{
+			stack_cue_list_index_remove(cue_list, child_cue);
+		}
+	}
+}
+
+// Marks the flattened cue list as out of date, after cues have been moved or
+// removed
+static void stack_cue_list_invalidate_flat(StackCueList *cue_list)
+{
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	cue_list->flat_cues_valid = false;
+	cue_list->structure_version++;
+}
+
+// Notes where the children of a top-level cue are in the lookup tables, and
+// how many there are in the order tree. Called whenever the children of a cue
+// change. The cue_index_lock should be held whilst calling this
+static void stack_cue_list_index_update_children(StackCueList *cue_list, StackCue *cue)
+{
+	StackCueListIndex &cue_index = cue_list->cue_index;
+
+	auto entry = cue_index.by_uid.find(cue->uid);
+	if (!cue->can_have_children || entry == cue_index.by_uid.end() || entry->second.node == NULL)
+	{
+		return;
+	}
+
+	StackCueStdList *children = stack_cue_get_children(cue);
+	for (auto child_iter = children->begin(); child_iter != children->end(); ++child_iter)
+	{
+		auto child_entry = cue_index.by_uid.find((*child_iter)->uid);
+		if (child_entry != cue_index.by_uid.end())
+		{
+			child_entry->second.iter = child_iter;
+			child_entry->second.parent_cue = cue;
+			child_entry->second.node = NULL;
+		}
+	}
+
+	stack_cue_order_tree_set_weight(entry->second.node, 1 + children->size());
+}
+
+// Notes the position of a cue that has just been put in the top-level of the
+// cue list. The cue must already be in the lookup tables. The cue_index_lock
+// should be held whilst calling this
+// @param iter The position of the cue in the cue list
+// @param index The index of the cue amongst the top-level cues
+static void stack_cue_list_index_insert(StackCueList *cue_list, StackCueStdList::iterator iter, size_t index)
+{
+	StackCueListIndexEntry &entry = cue_list->cue_index.by_uid[(*iter)->uid];
+	entry.iter = iter;
+	entry.parent_cue = NULL;
+	entry.node = stack_cue_order_tree_insert(&cue_list->cue_index.order, index, *iter, 1);
+	stack_cue_list_index_update_children(cue_list, *iter);
+}
+
+// Takes a cue out of the list that holds it (either the cue list itself or the
+// children of a group), and notes that it no longer has a position. The cue
+// stays in the lookup tables. The cue_index_lock should be held whilst calling
+// this
+// @returns Whether the cue was in a list
+static bool stack_cue_list_index_detach(StackCueList *cue_list, StackCue *cue)
+{
+	StackCueListIndex &cue_index = cue_list->cue_index;
+
+	auto entry = cue_index.by_uid.find(cue->uid);
+	if (entry == cue_index.by_uid.end())
+	{
+		return false;
+	}
+
+	if (entry->second.parent_cue != NULL)
+	{
+		StackCue *parent_cue = entry->second.parent_cue;
+		stack_cue_get_children(parent_cue)->erase(entry->second.iter);
+		entry->second.parent_cue = NULL;
+		stack_cue_list_index_update_children(cue_list, parent_cue);
+		return true;
+	}
+	else if (entry->second.node != NULL)
+	{
+		cue_list->cues->erase(entry->second.iter);
+		stack_cue_order_tree_erase(&cue_index.order, entry->second.node);
+		entry->second.node = NULL;
+		return true;
+	}
+
+	return false;
+}
+
+// Appends a cue and its children to a flattened cue list
+static void stack_cue_list_flatten(StackCueFlatList &flat_cues, StackCue *cue, uint32_t depth)
+{
+	const size_t position = flat_cues.size();
+	flat_cues.push_back(StackCueListFlatEntry{cue, depth, 1});
+
+	if (cue->can_have_children)
+	{
+		for (auto child_cue : *stack_cue_get_children(cue))
+		{
+			stack_cue_list_flatten(flat_cues, child_cue, depth + 1);
+		}
+	}
+
+	flat_cues[position].subtree_size = flat_cues.size() - position;
+}
+
+/// Gets the cues in the cue list (including children) as a contiguous array
+/// in the order that a recursive_iterator would visit them. This is rebuilt
+/// if the cue list has changed structure since it was last used. The cue list
+/// should be locked whilst calling this and whilst using the result, and cues
+/// shouldn't be added, moved or removed whilst iterating over it
+/// @param cue_list The cue list
+/// @returns The flattened cue list
+const StackCueFlatList &stack_cue_list_get_flat(StackCueList *cue_list)
+{
+	if (!cue_list->flat_cues_valid)
+	{
+		cue_list->flat_cues.clear();
+		for (auto cue : *cue_list->cues)
+		{
+			stack_cue_list_flatten(cue_list->flat_cues, cue, 0);
+		}
+		cue_list->flat_cues_valid = true;
+	}
+
+	return cue_list->flat_cues;
+}
+
 /// Returns the number of cues in the cue list
 /// @param cue_list The cue list
 size_t stack_cue_list_count(StackCueList *cue_list)
@@ -262,9 +496,22 @@ size_t stack_cue_list_count(StackCueList *cue_list)
 /// @param cue The cue to append.
 void stack_cue_list_append(StackCueList *cue_list, StackCue *cue)
 {
-	cue_list->changed = true;
 	cue_list->cues->push_back(cue);
 
+	// Add the cue to the lookup tables
+	{
+		std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+		stack_cue_list_index_add(cue_list, cue);
+		stack_cue_list_index_insert(cue_list, std::prev(cue_list->cues->end()), stack_cue_order_tree_size(&cue_list->cue_index.order));
+	}
+	if (cue_list->flat_cues_valid)
+	{
+		stack_cue_list_flatten(cue_list->flat_cues, cue, 0);
+	}
+	cue_list->structure_version++;
+
+	stack_cue_list_changed(cue_list, cue, NULL);
+
 	// Add a remap that remaps back to itself so that stack_*_cue_from_json
 	// can continue to work with cues in the cue list when pasting from the
 	// clipboard (as we only remap at load)
@@ -295,151 +542,137 @@ void stack_cue_list_move(StackCueList *cue_list, StackCue *cue, StackCue *dest,
 		return;
 	}
 
-	if (cue->parent_cue != NULL)
+	// Find the cue to move
 	{
-		StackCueStdList *children = stack_cue_get_children(cue->parent_cue);
-
-		// Search for the cue to move
-		for (auto iter = children->begin(); iter != children->end(); ++iter)
-		{
-			if (*iter == cue)
-			{
-				// If found, erase it from the list temporarily and stop searching
-				cue_list->changed = true;
-				children->erase(iter);
-				found_src = true;
-
-				// Cue is no longer a child
-				cue->parent_cue = NULL;
-				break;
-			}
-		}
+		std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+		auto entry = cue_list->cue_index.by_uid.find(cue->uid);
+		found_src = entry != cue_list->cue_index.by_uid.end() && (entry->second.parent_cue != NULL || entry->second.node != NULL);
 	}
-	else
+
+	if (found_src)
 	{
-		// Search for the cue to move
-		for (auto iter = cues->begin(); iter != cues->end(); ++iter)
+		// Note the change whilst the cue is still in its old group (if any),
+		// and then take it out of the list temporarily
+		stack_cue_list_changed(cue_list, cue, NULL);
 		{
-			if (*iter == cue)
-			{
-				// If found, erase it from the list temporarily and stop searching
-				cue_list->changed = true;
-				cues->erase(iter);
-				found_src = true;
-				break;
-			}
+			std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+			stack_cue_list_index_detach(cue_list, cue);
 		}
-	}
+		stack_cue_list_invalidate_flat(cue_list);
 
-	// If we found the cue, put it back in at it's new location
-	if (found_src)
-	{
-		for (auto iter = cues->recursive_begin(); iter != cues->recursive_end(); ++iter)
+		// Cue is no longer a child
+		cue->parent_cue = NULL;
+
+		// Put it back in at it's new location
+		auto iter = stack_cue_list_recursive_iter_at(cue_list, dest->uid, NULL);
+		if (iter != cues->recursive_end())
 		{
-			if (*iter == dest)
-			{
-				found_dest = true;
+			found_dest = true;
 
-				if (iter.is_child())
+			if (iter.is_child())
+			{
+				// If we're not expecting the destination to be in a child,
+				// leave the child list in the appropriate direction
+				if (!dest_in_child)
 				{
-					// If we're not expecting the destination to be in a child,
-					// leave the child list in the appropriate direction
-					if (!dest_in_child)
-					{
-						iter.leave_child(!before);
-					}
+					iter.leave_child(!before);
 				}
+			}
 
-				// Our destination cue could have changed by the above logic, so
-				// update it
-				dest = *iter;
+			// Our destination cue could have changed by the above logic, so
+			// update it
+			dest = *iter;
 
-				if (dest_in_child)
+			if (dest_in_child)
+			{
+				StackCueStdList *children = NULL;
+
+				// If we're expecting the destination to be a child, but the
+				// destination we've found is not a child, then move into the
+				// child and flip our before flag (i.e. after parent becomes
+				// before first child)
+				if (!iter.is_child())
 				{
-					StackCueStdList *children = NULL;
+					children = stack_cue_get_children(dest);
+					cue->parent_cue = dest;
 
-					// If we're expecting the destination to be a child, but the
-					// destination we've found is not a child, then move into the
-					// child and flip our before flag (i.e. after parent becomes
-					// before first child)
-					if (!iter.is_child())
-					{
-						children = stack_cue_get_children(dest);
-						cue->parent_cue = dest;
-
-						// Only move forward if the cue has children (as otherwise we'll
-						// move forward to the next cue)
-						if (children->size() != 0)
-						{
-							++iter;
-							before = true;
-							dest = *iter;
-						}
-					}
-					else
+					// Only move forward if the cue has children (as otherwise we'll
+					// move forward to the next cue)
+					if (children->size() != 0)
 					{
-						// The cue we're going to become a child of is the parent of the destination cue
-						children = stack_cue_get_children(dest->parent_cue);
-						cue->parent_cue = dest->parent_cue;
+						++iter;
+						before = true;
+						dest = *iter;
 					}
+				}
+				else
+				{
+					// The cue we're going to become a child of is the parent of the destination cue
+					children = stack_cue_get_children(dest->parent_cue);
+					cue->parent_cue = dest->parent_cue;
+				}
 
-					if (!before)
+				if (!before)
+				{
+					// If we're inserting after the destination cue, increment the
+					// iterator (as std::list::insert inserts before the iterator)
+					++iter;
+					if (!iter.is_child())
 					{
-						// If we're inserting after the destination cue, increment the
-						// iterator (as std::list::insert inserts before the iterator)
-						++iter;
-						if (!iter.is_child())
-						{
-							// If we're no longer in a child, which would be a mistake
-							// then go back and just append to the list instead
-							--iter;
-							children->push_back(cue);
-						}
-						else
-						{
-							children->insert(iter.child_iterator(), cue);
-						}
+						// If we're no longer in a child, which would be a mistake
+						// then go back and just append to the list instead
+						--iter;
+						children->push_back(cue);
 					}
 					else
 					{
-						if (children->size() == 0)
-						{
-							children->push_back(cue);
-						}
-						else
-						{
-							children->insert(iter.child_iterator(), cue);
-						}
+						children->insert(iter.child_iterator(), cue);
 					}
 				}
 				else
 				{
-					// If we're inserting after the destination cue, increment the
-					// iterator (as std::list::insert inserts before the iterator)
-					if (!before)
+					if (children->size() == 0)
 					{
-						++iter;
-						// If we're not expecting the destination to be in a child,
-						// leave the child list in the appropriate direction
-						if (iter.is_child() && !dest_in_child)
-						{
-							iter.leave_child(!before);
-						}
+						children->push_back(cue);
 					}
-
-					// Re-insert the cue in the main list
-					if (iter != cues->recursive_end())
+					else
 					{
-						cues->insert(iter.main_iterator(), cue);
+						children->insert(iter.child_iterator(), cue);
 					}
-					else
+				}
+
+				// Note where the group's children now are
+				std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+				stack_cue_list_index_update_children(cue_list, cue->parent_cue);
+			}
+			else
+			{
+				// If we're inserting after the destination cue, increment the
+				// iterator (as std::list::insert inserts before the iterator)
+				if (!before)
+				{
+					++iter;
+					// If we're not expecting the destination to be in a child,
+					// leave the child list in the appropriate direction
+					if (iter.is_child() && !dest_in_child)
 					{
-						stack_cue_list_append(cue_list, cue);
+						iter.leave_child(!before);
 					}
 				}
 
-				// Stop searching
-				break;
+				// Re-insert the cue in the main list, before the top-level
+				// cue that's at the position we want
+				if (iter != cues->recursive_end())
+				{
+					StackCueStdList::iterator next_iter = iter.main_iterator();
+					std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+					const size_t index = stack_cue_order_tree_index(cue_list->cue_index.by_uid[(*next_iter)->uid].node);
+					stack_cue_list_index_insert(cue_list, cues->insert(next_iter, cue), index);
+				}
+				else
+				{
+					stack_cue_list_append(cue_list, cue);
+				}
 			}
 		}
 	}
@@ -451,6 +684,10 @@ void stack_cue_list_move(StackCueList *cue_list, StackCue *cue, StackCue *dest,
 		stack_log("stack_cue_list_move(): ERROR: Didn't find destination, re-adding to main cue list\n");
 		stack_cue_list_append(cue_list, cue);
 	}
+
+	// The group the cue has moved in to (if any) must be saved again too
+	stack_cue_list_forget_saved_cue(cue_list, cue);
+	stack_cue_list_invalidate_flat(cue_list);
 }
 
 /// Returns an iterator to the cue list that is positioned on a certain cue, or
@@ -461,29 +698,27 @@ void stack_cue_list_move(StackCueList *cue_list, StackCue *cue, StackCue *dest,
 /// @returns An iterator
 StackCueStdList::iterator stack_cue_list_iter_at(StackCueList *cue_list, cue_uid_t cue_uid, size_t *index)
 {
-	size_t local_index = 0;
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	StackCueListIndex &cue_index = cue_list->cue_index;
 
-	StackCueStdList::iterator result = cue_list->cues->begin();
-	while (result != cue_list->cues->end() && (*result)->uid != cue_uid)
+	// Only top-level cues are found
+	auto entry = cue_index.by_uid.find(cue_uid);
+	if (entry == cue_index.by_uid.end() || entry->second.node == NULL)
 	{
-		local_index++;
-		result++;
+		if (index != NULL)
+		{
+			*index = -1;
+		}
+		return cue_list->cues->end();
 	}
 
 	// Return the index
 	if (index != NULL)
 	{
-		if (result == cue_list->cues->end())
-		{
-			*index = -1;
-		}
-		else
-		{
-			*index = local_index;
-		}
+		*index = stack_cue_order_tree_index(entry->second.node);
 	}
 
-	return result;
+	return entry->second.iter;
 }
 
 /// Returns a recursive iterator to the cue list that is positioned on a
@@ -494,29 +729,37 @@ StackCueStdList::iterator stack_cue_list_iter_at(StackCueList *cue_list, cue_uid
 /// @returns A recursive iterator
 StackCueStdList::recursive_iterator stack_cue_list_recursive_iter_at(StackCueList *cue_list, cue_uid_t cue_uid, size_t *index)
 {
-	size_t local_index = 0;
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	StackCueListIndex &cue_index = cue_list->cue_index;
 
-	StackCueStdList::recursive_iterator result = cue_list->cues->recursive_begin();
-	while (result != cue_list->cues->recursive_end() && (*result)->uid != cue_uid)
+	// Find the top-level cue that is, or contains, the cue
+	auto entry = cue_index.by_uid.find(cue_uid);
+	auto main_entry = cue_index.by_uid.end();
+	if (entry != cue_index.by_uid.end())
 	{
-		local_index++;
-		result++;
+		main_entry = entry->second.parent_cue != NULL ? cue_index.by_uid.find(entry->second.parent_cue->uid) : entry;
 	}
-
-	// Return the index
-	if (index != NULL)
+	if (main_entry == cue_index.by_uid.end() || main_entry->second.node == NULL)
 	{
-		if (result == cue_list->cues->recursive_end())
+		if (index != NULL)
 		{
 			*index = -1;
 		}
-		else
+		return cue_list->cues->recursive_end();
+	}
+
+	// Return the index, counting the children of the cues before it
+	const bool is_child = entry != main_entry;
+	if (index != NULL)
+	{
+		*index = stack_cue_order_tree_weight_before(main_entry->second.node);
+		if (is_child)
 		{
-			*index = local_index;
+			*index += 1 + std::distance(stack_cue_get_children(entry->second.parent_cue)->begin(), entry->second.iter);
 		}
 	}
 
-	return result;
+	return StackCueStdList::recursive_iterator(*cue_list->cues, main_entry->second.iter, entry->second.iter, is_child);
 }
 
 // Callback for cue pulsing timer
@@ -554,9 +797,10 @@ void stack_cue_list_pulse(StackCueList *cue_list)
 	// Iterate over all the cues. Note that we do this recursively, so that:
 	// a) cues with children don't need to pulse their children
 	// b) child cues can be played irrespective of whether their parent is playing
-	for (auto citer = cue_list->cues->recursive_begin(); citer != cue_list->cues->recursive_end(); ++citer)
+	const StackCueFlatList &flat_cues = stack_cue_list_get_flat(cue_list);
+	for (size_t i = 0; i < flat_cues.size(); i++)
 	{
-		StackCue *cue = *citer;
+		StackCue *cue = flat_cues[i].cue;
 
 		// If the cue is in one of the playing states
 		auto cue_state = cue->state;
@@ -582,14 +826,30 @@ void stack_cue_list_pulse(StackCueList *cue_list)
 	}
 
 	// Update master RMS peaks
+	bool meters_silent = true;
 	for (size_t channel = 0; channel < cue_list->channels; channel++)
 	{
 		if (clocktime - cue_list->master_rms_data[channel].peak_time > peak_hold_time)
 		{
 			cue_list->master_rms_data[channel].peak_level -= 0.1;
 		}
+
+		if (cue_list->master_rms_data[channel].current_level > STACK_CUE_LIST_METER_FLOOR || cue_list->master_rms_data[channel].peak_level > STACK_CUE_LIST_METER_FLOOR)
+		{
+			meters_silent = false;
+		}
 	}
 
+	// Let the UI know that the meters need redrawing (but not on every pulse)
+	if (!meters_silent && clocktime - cue_list->meter_event_time >= STACK_CUE_LIST_METER_EVENT_INTERVAL * NANOSECS_PER_MILLISEC)
+	{
+		stack_event_queue_push(cue_list->events, STACK_CUE_LIST_EVENT_METERS, 0);
+		cue_list->meter_event_time = clocktime;
+	}
+
+	// Publish a new snapshot for readers if it's due
+	stack_cue_list_snapshot_update(cue_list, clocktime);
+
 	// Track how long the cue pulses took
 	//stack_time_t cue_pulse_time = stack_get_clock_time() - clocktime;
 
@@ -617,125 +877,457 @@ void stack_cue_list_unlock(StackCueList *cue_list)
 /// @param cue_list The cue list
 void stack_cue_list_stop_all(StackCueList *cue_list)
 {
-	// Lock the cue list
+	// Lock the cue list
+	stack_cue_list_lock(cue_list);
+
+	// Iterate over all the cues
+	const StackCueFlatList &flat_cues = stack_cue_list_get_flat(cue_list);
+	for (size_t i = 0; i < flat_cues.size(); i++)
+	{
+		StackCue *cue = flat_cues[i].cue;
+		if ((cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST) || cue->state == STACK_CUE_STATE_PAUSED)
+		{
+			// Stop the cue
+			stack_cue_stop(cue);
+		}
+	}
+
+	// Unlock the cue list
+	stack_cue_list_unlock(cue_list);
+}
+
+/// Builds the parts of the JSON document that represents the cue list other
+/// than the cues themselves, leaving an empty 'cues' array. The cue list
+/// should be locked whilst calling this
+/// @param cue_list The cue list
+/// @param root The value to write the document to
+static void stack_cue_list_settings_to_json_value(StackCueList *cue_list, Json::Value &root)
+{
+	root["show_name"] = cue_list->show_name;
+	root["designer"] = cue_list->show_designer;
+	root["revision"] = cue_list->show_revision;
+	root["channels"] = cue_list->channels;
+	if (cue_list->audio_device)
+	{
+		root["audio_device_class"] = cue_list->audio_device->_class_name;
+		root["audio_device_sample_rate"] = cue_list->audio_device->sample_rate;
+		if (cue_list->audio_device->device_name != NULL)
+		{
+			root["audio_device_name"] = cue_list->audio_device->device_name;
+		}
+		else
+		{
+			root["audio_device_name"] = Json::nullValue;
+		}
+		root["audio_device_dither"] = cue_list->audio_device->dither;
+	}
+	root["cues"] = Json::Value(Json::ValueType::arrayValue);
+	root["config"] = Json::Value(Json::ValueType::objectValue);
+
+	// Save all our MIDI devices
+	root["midi_devices"] = Json::Value(Json::ValueType::objectValue);
+	for (auto midi_patch : cue_list->midi_devices)
+	{
+		stack_midi_device_to_json_value(midi_patch.second, root["midi_devices"][midi_patch.first]);
+	}
+
+	// Iterate over the trigger classes
+	for (auto citer : *stack_trigger_class_map_get())
+	{
+		// Get the class name
+		const char *class_name = citer.second->class_name;
+
+		char *trigger_config_json_data = stack_trigger_config_to_json(class_name);
+		if (trigger_config_json_data != NULL)
+		{
+			Json::Value trigger_config_root;
+			stack_json_read_string(trigger_config_json_data, &trigger_config_root);
+			root["config"][class_name] = trigger_config_root;
+			stack_trigger_config_free_json(class_name, trigger_config_json_data);
+		}
+	}
+}
+
+/// Builds the JSON document that represents the cue list. The cue list
+/// should be locked whilst calling this
+/// @param cue_list The cue list
+/// @param root The value to write the document to
+void stack_cue_list_to_json_value(StackCueList *cue_list, Json::Value &root)
+{
+	stack_cue_list_settings_to_json_value(cue_list, root);
+
+	// Iterate over all the cues, writing each directly in to the cues entry
+	Json::Value &cues_root = root["cues"];
+	for (auto cue : *cue_list->cues)
+	{
+		stack_cue_to_json_value(cue, cues_root.append(Json::Value()));
+	}
+}
+
+/// Writes a file such that after a crash either the old or new contents are
+/// present in their entirety. The data is written to a temporary file, synced
+/// to disk and then renamed over the original
+/// @param path The path of the file to write
+/// @param data The contents of the file
+/// @param size The size of the contents
+/// @param progress If not NULL, updated with the proportion of the file that
+/// has been written so far
+/// @returns A boolean indicating whether the file was written
+bool stack_cue_list_write_file(const char *path, const char *data, size_t size, std::atomic<double> *progress)
+{
+	// Keep the permissions of the file we're replacing
+	mode_t mode = 0666;
+	struct stat file_stat;
+	if (stat(path, &file_stat) == 0)
+	{
+		mode = file_stat.st_mode & 07777;
+	}
+
+	char *temp_path = g_strdup_printf("%s.tmp", path);
+	int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+	if (fd < 0)
+	{
+		stack_log("stack_cue_list_write_file(): Failed to create %s: %s\n", temp_path, strerror(errno));
+		g_free(temp_path);
+		return false;
+	}
+
+	// Write out the data a block at a time, so that we can report progress
+	const size_t total_size = size;
+	bool result = true;
+	int error = 0;
+	while (size > 0)
+	{
+		ssize_t written = write(fd, data, std::min(size, (size_t)(1024 * 1024)));
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (written <= 0)
+		{
+			// A short write of nothing doesn't set errno
+			error = written < 0 ? errno : ENOSPC;
+			result = false;
+			break;
+		}
+		data += written;
+		size -= written;
+
+		if (progress != NULL)
+		{
+			*progress = (double)(total_size - size) / (double)total_size;
+		}
+	}
+
+	// Make sure the data is on disk before it replaces the old file. Note
+	// errno as soon as anything fails, as close and unlink can change it
+	if (result && fsync(fd) != 0)
+	{
+		error = errno;
+		result = false;
+	}
+	close(fd);
+	if (result && rename(temp_path, path) != 0)
+	{
+		error = errno;
+		result = false;
+	}
+
+	if (result)
+	{
+		// Make sure the rename itself is on disk
+		char *directory = g_path_get_dirname(path);
+		int dir_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dir_fd >= 0)
+		{
+			fsync(dir_fd);
+			close(dir_fd);
+		}
+		g_free(directory);
+
+		if (progress != NULL)
+		{
+			*progress = 1.0;
+		}
+	}
+	else
+	{
+		stack_log("stack_cue_list_write_file(): Failed to write %s: %s\n", path, strerror(error));
+		unlink(temp_path);
+	}
+	g_free(temp_path);
+
+	return result;
+}
+
+// Writes a snapshot of a cue list to a file in the format chosen by its
+// extension. This doesn't touch the cue list, so is safe to run without it
+// being locked
+static bool stack_cue_list_write_snapshot(const Json::Value &root, const char *uri, std::atomic<double> *progress)
+{
+	// Encode the show in the format chosen by the file extension
+	std::string output;
+	if (stack_show_binary_uri_is_binary(uri))
+	{
+		stack_show_binary_encode(root, output);
+	}
+	else
+	{
+		Json::StreamWriterBuilder builder;
+		output = Json::writeString(builder, root);
+	}
+
+	GFile *file = g_file_new_for_uri(uri);
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	bool result = false;
+	char *path = g_file_get_path(file);
+	if (path != NULL)
+	{
+		result = stack_cue_list_write_file(path, output.data(), output.size(), progress);
+		g_free(path);
+	}
+	else
+	{
+		// Not a local file, so leave it to GIO to replace it as safely as
+		// the location allows
+		GError *error = NULL;
+		result = g_file_replace_contents(file, output.data(), output.size(), NULL, false, G_FILE_CREATE_NONE, NULL, NULL, &error);
+		if (!result)
+		{
+			stack_log("stack_cue_list_write_snapshot(): Failed to write %s: %s\n", uri, error->message);
+			g_error_free(error);
+		}
+		else if (progress != NULL)
+		{
+			*progress = 1.0;
+		}
+	}
+
+	// Tidy up
+	g_object_unref(file);
+
+	return result;
+}
+
+// A snapshot of a cue list taken to be saved: its settings, and the JSON of
+// each of its top-level cues, which is shared with the cue list's cache
+struct StackCueListSaveSnapshot
+{
+	Json::Value settings;
+	std::vector<std::shared_ptr<const Json::Value>> cues;
+};
+
+// Forgets the saved JSON of the top-level cue that a cue belongs to, so that
+// the next save serialises it again
+static void stack_cue_list_forget_saved_cue(StackCueList *cue_list, StackCue *cue)
+{
+	while (cue->parent_cue != NULL)
+	{
+		cue = cue->parent_cue;
+	}
+
+	std::unique_lock<std::mutex> lock(cue_list->saved_cues_lock);
+	cue_list->saved_cues.erase(cue->uid);
+}
+
+// Takes the snapshot of a cue list that will be saved. The cue list must not be
+// locked whilst calling this. Only the cues that have changed since the last
+// save are serialised (with the cue list locked, so that the snapshot is
+// consistent); the rest share the JSON from the last save. The document
+// itself is put together by stack_cue_list_build_save_document, which
+// doesn't need the lock
+static void stack_cue_list_take_save_snapshot(StackCueList *cue_list, StackCueListSaveSnapshot &snapshot)
+{
+	stack_cue_list_lock(cue_list);
+	stack_cue_list_settings_to_json_value(cue_list, snapshot.settings);
+
+	std::unique_lock<std::mutex> saved_cues_lock(cue_list->saved_cues_lock);
+	std::unordered_map<cue_uid_t, std::shared_ptr<const Json::Value>> saved_cues;
+	snapshot.cues.reserve(cue_list->cues->size());
+	for (auto cue : *cue_list->cues)
+	{
+		std::shared_ptr<const Json::Value> cue_json;
+		auto saved_cue = cue_list->saved_cues.find(cue->uid);
+		if (saved_cue != cue_list->saved_cues.end())
+		{
+			cue_json = saved_cue->second;
+		}
+		else
+		{
+			Json::Value *new_cue_json = new Json::Value();
+			stack_cue_to_json_value(cue, *new_cue_json);
+			cue_json.reset(new_cue_json);
+		}
+
+		snapshot.cues.push_back(cue_json);
+		saved_cues.emplace(cue->uid, cue_json);
+	}
+
+	// Only keep the cues that still exist
+	cue_list->saved_cues.swap(saved_cues);
+	saved_cues_lock.unlock();
+
+	// The snapshot holds every change so far, so any changes from here on
+	// will mark the cue list as changed again
+	cue_list->changed = false;
+	stack_cue_list_unlock(cue_list);
+}
+
+// Puts together the document to save from a snapshot taken by
+// stack_cue_list_take_save_snapshot. This doesn't touch the cue list, so is
+// safe to run on another thread
+static void stack_cue_list_build_save_document(const StackCueListSaveSnapshot &snapshot, Json::Value &root)
+{
+	root = snapshot.settings;
+	Json::Value &cues_root = root["cues"];
+	cues_root = Json::Value(Json::ValueType::arrayValue);
+	for (auto &cue_json : snapshot.cues)
+	{
+		cues_root.append(*cue_json);
+	}
+}
+
+// Starts a new journal for the cue list once it has been saved, as the file
+// now holds every change up to the save. The old journal's recovery files are
+// only deleted here, after the file has been written and renamed in to place.
+// Must be called on the UI thread without the cue list locked, as it waits for
+// the old journal's writer thread
+static void stack_cue_list_rotate_journal(StackCueList *cue_list, const char *uri)
+{
+	StackCueListJournal *journal = stack_cue_list_journal_new(cue_list, uri);
+
 	stack_cue_list_lock(cue_list);
+	StackCueListJournal *old_journal = cue_list->journal;
+	cue_list->journal = journal;
+	stack_cue_list_unlock(cue_list);
 
-	// Iterate over all the cues
-	for (auto citer = cue_list->cues->recursive_begin(); citer != cue_list->cues->recursive_end(); ++citer)
+	if (old_journal != NULL)
 	{
-		StackCue *cue = *citer;
-		if ((cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST) || cue->state == STACK_CUE_STATE_PAUSED)
-		{
-			// Stop the cue
-			stack_cue_stop(cue);
-		}
+		stack_cue_list_journal_destroy(old_journal);
 	}
+}
 
-	// Unlock the cue list
-	stack_cue_list_unlock(cue_list);
+// Waits for a background save to finish (without reporting its result), and
+// starts a new journal if it succeeded
+static void stack_cue_list_wait_for_save(StackCueList *cue_list)
+{
+	if (cue_list->save_thread.joinable())
+	{
+		cue_list->save_thread.join();
+	}
+	if (cue_list->save_state == STACK_CUE_LIST_SAVE_SUCCEEDED)
+	{
+		stack_cue_list_rotate_journal(cue_list, cue_list->save_uri);
+	}
+	free(cue_list->save_uri);
+	cue_list->save_uri = NULL;
+	cue_list->save_state = STACK_CUE_LIST_SAVE_IDLE;
+}
+
+// Thread that writes the snapshot taken by stack_cue_list_save_async
+static void stack_cue_list_save_thread(StackCueList *cue_list, StackCueListSaveSnapshot *snapshot)
+{
+	Json::Value root;
+	stack_cue_list_build_save_document(*snapshot, root);
+	delete snapshot;
+
+	const bool result = stack_cue_list_write_snapshot(root, cue_list->save_uri, &cue_list->save_progress);
+	cue_list->save_state = result ? STACK_CUE_LIST_SAVE_SUCCEEDED : STACK_CUE_LIST_SAVE_FAILED;
 }
 
-/// Saves the cue list to a file
+/// Saves the cue list to a file, waiting for it to be written. The cue list
+/// must not be locked whilst calling this (it is locked whilst the snapshot
+/// of it is taken). Must be called on the UI thread
 /// @param cue_list The cue list
 /// @param uri The URI of the path to save to (e.g. file:///home/blah/test.stack)
 /// @returns A boolean indicating whether the save was successful
 bool stack_cue_list_save(StackCueList *cue_list, const char *uri)
 {
-	// TODO: Better error checking
+	// Let any background save finish first, so that it can't overwrite us
+	stack_cue_list_wait_for_save(cue_list);
 
-	// Open the file
-	GFile *file = g_file_new_for_uri(uri);
-	if (file == NULL)
+	StackCueListSaveSnapshot snapshot;
+	stack_cue_list_take_save_snapshot(cue_list, snapshot);
+
+	Json::Value root;
+	stack_cue_list_build_save_document(snapshot, root);
+	if (!stack_cue_list_write_snapshot(root, uri, NULL))
 	{
+		cue_list->changed = true;
 		return false;
 	}
 
-	// Get a write stream
-	GFileOutputStream *stream = g_file_replace(file, NULL, false, G_FILE_CREATE_NONE, NULL, NULL);
-	if (stream == NULL)
+	stack_cue_list_rotate_journal(cue_list, uri);
+
+	return true;
+}
+
+/// Saves the cue list to a file in the background. A snapshot of the cue list
+/// is taken straight away, and is encoded and written on another thread so
+/// that neither the UI nor playback wait for it. The cue list must not be
+/// locked whilst calling this (it is locked whilst the snapshot of it is
+/// taken). Must be called on the UI thread. Use stack_cue_list_get_save_state
+/// to find out when the save has finished
+/// @param cue_list The cue list
+/// @param uri The URI of the path to save to (e.g. file:///home/blah/test.stack)
+/// @returns A boolean indicating whether the save was started, which it
+/// won't be if there is already a save in progress
+bool stack_cue_list_save_async(StackCueList *cue_list, const char *uri)
+{
+	if (cue_list->save_state == STACK_CUE_LIST_SAVE_RUNNING)
 	{
-		g_object_unref(file);
+		stack_log("stack_cue_list_save_async(): A save is already in progress\n");
 		return false;
 	}
 
-	Json::Value root;
-	root["show_name"] = cue_list->show_name;
-	root["designer"] = cue_list->show_designer;
-	root["revision"] = cue_list->show_revision;
-	root["channels"] = cue_list->channels;
-	if (cue_list->audio_device)
-	{
-		root["audio_device_class"] = cue_list->audio_device->_class_name;
-		root["audio_device_sample_rate"] = cue_list->audio_device->sample_rate;
-		if (cue_list->audio_device->device_name != NULL)
-		{
-			root["audio_device_name"] = cue_list->audio_device->device_name;
-		}
-		else
-		{
-			root["audio_device_name"] = Json::nullValue;
-		}
-	}
-	root["cues"] = Json::Value(Json::ValueType::arrayValue);
-	root["config"] = Json::Value(Json::ValueType::objectValue);
+	// Tidy up after any previous save that hasn't been reported
+	stack_cue_list_wait_for_save(cue_list);
 
-	// Save all our MIDI devices
-	root["midi_devices"] = Json::Value(Json::ValueType::objectValue);
-	for (auto midi_patch : cue_list->midi_devices)
-	{
-		Json::Value midi_device_root;
-		char *midi_device_json_data = stack_midi_device_to_json(midi_patch.second);
-		stack_json_read_string(midi_device_json_data, &midi_device_root);
-		stack_midi_device_free_json(midi_patch.second, midi_device_json_data);
-		root["midi_devices"][midi_patch.first] = midi_device_root;
-	}
+	StackCueListSaveSnapshot *snapshot = new StackCueListSaveSnapshot();
+	stack_cue_list_take_save_snapshot(cue_list, *snapshot);
 
-	// Iterate over all the cues
-	for (auto cue : *cue_list->cues)
-	{
-		// Get the JSON representation of the cue
-		Json::Value cue_root;
-		char *cue_json_data = stack_cue_to_json(cue);
-		stack_json_read_string(cue_json_data, &cue_root);
-		stack_cue_free_json(cue, cue_json_data);
+	cue_list->save_uri = strdup(uri);
+	cue_list->save_progress = 0.0;
+	cue_list->save_state = STACK_CUE_LIST_SAVE_RUNNING;
+	cue_list->save_thread = std::thread(stack_cue_list_save_thread, cue_list, snapshot);
 
-		// Add it to the cues entry
-		root["cues"].append(cue_root);
+	return true;
+}
+
+/// Gets the state of a background save. A finished save is reported only
+/// once, after which the state returns to STACK_CUE_LIST_SAVE_IDLE. Must be
+/// called on the UI thread
+/// @param cue_list The cue list
+/// @param progress If not NULL, receives the proportion of the file that has
+/// been written so far
+/// @returns The state of the save
+StackCueListSaveState stack_cue_list_get_save_state(StackCueList *cue_list, double *progress)
+{
+	const StackCueListSaveState state = (StackCueListSaveState)cue_list->save_state.load();
+	if (progress != NULL)
+	{
+		*progress = cue_list->save_progress;
 	}
 
-	// Iterate over the trigger classes
-	for (auto citer : *stack_trigger_class_map_get())
+	if (state == STACK_CUE_LIST_SAVE_SUCCEEDED || state == STACK_CUE_LIST_SAVE_FAILED)
 	{
-		// Get the class name
-		const char *class_name = citer.second->class_name;
+		stack_cue_list_wait_for_save(cue_list);
 
-		char *trigger_config_json_data = stack_trigger_config_to_json(class_name);
-		if (trigger_config_json_data != NULL)
+		// The file doesn't hold our changes after all
+		if (state == STACK_CUE_LIST_SAVE_FAILED)
 		{
-			Json::Value trigger_config_root;
-			stack_json_read_string(trigger_config_json_data, &trigger_config_root);
-			root["config"][class_name] = trigger_config_root;
-			stack_trigger_config_free_json(class_name, trigger_config_json_data);
+			cue_list->changed = true;
 		}
 	}
 
-	Json::StreamWriterBuilder builder;
-	std::string output = Json::writeString(builder, root);
-
-	// Write to the output stream
-	g_output_stream_printf(G_OUTPUT_STREAM(stream), NULL, NULL, NULL, "%s", output.c_str());
-
-	// Tidy up
-	g_object_unref(stream);
-	g_object_unref(file);
-
-	// We've saved the cue list, so set it to not have been changed
-	cue_list->changed = false;
-
-	return true;
+	return state;
 }
 
-StackCue *stack_cue_list_create_cue_from_json(StackCueList *cue_list, Json::Value &cue_json, bool construct)
+StackCue *stack_cue_list_create_cue_from_json(StackCueList *cue_list, const Json::Value &cue_json, bool construct)
 {
 	// Make sure we have a class parameter
 	if (!cue_json.isMember("class"))
@@ -759,26 +1351,24 @@ StackCue *stack_cue_list_create_cue_from_json(StackCueList *cue_list, Json::Valu
 	}
 
 	// Create a new cue of the correct type
-	const char *class_name = cue_json["class"].asString().c_str();
-	StackCue *cue = stack_cue_new(class_name, cue_list);
+	const std::string class_name = cue_json["class"].asString();
+	StackCue *cue = stack_cue_new(class_name.c_str(), cue_list);
 	if (cue == NULL)
 	{
-		stack_log("stack_cue_list_create_cue_from_json(): Failed to create cue of type '%s', skipping\n", class_name);
+		stack_log("stack_cue_list_create_cue_from_json(): Failed to create cue of type '%s', skipping\n", class_name.c_str());
 		return NULL;
 	}
 
 	// Get the UID of the newly created cue and put a mapping from
-	// the old UID to the new UID. Also store it in the JSON object
-	// so that we can re-use it on the second loop
+	// the old UID to the new UID
 	(*cue_list->uid_remap)[cue_json["StackCue"]["uid"].asUInt64()] = cue->uid;
-	cue_json["_new_uid"] = (Json::UInt64)cue->uid;
 
 	// Call base constructor
-	stack_cue_from_json_base(cue, cue_json.toStyledString().c_str());
+	stack_cue_from_json_value_base(cue, cue_json);
 
 	if (construct)
 	{
-		stack_cue_from_json(stack_cue_get_by_uid(cue_json["_new_uid"].asUInt64()), cue_json.toStyledString().c_str());
+		stack_cue_from_json_value(cue, cue_json);
 	}
 
 	return cue;
@@ -796,15 +1386,65 @@ StackCue *stack_cue_list_create_cue_from_json_string(StackCueList *cue_list, con
 	return stack_cue_list_create_cue_from_json(cue_list, cue_root, construct);
 }
 
+/// Collects the URIs of the media files used by a cue (and its children) so
+/// that they can be opened ahead of time. By convention, cues that play a file
+/// store it in a 'file' member of their class data
+/// @param cue_json The JSON of the cue
+/// @param uris The vector to append URIs to
+static void stack_cue_list_collect_media(const Json::Value &cue_json, std::vector<std::string> &uris)
+{
+	if (!cue_json.isMember("class"))
+	{
+		return;
+	}
+
+	const Json::Value &cue_data = cue_json[cue_json["class"].asString()];
+	if (!cue_data.isObject())
+	{
+		return;
+	}
+
+	if (cue_data.isMember("file") && cue_data["file"].isString() && cue_data["file"].asString().length() > 0)
+	{
+		uris.push_back(cue_data["file"].asString());
+	}
+
+	// Recurse in to any child cues
+	if (cue_data.isMember("cues") && cue_data["cues"].isArray())
+	{
+		for (auto &child_json : cue_data["cues"])
+		{
+			stack_cue_list_collect_media(child_json, uris);
+		}
+	}
+}
+
+/// Context for reporting media prefetch progress
+struct StackCueListPrefetchProgress
+{
+	StackCueList *cue_list;
+	stack_cue_list_load_callback_t progress_callback;
+	void *progress_user_data;
+};
+
 /// Creates a new cue list using the contents of a file
 /// @param uri The URI of the path to read from (e.g. file:///home/blah/test.stack)
 /// @param audio_callback The callback function to pass to the audio device for requesting audio
 /// @param audio_callback_user_data Arbitrary data to pass to the audio_callback function
 /// @param progess_callback The callback function to notify on progress
 /// @param progess_user_data Arbitrary data to pass to the callback function
+/// @param recover_callback Called (on the loading thread) to ask whether to
+/// recover unsaved changes if the show wasn't closed cleanly. If NULL, they
+/// are not recovered
+/// @param recover_user_data Arbitrary data to pass to the recover_callback
 /// @returns A new cue list or NULL on error
-StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_audio_request_t audio_callback, void *audio_callback_user_data, stack_cue_list_load_callback_t progress_callback, void *progress_user_data)
+StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_audio_request_t audio_callback, void *audio_callback_user_data, stack_cue_list_load_callback_t progress_callback, void *progress_user_data, stack_cue_list_recover_callback_t recover_callback, void *recover_user_data)
 {
+	// Time each phase of the load
+	stack_time_t load_start_time = stack_get_clock_time();
+	stack_time_t read_time = 0, parse_time = 0, create_time = 0, media_time = 0, construct_time = 0;
+	stack_time_t phase_start_time = load_start_time;
+
 	if (progress_callback != NULL)
 	{
 		progress_callback(NULL, 0, "Opening file...", progress_user_data);
@@ -844,7 +1484,7 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 	g_object_unref(file_info);
 
 	// Allocate memory
-	std::vector<char> json_buffer(size + 1);
+	std::vector<char> file_buffer(size + 1);
 
 	if (progress_callback)
 	{
@@ -852,7 +1492,7 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 	}
 
 	// Read the file in to the buffer
-	if (g_input_stream_read(G_INPUT_STREAM(stream), &json_buffer[0], size, NULL, NULL) != size)
+	if (g_input_stream_read(G_INPUT_STREAM(stream), &file_buffer[0], size, NULL, NULL) != size)
 	{
 		stack_log("stack_cue_list_new_from_file(): Failed to read file\n");
 		g_object_unref(stream);
@@ -861,24 +1501,38 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 	}
 
 	// Null-terminate the string
-	json_buffer[size] = '\0';
+	file_buffer[size] = '\0';
 
 	// We don't need the file any more, tidy up
 	g_object_unref(stream);
 	g_object_unref(file);
+	read_time = stack_get_clock_time() - phase_start_time;
+	phase_start_time = stack_get_clock_time();
 
-	// Parse the JSON
+	// Parse the JSON (or decode the binary format)
 	if (progress_callback)
 	{
 		progress_callback(NULL, 0.03, "Parsing file...", progress_user_data);
 	}
 	Json::Value cue_list_root;
-	if (!stack_json_read_string(&json_buffer[0], &cue_list_root))
+	if (stack_show_binary_is_binary(&file_buffer[0], size))
+	{
+		if (!stack_show_binary_decode(&file_buffer[0], size, &cue_list_root))
+		{
+			stack_log("stack_cue_list_new_file_file(): Failed to decode binary show\n");
+			return NULL;
+		}
+	}
+	else if (!stack_json_read_string(&file_buffer[0], &cue_list_root))
 	{
 		stack_log("stack_cue_list_new_file_file(): Failed to parse show JSON\n");
 		return NULL;
 	}
 
+	// If the show wasn't closed cleanly last time, load it as it was (with
+	// any unsaved changes) instead, if that's what's wanted
+	const bool recovered = stack_cue_list_journal_recover(uri, &cue_list_root, recover_callback, recover_user_data);
+
 	// Validation: check we have 'channels'
 	if (!cue_list_root.isMember("channels"))
 	{
@@ -893,6 +1547,8 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 		return NULL;
 	}
 
+	parse_time = stack_get_clock_time() - phase_start_time;
+
 	// Generate a new cue list
 	StackCueList *cue_list = stack_cue_list_new(cue_list_root["channels"].asUInt());
 
@@ -937,7 +1593,7 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 			{
 				// Call the appropriate overloaded function
 				StackMidiDevice *mdev = stack_midi_device_new(mdev_root[patch]["class"].asString().c_str(), "", "");
-				stack_midi_device_from_json(mdev, mdev_root[patch].toStyledString().c_str());
+				stack_midi_device_from_json_value(mdev, mdev_root[patch]);
 				stack_cue_list_add_midi_device(cue_list, patch.c_str(), mdev);
 			}
 		}
@@ -954,7 +1610,7 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 	// If we have some cues...
 	if (cue_list_root.isMember("cues"))
 	{
-		Json::Value& cues_root = cue_list_root["cues"];
+		const Json::Value& cues_root = cue_list_root["cues"];
 
 		if (cues_root.isArray())
 		{
@@ -963,21 +1619,26 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 				progress_callback(cue_list, 0.1, "Preparing cue list...", progress_user_data);
 			}
 
+			phase_start_time = stack_get_clock_time();
+
+			// The cues we create on the first pass, so that we can re-use
+			// them on the second loop (NULL for cues we skipped)
+			std::vector<StackCue*> new_cues;
+			new_cues.reserve(cues_root.size());
+
 			// Iterate over the cues, creating their instances, and populating
 			// just their base classes (we need to have built a UID map)
 			int cue_count = 0;
 			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter)
 			{
-				Json::Value& cue_json = *iter;
-
 				// Create a new cue of the correct type
-				StackCue *cue = stack_cue_list_create_cue_from_json(cue_list, cue_json, false);
+				StackCue *cue = stack_cue_list_create_cue_from_json(cue_list, *iter, false);
+				new_cues.push_back(cue);
 				if (cue == NULL)
 				{
 					// TODO: It would be nice if we have some sort of "error cue" which
 					// contained the JSON for the cue, so we didn't just drop cues from
 					// the stack
-					cue_json["_skip"] = 1;
 					continue;
 				}
 
@@ -986,34 +1647,84 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 				cue_count++;
 			}
 
+			create_time = stack_get_clock_time() - phase_start_time;
+			phase_start_time = stack_get_clock_time();
+
+			// Opening and probing media files is the slowest part of loading a
+			// show (especially from network storage), but the constructors
+			// below must run in order on this thread. So open all the files in
+			// parallel first, and the constructors will pick them up from the
+			// cue list's prefetch set
+			std::vector<std::string> media_uris;
+			size_t index = 0;
+			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter, index++)
+			{
+				if (new_cues[index] != NULL)
+				{
+					stack_cue_list_collect_media(*iter, media_uris);
+				}
+			}
+			if (media_uris.size() > 0)
+			{
+				if (progress_callback)
+				{
+					progress_callback(cue_list, 0.2, "Opening media...", progress_user_data);
+				}
+
+				StackCueListPrefetchProgress prefetch_progress = { cue_list, progress_callback, progress_user_data };
+				cue_list->media_prefetch = stack_audio_file_prefetch(media_uris, [](size_t opened, size_t total, void *user_data) {
+					StackCueListPrefetchProgress *prefetch_progress = (StackCueListPrefetchProgress*)user_data;
+					if (prefetch_progress->progress_callback)
+					{
+						// We count 20% to 50% as opening media
+						double progress = 0.2 + ((double)opened * 0.3 / (double)total);
+						prefetch_progress->progress_callback(prefetch_progress->cue_list, progress, "Opening media...", prefetch_progress->progress_user_data);
+					}
+				}, &prefetch_progress);
+			}
+
+			media_time = stack_get_clock_time() - phase_start_time;
+			phase_start_time = stack_get_clock_time();
+
 			if (progress_callback)
 			{
-				progress_callback(cue_list, 0.2, "Initialising cues...", progress_user_data);
+				progress_callback(cue_list, 0.5, "Initialising cues...", progress_user_data);
 			}
 
-			// Iterate over the cues again calling their actual constructor
+			// Iterate over the cues again calling their actual constructor.
+			// This isn't batched, as the constructors rely on their property
+			// callbacks (e.g. an audio cue's file) running immediately
 			int prepared_cues = 0;
-			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter)
+			index = 0;
+			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter, index++)
 			{
-				Json::Value& cue_json = *iter;
-
 				// Skip over cues we skipped because of errors last time
-				if (cue_json.isMember("_skip"))
+				if (new_cues[index] == NULL)
 				{
 					continue;
 				}
 
 				// Call the appropriate overloaded function
-				stack_cue_from_json(stack_cue_get_by_uid(cue_json["_new_uid"].asUInt64()), cue_json.toStyledString().c_str());
+				stack_cue_from_json_value(new_cues[index], *iter);
 				prepared_cues++;
 
 				if (progress_callback)
 				{
-					// We count the first 20% as parsing the cue list
-					double progress = 0.2 + ((double)prepared_cues * 0.7 / (double)cue_count);
+					// We count the first 50% as parsing the cue list and
+					// opening media
+					double progress = 0.5 + ((double)prepared_cues * 0.4 / (double)cue_count);
 					progress_callback(cue_list, progress, "Initialising cues...", progress_user_data);
 				}
 			}
+
+			// Close any files that weren't used (e.g. if a cue failed to load)
+			if (cue_list->media_prefetch != NULL)
+			{
+				stack_audio_file_prefetch_destroy(cue_list->media_prefetch);
+				cue_list->media_prefetch = NULL;
+			}
+
+			construct_time = stack_get_clock_time() - phase_start_time;
 		}
 		else
 		{
@@ -1025,6 +1736,8 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 		stack_log("stack_cue_list_new_from_file(): Missing 'cues' option\n");
 	}
 
+	phase_start_time = stack_get_clock_time();
+
 	// Set up the audio device
 	progress_callback(cue_list, 0.9, "Initialising audio device...", progress_user_data);
 	if (cue_list_root.isMember("audio_device_class"))
@@ -1048,14 +1761,27 @@ StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_a
 		}
 
 		cue_list->audio_device = stack_audio_device_new(audio_device_class_name, audio_device_name, cue_list->channels, sample_rate, audio_callback, audio_callback_user_data);
+		if (cue_list->audio_device != NULL && cue_list_root.isMember("audio_device_dither"))
+		{
+			cue_list->audio_device->dither = cue_list_root["audio_device_dither"].asBool();
+		}
 	}
 
-	// Flag that the cue list hasn't changed
-	cue_list->changed = false;
+	stack_time_t device_time = stack_get_clock_time() - phase_start_time;
+	stack_log("stack_cue_list_new_from_file(): Loaded in %.3fs (read %.3fs, parse %.3fs, create cues %.3fs, open media %.3fs, construct cues %.3fs, audio device %.3fs)\n",
+		(double)(stack_get_clock_time() - load_start_time) / NANOSECS_PER_SEC_F, (double)read_time / NANOSECS_PER_SEC_F, (double)parse_time / NANOSECS_PER_SEC_F,
+		(double)create_time / NANOSECS_PER_SEC_F, (double)media_time / NANOSECS_PER_SEC_F, (double)construct_time / NANOSECS_PER_SEC_F, (double)device_time / NANOSECS_PER_SEC_F);
+
+	// Flag that the cue list hasn't changed (unless we recovered changes that
+	// haven't been saved)
+	cue_list->changed = recovered;
 
 	// Store the URI of the file we opened
 	cue_list->uri = strdup(uri);
 
+	// Start journaling changes so that we can recover from a crash
+	cue_list->journal = stack_cue_list_journal_new(cue_list, uri);
+
 	if (progress_callback)
 	{
 		progress_callback(cue_list, 1.0, "Ready", progress_user_data);
@@ -1072,6 +1798,18 @@ cue_uid_t stack_cue_list_remap(StackCueList *cue_list, cue_uid_t old_uid)
 	return (*cue_list->uid_remap)[old_uid];
 }
 
+// Marks the cue list as changed, and drops what we've cached about the cue
+static void stack_cue_list_mark_changed(StackCueList *cue_list, StackCue *cue)
+{
+	cue_list->changed = true;
+	cue_list->change_count++;
+	stack_cue_list_snapshot_invalidate(cue_list, NULL);
+	if (cue != NULL)
+	{
+		stack_cue_list_forget_saved_cue(cue_list, cue);
+	}
+}
+
 /// Called by child cues to let us know that something about them has changed
 /// (but not their state!)
 /// @param cue_list The cue list
@@ -1079,7 +1817,142 @@ cue_uid_t stack_cue_list_remap(StackCueList *cue_list, cue_uid_t old_uid)
 /// @param property The property that caused the change (could be NULL)
 void stack_cue_list_changed(StackCueList *cue_list, StackCue *cue, StackProperty *property)
 {
-	cue_list->changed = true;
+	stack_cue_list_mark_changed(cue_list, cue);
+
+	// If a change batch is open, hold back property changes until it's
+	// committed. Anything else is passed on straight away, as the cue may be
+	// about to be destroyed, but makes any property changes to the cue in the
+	// batch redundant, as the whole cue gets written to the journal
+	if (cue_list->change_batch_depth > 0 && cue != NULL)
+	{
+		auto result = cue_list->change_batch_changes.emplace(cue->uid, StackCueListPendingChange());
+		StackCueListPendingChange &change = result.first->second;
+		if (result.second)
+		{
+			change.whole_cue = false;
+			cue_list->change_batch_cues.push_back(cue->uid);
+		}
+
+		if (property != NULL)
+		{
+			if (!change.whole_cue && std::find(change.keys.begin(), change.keys.end(), property->key) == change.keys.end())
+			{
+				change.keys.push_back(property->key);
+			}
+			return;
+		}
+
+		change.whole_cue = true;
+		change.keys.clear();
+	}
+
+	// Anything other than a property change may have renumbered the cue or
+	// given it new children, so update the lookup tables
+	if (property == NULL && cue != NULL)
+	{
+		std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+		StackCueListIndex &cue_index = cue_list->cue_index;
+		auto entry = cue_index.by_uid.find(cue->uid);
+		if (entry != cue_index.by_uid.end())
+		{
+			if (entry->second.id != cue->id)
+			{
+				stack_cue_list_index_remove_id(cue_list, cue, entry->second.id);
+				cue_index.by_id.emplace(cue->id, cue);
+				entry->second.id = cue->id;
+			}
+
+			if (cue->can_have_children && stack_cue_list_index_add(cue_list, cue))
+			{
+				stack_cue_list_index_update_children(cue_list, cue);
+				cue_list->flat_cues_valid = false;
+				cue_list->structure_version++;
+			}
+		}
+	}
+
+	if (cue_list->journal)
+	{
+		stack_cue_list_journal_record(cue_list->journal, cue, property);
+	}
+}
+
+/// Starts a batch of changes to the cue list. Until the matching call to
+/// stack_cue_list_commit_changes, property change notifications (on this
+/// thread) are held back and de-duplicated, so that bulk operations such as
+/// renumbering don't cause a storm of callbacks. As every property callback is
+/// deferred, this isn't suitable where code relies on the callbacks having run
+/// (e.g. constructing cues from JSON). Batches may be nested. Must be called on
+/// the UI thread
+/// @param cue_list The cue list
+void stack_cue_list_begin_changes(StackCueList *cue_list)
+{
+	stack_property_batch_begin();
+	cue_list->change_batch_depth++;
+}
+
+/// Ends a batch of changes to the cue list started by
+/// stack_cue_list_begin_changes. When the outermost batch is committed, each
+/// property that changed is notified once, and then each cue that still exists
+/// makes one change to the cue list covering all of its changed properties
+/// @param cue_list The cue list
+void stack_cue_list_commit_changes(StackCueList *cue_list)
+{
+	if (cue_list->change_batch_depth == 0)
+	{
+		stack_log("stack_cue_list_commit_changes(): Called without a batch\n");
+		return;
+	}
+
+	// Deliver the property notifications first, as these feed the cue list
+	// notifications we're holding back
+	stack_property_batch_commit();
+	if (--cue_list->change_batch_depth > 0)
+	{
+		return;
+	}
+
+	std::vector<cue_uid_t> cues;
+	std::unordered_map<cue_uid_t, StackCueListPendingChange> changes;
+	cues.swap(cue_list->change_batch_cues);
+	changes.swap(cue_list->change_batch_changes);
+
+	std::vector<StackProperty*> properties;
+	for (cue_uid_t uid : cues)
+	{
+		const StackCueListPendingChange &change = changes[uid];
+		if (change.whole_cue)
+		{
+			continue;
+		}
+
+		// The cue may have been removed during the batch
+		StackCue *cue = stack_cue_get_by_uid(uid);
+		if (cue == NULL || cue->parent != cue_list)
+		{
+			continue;
+		}
+
+		properties.clear();
+		for (stack_property_key_t key : change.keys)
+		{
+			StackProperty *property = stack_cue_get_property_by_key(cue, key);
+			if (property != NULL)
+			{
+				properties.push_back(property);
+			}
+		}
+		if (properties.empty())
+		{
+			continue;
+		}
+
+		stack_cue_list_mark_changed(cue_list, cue);
+		if (cue_list->journal)
+		{
+			stack_cue_list_journal_record_properties(cue_list->journal, cue, properties);
+		}
+	}
 }
 
 /// Called by child cues to let us know that their state has changed
@@ -1087,6 +1960,9 @@ void stack_cue_list_changed(StackCueList *cue_list, StackCue *cue, StackProperty
 /// @param cue The cue that caused the change (currently unused)
 void stack_cue_list_state_changed(StackCueList *cue_list, StackCue *cue)
 {
+	stack_cue_list_snapshot_invalidate(cue_list, cue);
+	stack_event_queue_push(cue_list->events, STACK_CUE_LIST_EVENT_STATE, cue->uid);
+
 	if (cue_list->state_change_func != NULL)
 	{
 		cue_list->state_change_func(cue_list, cue, cue_list->state_change_func_data);
@@ -1111,29 +1987,20 @@ void stack_cue_list_state_changed(StackCueList *cue_list, StackCue *cue)
 /// @param cue The cue to remove
 void stack_cue_list_remove(StackCueList *cue_list, StackCue *cue)
 {
-	// Iterate over all the cues
-	for (auto iter = cue_list->cues->recursive_begin(); iter != cue_list->cues->recursive_end(); ++iter)
+	// Take the cue out of the list that holds it, and out of the lookup tables
 	{
-		// If we've found the cue
-		if (*iter == cue)
+		std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+		if (!stack_cue_list_index_detach(cue_list, cue))
 		{
-			if (iter.is_child())
-			{
-				stack_cue_get_children(cue->parent_cue)->erase(iter.child_iterator());
-			}
-			else
-			{
-				// Erase it
-				cue_list->cues->erase(iter.main_iterator());
-			}
-
-			// Note that the cue list has been modified
-			stack_cue_list_changed(cue_list, cue, NULL);
-
-			// Stop searching
 			return;
 		}
+		stack_cue_list_index_remove(cue_list, cue);
 	}
+	cue_list->flat_cues_valid = false;
+	cue_list->structure_version++;
+
+	// Note that the cue list has been modified
+	stack_cue_list_changed(cue_list, cue, NULL);
 }
 
 /// Gets the cue that follows 'cue' in the 'cue_list'
@@ -1141,59 +2008,42 @@ void stack_cue_list_remove(StackCueList *cue_list, StackCue *cue)
 /// @param cue The cue to find the following cue of
 StackCue *stack_cue_list_get_cue_after(StackCueList *cue_list, StackCue *cue)
 {
-	// Iterate over all the cues
-	for (auto iter = cue_list->cues->begin(); iter != cue_list->cues->end(); ++iter)
-	{
-		// If we've found the cue
-		if (*iter == cue)
-		{
-			// Increment the iterator to the next cue
-			++iter;
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	StackCueListIndex &cue_index = cue_list->cue_index;
 
-			// If we're now past the end of the cue list
-			if (iter == cue_list->cues->end())
-			{
-				return NULL;
-			}
-			else
-			{
-				return *iter;
-			}
-		}
+	// Only top-level cues have a following cue
+	auto entry = cue_index.by_uid.find(cue->uid);
+	if (entry == cue_index.by_uid.end() || entry->second.node == NULL)
+	{
+		return NULL;
 	}
 
-	return NULL;
+	StackCueOrderNode *next = stack_cue_order_tree_at(&cue_index.order, stack_cue_order_tree_index(entry->second.node) + 1);
+	return next != NULL ? next->cue : NULL;
 }
 
 StackCue *stack_cue_list_get_cue_by_uid(StackCueList *cue_list, cue_uid_t uid)
 {
-	// Iterate over all the cues
-	for (auto cue : *cue_list->cues)
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	StackCueListIndex &cue_index = cue_list->cue_index;
+
+	// Only top-level cues are found
+	auto entry = cue_index.by_uid.find(uid);
+	if (entry == cue_index.by_uid.end() || entry->second.node == NULL)
 	{
-		if (cue->uid == uid)
-		{
-			return cue;
-		}
+		return NULL;
 	}
 
-	return NULL;
+	return entry->second.cue;
 }
 
 StackCue *stack_cue_list_get_cue_by_index(StackCueList *cue_list, size_t index)
 {
-	size_t count = 0;
-
-	// Iterate over all the cues
-	for (auto cue : *cue_list->cues)
-	{
-		if (count == index)
-		{
-			return cue;
-		}
-		count++;
-	}
+	std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+	StackCueListIndex &cue_index = cue_list->cue_index;
 
-	return NULL;
+	StackCueOrderNode *node = stack_cue_order_tree_at(&cue_index.order, index);
+	return node != NULL ? node->cue : NULL;
 }
 
 /// Gets the cue number that should be inserted next
@@ -1202,13 +2052,13 @@ cue_id_t stack_cue_list_get_next_cue_number(StackCueList *cue_list)
 {
 	cue_id_t max_cue_id = 0;
 
-	// Iterate over all the cues, searching for the maximum cue ID
-	for (auto iter = cue_list->cues->recursive_begin(); iter != cue_list->cues->recursive_end(); ++iter)
+	// The highest cue number is the last in the index
 	{
-		const StackCue* cue = *iter;
-		if (cue->id > max_cue_id)
+		std::unique_lock<std::mutex> lock(cue_list->cue_index_lock);
+		StackCueListIndex &cue_index = cue_list->cue_index;
+		if (!cue_index.by_id.empty() && cue_index.by_id.rbegin()->first > 0)
 		{
-			max_cue_id = cue->id;
+			max_cue_id = cue_index.by_id.rbegin()->first;
 		}
 	}
 
@@ -1316,9 +2166,10 @@ void stack_cue_list_populate_buffers(StackCueList *cue_list, size_t samples)
 	// their parent.
 	// TODO: I'm not sure I like this. Maybe we should call get_audio on any
 	// cue that has children.
-	for (auto citer = cue_list->cues->recursive_begin(); citer != cue_list->cues->recursive_end(); ++citer)
+	const StackCueFlatList &flat_cues = stack_cue_list_get_flat(cue_list);
+	for (size_t i = 0; i < flat_cues.size(); i++)
 	{
-		StackCue *cue = *citer;
+		StackCue *cue = flat_cues[i].cue;
 
 		// Skip cues that are not playing
 		if (cue->state != STACK_CUE_STATE_PLAYING_ACTION)
@@ -1326,12 +2177,9 @@ void stack_cue_list_populate_buffers(StackCueList *cue_list, size_t samples)
 			continue;
 		}
 
-		// If the cue is a child and the parent is playing, don't get the audio
-		// as we'll have gotten it from the parent already
-		if (cue->parent_cue != NULL && cue->parent_cue->state == STACK_CUE_STATE_PLAYING_ACTION)
-		{
-			continue;
-		}
+		// If the cue has children, we get their audio from it, so skip over
+		// them
+		i += flat_cues[i].subtree_size - 1;
 
 		// Reset clipping marker array (otherwise we'll set clipped on each subsequent cue)
 		memset(new_clipped, 0, cue_list->channels * sizeof(bool));
@@ -2,21 +2,34 @@
 #define _STACKCUELIST_H_INCLUDED
 
 // System includes:
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 // Things defined in this fine
 struct StackCueList;
+struct StackAudioFilePrefetch;
+struct StackCueListJournal;
+struct StackCueListSnapshot;
 
 // Typedefs:
 typedef void(*state_changed_t)(StackCueList*, StackCue*, void*);
 typedef void(*stack_cue_list_load_callback_t)(StackCueList*, double, const char*, void*);
+typedef bool(*stack_cue_list_recover_callback_t)(const char*, void*);
 
 // Includes
 #include "StackCue.h"
 #include "StackAudioDevice.h"
 #include "StackMidiDevice.h"
 #include "StackRPCSocket.h"
+#include "StackEventQueue.h"
+#include "StackCueOrderTree.h"
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
 #include <cstdint>
@@ -24,6 +37,38 @@ typedef void(*stack_cue_list_load_callback_t)(StackCueList*, double, const char*
 // Typedefs:
 typedef std::map<std::string, StackMidiDevice*> StackMidiDevicePatchMap;
 
+// The types of event the cue list sends to the UI through its event queue
+enum StackCueListEventType
+{
+	// A cue has changed state (the data is the UID of the cue)
+	STACK_CUE_LIST_EVENT_STATE = 0,
+
+	// A snapshot has been published whilst cues are running, so their running
+	// times have moved on (the data is the version of the snapshot)
+	STACK_CUE_LIST_EVENT_TIMES,
+
+	// The master levels have changed
+	STACK_CUE_LIST_EVENT_METERS,
+};
+
+// The number of events that can be waiting for the UI
+#define STACK_CUE_LIST_EVENT_QUEUE_SIZE 1024
+
+// How often to send meter events whilst there is anything to show (ms)
+#define STACK_CUE_LIST_METER_EVENT_INTERVAL 20
+
+// Levels (in dB) below which the meters are considered silent
+#define STACK_CUE_LIST_METER_FLOOR -120.0
+
+// The state of a background save
+enum StackCueListSaveState
+{
+	STACK_CUE_LIST_SAVE_IDLE = 0,
+	STACK_CUE_LIST_SAVE_RUNNING,
+	STACK_CUE_LIST_SAVE_SUCCEEDED,
+	STACK_CUE_LIST_SAVE_FAILED,
+};
+
 // Define StackCueStdList as a custom std::list<StackCue*> that has a custom
 // recursive_iterator that descends in to child cues
 class StackCueStdList : public std::list<StackCue*>
@@ -39,6 +84,7 @@ class StackCueStdList : public std::list<StackCue*>
 			public:
 				recursive_iterator(const recursive_iterator& other) = default;
 				recursive_iterator(StackCueStdList &cl) : cue_list(cl), main_iter(cl.begin()), child_iter(cl.end()), in_child(false) {}
+				recursive_iterator(StackCueStdList &cl, StackCueStdList::iterator main, StackCueStdList::iterator child, bool child_valid) : cue_list(cl), main_iter(main), child_iter(child_valid ? child : cl.end()), in_child(child_valid) {}
 
 				recursive_iterator begin() const
 				{
@@ -129,6 +175,76 @@ class StackCueStdList : public std::list<StackCue*>
 		}
 };
 
+// An entry in the lookup tables for a cue
+struct StackCueListIndexEntry
+{
+	// The cue
+	StackCue *cue;
+
+	// The cue number the cue is filed under in by_id
+	cue_id_t id;
+
+	// The remaining fields are set once the cue is in the cue list:
+
+	// The position of the cue in the list that holds it (either the cue list
+	// itself or the children of a group)
+	StackCueStdList::iterator iter;
+
+	// The cue that the cue is a child of (NULL for top-level cues)
+	StackCue *parent_cue;
+
+	// The node of a top-level cue in the order tree (NULL for children)
+	StackCueOrderNode *node;
+};
+
+// Lookup tables for the cues in a cue list, which are kept up to date as cues
+// are added, moved, removed and renumbered. The positions of the top-level
+// cues are kept in an order tree, weighted by the number of cues each covers
+// (including its children), so that converting between a cue and its index
+// (with or without children) is O(log n) however the cue list is changed
+struct StackCueListIndex
+{
+	// Every cue (including children) by UID
+	std::unordered_map<cue_uid_t, StackCueListIndexEntry> by_uid;
+
+	// The cues (including children) ordered by cue number
+	std::multimap<cue_id_t, StackCue*> by_id;
+
+	// The top-level cues in order
+	StackCueOrderTree order;
+};
+
+// A cue in the flattened cue list
+struct StackCueListFlatEntry
+{
+	// The cue
+	StackCue *cue;
+
+	// How deeply the cue is nested (zero for top-level cues)
+	uint32_t depth;
+
+	// The number of entries taken up by the cue and its children, so adding
+	// this to the position of the cue skips over its children
+	uint32_t subtree_size;
+};
+
+// The cues in a cue list, including children, in the order that a
+// recursive_iterator would visit them. Held contiguously so that the loops
+// that run on every pulse and audio buffer don't chase list nodes
+typedef std::vector<StackCueListFlatEntry> StackCueFlatList;
+
+// The changes made to a cue during a change batch (see
+// stack_cue_list_begin_changes)
+struct StackCueListPendingChange
+{
+	// Whether the cue has changed other than through its properties, in which
+	// case the change has already been passed on
+	bool whole_cue;
+
+	// The properties that have changed (in the order they first changed)
+	std::vector<stack_property_key_t> keys;
+};
+
 struct StackChannelRMSData
 {
 	float current_level;
@@ -143,6 +259,20 @@ struct StackCueList
 	// The array of cues (this is a std::list internally)
 	StackCueStdList *cues;
 
+	// Lookup tables for the cues (protected by cue_index_lock)
+	StackCueListIndex cue_index;
+	std::mutex cue_index_lock;
+
+	// The flattened cue list (see stack_cue_list_get_flat), which is
+	// protected by the cue list lock
+	StackCueFlatList flat_cues;
+	bool flat_cues_valid;
+
+	// Increases each time cues are added, moved or removed, so that anything
+	// that caches the layout of the list (e.g. the UI) can tell when it is out
+	// of date
+	std::atomic<uint64_t> structure_version;
+
 	// Channels - the number of channels configured for playback
 	uint16_t channels;
 
@@ -163,9 +293,61 @@ struct StackCueList
 	// Cue UID remapping. Used during loading.
 	std::map<cue_uid_t, cue_uid_t> *uid_remap;
 
+	// Media opened ahead of the cues whilst loading from a file, which only
+	// the cues of this cue list take from (NULL when not loading)
+	StackAudioFilePrefetch *media_prefetch;
+
 	// Changed since we were initialised?
 	bool changed;
 
+	// How many change batches are open on the cue list, and the changes held
+	// back by them: the cues in the order they first changed, and what changed
+	uint32_t change_batch_depth;
+	std::vector<cue_uid_t> change_batch_cues;
+	std::unordered_map<cue_uid_t, StackCueListPendingChange> change_batch_changes;
+
+	// The snapshot of the cue list for readers that don't take the lock (see
+	// StackCueListSnapshot.h), and when it was last published
+	std::shared_ptr<const StackCueListSnapshot> snapshot;
+	stack_time_t snapshot_time;
+
+	// The thread that copies the cues for snapshots. The latest copy, what has
+	// changed since it was made, and the cues whose state has changed since
+	// the last snapshot was published are protected by snapshot_lock
+	std::thread snapshot_thread;
+	std::mutex snapshot_lock;
+	std::condition_variable snapshot_condition;
+	bool snapshot_kill;
+	std::shared_ptr<const StackCueListSnapshot> snapshot_copy;
+	bool snapshot_rebuild;
+	std::unordered_set<cue_uid_t> snapshot_dirty_cues;
+	std::unordered_set<cue_uid_t> snapshot_state_cues;
+
+	// The cues that are running or paused (accessed only by the pulse thread)
+	std::vector<cue_uid_t> snapshot_active;
+
+	// The crash recovery journal (NULL until the cue list has been loaded
+	// from or saved to a file)
+	StackCueListJournal *journal;
+
+	// The thread that saves the cue list in the background, its state (a
+	// StackCueListSaveState), how much of the file has been written, and the
+	// URI it's writing to
+	std::thread save_thread;
+	std::atomic<int> save_state;
+	std::atomic<double> save_progress;
+	char *save_uri;
+
+	// Increases each time stack_cue_list_changed is called, so that a save
+	// can tell whether anything changed whilst it was taking its snapshot
+	std::atomic<uint64_t> change_count;
+
+	// The JSON of each top-level cue (including its children) as of the last
+	// save, which later saves share until the cue changes rather than
+	// serialising it again. Protected by saved_cues_lock
+	std::mutex saved_cues_lock;
+	std::unordered_map<cue_uid_t, std::shared_ptr<const Json::Value>> saved_cues;
+
 	// Ring buffers for audio
 	StackRingBuffer **buffers;
 
@@ -189,6 +371,11 @@ struct StackCueList
 	std::map<cue_uid_t, StackChannelRMSData*> *rms_data;
 	StackChannelRMSData *master_rms_data;
 
+	// Events for the UI (see StackCueListEventType), and when the last meter
+	// event was sent
+	StackEventQueue *events;
+	stack_time_t meter_event_time;
+
 	// Cache
 	bool *active_channels_cache;
 	float *rms_cache;
@@ -201,22 +388,29 @@ struct StackCueList
 
 // Functions: Cue list count
 StackCueList *stack_cue_list_new(uint16_t channels);
-StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_audio_request_t audio_callback, void *audio_callback_user_data, stack_cue_list_load_callback_t progress_callback = NULL, void *progress_user_data = NULL);
-StackCue *stack_cue_list_create_cue_from_json(StackCueList *cue_list, Json::Value &json, bool construct);
+StackCueList *stack_cue_list_new_from_file(const char *uri, stack_audio_device_audio_request_t audio_callback, void *audio_callback_user_data, stack_cue_list_load_callback_t progress_callback = NULL, void *progress_user_data = NULL, stack_cue_list_recover_callback_t recover_callback = NULL, void *recover_user_data = NULL);
+StackCue *stack_cue_list_create_cue_from_json(StackCueList *cue_list, const Json::Value &json, bool construct);
 StackCue *stack_cue_list_create_cue_from_json_string(StackCueList *cue_list, const char* json, bool construct);
 bool stack_cue_list_save(StackCueList *cue_list, const char *uri);
+bool stack_cue_list_save_async(StackCueList *cue_list, const char *uri);
+StackCueListSaveState stack_cue_list_get_save_state(StackCueList *cue_list, double *progress);
+bool stack_cue_list_write_file(const char *path, const char *data, size_t size, std::atomic<double> *progress = NULL);
+void stack_cue_list_to_json_value(StackCueList *cue_list, Json::Value &root);
 void stack_cue_list_destroy(StackCueList *cue_list);
 void stack_cue_list_set_audio_device(StackCueList *cue_list, StackAudioDevice *audio_device);
 size_t stack_cue_list_count(StackCueList *cue_list);
 void stack_cue_list_append(StackCueList *cue_list, StackCue *cue);
 StackCueStdList::iterator stack_cue_list_iter_at(StackCueList *cue_list, cue_uid_t cue_uid, size_t *index);
 StackCueStdList::recursive_iterator stack_cue_list_recursive_iter_at(StackCueList *cue_list, cue_uid_t cue_uid, size_t *index);
+const StackCueFlatList &stack_cue_list_get_flat(StackCueList *cue_list);
 void stack_cue_list_pulse(StackCueList *cue_list);
 void stack_cue_list_lock(StackCueList *cue_list);
 void stack_cue_list_unlock(StackCueList *cue_list);
 void stack_cue_list_stop_all(StackCueList *cue_list);
 cue_uid_t stack_cue_list_remap(StackCueList *cue_list, cue_uid_t old_uid);
 void stack_cue_list_changed(StackCueList *cue_list, StackCue *cue, StackProperty *property);
+void stack_cue_list_begin_changes(StackCueList *cue_list);
+void stack_cue_list_commit_changes(StackCueList *cue_list);
 void stack_cue_list_state_changed(StackCueList *cue_list, StackCue *cue);
 void stack_cue_list_remove(StackCueList *cue_list, StackCue *cue);
 void stack_cue_list_move(StackCueList *cue_list, StackCue *cue, StackCue *dest, bool before, bool dest_in_child);
@@ -2,6 +2,8 @@
 #include "StackCueListWidget.h"
 #include "StackLog.h"
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <glib-2.0/gobject/gsignal.h>
 
 #define RGBf(r, g, b) (float)(r) / 255.0f, (float)(g) / 255.0f, (float)(b) / 255.0f
@@ -22,6 +24,7 @@ typedef struct SCLWUpdateCue
 
 // Pre-defs:
 static bool stack_cue_list_content_widget_update_row(StackCueListContentWidget *sclw, StackCue *cue, SCLWColumnGeometry *geom, double row_y, const int32_t fields);
+static void stack_cue_list_content_widget_scroll_list_cache(StackCueListContentWidget *sclw);
 
 void stack_cue_list_content_widget_reload_icons(StackCueListContentWidget *sclw)
 {
@@ -59,6 +62,11 @@ GtkWidget *stack_cue_list_content_widget_new()
 	sclw->scriptref_width = 0;
 
 	sclw->cue_flags = SCLWCueFlagsMap();
+	sclw->row_index = new SCLWRowIndex;
+	sclw->row_index->cue_list = NULL;
+	sclw->row_index->structure_version = 0;
+	sclw->row_index->valid = false;
+	sclw->row_index->total_rows = 0;
 	stack_cue_list_content_widget_set_cue_list(sclw, NULL);
 
 	sclw->list_cr = NULL;
@@ -164,68 +172,233 @@ void stack_cue_list_content_widget_set_row_height(StackCueListContentWidget *scl
 	gdk_threads_add_idle(stack_cue_list_content_widget_idle_redraw, sclw);
 }
 
-/// @brief Takes an index within the list and returns the cue at that index, or NULL if there is not a cue
-/// @param sclw The cue list widget
-/// @param search_index The index
-/// @param placeholder_for If the entry at the index is a placeholder, return the cue it's a placeholder for
-/// @return A cue if a cue was found or NULL if there was an error or if the entry at the index was a placeholder
-StackCue *stack_cue_list_get_cue_at_index(StackCueListContentWidget *sclw, uint32_t search_index, StackCue **placeholder_for)
+// Returns the number of rows taken up by a top-level cue in the row index
+static int32_t stack_cue_list_content_widget_get_cue_rows(StackCueListContentWidget *sclw, const SCLWRowIndexCue &entry)
 {
+	if (entry.cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, entry.cue->uid))
+	{
+		// Expanded cues show their children, or a placeholder if they are empty
+		return 1 + (entry.child_count == 0 ? 1 : (int32_t)entry.child_count);
+	}
+
+	return 1;
+}
+
+// Rebuilds the row index from the cue list
+static void stack_cue_list_content_widget_build_row_index(StackCueListContentWidget *sclw)
+{
+	SCLWRowIndex *row_index = sclw->row_index;
+	row_index->cue_list = sclw->cue_list;
+	row_index->valid = true;
+	row_index->top_level.clear();
+	row_index->children.clear();
+	row_index->by_uid.clear();
+	row_index->total_rows = 0;
+
 	if (sclw->cue_list == NULL)
 	{
-		if (placeholder_for != NULL)
+		row_index->tree.assign(1, 0);
+		return;
+	}
+
+	row_index->structure_version = sclw->cue_list->structure_version;
+	row_index->top_level.reserve(sclw->cue_list->cues->size());
+
+	for (auto cue : *sclw->cue_list->cues)
+	{
+		const size_t position = row_index->top_level.size();
+		SCLWRowIndexCue entry{cue, row_index->children.size(), 0, 0};
+		row_index->by_uid[cue->uid] = SCLWRowIndexEntry{position, 0};
+
+		if (cue->can_have_children)
 		{
-			*placeholder_for = NULL;
+			StackCueStdList *children = stack_cue_get_children(cue);
+			if (children != NULL)
+			{
+				for (auto child_cue : *children)
+				{
+					entry.child_count++;
+					row_index->by_uid[child_cue->uid] = SCLWRowIndexEntry{position, (int32_t)entry.child_count};
+					row_index->children.push_back(child_cue);
+				}
+			}
 		}
-		return NULL;
+
+		entry.rows = stack_cue_list_content_widget_get_cue_rows(sclw, entry);
+		row_index->total_rows += entry.rows;
+		row_index->top_level.push_back(entry);
 	}
 
-	if (stack_cue_list_count(sclw->cue_list) == 0)
+	// Build the Fenwick tree in a single pass by adding each node on to its
+	// parent
+	const size_t count = row_index->top_level.size();
+	row_index->tree.assign(count + 1, 0);
+	for (size_t i = 1; i <= count; i++)
 	{
-		if (placeholder_for != NULL)
+		row_index->tree[i] += row_index->top_level[i - 1].rows;
+		const size_t parent = i + (i & -i);
+		if (parent <= count)
 		{
-			*placeholder_for = NULL;
+			row_index->tree[parent] += row_index->tree[i];
 		}
-		return NULL;
+	}
+}
+
+// Returns the row index, rebuilding it if the cue list has changed
+static SCLWRowIndex *stack_cue_list_content_widget_get_row_index(StackCueListContentWidget *sclw)
+{
+	SCLWRowIndex *row_index = sclw->row_index;
+	if (!row_index->valid || row_index->cue_list != sclw->cue_list || (sclw->cue_list != NULL && row_index->structure_version != sclw->cue_list->structure_version))
+	{
+		stack_cue_list_content_widget_build_row_index(sclw);
 	}
 
-	int32_t current_cue_index = 0;
+	return row_index;
+}
 
-	for (auto citer = sclw->cue_list->cues->recursive_begin(); citer != sclw->cue_list->cues->recursive_end();)
+// Returns the first row of the top-level cue at the given position
+static int32_t stack_cue_list_content_widget_row_index_prefix(const SCLWRowIndex *row_index, size_t position)
+{
+	int32_t row = 0;
+	for (size_t i = position; i > 0; i -= (i & -i))
 	{
-		StackCue *cue = *citer;
+		row += row_index->tree[i];
+	}
 
-		// If we're in a child cue and the parent isn't expanded, skip it
-		if (citer.is_child() && !stack_cue_list_content_widget_is_cue_expanded(sclw, cue->parent_cue->uid))
-		{
-			citer.leave_child(true);
-			continue;
-		}
+	return row;
+}
 
-		if (current_cue_index == search_index)
+// Finds the top-level cue whose rows include the given row, and the row
+// relative to the first row of that cue. Returns false if the row is outside
+// of the list
+static bool stack_cue_list_content_widget_row_index_find(const SCLWRowIndex *row_index, int32_t row, size_t *position, int32_t *offset)
+{
+	if (row < 0 || row >= row_index->total_rows)
+	{
+		return false;
+	}
+
+	// Find the number of top-level cues that end at or before the row by
+	// descending the tree from the largest power of two
+	const size_t count = row_index->top_level.size();
+	size_t step = 1;
+	while (step * 2 <= count)
+	{
+		step *= 2;
+	}
+
+	size_t found = 0;
+	for (; step > 0; step >>= 1)
+	{
+		if (found + step <= count && row_index->tree[found + step] <= row)
 		{
-			return cue;
+			found += step;
+			row -= row_index->tree[found];
 		}
+	}
+
+	*position = found;
+	*offset = row;
+	return true;
+}
+
+// Updates the number of rows taken up by a top-level cue after it has been
+// expanded or collapsed
+static void stack_cue_list_content_widget_row_index_update(StackCueListContentWidget *sclw, cue_uid_t uid)
+{
+	SCLWRowIndex *row_index = sclw->row_index;
+
+	// If the index is out of date, it'll pick up the change when it's rebuilt
+	if (!row_index->valid)
+	{
+		return;
+	}
+
+	auto iter = row_index->by_uid.find(uid);
+	if (iter == row_index->by_uid.end() || iter->second.offset != 0)
+	{
+		return;
+	}
+
+	SCLWRowIndexCue &entry = row_index->top_level[iter->second.top_level];
+	const int32_t rows = stack_cue_list_content_widget_get_cue_rows(sclw, entry);
+	const int32_t delta = rows - entry.rows;
+	if (delta == 0)
+	{
+		return;
+	}
+
+	entry.rows = rows;
+	row_index->total_rows += delta;
+	for (size_t i = iter->second.top_level + 1; i < row_index->tree.size(); i += (i & -i))
+	{
+		row_index->tree[i] += delta;
+	}
+}
+
+// Returns the row that a cue appears in, or -1 if the cue is not visible in the
+// list (either it's not in the cue list or it's the child of a collapsed cue)
+static int32_t stack_cue_list_content_widget_get_cue_row(StackCueListContentWidget *sclw, cue_uid_t cue_uid)
+{
+	SCLWRowIndex *row_index = stack_cue_list_content_widget_get_row_index(sclw);
+
+	auto iter = row_index->by_uid.find(cue_uid);
+	if (iter == row_index->by_uid.end())
+	{
+		return -1;
+	}
+
+	// Children of collapsed cues have an offset past the rows of their parent
+	if (iter->second.offset >= row_index->top_level[iter->second.top_level].rows)
+	{
+		return -1;
+	}
+
+	return stack_cue_list_content_widget_row_index_prefix(row_index, iter->second.top_level) + iter->second.offset;
+}
+
+/// @brief Takes an index within the list and returns the cue at that index, or NULL if there is not a cue
+/// @param sclw The cue list widget
+/// @param search_index The index
+/// @param placeholder_for If the entry at the index is a placeholder, return the cue it's a placeholder for
+/// @return A cue if a cue was found or NULL if there was an error or if the entry at the index was a placeholder
+StackCue *stack_cue_list_get_cue_at_index(StackCueListContentWidget *sclw, uint32_t search_index, StackCue **placeholder_for)
+{
+	if (placeholder_for != NULL)
+	{
+		*placeholder_for = NULL;
+	}
+
+	if (sclw->cue_list == NULL)
+	{
+		return NULL;
+	}
+
+	SCLWRowIndex *row_index = stack_cue_list_content_widget_get_row_index(sclw);
+	size_t position;
+	int32_t offset;
+	if (!stack_cue_list_content_widget_row_index_find(row_index, (int32_t)search_index, &position, &offset))
+	{
+		return NULL;
+	}
+
+	const SCLWRowIndexCue &entry = row_index->top_level[position];
+	if (offset == 0)
+	{
+		return entry.cue;
+	}
 
-		// Check if this is an empty, expanded cue that can have children and handle the placeholder special case
-		if (cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && stack_cue_get_children(cue)->size() == 0)
+	// Handle the placeholder for an empty, expanded cue that can have children
+	if (entry.child_count == 0)
+	{
+		if (placeholder_for != NULL)
 		{
-			++current_cue_index;
-			if (current_cue_index == search_index)
-			{
-				if (placeholder_for != NULL)
-				{
-					*placeholder_for = cue;
-				}
-				return NULL;
-			}
+			*placeholder_for = entry.cue;
 		}
-
-		++citer;
-		++current_cue_index;
+		return NULL;
 	}
 
-	return NULL;
+	return row_index->children[entry.first_child + offset - 1];
 }
 
 void stack_cue_list_content_widget_recalculate_top_cue(StackCueListContentWidget *sclw)
@@ -264,33 +437,7 @@ int32_t stack_cue_list_content_widget_get_visible_count(StackCueListContentWidge
 		return -1;
 	}
 
-	size_t count = stack_cue_list_count(sclw->cue_list);
-
-	// We don't use the recursive iterator here as this is easier
-	for (auto cue : *sclw->cue_list->cues)
-	{
-		if (cue->can_have_children)
-		{
-			StackCueStdList *children = stack_cue_get_children(cue);
-
-			// Determine if the queue is expanded
-			if (stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && children != NULL)
-			{
-				if (children->size() == 0)
-				{
-					// Cue is expanded but empty, count the placeholder
-					count++;
-				}
-				else
-				{
-					// Cue is expanded, add on the count of its subcues
-					count += children->size();
-				}
-			}
-		}
-	}
-
-	return count;
+	return stack_cue_list_content_widget_get_row_index(sclw)->total_rows;
 }
 
 void stack_cue_list_content_widget_update_height(StackCueListContentWidget *sclw)
@@ -338,41 +485,13 @@ int32_t stack_cue_list_content_widget_get_cue_y(StackCueListContentWidget *sclw,
 		return -1;
 	}
 
-	size_t index = 0;
-
-	for (auto citer = sclw->cue_list->cues->recursive_begin(); citer != sclw->cue_list->cues->recursive_end(); )
+	int32_t row = stack_cue_list_content_widget_get_cue_row(sclw, cue_uid);
+	if (row == -1)
 	{
-		StackCue *cue = *citer;
-
-		if (cue->uid == cue_uid)
-		{
-			return index * sclw->row_height;
-		}
-
-		if (citer.is_child())
-		{
-			if (!stack_cue_list_content_widget_is_cue_expanded(sclw, cue->parent_cue->uid))
-			{
-				// Increment to next main list cue
-				citer.leave_child(true);
-				continue;
-			}
-		}
-		else
-		{
-			// Leave a placeholder space for empty, expanded cues that can have children
-			if (cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && stack_cue_get_children(cue)->size() == 0)
-			{
-				index++;
-			}
-		}
-
-		// Increment to the next cue
-		index++;
-		++citer;
+		return -1;
 	}
 
-	return -1;
+	return row * sclw->row_height;
 }
 
 bool stack_cue_list_content_widget_ensure_cue_visible(StackCueListContentWidget *sclw, cue_uid_t cue)
@@ -417,8 +536,8 @@ bool stack_cue_list_content_widget_ensure_cue_visible(StackCueListContentWidget
 		// We've scrolled so we need to recalculate which cue is at the top of the list
 		stack_cue_list_content_widget_recalculate_top_cue(sclw);
 
-		// Redraw the entire list
-		stack_cue_list_content_widget_update_list_cache(sclw, 0, 0);
+		// Move the cached list to the new position
+		stack_cue_list_content_widget_scroll_list_cache(sclw);
 		gdk_threads_add_idle(stack_cue_list_content_widget_idle_redraw, sclw);
 	}
 
@@ -432,27 +551,13 @@ bool stack_cue_list_content_widget_is_cue_visible(StackCueListContentWidget *scl
 		return false;
 	}
 
-	// Ensure the cue is in the cue list (at early cue creation time, there's
-	// a possibility it isn't!)
-	bool found = false;
-	for (auto citer = sclw->cue_list->cues->recursive_begin(); citer != sclw->cue_list->cues->recursive_end(); citer++)
-	{
-		if ((*citer)->uid == cue)
-		{
-			found = true;
-			break;
-		}
-	}
-	if (!found)
-	{
-		return false;
-	}
-
 	// Calculate the Y location of the cue in the list
 	int32_t cue_y = stack_cue_list_content_widget_get_cue_y(sclw, cue);
 	if (cue_y == -1)
 	{
-		// Can't be visible if we don't have a Y component
+		// Can't be visible if we don't have a Y component (this includes cues
+		// that aren't in the cue list yet, which happens at early cue creation
+		// time)
 		return false;
 	}
 
@@ -482,46 +587,19 @@ int32_t stack_cue_list_content_widget_get_index_at_point(StackCueListContentWidg
 
 cue_uid_t stack_cue_list_content_widget_get_cue_at_point(StackCueListContentWidget *sclw, int32_t x, int32_t y)
 {
-	int32_t row_y = 0;
-
-	if (sclw->cue_list == NULL)
+	if (sclw->cue_list == NULL || y < 0)
 	{
 		return STACK_CUE_UID_NONE;
 	}
 
-	for (auto citer = sclw->cue_list->cues->recursive_begin(); citer != sclw->cue_list->cues->recursive_end(); )
+	// Placeholders don't count as a cue
+	StackCue *cue = stack_cue_list_get_cue_at_index(sclw, y / sclw->row_height, NULL);
+	if (cue == NULL)
 	{
-		StackCue *cue = *citer;
-
-		// Skip past child cues of unexpanded parents
-		if (citer.is_child())
-		{
-			if (!stack_cue_list_content_widget_is_cue_expanded(sclw, cue->parent_cue->uid))
-			{
-				// Increment to next main list cue
-				citer.leave_child(true);
-				continue;
-			}
-		}
-
-		if (y >= row_y && y < row_y + sclw->row_height)
-		{
-			return cue->uid;
-		}
-
-		// Leave space for placeholders
-		if (cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && stack_cue_get_children(cue)->size() == 0)
-		{
-			row_y += sclw->row_height;
-		}
-
-		// Increment to the next cue
-		row_y += sclw->row_height;
-		++citer;
+		return STACK_CUE_UID_NONE;
 	}
 
-	// Didn't find anything
-	return STACK_CUE_UID_NONE;
+	return cue->uid;
 }
 
 static gboolean stack_cue_list_content_widget_idle_update_cue(gpointer user_data)
@@ -552,6 +630,25 @@ void stack_cue_list_content_widget_update_cue(StackCueListContentWidget *sclw, c
 	}
 }
 
+// Like stack_cue_list_content_widget_update_cue, but updates the row straight
+// away rather than in an idle callback, so must be called on the UI thread.
+// The widget is redrawn once however many rows are refreshed before it is next
+// drawn
+void stack_cue_list_content_widget_refresh_cue(StackCueListContentWidget *sclw, cue_uid_t cue_uid, int32_t fields)
+{
+	if (!stack_cue_list_content_widget_is_cue_visible(sclw, cue_uid))
+	{
+		return;
+	}
+
+	stack_cue_list_content_widget_update_row(sclw, stack_cue_get_by_uid(cue_uid), NULL, -1, fields);
+	if (!sclw->redraw_pending)
+	{
+		gtk_widget_queue_draw(GTK_WIDGET(sclw));
+		sclw->redraw_pending = true;
+	}
+}
+
 void stack_cue_list_content_widget_render_text(StackCueListContentWidget *sclw, cairo_t *cr, double x, double y, double width, double height, const char *text, bool align_center, bool bold, GtkStyleContext *style_context)
 {
 	PangoContext *pc = gtk_widget_get_pango_context(GTK_WIDGET(sclw));
@@ -623,6 +720,9 @@ void stack_cue_list_content_widget_list_modified(StackCueListContentWidget *sclw
 		sclw->primary_selection = STACK_CUE_UID_NONE;
 	}
 
+	// The rows will have changed
+	sclw->row_index->valid = false;
+
 	// Re-calculate which cue is at the top as it could have changed
 	stack_cue_list_content_widget_recalculate_top_cue(sclw);
 
@@ -960,6 +1060,57 @@ static bool stack_cue_list_content_widget_update_row(StackCueListContentWidget *
 	return true;
 }
 
+// Fills part of the list cache with the background colour
+static void stack_cue_list_content_widget_render_background(StackCueListContentWidget *sclw, double y, double height)
+{
+	GtkStyleContext *style_context = gtk_style_context_new();
+	GtkWidgetPath *path = gtk_widget_path_new();
+	gtk_widget_path_append_type(path, G_TYPE_NONE);
+	gtk_widget_path_iter_set_object_name(path, -1, "treeview");
+	gtk_widget_path_iter_add_class(path, -1, "view");
+	gtk_widget_path_iter_set_state(path, -1, GTK_STATE_FLAG_NORMAL);
+	gtk_style_context_set_state(style_context, gtk_widget_path_iter_get_state(path, -1));
+	gtk_style_context_set_path(style_context, path);
+	gtk_render_background(style_context, sclw->list_cr, 0, y, sclw->list_cache_width, height);
+	gtk_widget_path_unref(path);
+	g_object_unref(style_context);
+}
+
+// Renders the rows that appear between two Y co-ordinates of the list cache.
+// Only the rows in that range are looked up, so this doesn't depend on the
+// length of the list. The cue list should be locked whilst calling this
+static void stack_cue_list_content_widget_render_rows(StackCueListContentWidget *sclw, SCLWColumnGeometry *geom, int32_t scroll_offset, int32_t from_y, int32_t to_y)
+{
+	if (to_y <= from_y)
+	{
+		return;
+	}
+
+	const int32_t first_row = (scroll_offset + from_y) / sclw->row_height;
+	const int32_t last_row = (scroll_offset + to_y - 1) / sclw->row_height;
+
+	for (int32_t row = first_row; row <= last_row; row++)
+	{
+		StackCue *placeholder_for = NULL;
+		StackCue *cue = stack_cue_list_get_cue_at_index(sclw, row, &placeholder_for);
+		const double row_y = (double)(row * sclw->row_height - scroll_offset);
+
+		if (cue != NULL)
+		{
+			stack_cue_list_content_widget_update_row(sclw, cue, geom, row_y, 0);
+		}
+		else if (placeholder_for != NULL)
+		{
+			stack_cue_list_content_widget_render_placeholder(sclw, geom, row_y);
+		}
+		else
+		{
+			// We've gone past the end of the list
+			break;
+		}
+	}
+}
+
 void stack_cue_list_content_widget_update_list_cache(StackCueListContentWidget *sclw, guint width, guint height)
 {
 	// Tidy up existing objects
@@ -998,17 +1149,7 @@ void stack_cue_list_content_widget_update_list_cache(StackCueListContentWidget *
 	stack_cue_list_content_widget_get_geometry(sclw, &geom);
 
 	// Fill the background
-	GtkStyleContext *style_context = gtk_style_context_new();
-	GtkWidgetPath *path = gtk_widget_path_new();
-	gtk_widget_path_append_type(path, G_TYPE_NONE);
-	gtk_widget_path_iter_set_object_name(path, -1, "treeview");
-	gtk_widget_path_iter_add_class(path, -1, "view");
-	gtk_widget_path_iter_set_state(path, -1, GTK_STATE_FLAG_NORMAL);
-	gtk_style_context_set_state(style_context, gtk_widget_path_iter_get_state(path, -1));
-	gtk_style_context_set_path(style_context, path);
-	gtk_render_background(style_context, sclw->list_cr, 0, 0, width, height);
-	gtk_widget_path_unref(path);
-	g_object_unref(style_context);
+	stack_cue_list_content_widget_render_background(sclw, 0, height);
 
 	// If we don't have a cue list then return
 	if (sclw->cue_list == NULL)
@@ -1019,66 +1160,76 @@ void stack_cue_list_content_widget_update_list_cache(StackCueListContentWidget *
 	// Lock the cue list
 	stack_cue_list_lock(sclw->cue_list);
 
-	// If we don't have a top cue currently, work it out
-	//if (sclw->top_cue == STACK_CUE_UID_NONE)
-	//{
-		stack_cue_list_content_widget_recalculate_top_cue(sclw);
-	//}
+	// Work out which cue is at the top
+	stack_cue_list_content_widget_recalculate_top_cue(sclw);
 
-	// Get an iterator over the cue list
-	size_t count = 0;
-	//double row_y = (double)-(stack_cue_list_content_widget_get_scroll_offset(sclw));
-	double row_y = -fmod(stack_cue_list_content_widget_get_scroll_offset(sclw), sclw->row_height);
-	bool found_first = false;
+	// Render the visible rows
+	const int32_t scroll_offset = stack_cue_list_content_widget_get_scroll_offset(sclw);
+	stack_cue_list_content_widget_render_rows(sclw, &geom, scroll_offset, 0, height);
+
+	// Store what we rendered
+	sclw->rendered_scroll_offset = scroll_offset;
 
-	for (auto citer = sclw->cue_list->cues->recursive_begin(); citer != sclw->cue_list->cues->recursive_end(); )
+	// Unlock the cue list
+	stack_cue_list_unlock(sclw->cue_list);
+}
+
+// Brings the list cache up to date with the current scroll offset. The rows
+// that are still visible are moved within the cache, and only the rows that
+// have scrolled into view are rendered
+static void stack_cue_list_content_widget_scroll_list_cache(StackCueListContentWidget *sclw)
+{
+	const int32_t scroll_offset = stack_cue_list_content_widget_get_scroll_offset(sclw);
+	const int32_t delta = scroll_offset - sclw->rendered_scroll_offset;
+	if (delta == 0 && sclw->list_surface != NULL)
 	{
-		StackCue *cue = *citer;
+		return;
+	}
 
-		if (citer.is_child())
-		{
-			if (!stack_cue_list_content_widget_is_cue_expanded(sclw, cue->parent_cue->uid))
-			{
-				// Increment to next main list cue
-				citer.leave_child(true);
-				continue;
-			}
-		}
+	// If there's nothing we can keep, render everything
+	if (sclw->list_surface == NULL || sclw->cue_list == NULL || sclw->rendered_scroll_offset < 0 || std::abs(delta) >= sclw->list_cache_height)
+	{
+		stack_cue_list_content_widget_update_list_cache(sclw, 0, 0);
+		return;
+	}
 
-		if (!found_first && cue->uid == sclw->top_cue)
-		{
-			found_first = true;
-		}
+	// Move the rows that are still visible. memmove copes with the source and
+	// destination overlapping
+	cairo_surface_flush(sclw->list_surface);
+	unsigned char *data = cairo_image_surface_get_data(sclw->list_surface);
+	const size_t stride = (size_t)cairo_image_surface_get_stride(sclw->list_surface);
+	const int32_t exposed_height = std::abs(delta);
+	const int32_t kept_height = sclw->list_cache_height - exposed_height;
+	int32_t exposed_y = 0;
+	if (delta > 0)
+	{
+		// Scrolled down, so the rows move up
+		memmove(data, data + exposed_height * stride, kept_height * stride);
+		exposed_y = kept_height;
+	}
+	else
+	{
+		// Scrolled up, so the rows move down
+		memmove(data + exposed_height * stride, data, kept_height * stride);
+	}
+	cairo_surface_mark_dirty(sclw->list_surface);
 
-		if (found_first)
-		{
-			bool rendered = stack_cue_list_content_widget_update_row(sclw, cue, &geom, row_y, 0);
-			if (!rendered)
-			{
-				break;
-			}
-			if (cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && stack_cue_get_children(cue)->size() == 0)
-			{
-				// Draw the placeholder and increment Y to account for its space
-				row_y += (double)sclw->row_height;
-				stack_cue_list_content_widget_render_placeholder(sclw, &geom, row_y);
-			}
-			row_y += (double)sclw->row_height;
-		}
+	// Get some geometry
+	SCLWColumnGeometry geom;
+	stack_cue_list_content_widget_get_geometry(sclw, &geom);
 
-		if (!found_first && cue->can_have_children && stack_cue_list_content_widget_is_cue_expanded(sclw, cue->uid) && stack_cue_get_children(cue)->size() == 0)
-		{
-			// Leave a gap for placeholder
-			row_y += (double)sclw->row_height;
-		}
+	// Lock the cue list
+	stack_cue_list_lock(sclw->cue_list);
 
-		// Increment to the next cue
-		++citer;
-		//row_y += (double)sclw->row_height;
-	}
+	// Work out which cue is at the top
+	stack_cue_list_content_widget_recalculate_top_cue(sclw);
+
+	// Render the rows that have scrolled into view
+	stack_cue_list_content_widget_render_background(sclw, exposed_y, exposed_height);
+	stack_cue_list_content_widget_render_rows(sclw, &geom, scroll_offset, exposed_y, exposed_y + exposed_height);
 
 	// Store what we rendered
-	sclw->rendered_scroll_offset = stack_cue_list_content_widget_get_scroll_offset(sclw);
+	sclw->rendered_scroll_offset = scroll_offset;
 
 	// Unlock the cue list
 	stack_cue_list_unlock(sclw->cue_list);
@@ -1109,11 +1260,16 @@ static gboolean stack_cue_list_content_widget_draw(GtkWidget *widget, cairo_t *c
 		stack_cue_list_content_widget_set_row_height(sclw, (text_size / PANGO_SCALE) + 13);
 	}
 
-	// Update list cache if necessary
-	if (sclw->list_surface == NULL || sclw->list_cache_width != width || sclw->list_cache_height != height || sclw->rendered_scroll_offset != stack_cue_list_content_widget_get_scroll_offset(sclw))
+	// Update list cache if necessary. If we've only scrolled, we can re-use
+	// most of what we've already rendered
+	if (sclw->list_surface == NULL || sclw->list_cache_width != width || sclw->list_cache_height != height)
 	{
 		stack_cue_list_content_widget_update_list_cache(sclw, width, height);
 	}
+	else if (sclw->rendered_scroll_offset != stack_cue_list_content_widget_get_scroll_offset(sclw))
+	{
+		stack_cue_list_content_widget_scroll_list_cache(sclw);
+	}
 
 	// Render the list
 	cairo_set_source_surface(cr, sclw->list_surface, 0, stack_cue_list_content_widget_get_scroll_offset(sclw));
@@ -1291,6 +1447,7 @@ void stack_cue_list_content_widget_toggle_selection(StackCueListContentWidget *s
 void stack_cue_list_content_widget_toggle_expansion(StackCueListContentWidget *sclw, cue_uid_t new_uid)
 {
 	stack_cue_list_content_widget_toggle_flag(sclw, new_uid, SCLW_FLAG_EXPANDED);
+	stack_cue_list_content_widget_row_index_update(sclw, new_uid);
 
 	// Recalculate the height of the widget
 	stack_cue_list_content_widget_update_height(sclw);
@@ -2019,6 +2176,7 @@ static void stack_cue_list_content_widget_finalize(GObject *obj)
 	{
 		cairo_destroy(sclw->list_cr);
 	}
+	delete sclw->row_index;
 
 	// Chain up
 	G_OBJECT_CLASS(stack_cue_list_content_widget_parent_class)->finalize(obj);
@@ -0,0 +1,587 @@
+// Includes:
+#include "StackCueListJournal.h"
+#include "StackShowBinary.h"
+#include "StackJson.h"
+#include "StackLog.h"
+#include "StackMediaCache.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <set>
+#include <unistd.h>
+
+// A piece of work for the writer thread
+struct StackCueListJournalJob
+{
+	// Whether this is a new snapshot (rather than lines to append)
+	bool snapshot;
+
+	// For snapshots: the generation and the show document
+	uint64_t generation;
+	Json::Value root;
+
+	// For appends: the lines to append
+	std::string text;
+};
+
+struct StackCueListJournal
+{
+	// The cue list being journaled
+	StackCueList *cue_list;
+
+	// The paths of the recovery files
+	char *snapshot_path;
+	char *journal_path;
+
+	// The size and modification time of the show file when journaling started
+	bool show_file_valid;
+	uint64_t show_file_size;
+	uint64_t show_file_mtime;
+
+	// The timer that writes changes to the journal
+	guint timer;
+
+	// Changes since they were last written (protected by pending_mutex):
+	// property values by cue UID, the UIDs of cues that must be written in
+	// full, and whether the order of the top-level cues must be written
+	std::mutex pending_mutex;
+	std::map<cue_uid_t, Json::Value> pending_properties;
+	std::set<cue_uid_t> pending_cues;
+	bool pending_order;
+
+	// Accessed only from the UI thread
+	bool started;
+	uint64_t generation;
+	size_t journal_size;
+
+	// The writer thread and its queue (protected by jobs_mutex)
+	std::thread writer_thread;
+	std::mutex jobs_mutex;
+	std::condition_variable jobs_condition;
+	std::deque<StackCueListJournalJob*> jobs;
+	bool kill_thread;
+
+	// The journal file, accessed only from the writer thread
+	int fd;
+};
+
+// Gets the path of a recovery file for a show
+static char *stack_cue_list_journal_get_path(const char *uri, const char *type)
+{
+	// Name the files after a hash of the URI so that shows with the same name
+	// in different directories don't collide
+	char *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri, -1);
+	char *filename = g_strdup_printf("%s.%s", hash, type);
+	char *path = g_build_filename(g_get_user_data_dir(), "stack", "recovery", filename, NULL);
+
+	// Tidy up
+	g_free(filename);
+	g_free(hash);
+
+	return path;
+}
+
+// Converts a JSON value to a single line of text
+static void stack_cue_list_journal_append_line(std::string &text, const Json::Value &value)
+{
+	static Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	text += Json::writeString(builder, value);
+	text += '\n';
+}
+
+// The writer thread
+static void stack_cue_list_journal_writer(StackCueListJournal *journal)
+{
+	// Make sure the directory exists
+	char *directory = g_path_get_dirname(journal->snapshot_path);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+
+	while (true)
+	{
+		StackCueListJournalJob *job = NULL;
+
+		// Wait for something to do
+		{
+			std::unique_lock<std::mutex> lock(journal->jobs_mutex);
+			journal->jobs_condition.wait(lock, [journal]() { return journal->kill_thread || !journal->jobs.empty(); });
+			if (journal->kill_thread)
+			{
+				break;
+			}
+			job = journal->jobs.front();
+			journal->jobs.pop_front();
+		}
+
+		if (job->snapshot)
+		{
+			// Write the snapshot first, then start a new journal. If we crash
+			// in between, the old journal won't match the new snapshot, so
+			// it'll be ignored (and the snapshot already contains its changes)
+			std::string snapshot;
+			stack_show_binary_encode(job->root, snapshot);
+
+			std::string header;
+			Json::Value header_root;
+			header_root["generation"] = (Json::UInt64)job->generation;
+			stack_cue_list_journal_append_line(header, header_root);
+
+			if (journal->fd >= 0)
+			{
+				close(journal->fd);
+				journal->fd = -1;
+			}
+			if (stack_cue_list_write_file(journal->snapshot_path, snapshot.data(), snapshot.size())
+				&& stack_cue_list_write_file(journal->journal_path, header.data(), header.size()))
+			{
+				journal->fd = open(journal->journal_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+			}
+		}
+		else if (journal->fd >= 0)
+		{
+			// Append to the journal. We stop journaling if this fails, as
+			// the journal would no longer be complete
+			if (write(journal->fd, job->text.data(), job->text.size()) != (ssize_t)job->text.size() || fdatasync(journal->fd) != 0)
+			{
+				stack_log("stack_cue_list_journal_writer(): Failed to write journal: %s\n", strerror(errno));
+				close(journal->fd);
+				journal->fd = -1;
+			}
+		}
+
+		delete job;
+	}
+
+	if (journal->fd >= 0)
+	{
+		close(journal->fd);
+		journal->fd = -1;
+	}
+}
+
+// Gets the top-level cue that contains a cue
+static StackCue *stack_cue_list_journal_get_top_level(StackCue *cue)
+{
+	while (cue->parent_cue != NULL)
+	{
+		cue = cue->parent_cue;
+	}
+	return cue;
+}
+
+// Writes any changes to the journal (or a new snapshot). Called periodically
+// on the UI thread
+static gboolean stack_cue_list_journal_timer(gpointer user_data)
+{
+	StackCueListJournal *journal = (StackCueListJournal*)user_data;
+	StackCueList *cue_list = journal->cue_list;
+
+	// Take the changes since last time
+	std::map<cue_uid_t, Json::Value> properties;
+	std::set<cue_uid_t> cues;
+	bool order = false;
+	{
+		std::unique_lock<std::mutex> lock(journal->pending_mutex);
+		properties.swap(journal->pending_properties);
+		cues.swap(journal->pending_cues);
+		order = journal->pending_order;
+		journal->pending_order = false;
+	}
+
+	const bool compact = !journal->started || journal->journal_size >= STACK_CUE_LIST_JOURNAL_COMPACT_SIZE;
+	if (!compact && properties.empty() && cues.empty() && !order)
+	{
+		return G_SOURCE_CONTINUE;
+	}
+
+	StackCueListJournalJob *job = new StackCueListJournalJob;
+	job->snapshot = compact;
+
+	stack_cue_list_lock(cue_list);
+
+	if (compact)
+	{
+		// Generations must always increase
+		journal->generation = std::max(journal->generation + 1, (uint64_t)g_get_real_time());
+		job->generation = journal->generation;
+
+		// A snapshot contains all the changes so far, so we don't need to
+		// write any of them individually
+		stack_cue_list_to_json_value(cue_list, job->root);
+		job->root["journal_generation"] = (Json::UInt64)journal->generation;
+		if (journal->show_file_valid)
+		{
+			job->root["journal_show_file_size"] = (Json::UInt64)journal->show_file_size;
+			job->root["journal_show_file_mtime"] = (Json::UInt64)journal->show_file_mtime;
+		}
+		journal->started = true;
+		journal->journal_size = 0;
+	}
+	else
+	{
+		// Find the top-level cues that need writing in full (which
+		// includes any groups that cues have been moved in to or out of)
+		std::set<cue_uid_t> top_level_cues;
+		for (auto cue : *cue_list->cues)
+		{
+			top_level_cues.insert(cue->uid);
+		}
+		std::set<cue_uid_t> full_cues;
+		for (cue_uid_t uid : cues)
+		{
+			StackCue *cue = stack_cue_get_by_uid(uid);
+			if (cue != NULL && cue->parent == cue_list)
+			{
+				cue_uid_t top_level_uid = stack_cue_list_journal_get_top_level(cue)->uid;
+				if (top_level_cues.find(top_level_uid) != top_level_cues.end())
+				{
+					full_cues.insert(top_level_uid);
+				}
+			}
+		}
+
+		// Property changes, except for cues we're writing in full
+		for (auto &cue_properties : properties)
+		{
+			StackCue *cue = stack_cue_get_by_uid(cue_properties.first);
+			if (cue == NULL || cue->parent != cue_list || full_cues.find(stack_cue_list_journal_get_top_level(cue)->uid) != full_cues.end())
+			{
+				continue;
+			}
+
+			Json::Value entry;
+			entry["op"] = "properties";
+			entry["uid"] = (Json::UInt64)cue_properties.first;
+			entry["values"].swap(cue_properties.second);
+			stack_cue_list_journal_append_line(job->text, entry);
+		}
+
+		// Cues in full
+		for (cue_uid_t uid : full_cues)
+		{
+			Json::Value entry;
+			entry["op"] = "cue";
+			entry["uid"] = (Json::UInt64)uid;
+			stack_cue_to_json_value(stack_cue_get_by_uid(uid), entry["cue"]);
+			stack_cue_list_journal_append_line(job->text, entry);
+		}
+
+		// The order of the cues
+		if (order)
+		{
+			Json::Value entry;
+			entry["op"] = "order";
+			Json::Value &order_root = entry["cues"];
+			order_root = Json::Value(Json::arrayValue);
+			for (auto cue : *cue_list->cues)
+			{
+				order_root.append((Json::UInt64)cue->uid);
+			}
+			stack_cue_list_journal_append_line(job->text, entry);
+		}
+
+		journal->journal_size += job->text.size();
+	}
+
+	stack_cue_list_unlock(cue_list);
+
+	// Hand over to the writer thread
+	{
+		std::unique_lock<std::mutex> lock(journal->jobs_mutex);
+		journal->jobs.push_back(job);
+	}
+	journal->jobs_condition.notify_one();
+
+	return G_SOURCE_CONTINUE;
+}
+
+StackCueListJournal *stack_cue_list_journal_new(StackCueList *cue_list, const char *uri)
+{
+	StackCueListJournal *journal = new StackCueListJournal();
+	journal->cue_list = cue_list;
+	journal->snapshot_path = stack_cue_list_journal_get_path(uri, "snapshot");
+	journal->journal_path = stack_cue_list_journal_get_path(uri, "journal");
+	journal->pending_order = false;
+
+	// Note which version of the show file the journal applies to
+	GFile *file = g_file_new_for_uri(uri);
+	journal->show_file_size = 0;
+	journal->show_file_mtime = 0;
+	journal->show_file_valid = stack_media_cache_get_key(file, &journal->show_file_size, &journal->show_file_mtime);
+	g_object_unref(file);
+
+	journal->started = false;
+	journal->generation = 0;
+	journal->journal_size = 0;
+	journal->kill_thread = false;
+	journal->fd = -1;
+
+	// Start the writer and the timer
+	journal->writer_thread = std::thread(stack_cue_list_journal_writer, journal);
+	journal->timer = g_timeout_add(STACK_CUE_LIST_JOURNAL_INTERVAL, stack_cue_list_journal_timer, journal);
+
+	return journal;
+}
+
+void stack_cue_list_journal_destroy(StackCueListJournal *journal)
+{
+	// Stop the timer and the writer thread (abandoning anything queued, as
+	// we're about to delete the files anyway)
+	g_source_remove(journal->timer);
+	{
+		std::unique_lock<std::mutex> lock(journal->jobs_mutex);
+		journal->kill_thread = true;
+	}
+	journal->jobs_condition.notify_one();
+	journal->writer_thread.join();
+	for (auto job : journal->jobs)
+	{
+		delete job;
+	}
+
+	// Only remove the files if we've replaced them with our own, otherwise
+	// they may hold changes that haven't been recovered yet
+	if (journal->started)
+	{
+		unlink(journal->journal_path);
+		unlink(journal->snapshot_path);
+	}
+
+	// Tidy up
+	g_free(journal->snapshot_path);
+	g_free(journal->journal_path);
+	delete journal;
+}
+
+void stack_cue_list_journal_record(StackCueListJournal *journal, StackCue *cue, StackProperty *property)
+{
+	if (cue == NULL)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(journal->pending_mutex);
+	if (property != NULL)
+	{
+		stack_property_write_json(property, &journal->pending_properties[cue->uid]);
+	}
+	else
+	{
+		// Note the cue and the top-level cue it's in now, as a cue being
+		// moved or removed also changes the group it was in
+		journal->pending_cues.insert(cue->uid);
+		journal->pending_cues.insert(stack_cue_list_journal_get_top_level(cue)->uid);
+		journal->pending_order = true;
+	}
+}
+
+void stack_cue_list_journal_record_properties(StackCueListJournal *journal, StackCue *cue, const std::vector<StackProperty*> &properties)
+{
+	if (cue == NULL || properties.empty())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(journal->pending_mutex);
+	Json::Value &cue_properties = journal->pending_properties[cue->uid];
+	for (StackProperty *property : properties)
+	{
+		stack_property_write_json(property, &cue_properties);
+	}
+}
+
+// Builds a map of the cues (including child cues) in a show document by UID
+static void stack_cue_list_journal_index(Json::Value &cues_root, std::map<cue_uid_t, Json::Value*> &index)
+{
+	for (Json::Value &cue_json : cues_root)
+	{
+		if (!cue_json.isObject() || !cue_json.isMember("StackCue"))
+		{
+			continue;
+		}
+		index[cue_json["StackCue"]["uid"].asUInt64()] = &cue_json;
+
+		// Look for child cues in any of the classes
+		for (Json::Value &class_json : cue_json)
+		{
+			if (class_json.isObject() && class_json.isMember("cues") && class_json["cues"].isArray())
+			{
+				stack_cue_list_journal_index(class_json["cues"], index);
+			}
+		}
+	}
+}
+
+// Applies an entry from the journal to a show document. The index is cleared
+// when the entry changes the structure of the document
+static void stack_cue_list_journal_apply(Json::Value &root, const Json::Value &entry, std::map<cue_uid_t, Json::Value*> &index, std::map<cue_uid_t, Json::Value> &detached_cues)
+{
+	if (index.empty())
+	{
+		stack_cue_list_journal_index(root["cues"], index);
+	}
+
+	const std::string op = entry["op"].asString();
+	const cue_uid_t uid = entry["uid"].asUInt64();
+	if (op == "properties")
+	{
+		auto iter = index.find(uid);
+		if (iter == index.end())
+		{
+			return;
+		}
+		Json::Value &cue_json = *iter->second;
+
+		for (auto value_iter = entry["values"].begin(); value_iter != entry["values"].end(); ++value_iter)
+		{
+			// Find the class the property belongs to, assuming it's the most
+			// derived class if it wasn't set before
+			const std::string name = value_iter.name();
+			Json::Value *class_json = &cue_json[cue_json["class"].asString()];
+			for (Json::Value &candidate : cue_json)
+			{
+				if (candidate.isObject() && candidate.isMember(name))
+				{
+					class_json = &candidate;
+					break;
+				}
+			}
+			(*class_json)[name] = *value_iter;
+		}
+	}
+	else if (op == "cue")
+	{
+		// Replace the cue if we have it. Either way keep a copy in case it's
+		// a new cue or has been moved to the top level
+		auto iter = index.find(uid);
+		if (iter != index.end())
+		{
+			*iter->second = entry["cue"];
+			index.clear();
+		}
+		detached_cues[uid] = entry["cue"];
+	}
+	else if (op == "order")
+	{
+		// Re-build the top-level cues in the new order, dropping any that
+		// are no longer present
+		std::map<cue_uid_t, Json::Value*> top_level_cues;
+		for (Json::Value &cue_json : root["cues"])
+		{
+			if (cue_json.isObject() && cue_json.isMember("StackCue"))
+			{
+				top_level_cues[cue_json["StackCue"]["uid"].asUInt64()] = &cue_json;
+			}
+		}
+
+		Json::Value cues_root(Json::arrayValue);
+		for (const Json::Value &uid_json : entry["cues"])
+		{
+			auto top_level_iter = top_level_cues.find(uid_json.asUInt64());
+			auto detached_iter = detached_cues.find(uid_json.asUInt64());
+			if (top_level_iter != top_level_cues.end())
+			{
+				cues_root.append(*top_level_iter->second);
+			}
+			else if (detached_iter != detached_cues.end())
+			{
+				cues_root.append(detached_iter->second);
+			}
+		}
+		root["cues"].swap(cues_root);
+		index.clear();
+
+		// Cues are always written with the order that places them
+		detached_cues.clear();
+	}
+}
+
+bool stack_cue_list_journal_recover(const char *uri, Json::Value *root, stack_cue_list_recover_callback_t confirm, void *user_data)
+{
+	char *snapshot_path = stack_cue_list_journal_get_path(uri, "snapshot");
+	char *journal_path = stack_cue_list_journal_get_path(uri, "journal");
+
+	// Read the snapshot. If there isn't one, the show was closed cleanly
+	char *snapshot = NULL;
+	gsize snapshot_size = 0;
+	Json::Value recovered_root;
+	bool result = g_file_get_contents(snapshot_path, &snapshot, &snapshot_size, NULL)
+		&& stack_show_binary_decode(snapshot, snapshot_size, &recovered_root);
+	g_free(snapshot);
+
+	// The recovery files only apply to the version of the show file they were
+	// written against. If the file has changed since (e.g. it was saved by
+	// another copy of Stack), they'd undo the changes made to it
+	if (result)
+	{
+		uint64_t show_file_size = 0, show_file_mtime = 0;
+		GFile *file = g_file_new_for_uri(uri);
+		const bool show_file_valid = stack_media_cache_get_key(file, &show_file_size, &show_file_mtime);
+		g_object_unref(file);
+
+		if (!show_file_valid || !recovered_root.isMember("journal_show_file_size") || !recovered_root.isMember("journal_show_file_mtime")
+			|| recovered_root["journal_show_file_size"].asUInt64() != show_file_size || recovered_root["journal_show_file_mtime"].asUInt64() != show_file_mtime)
+		{
+			stack_log("stack_cue_list_journal_recover(): Show file has changed since the recovery files were written, ignoring them\n");
+			result = false;
+		}
+	}
+
+	// Check that the changes are wanted before applying them
+	if (result && (confirm == NULL || !confirm(uri, user_data)))
+	{
+		stack_log("stack_cue_list_journal_recover(): Not recovering unsaved changes\n");
+		result = false;
+	}
+
+	char *journal = NULL;
+	if (result && g_file_get_contents(journal_path, &journal, NULL, NULL))
+	{
+		// Replay the journal, provided it follows this snapshot. We stop at
+		// the first line we can't read, which will have been cut short
+		const uint64_t generation = recovered_root["journal_generation"].asUInt64();
+		std::map<cue_uid_t, Json::Value*> index;
+		std::map<cue_uid_t, Json::Value> detached_cues;
+		size_t entries = 0;
+		char *saveptr = NULL;
+		for (char *line = strtok_r(journal, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr), entries++)
+		{
+			Json::Value entry;
+			if (!stack_json_read_string(line, &entry) || !entry.isObject())
+			{
+				break;
+			}
+
+			if (entries == 0)
+			{
+				if (entry["generation"].asUInt64() != generation)
+				{
+					stack_log("stack_cue_list_journal_recover(): Journal does not match snapshot, ignoring\n");
+					break;
+				}
+			}
+			else
+			{
+				stack_cue_list_journal_apply(recovered_root, entry, index, detached_cues);
+			}
+		}
+		g_free(journal);
+
+		stack_log("stack_cue_list_journal_recover(): Recovered show from snapshot and %lu journal entries\n", entries > 0 ? entries - 1 : 0);
+	}
+
+	if (result)
+	{
+		recovered_root.removeMember("journal_generation");
+		recovered_root.removeMember("journal_show_file_size");
+		recovered_root.removeMember("journal_show_file_mtime");
+		root->swap(recovered_root);
+	}
+
+	g_free(snapshot_path);
+	g_free(journal_path);
+
+	return result;
+}
@@ -0,0 +1,72 @@
+#ifndef _STACKCUELISTJOURNAL_H_INCLUDED
+#define _STACKCUELISTJOURNAL_H_INCLUDED
+
+// Includes:
+#include "StackCue.h"
+#include <json/json.h>
+#include <vector>
+
+// The journal keeps a recovery copy of a show up to date as it is edited, so
+// that unsaved changes survive a crash. It consists of a snapshot of the whole
+// show (in the binary show format) and an append-only file of the changes made
+// since the snapshot. Changes are collected as they happen and appended every
+// STACK_CUE_LIST_JOURNAL_INTERVAL milliseconds. Once the journal has grown
+// beyond STACK_CUE_LIST_JOURNAL_COMPACT_SIZE it is replaced by a new snapshot.
+// All file I/O happens on a background thread
+//
+// The snapshot also records the size and modification time of the show file it
+// was taken against, so that it's never applied to a different version of the
+// show. Each line of the journal is a JSON object. The first line holds the
+// generation of the snapshot the journal applies to, and the others are one
+// of:
+//   {"op": "properties", "uid": <cue>, "values": {<property>: <value>, ...}}
+//   {"op": "cue", "uid": <cue>, "cue": <the JSON of the whole cue>}
+//   {"op": "order", "cues": [<uid of each top-level cue>, ...]}
+
+// How often changes are written to the journal (milliseconds)
+#define STACK_CUE_LIST_JOURNAL_INTERVAL 500
+
+// The size the journal can grow to before it is compacted in to a snapshot
+#define STACK_CUE_LIST_JOURNAL_COMPACT_SIZE (4 * 1024 * 1024)
+
+// Functions:
+
+// Starts journaling changes to a cue list. The first snapshot is taken shortly
+// afterwards, so any existing recovery files for the show are left alone until
+// then
+// @param cue_list The cue list
+// @param uri The URI the cue list was loaded from or saved to
+StackCueListJournal *stack_cue_list_journal_new(StackCueList *cue_list, const char *uri);
+
+// Stops journaling and deletes the recovery files (as the show is being closed
+// or has been saved, so they are no longer needed). Must be called on the UI
+// thread
+// @param journal The journal
+void stack_cue_list_journal_destroy(StackCueListJournal *journal);
+
+// Records a change to a cue. Safe to call from any thread
+// @param journal The journal
+// @param cue The cue that has changed
+// @param property The property that has changed, or NULL if the cue has been
+// changed in some other way (or added, moved or removed)
+void stack_cue_list_journal_record(StackCueListJournal *journal, StackCue *cue, StackProperty *property);
+
+// Records a change to several properties of a cue at once. Safe to call from
+// any thread
+// @param journal The journal
+// @param cue The cue that has changed
+// @param properties The properties that have changed
+void stack_cue_list_journal_record_properties(StackCueListJournal *journal, StackCue *cue, const std::vector<StackProperty*> &properties);
+
+// Recovers the unsaved changes to a show that was not closed cleanly. The
+// recovery files are only used if the show file is the same version (by size
+// and modification time) that they were written against
+// @param uri The URI of the show
+// @param root Receives the recovered show document
+// @param confirm Called to ask whether to recover the changes once they've
+// been found to apply. If NULL, nothing is recovered
+// @param user_data Passed to the confirm callback
+// @returns Whether the changes were recovered. If not, root is unchanged
+bool stack_cue_list_journal_recover(const char *uri, Json::Value *root, stack_cue_list_recover_callback_t confirm, void *user_data);
+
+#endif
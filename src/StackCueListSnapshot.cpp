@@ -0,0 +1,364 @@
+// Includes:
+#include "StackCueListSnapshot.h"
+#include "StackLog.h"
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+
+// Returns whether a cue is running or paused (and so needs its running times
+// updating in each snapshot)
+static inline bool stack_cue_list_snapshot_is_active(StackCueState state)
+{
+	return state == STACK_CUE_STATE_PAUSED || (state >= STACK_CUE_STATE_PLAYING_PRE && state <= STACK_CUE_STATE_PLAYING_POST);
+}
+
+// Takes a copy of a cue for a snapshot. The cue list must be locked
+// @param entry The entry for the cue in the flattened cue list
+static std::shared_ptr<const StackCueSnapshot> stack_cue_list_snapshot_cue(const StackCueListFlatEntry &entry)
+{
+	StackCue *cue = entry.cue;
+	StackCueSnapshot *snapshot = new StackCueSnapshot();
+	snapshot->uid = cue->uid;
+	snapshot->parent_uid = (cue->parent_cue != NULL) ? cue->parent_cue->uid : STACK_CUE_UID_NONE;
+	snapshot->id = cue->id;
+	snapshot->state = cue->state;
+	snapshot->depth = entry.depth;
+	snapshot->subtree_size = entry.subtree_size;
+
+	// Display fields
+	snapshot->name = stack_cue_get_rendered_name(cue);
+	char *notes = NULL, *script_ref = NULL;
+	stack_property_get_string(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_NOTES), STACK_PROPERTY_VERSION_DEFINED, &notes);
+	stack_property_get_string(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_SCRIPT_REF), STACK_PROPERTY_VERSION_DEFINED, &script_ref);
+	snapshot->notes = (notes != NULL) ? notes : "";
+	snapshot->script_ref = (script_ref != NULL) ? script_ref : "";
+	snapshot->r = snapshot->g = snapshot->b = 0;
+	stack_property_get_uint8(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_R), STACK_PROPERTY_VERSION_DEFINED, &snapshot->r);
+	stack_property_get_uint8(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_G), STACK_PROPERTY_VERSION_DEFINED, &snapshot->g);
+	stack_property_get_uint8(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_B), STACK_PROPERTY_VERSION_DEFINED, &snapshot->b);
+
+	// Times
+	snapshot->pre_time = snapshot->action_time = snapshot->post_time = 0;
+	snapshot->post_trigger = STACK_CUE_WAIT_TRIGGER_NONE;
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_PRE_TIME), STACK_PROPERTY_VERSION_DEFINED, &snapshot->pre_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_ACTION_TIME), STACK_PROPERTY_VERSION_DEFINED, &snapshot->action_time);
+	stack_property_get_int64(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TIME), STACK_PROPERTY_VERSION_DEFINED, &snapshot->post_time);
+	stack_property_get_int32(stack_cue_get_property_by_key(cue, STACK_PROPERTY_KEY_POST_TRIGGER), STACK_PROPERTY_VERSION_DEFINED, &snapshot->post_trigger);
+
+	return std::shared_ptr<const StackCueSnapshot>(snapshot);
+}
+
+// Copies some of the cues in the cue list, locking the cue list for a chunk of
+// them at a time
+// @param cue_list The cue list
+// @param layout The flattened cue list, as it was at structure_version
+// @param structure_version The structure version of the cue list
+// @param positions The positions in layout of the cues to copy
+// @param chunk The number of cues to copy each time the cue list is locked
+// @param cues The list to store the copies in
+// @returns Whether the cues were copied, or false if the structure of the cue
+// list changed part of the way through (and so layout is out of date)
+static bool stack_cue_list_snapshot_copy_cues(StackCueList *cue_list, const StackCueFlatList &layout, uint64_t structure_version, const std::vector<size_t> &positions, size_t chunk, StackCueSnapshotList &cues)
+{
+	for (size_t start = 0; start < positions.size(); start += chunk)
+	{
+		stack_cue_list_lock(cue_list);
+		if (cue_list->structure_version != structure_version)
+		{
+			stack_cue_list_unlock(cue_list);
+			return false;
+		}
+
+		const size_t end = std::min(positions.size(), start + chunk);
+		for (size_t i = start; i < end; i++)
+		{
+			cues[positions[i]] = stack_cue_list_snapshot_cue(layout[positions[i]]);
+		}
+		stack_cue_list_unlock(cue_list);
+	}
+
+	return true;
+}
+
+// Makes a new copy of the cues for snapshots. The cue list must not be locked
+// @param cue_list The cue list
+// @param previous The previous copy
+// @param structure_version The structure version of the cue list when the
+// previous copy was made. Updated to match the new copy
+// @param rebuild Whether every cue needs copying again
+// @param dirty_cues The cues that need copying again otherwise
+static std::shared_ptr<const StackCueListSnapshot> stack_cue_list_snapshot_copy(StackCueList *cue_list, const std::shared_ptr<const StackCueListSnapshot> &previous, uint64_t &structure_version, bool rebuild, const std::unordered_set<cue_uid_t> &dirty_cues)
+{
+	for (size_t attempt = 0; ; attempt++)
+	{
+		// Get the current layout of the cue list. This is quick, as the
+		// entries are small and don't need the cues themselves looking at
+		stack_cue_list_lock(cue_list);
+		StackCueFlatList layout = stack_cue_list_get_flat(cue_list);
+		const uint64_t version = cue_list->structure_version;
+		stack_cue_list_unlock(cue_list);
+
+		// If the structure hasn't changed, we can keep the previous index
+		// and, unless every cue has to be copied, the unchanged cues
+		const bool same_structure = (version == structure_version && layout.size() == previous->cues->size());
+		StackCueSnapshotList *cues = NULL;
+		std::vector<size_t> positions;
+		if (same_structure && !rebuild)
+		{
+			cues = new StackCueSnapshotList(*previous->cues);
+			for (cue_uid_t uid : dirty_cues)
+			{
+				auto iter = previous->by_uid->find(uid);
+				if (iter != previous->by_uid->end())
+				{
+					positions.push_back(iter->second);
+				}
+			}
+		}
+		else
+		{
+			cues = new StackCueSnapshotList(layout.size());
+			positions.resize(layout.size());
+			for (size_t i = 0; i < layout.size(); i++)
+			{
+				positions[i] = i;
+			}
+		}
+
+		// Copy the cues a chunk at a time, so that we don't hold up the pulse
+		// thread for long. If the structure of the cue list keeps changing
+		// underneath us, give in and copy them all in one go
+		const size_t chunk = (attempt < 3) ? STACK_CUE_LIST_SNAPSHOT_CHUNK : std::max(positions.size(), (size_t)1);
+		if (!stack_cue_list_snapshot_copy_cues(cue_list, layout, version, positions, chunk, *cues))
+		{
+			delete cues;
+			continue;
+		}
+
+		StackCueListSnapshot *snapshot = new StackCueListSnapshot();
+		snapshot->version = 0;
+		snapshot->clocktime = 0;
+		snapshot->cues = std::shared_ptr<const StackCueSnapshotList>(cues);
+		if (same_structure)
+		{
+			snapshot->by_uid = previous->by_uid;
+			snapshot->top_level_count = previous->top_level_count;
+		}
+		else
+		{
+			StackCueSnapshotIndex *by_uid = new StackCueSnapshotIndex();
+			by_uid->reserve(layout.size());
+			snapshot->top_level_count = 0;
+			for (size_t i = 0; i < layout.size(); i++)
+			{
+				(*by_uid)[layout[i].cue->uid] = i;
+				if (layout[i].depth == 0)
+				{
+					snapshot->top_level_count++;
+				}
+			}
+			snapshot->by_uid = std::shared_ptr<const StackCueSnapshotIndex>(by_uid);
+		}
+
+		structure_version = version;
+		return std::shared_ptr<const StackCueListSnapshot>(snapshot);
+	}
+}
+
+// Thread that copies the cues for snapshots whenever the cue list changes
+static void stack_cue_list_snapshot_thread(StackCueList *cue_list)
+{
+	// Set the thread name
+	pthread_setname_np(pthread_self(), "stack-snapshot");
+
+	std::shared_ptr<const StackCueListSnapshot> copy;
+	uint64_t structure_version = 0;
+	{
+		std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+		copy = cue_list->snapshot_copy;
+	}
+
+	while (true)
+	{
+		// Wait for something to change
+		bool rebuild = false;
+		std::unordered_set<cue_uid_t> dirty_cues;
+		{
+			std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+			cue_list->snapshot_condition.wait(lock, [cue_list]() { return cue_list->snapshot_kill || cue_list->snapshot_rebuild || !cue_list->snapshot_dirty_cues.empty(); });
+			if (cue_list->snapshot_kill)
+			{
+				break;
+			}
+			rebuild = cue_list->snapshot_rebuild;
+			dirty_cues.swap(cue_list->snapshot_dirty_cues);
+			cue_list->snapshot_rebuild = false;
+		}
+
+		copy = stack_cue_list_snapshot_copy(cue_list, copy, structure_version, rebuild, dirty_cues);
+
+		// Hand the copy over to the pulse thread, then don't copy the cues
+		// again too soon
+		std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+		cue_list->snapshot_copy = copy;
+		cue_list->snapshot_condition.wait_for(lock, std::chrono::milliseconds(STACK_CUE_LIST_SNAPSHOT_INTERVAL), [cue_list]() { return cue_list->snapshot_kill; });
+	}
+}
+
+void stack_cue_list_snapshot_start(StackCueList *cue_list)
+{
+	StackCueListSnapshot *snapshot = new StackCueListSnapshot();
+	snapshot->version = 0;
+	snapshot->clocktime = 0;
+	snapshot->cues = std::make_shared<const StackCueSnapshotList>();
+	snapshot->by_uid = std::make_shared<const StackCueSnapshotIndex>();
+	snapshot->top_level_count = 0;
+
+	cue_list->snapshot = std::shared_ptr<const StackCueListSnapshot>(snapshot);
+	cue_list->snapshot_time = 0;
+	cue_list->snapshot_copy = cue_list->snapshot;
+	cue_list->snapshot_kill = false;
+	cue_list->snapshot_rebuild = false;
+	cue_list->snapshot_thread = std::thread(stack_cue_list_snapshot_thread, cue_list);
+}
+
+void stack_cue_list_snapshot_stop(StackCueList *cue_list)
+{
+	{
+		std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+		cue_list->snapshot_kill = true;
+	}
+	cue_list->snapshot_condition.notify_one();
+	cue_list->snapshot_thread.join();
+}
+
+std::shared_ptr<const StackCueListSnapshot> stack_cue_list_get_snapshot(StackCueList *cue_list)
+{
+	return std::atomic_load(&cue_list->snapshot);
+}
+
+const StackCueSnapshot *stack_cue_list_snapshot_find(const StackCueListSnapshot *snapshot, cue_uid_t uid)
+{
+	auto iter = snapshot->by_uid->find(uid);
+	if (iter == snapshot->by_uid->end())
+	{
+		return NULL;
+	}
+
+	return (*snapshot->cues)[iter->second].get();
+}
+
+void stack_cue_list_snapshot_invalidate(StackCueList *cue_list, StackCue *cue)
+{
+	bool notify = false;
+	{
+		std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+
+		// Only wake the thread up if it isn't already due to copy the cues
+		notify = !cue_list->snapshot_rebuild && cue_list->snapshot_dirty_cues.empty();
+		if (cue == NULL)
+		{
+			cue_list->snapshot_rebuild = true;
+		}
+		else
+		{
+			cue_list->snapshot_state_cues.insert(cue->uid);
+			if (!cue_list->snapshot_rebuild)
+			{
+				cue_list->snapshot_dirty_cues.insert(cue->uid);
+			}
+		}
+	}
+
+	if (notify)
+	{
+		cue_list->snapshot_condition.notify_one();
+	}
+}
+
+void stack_cue_list_snapshot_update(StackCueList *cue_list, stack_time_t clocktime)
+{
+	// Don't publish too often
+	if (clocktime - cue_list->snapshot_time < STACK_CUE_LIST_SNAPSHOT_INTERVAL * NANOSECS_PER_MILLISEC)
+	{
+		return;
+	}
+
+	// Take the latest copy of the cues, and the cues that have changed state
+	std::shared_ptr<const StackCueListSnapshot> copy;
+	std::unordered_set<cue_uid_t> state_cues;
+	{
+		std::unique_lock<std::mutex> lock(cue_list->snapshot_lock);
+		copy = cue_list->snapshot_copy;
+		state_cues.swap(cue_list->snapshot_state_cues);
+	}
+
+	// We're the only writer, so nothing can replace this under us
+	std::shared_ptr<const StackCueListSnapshot> previous = std::atomic_load(&cue_list->snapshot);
+	if (copy->cues == previous->cues && state_cues.empty() && cue_list->snapshot_active.empty())
+	{
+		return;
+	}
+	cue_list->snapshot_time = clocktime;
+
+	// Keep track of which cues are running or paused
+	std::vector<cue_uid_t> &active = cue_list->snapshot_active;
+	for (cue_uid_t uid : state_cues)
+	{
+		StackCue *cue = stack_cue_get_by_uid(uid);
+		const bool is_active = (cue != NULL && cue->parent == cue_list && stack_cue_list_snapshot_is_active(cue->state));
+		auto iter = std::find(active.begin(), active.end(), uid);
+		if (is_active && iter == active.end())
+		{
+			active.push_back(uid);
+		}
+		else if (!is_active && iter != active.end())
+		{
+			active.erase(iter);
+		}
+	}
+
+	StackCueListSnapshot *snapshot = new StackCueListSnapshot();
+	snapshot->version = previous->version + 1;
+	snapshot->clocktime = clocktime;
+	snapshot->cues = copy->cues;
+	snapshot->by_uid = copy->by_uid;
+	snapshot->top_level_count = copy->top_level_count;
+
+	// Work out the running times of the active cues
+	for (size_t i = 0; i < active.size(); )
+	{
+		StackCue *cue = stack_cue_get_by_uid(active[i]);
+		if (cue == NULL)
+		{
+			active.erase(active.begin() + i);
+			continue;
+		}
+
+		// Skip over cues that haven't been copied yet
+		auto iter = snapshot->by_uid->find(active[i]);
+		if (iter != snapshot->by_uid->end())
+		{
+			StackCueSnapshotTimes times;
+			times.index = iter->second;
+			times.state = cue->state;
+			stack_cue_get_running_times(cue, clocktime, &times.run_pre_time, &times.run_action_time, &times.run_post_time, NULL, NULL, NULL);
+			snapshot->active.push_back(times);
+		}
+		i++;
+	}
+
+	// Let the UI know if running times have moved on (including when the
+	// last cue stops)
+	const bool times_changed = !snapshot->active.empty() || !previous->active.empty();
+	const uint64_t version = snapshot->version;
+
+	// Publish the snapshot. The previous one is freed once the last reader
+	// has finished with it
+	std::atomic_store(&cue_list->snapshot, std::shared_ptr<const StackCueListSnapshot>(snapshot));
+
+	if (times_changed)
+	{
+		stack_event_queue_push(cue_list->events, STACK_CUE_LIST_EVENT_TIMES, version);
+	}
+}
@@ -0,0 +1,145 @@
+#ifndef _STACKCUELISTSNAPSHOT_H_INCLUDED
+#define _STACKCUELISTSNAPSHOT_H_INCLUDED
+
+// Includes:
+#include "StackCue.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A snapshot is an immutable copy of the parts of a cue list that are needed
+// to display it or answer queries about it: the order of the cues, their
+// display fields, state and running times. It's built in two halves so that
+// playback is never held up. The cues are copied by a background thread when
+// the cue list changes, taking the cue list lock for a few cues at a time. The
+// pulse thread (whilst it holds the cue list lock anyway) then publishes that
+// copy along with the running times of the active cues, at most every
+// STACK_CUE_LIST_SNAPSHOT_INTERVAL milliseconds, and only when something has
+// changed or a cue is running. Readers take a reference to the current
+// snapshot without taking the cue list lock, and a snapshot is freed once the
+// last reader has let go of it. Cues that haven't changed are shared between
+// successive snapshots
+
+// How often a new snapshot may be published, and the cues copied (milliseconds)
+#define STACK_CUE_LIST_SNAPSHOT_INTERVAL 20
+
+// How many cues are copied each time the cue list is locked
+#define STACK_CUE_LIST_SNAPSHOT_CHUNK 256
+
+// A cue within a snapshot
+struct StackCueSnapshot
+{
+	// The UID of the cue, and of its parent cue (or STACK_CUE_UID_NONE)
+	cue_uid_t uid;
+	cue_uid_t parent_uid;
+
+	// The cue number
+	cue_id_t id;
+
+	// The state of the cue when it was copied (see StackCueSnapshotTimes for
+	// the state of active cues)
+	StackCueState state;
+
+	// How deeply the cue is nested, and the number of entries taken up by the
+	// cue and its children (see StackCueListFlatEntry)
+	uint32_t depth;
+	uint32_t subtree_size;
+
+	// Display fields (the name is the rendered name)
+	std::string name;
+	std::string notes;
+	std::string script_ref;
+	uint8_t r, g, b;
+
+	// The (defined) wait and action times, and post-wait trigger
+	stack_time_t pre_time;
+	stack_time_t action_time;
+	stack_time_t post_time;
+	int32_t post_trigger;
+};
+
+// The cues in a snapshot, including children, in the same order as the
+// flattened cue list (see stack_cue_list_get_flat)
+typedef std::vector<std::shared_ptr<const StackCueSnapshot>> StackCueSnapshotList;
+
+// The position of each cue in a StackCueSnapshotList, by UID
+typedef std::unordered_map<cue_uid_t, size_t> StackCueSnapshotIndex;
+
+// A cue that is running or paused, and its running times at the time the
+// snapshot was published
+struct StackCueSnapshotTimes
+{
+	// The position of the cue in the snapshot
+	size_t index;
+
+	// The current state of the cue
+	StackCueState state;
+
+	stack_time_t run_pre_time;
+	stack_time_t run_action_time;
+	stack_time_t run_post_time;
+};
+
+// A snapshot of a cue list
+struct StackCueListSnapshot
+{
+	// Increases by one each time a snapshot is published
+	uint64_t version;
+
+	// The clock time the snapshot was published at
+	stack_time_t clocktime;
+
+	// The cues and their positions by UID. These are only replaced when the
+	// cue list changes, so are shared by the snapshots published whilst cues
+	// are running
+	std::shared_ptr<const StackCueSnapshotList> cues;
+	std::shared_ptr<const StackCueSnapshotIndex> by_uid;
+
+	// The number of top-level cues
+	size_t top_level_count;
+
+	// The cues that are running or paused
+	std::vector<StackCueSnapshotTimes> active;
+};
+
+// Functions:
+
+// Gets the current snapshot of a cue list. Safe to call from any thread, and
+// never takes the cue list lock
+// @param cue_list The cue list
+// @returns The snapshot, which remains valid for as long as a reference to it
+// is held
+std::shared_ptr<const StackCueListSnapshot> stack_cue_list_get_snapshot(StackCueList *cue_list);
+
+// Finds a cue in a snapshot
+// @param snapshot The snapshot
+// @param uid The UID of the cue to find
+// @returns The cue or NULL if it isn't in the snapshot
+const StackCueSnapshot *stack_cue_list_snapshot_find(const StackCueListSnapshot *snapshot, cue_uid_t uid);
+
+// Publishes an empty snapshot and starts the thread that copies the cues
+// @param cue_list The cue list
+void stack_cue_list_snapshot_start(StackCueList *cue_list);
+
+// Stops the thread that copies the cues. Must be called before any of the cues
+// are destroyed
+// @param cue_list The cue list
+void stack_cue_list_snapshot_stop(StackCueList *cue_list);
+
+// Notes that the snapshot is out of date. Safe to call from any thread
+// @param cue_list The cue list
+// @param cue The cue whose state has changed, or NULL if anything else has
+// changed (as a change to one cue can change the rendered name of another, this
+// copies every cue again)
+void stack_cue_list_snapshot_invalidate(StackCueList *cue_list, StackCue *cue);
+
+// Publishes a new snapshot if it's due, with the latest copy of the cues and
+// the running times of the active cues. This only looks at the active cues and
+// those whose state has changed, as it's called from the pulse thread. Must be
+// called with the cue list locked
+// @param cue_list The cue list
+// @param clocktime The current clock time
+void stack_cue_list_snapshot_update(StackCueList *cue_list, stack_time_t clocktime);
+
+#endif
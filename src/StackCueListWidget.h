@@ -4,6 +4,8 @@
 // Includes:
 #include <gtk/gtk.h>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include "StackCue.h"
 
 // Defines:
@@ -19,6 +21,62 @@
 
 typedef std::map<cue_uid_t, uint32_t> SCLWCueFlagsMap;
 
+// A top-level cue in the row index
+struct SCLWRowIndexCue
+{
+	// The cue
+	StackCue *cue;
+
+	// The position of the first child of the cue in SCLWRowIndex::children
+	size_t first_child;
+
+	// The number of children the cue has
+	size_t child_count;
+
+	// The number of rows the cue takes up: one for itself, plus one for each
+	// child (or one for the placeholder if it has none) if it is expanded
+	int32_t rows;
+};
+
+// Where a cue appears in the row index
+struct SCLWRowIndexEntry
+{
+	// The position of the top-level cue that is, or contains, the cue
+	size_t top_level;
+
+	// The row of the cue relative to the row of its top-level cue (zero for
+	// top-level cues)
+	int32_t offset;
+};
+
+// Maps between rows in the list and cues. The number of rows taken up by each
+// top-level cue is held in a Fenwick tree, so that finding the cue in a row and
+// the row of a cue are both O(log n), as is expanding or collapsing a cue.
+// The index is rebuilt when the structure of the cue list changes
+struct SCLWRowIndex
+{
+	// The cue list the index was built from, and its structure version at the
+	// time
+	StackCueList *cue_list;
+	uint64_t structure_version;
+	bool valid;
+
+	// The top-level cues in order
+	std::vector<SCLWRowIndexCue> top_level;
+
+	// The children of every top-level cue, in order
+	std::vector<StackCue*> children;
+
+	// The Fenwick tree over the rows taken up by each top-level cue (one-based)
+	std::vector<int32_t> tree;
+
+	// The total number of rows
+	int32_t total_rows;
+
+	// Every cue by UID
+	std::unordered_map<cue_uid_t, SCLWRowIndexEntry> by_uid;
+};
+
 struct StackCueListHeaderWidget;
 
 struct StackCueListContentWidget
@@ -53,6 +111,9 @@ struct StackCueListContentWidget
 	// Some additional data about the cue
 	SCLWCueFlagsMap cue_flags;
 
+	// Maps between rows and cues
+	SCLWRowIndex *row_index;
+
 	// Cache some icons
 	GdkPixbuf *icon_play;
 	GdkPixbuf *icon_pause;
@@ -157,6 +218,7 @@ void stack_cue_list_content_widget_add_to_selection(StackCueListContentWidget *s
 void stack_cue_list_content_widget_set_primary_selection(StackCueListContentWidget *sclw, cue_uid_t new_uid);
 StackCue *stack_cue_list_content_widget_cue_from_position(StackCueListContentWidget *sclw, int32_t x, int32_t y);
 void stack_cue_list_content_widget_update_cue(StackCueListContentWidget *sclw, cue_uid_t cue, int32_t fields);
+void stack_cue_list_content_widget_refresh_cue(StackCueListContentWidget *sclw, cue_uid_t cue, int32_t fields);
 void stack_cue_list_content_widget_list_modified(StackCueListContentWidget *sclw);
 bool stack_cue_list_content_widget_is_cue_selected(StackCueListContentWidget *sclw, cue_uid_t uid);
 bool stack_cue_list_content_widget_is_cue_expanded(StackCueListContentWidget *sclw, cue_uid_t uid);
@@ -0,0 +1,265 @@
+// Includes:
+#include "StackCueOrderTree.h"
+
+// Gets the number of nodes in a subtree
+static inline size_t stack_cue_order_tree_count(const StackCueOrderNode *node)
+{
+	return node != NULL ? node->count : 0;
+}
+
+// Gets the total weight of a subtree
+static inline size_t stack_cue_order_tree_total_weight(const StackCueOrderNode *node)
+{
+	return node != NULL ? node->total_weight : 0;
+}
+
+// Recalculates the size and total weight of a node's subtree from its children,
+// and points its children back at it
+static void stack_cue_order_tree_update(StackCueOrderNode *node)
+{
+	node->count = 1 + stack_cue_order_tree_count(node->left) + stack_cue_order_tree_count(node->right);
+	node->total_weight = node->weight + stack_cue_order_tree_total_weight(node->left) + stack_cue_order_tree_total_weight(node->right);
+	if (node->left != NULL)
+	{
+		node->left->parent = node;
+	}
+	if (node->right != NULL)
+	{
+		node->right->parent = node;
+	}
+}
+
+// Splits a subtree in to its first 'index' nodes and the rest. The parent
+// pointers of the two new roots are left for the caller to set
+static void stack_cue_order_tree_split(StackCueOrderNode *node, size_t index, StackCueOrderNode *&left, StackCueOrderNode *&right)
+{
+	if (node == NULL)
+	{
+		left = right = NULL;
+		return;
+	}
+
+	const size_t left_count = stack_cue_order_tree_count(node->left);
+	if (left_count < index)
+	{
+		// The node (and everything to its left) goes in the left part
+		stack_cue_order_tree_split(node->right, index - left_count - 1, node->right, right);
+		left = node;
+	}
+	else
+	{
+		stack_cue_order_tree_split(node->left, index, left, node->left);
+		right = node;
+	}
+	stack_cue_order_tree_update(node);
+}
+
+// Joins two subtrees, where every node in 'left' comes before every node in
+// 'right'. The parent pointer of the new root is left for the caller to set
+static StackCueOrderNode *stack_cue_order_tree_merge(StackCueOrderNode *left, StackCueOrderNode *right)
+{
+	if (left == NULL)
+	{
+		return right;
+	}
+	if (right == NULL)
+	{
+		return left;
+	}
+
+	if (left->priority > right->priority)
+	{
+		left->right = stack_cue_order_tree_merge(left->right, right);
+		stack_cue_order_tree_update(left);
+		return left;
+	}
+	else
+	{
+		right->left = stack_cue_order_tree_merge(left, right->left);
+		stack_cue_order_tree_update(right);
+		return right;
+	}
+}
+
+// Destroys a subtree
+static void stack_cue_order_tree_destroy_node(StackCueOrderNode *node)
+{
+	if (node != NULL)
+	{
+		stack_cue_order_tree_destroy_node(node->left);
+		stack_cue_order_tree_destroy_node(node->right);
+		delete node;
+	}
+}
+
+/// Initialises an empty order tree
+/// @param tree The tree
+void stack_cue_order_tree_init(StackCueOrderTree *tree)
+{
+	tree->root = NULL;
+	tree->seed = 2463534242u;
+}
+
+/// Removes every cue from an order tree
+/// @param tree The tree
+void stack_cue_order_tree_clear(StackCueOrderTree *tree)
+{
+	stack_cue_order_tree_destroy_node(tree->root);
+	tree->root = NULL;
+}
+
+/// Gets the number of cues in an order tree
+/// @param tree The tree
+/// @returns The number of cues
+size_t stack_cue_order_tree_size(const StackCueOrderTree *tree)
+{
+	return stack_cue_order_tree_count(tree->root);
+}
+
+/// Inserts a cue in to an order tree
+/// @param tree The tree
+/// @param index The position to insert the cue at. Positions past the end
+/// append the cue
+/// @param cue The cue
+/// @param weight The weight of the cue
+/// @returns The node holding the cue, which stays valid until it is erased
+StackCueOrderNode *stack_cue_order_tree_insert(StackCueOrderTree *tree, size_t index, StackCue *cue, size_t weight)
+{
+	StackCueOrderNode *node = new StackCueOrderNode;
+	node->cue = cue;
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	node->weight = weight;
+
+	// Pick a priority (xorshift32)
+	tree->seed ^= tree->seed << 13;
+	tree->seed ^= tree->seed >> 17;
+	tree->seed ^= tree->seed << 5;
+	node->priority = tree->seed;
+	stack_cue_order_tree_update(node);
+
+	StackCueOrderNode *left = NULL, *right = NULL;
+	stack_cue_order_tree_split(tree->root, index, left, right);
+	tree->root = stack_cue_order_tree_merge(stack_cue_order_tree_merge(left, node), right);
+	tree->root->parent = NULL;
+
+	return node;
+}
+
+/// Removes a cue from an order tree, destroying its node
+/// @param tree The tree
+/// @param node The node holding the cue
+void stack_cue_order_tree_erase(StackCueOrderTree *tree, StackCueOrderNode *node)
+{
+	// Replace the node with its children
+	StackCueOrderNode *parent = node->parent;
+	StackCueOrderNode *replacement = stack_cue_order_tree_merge(node->left, node->right);
+	if (replacement != NULL)
+	{
+		replacement->parent = parent;
+	}
+
+	if (parent == NULL)
+	{
+		tree->root = replacement;
+	}
+	else
+	{
+		if (parent->left == node)
+		{
+			parent->left = replacement;
+		}
+		else
+		{
+			parent->right = replacement;
+		}
+
+		// The subtrees above have one node fewer
+		for (StackCueOrderNode *ancestor = parent; ancestor != NULL; ancestor = ancestor->parent)
+		{
+			stack_cue_order_tree_update(ancestor);
+		}
+	}
+
+	delete node;
+}
+
+/// Changes the weight of a cue in an order tree
+/// @param node The node holding the cue
+/// @param weight The new weight of the cue
+void stack_cue_order_tree_set_weight(StackCueOrderNode *node, size_t weight)
+{
+	if (node->weight == weight)
+	{
+		return;
+	}
+
+	node->weight = weight;
+	for (StackCueOrderNode *ancestor = node; ancestor != NULL; ancestor = ancestor->parent)
+	{
+		stack_cue_order_tree_update(ancestor);
+	}
+}
+
+/// Finds the cue at a position in an order tree
+/// @param tree The tree
+/// @param index The position
+/// @returns The node holding the cue, or NULL if the position is past the end
+StackCueOrderNode *stack_cue_order_tree_at(const StackCueOrderTree *tree, size_t index)
+{
+	StackCueOrderNode *node = tree->root;
+	while (node != NULL)
+	{
+		const size_t left_count = stack_cue_order_tree_count(node->left);
+		if (index < left_count)
+		{
+			node = node->left;
+		}
+		else if (index == left_count)
+		{
+			return node;
+		}
+		else
+		{
+			index -= left_count + 1;
+			node = node->right;
+		}
+	}
+
+	return NULL;
+}
+
+/// Gets the position of a cue in an order tree
+/// @param node The node holding the cue
+/// @returns The position of the cue
+size_t stack_cue_order_tree_index(const StackCueOrderNode *node)
+{
+	size_t index = stack_cue_order_tree_count(node->left);
+	for (; node->parent != NULL; node = node->parent)
+	{
+		if (node == node->parent->right)
+		{
+			index += stack_cue_order_tree_count(node->parent->left) + 1;
+		}
+	}
+
+	return index;
+}
+
+/// Gets the total weight of the cues before a cue in an order tree
+/// @param node The node holding the cue
+/// @returns The total weight of the cues before it
+size_t stack_cue_order_tree_weight_before(const StackCueOrderNode *node)
+{
+	size_t weight = stack_cue_order_tree_total_weight(node->left);
+	for (; node->parent != NULL; node = node->parent)
+	{
+		if (node == node->parent->right)
+		{
+			weight += stack_cue_order_tree_total_weight(node->parent->left) + node->parent->weight;
+		}
+	}
+
+	return weight;
+}
@@ -0,0 +1,58 @@
+#ifndef _STACKCUEORDERTREE_H_INCLUDED
+#define _STACKCUEORDERTREE_H_INCLUDED
+
+// Includes:
+#include <cstdint>
+#include <unistd.h>
+
+struct StackCue;
+
+// A node in an order tree, which holds one cue
+struct StackCueOrderNode
+{
+	// The cue
+	StackCue *cue;
+
+	// The links in the tree
+	StackCueOrderNode *left;
+	StackCueOrderNode *right;
+	StackCueOrderNode *parent;
+
+	// The random priority that keeps the tree balanced (a parent's priority is
+	// never lower than its children's)
+	uint32_t priority;
+
+	// The weight of the cue (e.g. the number of cues it covers including its
+	// children)
+	size_t weight;
+
+	// The number of nodes, and their total weight, in the subtree rooted here
+	size_t count;
+	size_t total_weight;
+};
+
+// Keeps a sequence of cues in order, such that finding the cue at a position,
+// the position of a cue (and the total weight of the cues before it), and
+// inserting and removing cues anywhere are all O(log n). It is a treap
+// ordered by position, where every node knows the size of its subtree
+struct StackCueOrderTree
+{
+	// The root of the tree (NULL if empty)
+	StackCueOrderNode *root;
+
+	// The state of the random number generator for priorities
+	uint32_t seed;
+};
+
+// Functions:
+void stack_cue_order_tree_init(StackCueOrderTree *tree);
+void stack_cue_order_tree_clear(StackCueOrderTree *tree);
+size_t stack_cue_order_tree_size(const StackCueOrderTree *tree);
+StackCueOrderNode *stack_cue_order_tree_insert(StackCueOrderTree *tree, size_t index, StackCue *cue, size_t weight);
+void stack_cue_order_tree_erase(StackCueOrderTree *tree, StackCueOrderNode *node);
+void stack_cue_order_tree_set_weight(StackCueOrderNode *node, size_t weight);
+StackCueOrderNode *stack_cue_order_tree_at(const StackCueOrderTree *tree, size_t index);
+size_t stack_cue_order_tree_index(const StackCueOrderNode *node);
+size_t stack_cue_order_tree_weight_before(const StackCueOrderNode *node);
+
+#endif
@@ -0,0 +1,145 @@
+// Includes:
+#include "StackEventQueue.h"
+
+// This is a bounded queue where each slot has a sequence number. A slot at
+// position p is free for writing when its sequence is p, and ready for reading
+// when its sequence is p + 1. Producers claim a position by advancing the
+// write position, fill in the slot and then publish it by updating the
+// sequence. The consumer hands the slot back to the producers by setting the
+// sequence to the position it will next be written at (p + capacity)
+
+StackEventQueue *stack_event_queue_create(size_t capacity)
+{
+	// Round the capacity up to a power of two
+	size_t actual_capacity = 2;
+	while (actual_capacity < capacity)
+	{
+		actual_capacity <<= 1;
+	}
+
+	StackEventQueue *queue = new StackEventQueue;
+	queue->slots = new StackEventQueueSlot[actual_capacity];
+	queue->capacity = actual_capacity;
+	queue->mask = actual_capacity - 1;
+	for (size_t i = 0; i < actual_capacity; i++)
+	{
+		queue->slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	queue->write_position.store(0, std::memory_order_relaxed);
+	queue->read_position = 0;
+	queue->overflowed.store(false, std::memory_order_release);
+	queue->waiting.store(false, std::memory_order_release);
+	queue->wake_func = NULL;
+	queue->wake_user_data = NULL;
+
+	return queue;
+}
+
+void stack_event_queue_destroy(StackEventQueue *queue)
+{
+	delete [] queue->slots;
+	delete queue;
+}
+
+// Wakes the consumer if it's waiting for an event. The fence pairs with the one
+// in stack_event_queue_wait, so that either the consumer sees the event we've
+// just added, or we see that it is waiting
+static void stack_event_queue_wake(StackEventQueue *queue)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (queue->waiting.load(std::memory_order_relaxed) && queue->waiting.exchange(false, std::memory_order_acq_rel))
+	{
+		queue->wake_func(queue->wake_user_data);
+	}
+}
+
+bool stack_event_queue_push(StackEventQueue *queue, uint32_t type, uint64_t data)
+{
+	size_t position = queue->write_position.load(std::memory_order_relaxed);
+	while (true)
+	{
+		StackEventQueueSlot *slot = &queue->slots[position & queue->mask];
+		const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+		if (difference == 0)
+		{
+			// The slot is free: try and claim it
+			if (queue->write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				slot->event.type = type;
+				slot->event.data = data;
+				slot->sequence.store(position + 1, std::memory_order_release);
+				stack_event_queue_wake(queue);
+				return true;
+			}
+
+			// Another producer got there first (position has been updated
+			// by compare_exchange_weak)
+		}
+		else if (difference < 0)
+		{
+			// The slot hasn't been read yet, so the queue is full
+			queue->overflowed.store(true, std::memory_order_release);
+			stack_event_queue_wake(queue);
+			return false;
+		}
+		else
+		{
+			// Another producer has claimed this position
+			position = queue->write_position.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool stack_event_queue_pop(StackEventQueue *queue, StackEvent *event)
+{
+	const size_t position = queue->read_position;
+	StackEventQueueSlot *slot = &queue->slots[position & queue->mask];
+	const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+	// If the slot hasn't been published yet, the queue is empty
+	if ((intptr_t)sequence - (intptr_t)(position + 1) < 0)
+	{
+		return false;
+	}
+
+	*event = slot->event;
+	slot->sequence.store(position + queue->capacity, std::memory_order_release);
+	queue->read_position = position + 1;
+
+	return true;
+}
+
+bool stack_event_queue_take_overflow(StackEventQueue *queue)
+{
+	return queue->overflowed.exchange(false, std::memory_order_acq_rel);
+}
+
+void stack_event_queue_set_wake(StackEventQueue *queue, stack_event_queue_wake_t wake_func, void *user_data)
+{
+	queue->wake_func = wake_func;
+	queue->wake_user_data = user_data;
+}
+
+bool stack_event_queue_wait(StackEventQueue *queue)
+{
+	if (queue->wake_func == NULL)
+	{
+		return false;
+	}
+
+	queue->waiting.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// If an event arrived before we started waiting, carry on, unless a
+	// producer has already taken the wait and will wake us anyway
+	const StackEventQueueSlot *slot = &queue->slots[queue->read_position & queue->mask];
+	const bool ready = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)(queue->read_position + 1) >= 0;
+	if (ready || queue->overflowed.load(std::memory_order_acquire))
+	{
+		return !queue->waiting.exchange(false, std::memory_order_acq_rel);
+	}
+
+	return true;
+}
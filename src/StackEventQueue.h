@@ -0,0 +1,92 @@
+#ifndef _STACKEVENTQUEUE_H_INCLUDED
+#define _STACKEVENTQUEUE_H_INCLUDED
+
+// Includes:
+#include <atomic>
+#include <cstdint>
+#include <unistd.h>
+
+// An event passed through an event queue
+struct StackEvent
+{
+	// The type of the event (defined by whoever uses the queue)
+	uint32_t type;
+
+	// Data for the event (e.g. a cue UID)
+	uint64_t data;
+};
+
+// Called when an event is added to a queue whose consumer is waiting for one
+// (see stack_event_queue_wait). This is called on the thread that added the
+// event
+typedef void (*stack_event_queue_wake_t)(void *user_data);
+
+// A slot in the event queue. The sequence number tells producers and the
+// consumer whether the slot is free to write to or ready to be read
+struct StackEventQueueSlot
+{
+	std::atomic<size_t> sequence;
+	StackEvent event;
+};
+
+// A bounded, lock-free queue of events with many producers and one consumer.
+// Producers never block: if the queue is full the event is dropped and the
+// queue is marked as having overflowed, so that the consumer knows that it
+// has missed something and can refresh everything instead
+struct StackEventQueue
+{
+	// The slots (capacity is a power of two, and mask is capacity - 1)
+	StackEventQueueSlot *slots;
+	size_t capacity;
+	size_t mask;
+
+	// The position the next event will be written to. Kept apart from the
+	// read position so that producers and the consumer don't share a cache
+	// line
+	alignas(64) std::atomic<size_t> write_position;
+
+	// The position the next event will be read from (only used by the
+	// consumer)
+	alignas(64) size_t read_position;
+
+	// Whether an event has been dropped since the consumer last checked
+	std::atomic<bool> overflowed;
+
+	// Whether the consumer is waiting to be woken by the next event, and what
+	// to call to wake it
+	std::atomic<bool> waiting;
+	stack_event_queue_wake_t wake_func;
+	void *wake_user_data;
+};
+
+// Functions:
+
+// Creates a new event queue that can hold at least 'capacity' events
+StackEventQueue *stack_event_queue_create(size_t capacity);
+
+// Destroys an event queue
+void stack_event_queue_destroy(StackEventQueue *queue);
+
+// Adds an event to the queue. Safe to call from any thread, and never blocks.
+// Returns false (and marks the queue as overflowed) if the queue is full
+bool stack_event_queue_push(StackEventQueue *queue, uint32_t type, uint64_t data);
+
+// Takes the oldest event from the queue. Must only be called from one thread
+// at a time. Returns false if the queue is empty
+bool stack_event_queue_pop(StackEventQueue *queue, StackEvent *event);
+
+// Returns whether any events have been dropped since the last call, and
+// clears the flag. Should be called by the consumer
+bool stack_event_queue_take_overflow(StackEventQueue *queue);
+
+// Sets the function that wakes the consumer when it's waiting for an event.
+// Must be called by the consumer before it first waits
+void stack_event_queue_set_wake(StackEventQueue *queue, stack_event_queue_wake_t wake_func, void *user_data);
+
+// Tells the queue that the consumer is going to stop polling until it is woken
+// by the next event. Returns false if there are already events to read, in
+// which case the consumer should carry on polling. Should be called by the
+// consumer
+bool stack_event_queue_wait(StackEventQueue *queue);
+
+#endif
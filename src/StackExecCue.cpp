@@ -16,6 +16,14 @@ static GtkBuilder *sec_builder = NULL;
 // Global: A single instace of our icon
 static GdkPixbuf *icon = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackExecCueKeys
+{
+	stack_property_key_t command;
+};
+static StackExecCueKeys sec_keys;
+
 static void stack_exec_cue_ccb_command(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -66,7 +74,7 @@ static StackCue* stack_exec_cue_create(StackCueList *cue_list)
 	stack_cue_set_action_time(STACK_CUE(cue), 1);
 
 	// Add our properties
-	StackProperty *command = stack_property_create("command", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *command = stack_property_create_keyed(sec_keys.command, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(STACK_CUE(cue), command);
 	stack_property_set_changed_callback(command, stack_exec_cue_ccb_command, (void*)cue);
 
@@ -323,6 +331,9 @@ void stack_exec_cue_register()
 	// Load the icons
 	icon = gdk_pixbuf_new_from_resource("/org/stack/icons/stackexeccue.png", NULL);
 
+	// Register the names of our properties
+	sec_keys.command = stack_property_register_key("command");
+
 	// Register built in cue types
 	StackCueClass* exec_cue_class = new StackCueClass{ "StackExecCue", "StackCue", "Execution Cue", stack_exec_cue_create, stack_exec_cue_destroy, stack_exec_cue_play, NULL, NULL, stack_exec_cue_pulse, stack_exec_cue_set_tabs, stack_exec_cue_unset_tabs, stack_exec_cue_to_json, stack_exec_cue_free_json, stack_exec_cue_from_json, stack_exec_cue_get_error, NULL, NULL, NULL, stack_exec_cue_get_icon, NULL, NULL };
 	stack_register_cue_class(exec_cue_class);
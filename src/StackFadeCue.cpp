@@ -23,6 +23,18 @@ static GtkBuilder *sfc_builder = NULL;
 // Global: A single instace of our icon
 static GdkPixbuf *icon = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackFadeCueKeys
+{
+	stack_property_key_t target;
+	stack_property_key_t master_volume;
+	stack_property_key_t stop_target;
+	stack_property_key_t profile;
+	stack_property_key_t crosspoint;
+};
+static StackFadeCueKeys sfc_keys;
+
 // Pre-define these:
 StackProperty *stack_fade_cue_get_volume_property(StackCue *cue, size_t channel, bool create);
 StackProperty *stack_fade_cue_get_crosspoint_property(StackCue *cue, size_t input_channel, size_t output_channel, bool create);
@@ -119,6 +131,12 @@ static void stack_fade_cue_ccb_master_volume(StackProperty *property, StackPrope
 	stack_fade_cue_ccb_common(property, version, STACK_FADE_CUE(user_data));
 }
 
+/// Crosspoints property change callback
+static void stack_fade_cue_ccb_crosspoint(StackProperty *property, StackPropertyVersion version, void *user_data)
+{
+	stack_fade_cue_ccb_common(property, version, STACK_FADE_CUE(user_data));
+}
+
 /// Stop Target property change callback
 static void stack_fade_cue_ccb_stop_target(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
@@ -185,15 +203,10 @@ static void stack_fade_cue_pause_change_callbacks(StackCue *cue, bool pause)
 		// Pause/resume the channel volume property
 		StackProperty *channel_volume_property = stack_fade_cue_get_volume_property(cue, input_channel + 1, false);
 		stack_property_pause_change_callback(channel_volume_property, pause);
-
-		// Iterate over the output channels
-		for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
-		{
-			// Pause/resume the crosspoint property
-			StackProperty *crosspoint_property = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-			stack_property_pause_change_callback(crosspoint_property, pause);
-		}
 	}
+
+	// Pause/resume the crosspoints
+	stack_property_pause_change_callback(stack_cue_get_property_by_key(cue, sfc_keys.crosspoint), pause);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -226,28 +239,37 @@ static StackCue* stack_fade_cue_create(StackCueList *cue_list)
 	cue->playback_start_crosspoints = NULL;
 
 	// Add our properties
-	StackProperty *target = stack_property_create("target", STACK_PROPERTY_TYPE_UINT64);
+	StackProperty *target = stack_property_create_keyed(sfc_keys.target, STACK_PROPERTY_TYPE_UINT64);
 	stack_cue_add_property(STACK_CUE(cue), target);
 	stack_property_set_uint64(target, STACK_PROPERTY_VERSION_DEFINED, STACK_FADE_CUE_DEFAULT_TARGET);
 	stack_property_set_changed_callback(target, stack_fade_cue_ccb_target, (void*)cue);
 
-	StackProperty *master_volume = stack_property_create("master_volume", STACK_PROPERTY_TYPE_DOUBLE);
+	StackProperty *master_volume = stack_property_create_keyed(sfc_keys.master_volume, STACK_PROPERTY_TYPE_DOUBLE);
 	stack_cue_add_property(STACK_CUE(cue), master_volume);
 	stack_property_set_double(master_volume, STACK_PROPERTY_VERSION_DEFINED, STACK_FADE_CUE_DEFAULT_TARGET_VOLUME);
 	stack_property_set_changed_callback(master_volume, stack_fade_cue_ccb_master_volume, (void*)cue);
 	stack_property_set_validator(master_volume, (stack_property_validator_t)stack_fade_cue_validate_volume, (void*)cue);
 	stack_property_set_nullable(master_volume, true);
 
-	StackProperty *stop_target = stack_property_create("stop_target", STACK_PROPERTY_TYPE_BOOL);
+	StackProperty *stop_target = stack_property_create_keyed(sfc_keys.stop_target, STACK_PROPERTY_TYPE_BOOL);
 	stack_cue_add_property(STACK_CUE(cue), stop_target);
 	stack_property_set_bool(stop_target, STACK_PROPERTY_VERSION_DEFINED, STACK_FADE_CUE_DEFAULT_STOP_TARGET);
 	stack_property_set_changed_callback(stop_target, stack_fade_cue_ccb_stop_target, (void*)cue);
 
-	StackProperty *profile = stack_property_create("profile", STACK_PROPERTY_TYPE_INT32);
+	StackProperty *profile = stack_property_create_keyed(sfc_keys.profile, STACK_PROPERTY_TYPE_INT32);
 	stack_cue_add_property(STACK_CUE(cue), profile);
 	stack_property_set_int32(profile, STACK_PROPERTY_VERSION_DEFINED, STACK_FADE_CUE_DEFAULT_PROFILE);
 	stack_property_set_changed_callback(profile, stack_fade_cue_ccb_profile, (void*)cue);
 
+	// Crosspoints are stored as one matrix, with a row for each output channel
+	// and a column for each input channel. They're nullable, in case the user
+	// doesn't want the fade cue to touch some of them
+	StackProperty *crosspoints = stack_property_create_keyed(sfc_keys.crosspoint, STACK_PROPERTY_TYPE_MATRIX);
+	stack_cue_add_property(STACK_CUE(cue), crosspoints);
+	stack_property_set_nullable(crosspoints, true);
+	stack_property_set_changed_callback(crosspoints, stack_fade_cue_ccb_crosspoint, (void*)cue);
+	stack_property_set_validator(crosspoints, (stack_property_validator_t)stack_fade_cue_validate_volume, (void*)cue);
+
 	// Override the behaviour of action time change
 	stack_property_set_changed_callback(stack_cue_get_property(STACK_CUE(cue), "action_time"), stack_fade_cue_ccb_action_time, cue);
 
@@ -439,45 +461,38 @@ StackProperty *stack_fade_cue_get_volume_property(StackCue *cue, size_t channel,
 	return property;
 }
 
-/// Returns, optionally creating if necessary, the StackProperty object for the
-/// given crosspoint
+/// Returns the crosspoint matrix property if the given crosspoint has been set,
+/// optionally setting it to null if it has not
 /// @param cue The fade cue
-/// @param input_channel The input channel to get the property for. Note that
-/// unlike stack_fade_cue_get_volume_property, this channel is zero-based
-/// @param output_channel The output channel to get the property for. Note that
-/// unlike stack_fade_cue_get_volume_property, this channel is zero-based
-/// @param create Whether to create the property if it does not exist
+/// @param input_channel The input channel of the crosspoint. Note that unlike
+/// stack_fade_cue_get_volume_property, this channel is zero-based
+/// @param output_channel The output channel of the crosspoint. Note that unlike
+/// stack_fade_cue_get_volume_property, this channel is zero-based
+/// @param create Whether to set the crosspoint if it has not been set
 StackProperty *stack_fade_cue_get_crosspoint_property(StackCue *cue, size_t input_channel, size_t output_channel, bool create)
 {
-	// Build property name
-	char property_name[64];
-	snprintf(property_name, 64, "crosspoint_%lu_%lu", output_channel, input_channel);
-
-	// Get the property, creating it with a default value if it does not exist
-	StackProperty *property = stack_cue_get_property(STACK_CUE(cue), property_name);
-	if (property == NULL && create)
+	StackProperty *property = stack_cue_get_property_by_key(cue, sfc_keys.crosspoint);
+	if (stack_property_matrix_get_assigned(property, output_channel, input_channel))
 	{
-		// Property does not exist - create it
-		property = stack_property_create(property_name, STACK_PROPERTY_TYPE_DOUBLE);
-		stack_property_set_validator(property, (stack_property_validator_t)stack_fade_cue_validate_volume, (void*)cue);
-
-		// Property is nullable - in case the user doesn't want the fade cue to touch this
-		stack_property_set_nullable(property, true);
-
-		// Default crosspoints to NULL
-		stack_property_set_null(property, STACK_PROPERTY_VERSION_DEFINED, true);
-		stack_property_set_null(property, STACK_PROPERTY_VERSION_LIVE, true);
-
-		stack_cue_add_property(cue, property);
+		return property;
+	}
+	if (!create)
+	{
+		return NULL;
 	}
 
+	// Default crosspoints to NULL
+	bool paused = stack_property_pause_change_callback(property, true);
+	stack_property_matrix_set(property, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, NAN);
+	stack_property_matrix_set(property, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, NAN);
+	stack_property_pause_change_callback(property, paused);
+
 	return property;
 }
 
-/// Calculate the new value of a fading property
+/// Calculate the new value of a fading volume
 /// @param cue The fade cue which is used to determine the target cue
-/// @param source_property The property on the fade cue that we want the faded
-/// value of
+/// @param target_volume The volume (on the fade cue) that we're fading to
 /// @param profile The profile of the fade. This is passed in as this function
 /// is often called repeatedly for many properties, so this stops this function
 /// needing to read the profile property repeatedly
@@ -486,12 +501,8 @@ StackProperty *stack_fade_cue_get_crosspoint_property(StackCue *cue, size_t inpu
 /// it's the same for every property
 /// @param initial_volume The value of the property on the target cue before the
 /// fade started
-static double stack_fade_cue_fade_property(StackFadeCue *cue, const StackProperty *source_property, StackFadeProfile profile, double time_scaler, double initial_volume)
+static double stack_fade_cue_fade_volume(StackFadeCue *cue, double target_volume, StackFadeProfile profile, double time_scaler, double initial_volume)
 {
-	// Determine the volume we're working towards
-	double target_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
-	stack_property_get_double(source_property, STACK_PROPERTY_VERSION_LIVE, &target_volume);
-
 	// Convert start and end volumes from dB to linear scalars
 	const double vstart = stack_db_to_scalar(initial_volume);
 	const double vend = stack_db_to_scalar(target_volume);
@@ -583,32 +594,27 @@ static void stack_fade_cue_set_to_complete(StackCue *cue)
 		stack_property_set_double(stack_cue_get_property(target, stack_property_get_name(channel_volume_fade)), STACK_PROPERTY_VERSION_LIVE, new_volume);
 	}
 
-	// Perform the per-crosspoint fades
+	// Perform the per-crosspoint fades, batching the changes up so that the
+	// target is only notified of them once
+	const StackProperty *crosspoints_fade = stack_cue_get_property_by_key(cue, sfc_keys.crosspoint);
+	StackProperty *crosspoints_target = stack_cue_get_property_by_key(target, sfc_keys.crosspoint);
+	stack_property_batch_begin();
 	for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
 	{
 		for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
 		{
-			// Get the property
-			const StackProperty *crosspoint_fade = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-
-			// Skip channel volumes that have never been created
-			if (crosspoint_fade == NULL)
-			{
-				continue;
-			}
-
-			// Skip channel volumes that are unset
-			if (stack_property_get_null(crosspoint_fade, STACK_PROPERTY_VERSION_LIVE))
+			// Skip crosspoints that have never been set, or are unset
+			new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
+			if (!stack_property_matrix_get(crosspoints_fade, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, &new_volume) || std::isnan(new_volume))
 			{
 				continue;
 			}
 
 			// Jump to end volume
-			new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
-			stack_property_get_double(crosspoint_fade, STACK_PROPERTY_VERSION_LIVE, &new_volume);
-			stack_property_set_double(stack_cue_get_property(target, stack_property_get_name(crosspoint_fade)), STACK_PROPERTY_VERSION_LIVE, new_volume);
+			stack_property_matrix_set(crosspoints_target, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, new_volume);
 		}
 	}
+	stack_property_batch_commit();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -658,27 +664,20 @@ static bool stack_fade_cue_play(StackCue *cue)
 	fcue->playback_start_channel_volumes = new double[input_channels];
 	fcue->playback_start_crosspoints = new double[input_channels * cue->parent->channels];
 
+	// Copy the crosspoints
+	stack_property_copy_defined_to_live(stack_cue_get_property_by_key(cue, sfc_keys.crosspoint));
+	const StackProperty *crosspoints_target = stack_cue_get_property_by_key(target, sfc_keys.crosspoint);
+
 	// For each input channel
 	for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
 	{
-		// Iterate for all the crosspoints
+		// Iterate for all the crosspoints, getting their volume on the target
+		// (or null if the target doesn't have them, so we don't fade them)
 		for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
 		{
-			// Get the property from the fade cue, skipping if the property doesn't exist
-			StackProperty *crosspoint_fade = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-			if (crosspoint_fade == NULL)
-			{
-				continue;
-			}
-
-			// Get the property from the target
-			StackProperty *crosspoint_target = stack_cue_get_property(target, stack_property_get_name(crosspoint_fade));
 			size_t index = input_channel * cue->parent->channels + output_channel;
-			if (crosspoint_target != NULL)
-			{
-				stack_property_copy_defined_to_live(crosspoint_fade);
-				stack_property_get_double(crosspoint_target, STACK_PROPERTY_VERSION_LIVE, &fcue->playback_start_crosspoints[index]);
-			}
+			fcue->playback_start_crosspoints[index] = NAN;
+			stack_property_matrix_get(crosspoints_target, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, &fcue->playback_start_crosspoints[index]);
 		}
 
 		// Get the property from the fade cue skipping if the property doesn't exist
@@ -780,7 +779,8 @@ static void stack_fade_cue_pulse(StackCue *cue, stack_time_t clocktime)
 			if (!stack_property_get_null(master_volume, STACK_PROPERTY_VERSION_LIVE))
 			{
 				double new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
-				new_volume = stack_fade_cue_fade_property(STACK_FADE_CUE(cue), master_volume, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_master_volume);
+				stack_property_get_double(master_volume, STACK_PROPERTY_VERSION_LIVE, &new_volume);
+				new_volume = stack_fade_cue_fade_volume(STACK_FADE_CUE(cue), new_volume, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_master_volume);
 				stack_property_set_double(stack_cue_get_property(target, "master_volume"), STACK_PROPERTY_VERSION_LIVE, new_volume);
 			}
 
@@ -805,36 +805,39 @@ static void stack_fade_cue_pulse(StackCue *cue, stack_time_t clocktime)
 				}
 
 				double new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
-				new_volume = stack_fade_cue_fade_property(STACK_FADE_CUE(cue), channel_volume_fade, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_channel_volumes[channel]);
+				stack_property_get_double(channel_volume_fade, STACK_PROPERTY_VERSION_LIVE, &new_volume);
+				new_volume = stack_fade_cue_fade_volume(STACK_FADE_CUE(cue), new_volume, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_channel_volumes[channel]);
 				stack_property_set_double(stack_cue_get_property(target, stack_property_get_name(channel_volume_fade)), STACK_PROPERTY_VERSION_LIVE, new_volume);
 			}
 
-			// Perform the per-crosspoint fades
+			// Perform the per-crosspoint fades, batching the changes up so
+			// that the target is only notified of them once
+			const StackProperty *crosspoints_fade = stack_cue_get_property_by_key(cue, sfc_keys.crosspoint);
+			StackProperty *crosspoints_target = stack_cue_get_property_by_key(target, sfc_keys.crosspoint);
+			stack_property_batch_begin();
 			for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
 			{
 				for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
 				{
-					// Get the property
-					const StackProperty *crosspoint_fade = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-
-					// Skip channel volumes that have never been created
-					if (crosspoint_fade == NULL)
+					// Skip crosspoints that have never been set, or are unset
+					double new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
+					if (!stack_property_matrix_get(crosspoints_fade, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, &new_volume) || std::isnan(new_volume))
 					{
 						continue;
 					}
 
-					// Skip channel volumes that are unset
-					if (stack_property_get_null(crosspoint_fade, STACK_PROPERTY_VERSION_LIVE))
+					// Skip crosspoints the target didn't have when we started
+					size_t index = input_channel * cue->parent->channels + output_channel;
+					if (std::isnan(STACK_FADE_CUE(cue)->playback_start_crosspoints[index]))
 					{
 						continue;
 					}
 
-					double new_volume = STACK_FADE_CUE_DEFAULT_TARGET_VOLUME;
-					size_t index = input_channel * cue->parent->channels + output_channel;
-					new_volume = stack_fade_cue_fade_property(STACK_FADE_CUE(cue), crosspoint_fade, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_crosspoints[index]);
-					stack_property_set_double(stack_cue_get_property(target, stack_property_get_name(crosspoint_fade)), STACK_PROPERTY_VERSION_LIVE, new_volume);
+					new_volume = stack_fade_cue_fade_volume(STACK_FADE_CUE(cue), new_volume, profile, time_scaler, STACK_FADE_CUE(cue)->playback_start_crosspoints[index]);
+					stack_property_matrix_set(crosspoints_target, STACK_PROPERTY_VERSION_LIVE, output_channel, input_channel, new_volume);
 				}
 			}
+			stack_property_batch_commit();
 		}
 		else
 		{
@@ -1025,17 +1028,7 @@ static char *stack_fade_cue_to_json(StackCue *cue)
 			}
 		}
 
-		for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
-		{
-			for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
-			{
-				const StackProperty *crosspoint = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, false);
-				if (crosspoint != NULL)
-				{
-					stack_property_write_json(crosspoint, &cue_root);
-				}
-			}
-		}
+		stack_property_write_json(stack_cue_get_property_by_key(cue, sfc_keys.crosspoint), &cue_root);
 	}
 
 	// Write out JSON string and return (to be free'd by
@@ -1129,6 +1122,8 @@ void stack_fade_cue_from_json(StackCue *cue, const char *json_data)
 			}
 		}
 
+		StackProperty *crosspoints = stack_cue_get_property_by_key(cue, sfc_keys.crosspoint);
+		stack_property_matrix_ensure_size(crosspoints, cue->parent->channels, input_channels);
 		for (size_t input_channel = 0; input_channel < input_channels; input_channel++)
 		{
 			for (size_t output_channel = 0; output_channel < cue->parent->channels; output_channel++)
@@ -1138,21 +1133,17 @@ void stack_fade_cue_from_json(StackCue *cue, const char *json_data)
 
 				if (cue_data.isMember(property_name))
 				{
-					StackProperty *crosspoint_property = stack_fade_cue_get_crosspoint_property(cue, input_channel, output_channel, true);
 					if (cue_data[property_name].isString() && cue_data[property_name].asString() == "-Infinite")
 					{
-						stack_property_set_double(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, -INFINITY);
-						stack_property_set_null(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, false);
+						stack_property_matrix_set(crosspoints, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, -INFINITY);
 					}
 					else if (cue_data[property_name].isNull())
 					{
-						stack_property_set_double(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, 0.0);
-						stack_property_set_null(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, true);
+						stack_property_matrix_set(crosspoints, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, NAN);
 					}
 					else
 					{
-						stack_property_set_double(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, cue_data[property_name].asDouble());
-						stack_property_set_null(crosspoint_property, STACK_PROPERTY_VERSION_DEFINED, false);
+						stack_property_matrix_set(crosspoints, STACK_PROPERTY_VERSION_DEFINED, output_channel, input_channel, cue_data[property_name].asDouble());
 					}
 				}
 			}
@@ -1233,6 +1224,13 @@ void stack_fade_cue_register()
 	// Load the icon
 	icon = gdk_pixbuf_new_from_resource("/org/stack/icons/stackfadecue.png", NULL);
 
+	// Register the names of our properties
+	sfc_keys.target = stack_property_register_key("target");
+	sfc_keys.master_volume = stack_property_register_key("master_volume");
+	sfc_keys.stop_target = stack_property_register_key("stop_target");
+	sfc_keys.profile = stack_property_register_key("profile");
+	sfc_keys.crosspoint = stack_property_register_key("crosspoint");
+
 	// Register built in cue types
 	StackCueClass* fade_cue_class = new StackCueClass{ "StackFadeCue", "StackCue", "Fade Cue", stack_fade_cue_create, stack_fade_cue_destroy, stack_fade_cue_play, NULL, stack_fade_cue_stop, stack_fade_cue_pulse, stack_fade_cue_set_tabs, stack_fade_cue_unset_tabs, stack_fade_cue_to_json, stack_fade_cue_free_json, stack_fade_cue_from_json, stack_fade_cue_get_error, NULL, NULL, stack_fade_cue_get_field, stack_fade_cue_get_icon, NULL, NULL };
 	stack_register_cue_class(fade_cue_class);
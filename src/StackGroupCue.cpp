@@ -9,6 +9,7 @@
 #include <cmath>
 #include <list>
 #include <set>
+#include <vector>
 
 // Global: A single instance of our builder so we don't have to keep reloading
 // it every time we change the selected cue
@@ -17,6 +18,15 @@ static GtkBuilder *sgc_builder = NULL;
 // Global: A single instace of our icon
 static GdkPixbuf *icon = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackGroupCueKeys
+{
+	stack_property_key_t action;
+	stack_property_key_t master_volume;
+};
+static StackGroupCueKeys sgc_keys;
+
 static void stack_group_cue_ccb_action(StackProperty *property, StackPropertyVersion version, void *user_data)
 {
 	// If a defined-version property has changed, we should notify the cue list
@@ -70,13 +80,13 @@ static StackCue* stack_group_cue_create(StackCueList *cue_list)
 	// Initialise superclass variables
 	stack_cue_set_name(STACK_CUE(cue), "Group");
 
-	StackProperty *action = stack_property_create("action", STACK_PROPERTY_TYPE_INT32);
+	StackProperty *action = stack_property_create_keyed(sgc_keys.action, STACK_PROPERTY_TYPE_INT32);
 	stack_cue_add_property(STACK_CUE(cue), action);
 	stack_property_set_int32(action, STACK_PROPERTY_VERSION_DEFINED, STACK_GROUP_CUE_ENTER);
 	stack_property_set_changed_callback(action, stack_group_cue_ccb_action, (void*)cue);
 
 	// This property is not exposed to the user and is only used for live volume changes
-	StackProperty *volume = stack_property_create("master_volume", STACK_PROPERTY_TYPE_DOUBLE);
+	StackProperty *volume = stack_property_create_keyed(sgc_keys.master_volume, STACK_PROPERTY_TYPE_DOUBLE);
 	stack_cue_add_property(STACK_CUE(cue), volume);
 
 	return STACK_CUE(cue);
@@ -706,31 +716,29 @@ static void stack_group_cue_unset_tabs(StackCue *cue, GtkNotebook *notebook)
 	STACK_GROUP_CUE(cue)->group_tab = NULL;
 }
 
-/// Saves the details of this cue as JSON
-static char *stack_group_cue_to_json(StackCue *cue)
+/// Writes the details of this cue to a JSON value
+static void stack_group_cue_to_json_value(StackCue *cue, Json::Value &root)
 {
 	StackGroupCue *gcue = STACK_GROUP_CUE(cue);
 
-	// Build JSON
-	Json::Value root;
+	Json::Value &cues_root = root["cues"];
+	cues_root = Json::Value(Json::ValueType::arrayValue);
 
-	root["cues"] = Json::Value(Json::ValueType::arrayValue);
-
-	// Iterate over all the cues
-	for (auto cue : *gcue->cues)
+	// Iterate over all the cues, writing each directly in to the cues entry
+	for (auto child_cue : *gcue->cues)
 	{
-		// Get the JSON representation of the cue
-		Json::Value cue_root;
-		char *cue_json_data = stack_cue_to_json(cue);
-		stack_json_read_string(cue_json_data, &cue_root);
-		stack_cue_free_json(cue, cue_json_data);
-
-		// Add it to the cues entry
-		root["cues"].append(cue_root);
+		stack_cue_to_json_value(child_cue, cues_root.append(Json::Value()));
 	}
 
 	// Write out properties
 	stack_property_write_json(stack_cue_get_property(cue, "action"), &root);
+}
+
+/// Saves the details of this cue as JSON
+static char *stack_group_cue_to_json(StackCue *cue)
+{
+	Json::Value root;
+	stack_group_cue_to_json_value(cue, root);
 
 	// Write out JSON string and return (to be free'd by
 	// stack_fade_cue_free_json)
@@ -744,14 +752,9 @@ static void stack_group_cue_free_json(StackCue *cue, char *json_data)
 	free(json_data);
 }
 
-/// Re-initialises this cue from JSON Data
-void stack_group_cue_from_json(StackCue *cue, const char *json_data)
+/// Re-initialises this cue from a JSON value
+static void stack_group_cue_from_json_value(StackCue *cue, const Json::Value &cue_root)
 {
-	Json::Value cue_root;
-
-	// Parse JSON data
-	stack_json_read_string(json_data, &cue_root);
-
 	// Get the data that's pertinent to us
 	if (!cue_root.isMember("StackGroupCue"))
 	{
@@ -759,7 +762,7 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 		return;
 	}
 
-	Json::Value& cue_data = cue_root["StackGroupCue"];
+	const Json::Value& cue_data = cue_root["StackGroupCue"];
 
 	// Read our properties
 	stack_group_cue_set_action(STACK_GROUP_CUE(cue), (StackGroupCueAction)cue_data["action"].asInt());
@@ -767,21 +770,25 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 	// If we have some cues...
 	if (cue_data.isMember("cues"))
 	{
-		Json::Value& cues_root = cue_data["cues"];
+		const Json::Value& cues_root = cue_data["cues"];
 
 		if (cues_root.isArray())
 		{
+			// The cues we create on the first pass, so that we can re-use
+			// them on the second loop (NULL for cues we skipped)
+			std::vector<StackCue*> child_cues;
+			child_cues.reserve(cues_root.size());
+
 			// Iterate over the cues, creating their instances, and populating
 			// just their base classes (we need to have built a UID map)
-			int cue_count = 0;
 			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter)
 			{
-				Json::Value& cue_json = *iter;
+				const Json::Value& cue_json = *iter;
+				child_cues.push_back(NULL);
 
 				// Make sure we have a class parameter
 				if (!cue_json.isMember("class"))
 				{
-					cue_json["_skip"] = 1;
 					stack_log("stack_group_cue_from_json(): Cue missing 'class' parameter, skipping\n");
 					continue;
 				}
@@ -789,7 +796,6 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 				// Make sure we have a base class
 				if (!cue_json.isMember("StackCue"))
 				{
-					cue_json["_skip"] = 1;
 					stack_log("stack_group_cue_from_json(): Cue missing 'StackCue' class, skipping\n");
 					continue;
 				}
@@ -797,18 +803,16 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 				// Make sure we have a UID
 				if (!cue_json["StackCue"].isMember("uid"))
 				{
-					cue_json["_skip"] = 1;
 					stack_log("stack_group_cue_from_json(): Cue missing UID, skipping\n");
 					continue;
 				}
 
 				// Create a new cue of the correct type
-				const char *class_name = cue_json["class"].asString().c_str();
-				StackCue *child_cue = stack_cue_new(class_name, cue->parent);
+				const std::string class_name = cue_json["class"].asString();
+				StackCue *child_cue = stack_cue_new(class_name.c_str(), cue->parent);
 				if (child_cue == NULL)
 				{
-					stack_log("stack_group_cue_from_json(): Failed to create cue of type '%s', skipping\n", class_name);
-					cue_json["_skip"] = 1;
+					stack_log("stack_group_cue_from_json(): Failed to create cue of type '%s', skipping\n", class_name.c_str());
 
 					// TODO: It would be nice if we have some sort of "error cue" which
 					// contained the JSON for the cue, so we didn't just drop cues from
@@ -817,35 +821,34 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 					continue;
 				}
 
-				// Get the UID of the newly created cue and put a mapping from
-				// the old UID to the new UID. Also store it in the JSON object
-				// so that we can re-use it on the second loop
+				// Put a mapping from the old UID to the UID of the newly
+				// created cue
 				(*cue->parent->uid_remap)[cue_json["StackCue"]["uid"].asUInt64()] = child_cue->uid;
-				cue_json["_new_uid"] = (Json::UInt64)child_cue->uid;
+				child_cues.back() = child_cue;
 
 				// Call base constructor
-				stack_cue_from_json_base(child_cue, cue_json.toStyledString().c_str());
+				stack_cue_from_json_value_base(child_cue, cue_json);
 
 				// Append the cue to the child list
 				child_cue->parent_cue = cue;
 				STACK_GROUP_CUE(cue)->cues->push_back(child_cue);
 			}
 
+			// Let the cue list know about the new children
+			stack_cue_list_changed(cue->parent, cue, NULL);
+
 			// Iterate over the cues again calling their actual constructor
-			int prepared_cues = 0;
-			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter)
+			size_t index = 0;
+			for (auto iter = cues_root.begin(); iter != cues_root.end(); ++iter, index++)
 			{
-				Json::Value& cue_json = *iter;
-
 				// Skip over cues we skipped because of errors last time
-				if (cue_json.isMember("_skip"))
+				if (child_cues[index] == NULL)
 				{
 					continue;
 				}
 
 				// Call the appropriate overloaded function
-				stack_cue_from_json(stack_cue_get_by_uid(cue_json["_new_uid"].asUInt64()), cue_json.toStyledString().c_str());
-				prepared_cues++;
+				stack_cue_from_json_value(child_cues[index], *iter);
 			}
 		}
 		else
@@ -859,6 +862,17 @@ void stack_group_cue_from_json(StackCue *cue, const char *json_data)
 	}
 }
 
+/// Re-initialises this cue from JSON Data
+void stack_group_cue_from_json(StackCue *cue, const char *json_data)
+{
+	Json::Value cue_root;
+
+	// Parse JSON data
+	stack_json_read_string(json_data, &cue_root);
+
+	stack_group_cue_from_json_value(cue, cue_root);
+}
+
 /// Gets the error message for the cue
 bool stack_group_cue_get_error(StackCue *cue, char *message, size_t size)
 {
@@ -913,7 +927,11 @@ void stack_group_cue_register()
 	// Load the icon
 	icon = gdk_pixbuf_new_from_resource("/org/stack/icons/stackgroupcue.png", NULL);
 
+	// Register the names of our properties
+	sgc_keys.action = stack_property_register_key("action");
+	sgc_keys.master_volume = stack_property_register_key("master_volume");
+
 	// Register built in cue types
-	StackCueClass* action_cue_class = new StackCueClass{ "StackGroupCue", "StackCue", "Group Cue", stack_group_cue_create, stack_group_cue_destroy, stack_group_cue_play, stack_group_cue_pause, stack_group_cue_stop, stack_group_cue_pulse, stack_group_cue_set_tabs, stack_group_cue_unset_tabs, stack_group_cue_to_json, stack_group_cue_free_json, stack_group_cue_from_json, stack_group_cue_get_error, stack_group_cue_get_active_channels, stack_group_cue_get_audio, NULL, stack_group_cue_get_icon, stack_group_cue_get_children, stack_group_cue_get_next_cue };
+	StackCueClass* action_cue_class = new StackCueClass{ "StackGroupCue", "StackCue", "Group Cue", stack_group_cue_create, stack_group_cue_destroy, stack_group_cue_play, stack_group_cue_pause, stack_group_cue_stop, stack_group_cue_pulse, stack_group_cue_set_tabs, stack_group_cue_unset_tabs, stack_group_cue_to_json, stack_group_cue_free_json, stack_group_cue_from_json, stack_group_cue_get_error, stack_group_cue_get_active_channels, stack_group_cue_get_audio, NULL, stack_group_cue_get_icon, stack_group_cue_get_children, stack_group_cue_get_next_cue, stack_group_cue_to_json_value, stack_group_cue_from_json_value };
 	stack_register_cue_class(action_cue_class);
 }
@@ -0,0 +1,113 @@
+// Includes:
+#include "StackMediaCache.h"
+#include "StackLog.h"
+#include <cstring>
+#include <vector>
+
+bool stack_media_cache_get_key(GFile *file, uint64_t *size, uint64_t *mtime)
+{
+	GFileInfo *file_info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (file_info == NULL)
+	{
+		return false;
+	}
+
+	*size = (uint64_t)g_file_info_get_size(file_info);
+	*mtime = g_file_info_get_attribute_uint64(file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * 1000000 + g_file_info_get_attribute_uint32(file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	g_object_unref(file_info);
+
+	return true;
+}
+
+char *stack_media_cache_get_path(GFile *file, const char *type)
+{
+	// Name the cache after a hash of the URI so that files with the same name
+	// in different directories don't collide
+	char *uri = g_file_get_uri(file);
+	char *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri, -1);
+	char *filename = g_strdup_printf("%s.%s", hash, type);
+	char *path = g_build_filename(g_get_user_cache_dir(), "stack", filename, NULL);
+
+	// Tidy up
+	g_free(filename);
+	g_free(hash);
+	g_free(uri);
+
+	return path;
+}
+
+GMappedFile *stack_media_cache_map(GFile *file, const char *type, uint32_t version, const char **payload, size_t *payload_size)
+{
+	uint64_t file_size = 0, file_mtime = 0;
+	if (!stack_media_cache_get_key(file, &file_size, &file_mtime))
+	{
+		return NULL;
+	}
+
+	char *path = stack_media_cache_get_path(file, type);
+	GMappedFile *mapped = g_mapped_file_new(path, false, NULL);
+	g_free(path);
+	if (mapped == NULL)
+	{
+		return NULL;
+	}
+
+	// Validate the header against what we expect
+	const char *contents = g_mapped_file_get_contents(mapped);
+	const size_t length = g_mapped_file_get_length(mapped);
+	const StackMediaCacheHeader *header = (const StackMediaCacheHeader*)contents;
+	if (length < sizeof(StackMediaCacheHeader)
+		|| memcmp(header->magic, "STKC", 4) != 0
+		|| memcmp(header->type, type, 4) != 0
+		|| header->version != version
+		|| header->file_size != file_size
+		|| header->file_mtime != file_mtime
+		|| header->payload_size != length - sizeof(StackMediaCacheHeader))
+	{
+		g_mapped_file_unref(mapped);
+		return NULL;
+	}
+
+	*payload = contents + sizeof(StackMediaCacheHeader);
+	*payload_size = header->payload_size;
+
+	return mapped;
+}
+
+bool stack_media_cache_write(GFile *file, const char *type, uint32_t version, const void *payload, size_t payload_size)
+{
+	StackMediaCacheHeader header;
+	memcpy(header.magic, "STKC", 4);
+	memcpy(header.type, type, 4);
+	header.version = version;
+	header.reserved = 0;
+	header.payload_size = payload_size;
+	if (!stack_media_cache_get_key(file, &header.file_size, &header.file_mtime))
+	{
+		return false;
+	}
+
+	// Make sure the cache directory exists
+	char *directory = g_build_filename(g_get_user_cache_dir(), "stack", NULL);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+
+	// Build the file contents
+	std::vector<char> contents(sizeof(StackMediaCacheHeader) + payload_size);
+	memcpy(&contents[0], &header, sizeof(StackMediaCacheHeader));
+	memcpy(&contents[sizeof(StackMediaCacheHeader)], payload, payload_size);
+
+	// This writes to a temporary file and renames it over the top, so readers
+	// never see a partially-written cache
+	char *path = stack_media_cache_get_path(file, type);
+	GError *error = NULL;
+	bool result = g_file_set_contents(path, &contents[0], contents.size(), &error);
+	if (!result)
+	{
+		stack_log("stack_media_cache_write(): Failed to write %s: %s\n", path, error->message);
+		g_error_free(error);
+	}
+	g_free(path);
+
+	return result;
+}
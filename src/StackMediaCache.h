@@ -0,0 +1,66 @@
+#ifndef _STACKMEDIACACHE_H_INCLUDED
+#define _STACKMEDIACACHE_H_INCLUDED
+
+// Includes:
+#include <cstdint>
+#include <cstdlib>
+#include <gtk/gtk.h>
+
+// Sidecar caches hold data derived from a media file (frame indexes, seek
+// tables, waveform peaks) that is expensive to regenerate. They live in the
+// user's cache directory, named from a hash of the media file URI, and are
+// only considered valid whilst the size and modification time of the media
+// file match those recorded when the cache was written
+
+// Header written at the start of every cache file
+#pragma pack(push, 1)
+struct StackMediaCacheHeader
+{
+	char magic[4];          // Always "STKC"
+	char type[4];           // The type of the cache (e.g. "mp3i")
+	uint32_t version;       // The version of the cache type's payload
+	uint32_t reserved;      // Always zero
+	uint64_t file_size;     // The size of the media file in bytes
+	uint64_t file_mtime;    // The modification time of the media file in microseconds
+	uint64_t payload_size;  // The size of the data following this header
+};
+#pragma pack(pop)
+
+// Functions:
+
+// Gets the size and modification time of a media file, which together identify
+// a particular version of it
+// @param file The media file
+// @param size Receives the size of the file in bytes
+// @param mtime Receives the modification time of the file in microseconds
+// @returns Whether the details could be read
+bool stack_media_cache_get_key(GFile *file, uint64_t *size, uint64_t *mtime);
+
+// Returns the path of the cache file of the given type for a media file. The
+// result should be freed with g_free()
+// @param file The media file
+// @param type The four-character cache type
+char *stack_media_cache_get_path(GFile *file, const char *type);
+
+// Memory-maps a cache file of the given type for a media file, checking that it
+// is valid for the current version of the file
+// @param file The media file
+// @param type The four-character cache type
+// @param version The expected version of the payload
+// @param payload Receives a pointer to the payload within the mapping
+// @param payload_size Receives the size of the payload in bytes
+// @returns A mapped file (to be released with g_mapped_file_unref) or NULL if
+// there is no valid cache
+GMappedFile *stack_media_cache_map(GFile *file, const char *type, uint32_t version, const char **payload, size_t *payload_size);
+
+// Writes (atomically replacing) the cache file of the given type for a media
+// file. Safe to call from any thread
+// @param file The media file
+// @param type The four-character cache type
+// @param version The version of the payload
+// @param payload The data to write
+// @param payload_size The size of the data in bytes
+// @returns Whether the cache was written
+bool stack_media_cache_write(GFile *file, const char *type, uint32_t version, const void *payload, size_t payload_size);
+
+#endif
@@ -16,6 +16,18 @@ static GtkBuilder *smc_builder = NULL;
 // Global: A single instace of our icon
 static GdkPixbuf *icon = NULL;
 
+// Global: The keys of our properties, registered along with the class so that
+// cues can find them without a string lookup
+struct StackMidiCueKeys
+{
+	stack_property_key_t midi_patch;
+	stack_property_key_t event_type;
+	stack_property_key_t channel;
+	stack_property_key_t param1;
+	stack_property_key_t param2;
+};
+static StackMidiCueKeys smc_keys;
+
 // Pre-defs:
 bool stack_midi_cue_get_error(StackCue *cue, char *message, size_t size);
 
@@ -252,27 +264,27 @@ static StackCue* stack_midi_cue_create(StackCueList *cue_list)
 	cue->midi_tab = NULL;
 	stack_cue_set_action_time(STACK_CUE(cue), 1);
 
-	StackProperty *midi_patch = stack_property_create("midi_patch", STACK_PROPERTY_TYPE_STRING);
+	StackProperty *midi_patch = stack_property_create_keyed(smc_keys.midi_patch, STACK_PROPERTY_TYPE_STRING);
 	stack_cue_add_property(STACK_CUE(cue), midi_patch);
 	stack_property_set_changed_callback(midi_patch, stack_midi_cue_ccb_generic, (void*)cue);
 
-	StackProperty *event_type = stack_property_create("event_type", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *event_type = stack_property_create_keyed(smc_keys.event_type, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(STACK_CUE(cue), event_type);
 	stack_property_set_changed_callback(event_type, stack_midi_cue_ccb_generic, (void*)cue);
 	stack_property_set_uint8(event_type, STACK_PROPERTY_VERSION_DEFINED, STACK_MIDI_EVENT_NOTE_ON);
 
-	StackProperty *channel = stack_property_create("channel", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *channel = stack_property_create_keyed(smc_keys.channel, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(STACK_CUE(cue), channel);
 	stack_property_set_changed_callback(channel, stack_midi_cue_ccb_channel, (void*)cue);
 	stack_property_set_validator(channel, (stack_property_validator_t)stack_midi_cue_validate_channel, (void*)cue);
 	stack_property_set_uint8(channel, STACK_PROPERTY_VERSION_DEFINED, 1);
 
-	StackProperty *param1 = stack_property_create("param1", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *param1 = stack_property_create_keyed(smc_keys.param1, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(STACK_CUE(cue), param1);
 	stack_property_set_changed_callback(param1, stack_midi_cue_ccb_param1, (void*)cue);
 	stack_property_set_validator(param1, (stack_property_validator_t)stack_midi_cue_validate_parameter, (void*)cue);
 
-	StackProperty *param2 = stack_property_create("param2", STACK_PROPERTY_TYPE_UINT8);
+	StackProperty *param2 = stack_property_create_keyed(smc_keys.param2, STACK_PROPERTY_TYPE_UINT8);
 	stack_cue_add_property(STACK_CUE(cue), param2);
 	stack_property_set_changed_callback(param2, stack_midi_cue_ccb_param2, (void*)cue);
 	stack_property_set_validator(param2, (stack_property_validator_t)stack_midi_cue_validate_parameter, (void*)cue);
@@ -784,6 +796,13 @@ void stack_midi_cue_register()
 	// Load the icons
 	icon = gdk_pixbuf_new_from_resource("/org/stack/icons/stackmidicue.png", NULL);
 
+	// Register the names of our properties
+	smc_keys.midi_patch = stack_property_register_key("midi_patch");
+	smc_keys.event_type = stack_property_register_key("event_type");
+	smc_keys.channel = stack_property_register_key("channel");
+	smc_keys.param1 = stack_property_register_key("param1");
+	smc_keys.param2 = stack_property_register_key("param2");
+
 	// Register built in cue types
 	StackCueClass* midi_cue_class = new StackCueClass{ "StackMidiCue", "StackCue", "MIDI Cue", stack_midi_cue_create, stack_midi_cue_destroy, stack_midi_cue_play, NULL, NULL, stack_midi_cue_pulse, stack_midi_cue_set_tabs, stack_midi_cue_unset_tabs, stack_midi_cue_to_json, stack_midi_cue_free_json, stack_midi_cue_from_json, stack_midi_cue_get_error, NULL, NULL, stack_midi_cue_get_field, stack_midi_cue_get_icon, NULL, NULL };
 	stack_register_cue_class(midi_cue_class);
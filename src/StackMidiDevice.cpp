@@ -271,29 +271,35 @@ void stack_midi_device_destroy(StackMidiDevice *mdev)
 	iter->second->destroy_func(mdev);
 }
 
-char *stack_midi_device_to_json(StackMidiDevice *mdev)
+void stack_midi_device_to_json_value(StackMidiDevice *mdev, Json::Value &mdev_root)
 {
 	// Get the class name
 	const char *class_name = mdev->_class_name;
 
 	// Start a JSON response value
-	Json::Value mdev_root;
 	mdev_root["class"] = mdev->_class_name;
 
 	// Look for a to_json function. Iterate through superclasses if we don't have one
 	while (class_name != NULL)
 	{
 		// Start a node
-		mdev_root[class_name] = Json::Value();
+		Json::Value &class_root = mdev_root[class_name];
+		class_root = Json::Value();
 
-		if (mdev_class_map[class_name]->to_json_func)
+		if (mdev_class_map[class_name]->to_json_value_func)
+		{
+			mdev_class_map[class_name]->to_json_value_func(mdev, class_root);
+		}
+		else if (mdev_class_map[class_name]->to_json_func)
 		{
+			// Fall back to the string interface
 			if (mdev_class_map[class_name]->free_json_func)
 			{
 				char *json_data = mdev_class_map[class_name]->to_json_func(mdev);
 				if (json_data != NULL)
 				{
-					stack_json_read_string(json_data, &mdev_root[class_name]);
+					stack_json_read_string(json_data, &class_root);
+					mdev_class_map[class_name]->free_json_func(mdev, json_data);
 				}
 			}
 			else
@@ -309,24 +315,45 @@ char *stack_midi_device_to_json(StackMidiDevice *mdev)
 		// Iterate up to superclass
 		class_name = mdev_class_map[class_name]->super_class_name;
 	}
+}
+
+char *stack_midi_device_to_json(StackMidiDevice *mdev)
+{
+	Json::Value mdev_root;
+	stack_midi_device_to_json_value(mdev, mdev_root);
 
 	// Generate JSON string and return it (to be free'd by stack_midi_device_free_json)
 	Json::StreamWriterBuilder builder;
 	return strdup(Json::writeString(builder, mdev_root).c_str());
 }
 
-void stack_midi_device_from_json(StackMidiDevice *mdev, const char *json_data)
+void stack_midi_device_from_json_value(StackMidiDevice *mdev, const Json::Value &mdev_root)
 {
 	const char *class_name = mdev->_class_name;
 
 	// Look for a from_json function. Iterate through superclasses if we don't have one
-	while (class_name != NULL && mdev_class_map[class_name]->from_json_func == NULL)
+	while (class_name != NULL && mdev_class_map[class_name]->from_json_value_func == NULL && mdev_class_map[class_name]->from_json_func == NULL)
 	{
 		class_name = mdev_class_map[class_name]->super_class_name;
 	}
 
-	// Call the function
-	mdev_class_map[string(class_name)]->from_json_func(mdev, json_data);
+	// Call the function, falling back to the string interface
+	const StackMidiDeviceClass *mdev_class = mdev_class_map[string(class_name)];
+	if (mdev_class->from_json_value_func)
+	{
+		mdev_class->from_json_value_func(mdev, mdev_root);
+	}
+	else
+	{
+		mdev_class->from_json_func(mdev, mdev_root.toStyledString().c_str());
+	}
+}
+
+void stack_midi_device_from_json(StackMidiDevice *mdev, const char *json_data)
+{
+	Json::Value mdev_root;
+	stack_json_read_string(json_data, &mdev_root);
+	stack_midi_device_from_json_value(mdev, mdev_root);
 }
 
 void stack_midi_device_free_json(StackMidiDevice *mdev, char *json_data)
@@ -343,12 +370,16 @@ void stack_midi_device_free_json(StackMidiDevice *mdev, char *json_data)
 	mdev_class_map[string(class_name)]->free_json_func(mdev, json_data);
 }
 
+void stack_midi_device_to_json_value_base(StackMidiDevice *mdev, Json::Value &mdev_data)
+{
+	mdev_data["name"] = mdev->descriptor.name;
+	mdev_data["desc"] = mdev->descriptor.desc;
+}
+
 char *stack_midi_device_to_json_base(StackMidiDevice *mdev)
 {
 	Json::Value mdev_root;
-
-	mdev_root["name"] = mdev->descriptor.name;
-	mdev_root["desc"] = mdev->descriptor.desc;
+	stack_midi_device_to_json_value_base(mdev, mdev_root);
 
 	// Write out the JSON string and return it (to be free'd by
 	// stack_midi_device_free_json_base)
@@ -363,8 +394,13 @@ void stack_midi_device_from_json_base(StackMidiDevice *mdev, const char *json_da
 	// Parse JSON data
 	stack_json_read_string(json_data, &mdev_root);
 
+	stack_midi_device_from_json_value_base(mdev, mdev_root);
+}
+
+void stack_midi_device_from_json_value_base(StackMidiDevice *mdev, const Json::Value &mdev_root)
+{
 	// Get the data that's pertinent to us
-	Json::Value &stack_midi_device_data = mdev_root["StackMidiDevice"];
+	const Json::Value &stack_midi_device_data = mdev_root["StackMidiDevice"];
 
 	// Copy the data to the device
 	if (mdev->descriptor.name != NULL)
@@ -420,6 +456,6 @@ const StackMidiDeviceClassMap *stack_midi_device_class_get_map()
 // Registers base classes
 void stack_midi_device_initsystem()
 {
-	StackMidiDeviceClass* midi_device_class = new StackMidiDeviceClass{ "StackMidiDevice", NULL, NULL, NULL, stack_midi_device_create_base, stack_midi_device_destroy_base, stack_midi_device_get_friendly_name_base, stack_midi_device_send_event_base, stack_midi_device_to_json_base, stack_midi_device_from_json_base, stack_midi_device_free_json_base };
+	StackMidiDeviceClass* midi_device_class = new StackMidiDeviceClass{ "StackMidiDevice", NULL, NULL, NULL, stack_midi_device_create_base, stack_midi_device_destroy_base, stack_midi_device_get_friendly_name_base, stack_midi_device_send_event_base, stack_midi_device_to_json_base, stack_midi_device_from_json_base, stack_midi_device_free_json_base, stack_midi_device_to_json_value_base, stack_midi_device_from_json_value_base };
 	stack_register_midi_device_class(midi_device_class);
 }
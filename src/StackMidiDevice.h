@@ -8,6 +8,7 @@
 #include <string>
 #include <queue>
 #include <cstdint>
+#include <json/json.h>
 #include "semaphore.h"
 
 // Structure: Descriptor of a MIDI device
@@ -69,6 +70,8 @@ typedef bool(*stack_midi_device_send_event_t)(StackMidiDevice *, StackMidiEvent
 typedef char*(*stack_midi_device_to_json_t)(StackMidiDevice *);
 typedef void(*stack_midi_device_from_json_t)(StackMidiDevice *, const char *);
 typedef void(*stack_midi_device_free_json_t)(StackMidiDevice *, char *);
+typedef void(*stack_midi_device_to_json_value_t)(StackMidiDevice *, Json::Value &);
+typedef void(*stack_midi_device_from_json_value_t)(StackMidiDevice *, const Json::Value &);
 
 struct StackMidiDeviceClass
 {
@@ -84,6 +87,11 @@ struct StackMidiDeviceClass
 	stack_midi_device_to_json_t to_json_func;
 	stack_midi_device_from_json_t from_json_func;
 	stack_midi_device_free_json_t free_json_func;
+
+	// Structured alternatives to to_json_func and from_json_func, used in
+	// preference where provided
+	stack_midi_device_to_json_value_t to_json_value_func;
+	stack_midi_device_from_json_value_t from_json_value_func;
 };
 
 // Typedefs:
@@ -102,11 +110,15 @@ void stack_midi_device_init(StackMidiDevice *mdev, const char *name, const char
 // of StackMidiDevice
 void stack_midi_device_destroy_base(StackMidiDevice *mdev);
 void stack_midi_device_from_json_base(StackMidiDevice *mdev, const char *json_data);
+void stack_midi_device_to_json_value_base(StackMidiDevice *mdev, Json::Value &mdev_data);
+void stack_midi_device_from_json_value_base(StackMidiDevice *mdev, const Json::Value &mdev_root);
 
 // I/O
 char *stack_midi_device_to_json(StackMidiDevice *mdev);
 void stack_midi_device_from_json(StackMidiDevice *mdev, const char *json_data);
 void stack_midi_device_free_json(StackMidiDevice *mdev, char *json_data);
+void stack_midi_device_to_json_value(StackMidiDevice *mdev, Json::Value &mdev_root);
+void stack_midi_device_from_json_value(StackMidiDevice *mdev, const Json::Value &mdev_root);
 
 // Functions: Arbitrary MIDI device creation/deletion
 StackMidiDevice *stack_midi_device_new(const char *type, const char *name, const char *desc);
@@ -6,6 +6,78 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// The names of the fixed property keys, in the same order as the keys
+static const char *stack_property_builtin_key_names[STACK_PROPERTY_KEY_BUILTIN_COUNT] = {
+	"",
+	"name", "script_ref", "notes", "r", "g", "b", "pre_time", "action_time", "post_time", "post_trigger",
+};
+
+// The names of the other keys, in chunks indexed by key. Names are never
+// removed, so each is published once through an atomic and can then be read
+// without a lock
+#define STACK_PROPERTY_KEY_CHUNK_SIZE 256
+#define STACK_PROPERTY_KEY_MAX_CHUNKS 4096
+static std::atomic<std::atomic<const char*>*> stack_property_key_chunks[STACK_PROPERTY_KEY_MAX_CHUNKS];
+
+// The keys of the names, and the next keys to give out with and without a
+// slot. Only used when giving out keys
+static std::mutex stack_property_keys_mutex;
+static std::unordered_map<std::string, stack_property_key_t> stack_property_keys;
+static stack_property_key_t stack_property_next_slot_key = STACK_PROPERTY_KEY_BUILTIN_COUNT;
+static stack_property_key_t stack_property_next_key = STACK_PROPERTY_KEY_SLOT_COUNT;
+
+// Change notifications held back by a batch on this thread (see
+// stack_property_batch_begin), in the order the properties first changed, and
+// as a set so we can quickly tell if a change is already being held back
+typedef std::pair<StackProperty*, StackPropertyVersion> StackPropertyChange;
+typedef std::pair<const StackProperty*, StackPropertyVersion> StackPropertyChangeKey;
+
+// Hashes a change in stack_property_batch_change_set
+struct StackPropertyChangeKeyHash
+{
+	size_t operator()(const StackPropertyChangeKey &key) const
+	{
+		return std::hash<const StackProperty*>()(key.first) * 31 + (size_t)key.second;
+	}
+};
+
+static thread_local size_t stack_property_batch_depth = 0;
+static thread_local std::vector<StackPropertyChange> stack_property_batch_changes;
+static thread_local std::unordered_set<StackPropertyChangeKey, StackPropertyChangeKeyHash> stack_property_batch_change_set;
+
+// Returns whether a change to a property is being held back by a batch
+static bool stack_property_batch_pending(const StackProperty *property, StackPropertyVersion version)
+{
+	return stack_property_batch_depth > 0 && stack_property_batch_change_set.count(StackPropertyChangeKey(property, version)) > 0;
+}
+
+// Calls the changed callback of a property, or holds it back until the end of
+// the batch if there is one
+static void stack_property_notify(StackProperty *property, StackPropertyVersion version)
+{
+	if (property->change_callbacks_paused || property->changed_callback == NULL)
+	{
+		return;
+	}
+
+	if (stack_property_batch_depth > 0)
+	{
+		if (stack_property_batch_change_set.insert(StackPropertyChangeKey(property, version)).second)
+		{
+			stack_property_batch_changes.push_back(StackPropertyChange(property, version));
+		}
+		return;
+	}
+
+	property->changed_callback(property, version, property->changed_callback_user_data);
+}
 
 #define CASE_PROPERTY_INTS(size) \
 	case STACK_PROPERTY_TYPE_INT##size: \
@@ -27,7 +99,8 @@
 		p = (StackProperty*)p_uint##size; \
 		break;
 
-StackProperty *stack_property_create(const char *property, StackPropertyType type)
+// Creates a new StackProperty object with the given name and key
+static StackProperty *stack_property_new(const char *property, stack_property_key_t key, StackPropertyType type)
 {
 	StackProperty *p = NULL;
 	switch (type)
@@ -63,6 +136,16 @@ StackProperty *stack_property_create(const char *property, StackPropertyType typ
 			p_string->validator = NULL;
 			p = (StackProperty*)p_string;
 			break;
+		case STACK_PROPERTY_TYPE_MATRIX:
+			StackPropertyMatrix *p_matrix;
+			p_matrix = new StackPropertyMatrix;
+			p_matrix->cells.store(NULL);
+			p_matrix->readers.store(0);
+			p_matrix->changed_row = 0;
+			p_matrix->changed_column = 0;
+			p_matrix->validator = NULL;
+			p = (StackProperty*)p_matrix;
+			break;
 		default:
 			return NULL;
 	}
@@ -70,6 +153,7 @@ StackProperty *stack_property_create(const char *property, StackPropertyType typ
 	// Set up the property
 	p->type = type;
 	p->name = strdup(property);
+	p->key = key;
 	p->changed_callback = NULL;
 	p->changed_callback_user_data = NULL;
 	p->change_callbacks_paused = 0;
@@ -81,6 +165,33 @@ StackProperty *stack_property_create(const char *property, StackPropertyType typ
 	return p;
 }
 
+StackProperty *stack_property_create(const char *property, StackPropertyType type)
+{
+	return stack_property_new(property, stack_property_key(property), type);
+}
+
+StackProperty *stack_property_create_keyed(stack_property_key_t key, StackPropertyType type)
+{
+	const char *name = stack_property_key_name(key);
+	if (name == NULL)
+	{
+		stack_log("stack_property_create_keyed(): Unknown key %u\n", key);
+		return NULL;
+	}
+
+	return stack_property_new(name, key, type);
+}
+
+// Frees the storage of the cells of a matrix
+static void stack_property_matrix_free_cells(StackPropertyMatrixCells *cells)
+{
+	if (cells != NULL)
+	{
+		delete [] cells->assigned;
+		delete cells;
+	}
+}
+
 void stack_property_destroy(StackProperty *property)
 {
 	if (property == NULL)
@@ -88,6 +199,23 @@ void stack_property_destroy(StackProperty *property)
 		return;
 	}
 
+	// Forget about any change that's being held back
+	if (stack_property_batch_depth > 0)
+	{
+		bool pending = false;
+		for (StackPropertyVersion version : { STACK_PROPERTY_VERSION_DEFINED, STACK_PROPERTY_VERSION_LIVE, STACK_PROPERTY_VERSION_TARGET })
+		{
+			pending = stack_property_batch_change_set.erase(StackPropertyChangeKey(property, version)) > 0 || pending;
+		}
+		if (pending)
+		{
+			for (auto iter = stack_property_batch_changes.begin(); iter != stack_property_batch_changes.end(); )
+			{
+				iter = (iter->first == property) ? stack_property_batch_changes.erase(iter) : iter + 1;
+			}
+		}
+	}
+
 	// Base tidy up
 	free(property->name);
 
@@ -127,12 +255,25 @@ void stack_property_destroy(StackProperty *property)
 			delete (StackPropertyDouble*)property;
 			break;
 		case STACK_PROPERTY_TYPE_STRING:
+		{
 			StackPropertyString *p_string = (StackPropertyString*)property;
 			free(p_string->defined);
 			free(p_string->live);
 			free(p_string->target);
 			delete p_string;
 			break;
+		}
+		case STACK_PROPERTY_TYPE_MATRIX:
+		{
+			StackPropertyMatrix *p_matrix = (StackPropertyMatrix*)property;
+			for (StackPropertyMatrixCells *cells : p_matrix->retired)
+			{
+				stack_property_matrix_free_cells(cells);
+			}
+			stack_property_matrix_free_cells(p_matrix->cells.load());
+			delete p_matrix;
+			break;
+		}
 	}
 }
 
@@ -148,6 +289,117 @@ const char *stack_property_get_name(const StackProperty *property)
 	return property->name;
 }
 
+// Gets the key for a property name, giving it a new one if it hasn't been seen
+// before. The stack_property_keys_mutex should be held whilst calling this
+// @param name The name of the property
+// @param slot Whether to give it a key with a slot in StackCue::property_slots
+// @returns The key for the name
+static stack_property_key_t stack_property_key_locked(const char *name, bool slot)
+{
+	// Seed the table with the fixed keys the first time through
+	if (stack_property_keys.empty())
+	{
+		for (stack_property_key_t key = 1; key < STACK_PROPERTY_KEY_BUILTIN_COUNT; key++)
+		{
+			stack_property_keys[stack_property_builtin_key_names[key]] = key;
+		}
+	}
+
+	auto iter = stack_property_keys.find(name);
+	if (iter != stack_property_keys.end())
+	{
+		return iter->second;
+	}
+
+	stack_property_key_t key;
+	if (slot && stack_property_next_slot_key < STACK_PROPERTY_KEY_SLOT_COUNT)
+	{
+		key = stack_property_next_slot_key++;
+	}
+	else
+	{
+		if (slot)
+		{
+			stack_log("stack_property_register_key(): No slots left, '%s' will be looked up by name\n", name);
+		}
+		key = stack_property_next_key++;
+	}
+
+	const size_t chunk_index = key / STACK_PROPERTY_KEY_CHUNK_SIZE;
+	if (chunk_index >= STACK_PROPERTY_KEY_MAX_CHUNKS)
+	{
+		stack_log("stack_property_key(): Too many property names, can't add '%s'\n", name);
+		return STACK_PROPERTY_KEY_NONE;
+	}
+
+	// Publish the name before anything can be given its key
+	std::atomic<const char*> *chunk = stack_property_key_chunks[chunk_index].load(std::memory_order_relaxed);
+	if (chunk == NULL)
+	{
+		chunk = new std::atomic<const char*>[STACK_PROPERTY_KEY_CHUNK_SIZE]();
+		stack_property_key_chunks[chunk_index].store(chunk, std::memory_order_release);
+	}
+	chunk[key % STACK_PROPERTY_KEY_CHUNK_SIZE].store(strdup(name), std::memory_order_release);
+	stack_property_keys[name] = key;
+
+	return key;
+}
+
+// Registers the name of a property of a cue class, giving it a key that cues
+// keep a direct pointer to the property for
+// @param name The name of the property
+// @returns The key for the name
+stack_property_key_t stack_property_register_key(const char *name)
+{
+	if (name == NULL)
+	{
+		return STACK_PROPERTY_KEY_NONE;
+	}
+
+	std::unique_lock<std::mutex> lock(stack_property_keys_mutex);
+	return stack_property_key_locked(name, true);
+}
+
+// Gets the key for a property name, giving the name a new key if it hasn't
+// been seen before. Safe to call from any thread
+// @param name The name of the property
+// @returns The key for the name
+stack_property_key_t stack_property_key(const char *name)
+{
+	if (name == NULL)
+	{
+		return STACK_PROPERTY_KEY_NONE;
+	}
+
+	std::unique_lock<std::mutex> lock(stack_property_keys_mutex);
+	return stack_property_key_locked(name, false);
+}
+
+// Gets the property name for a key, without taking a lock
+// @param key The key
+// @returns The name of the property, or NULL if the key is not known
+const char *stack_property_key_name(stack_property_key_t key)
+{
+	if (key < STACK_PROPERTY_KEY_BUILTIN_COUNT)
+	{
+		return key == STACK_PROPERTY_KEY_NONE ? NULL : stack_property_builtin_key_names[key];
+	}
+
+	const size_t chunk_index = key / STACK_PROPERTY_KEY_CHUNK_SIZE;
+	if (chunk_index >= STACK_PROPERTY_KEY_MAX_CHUNKS)
+	{
+		return NULL;
+	}
+
+	const std::atomic<const char*> *chunk = stack_property_key_chunks[chunk_index].load(std::memory_order_acquire);
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+
+	return chunk[key % STACK_PROPERTY_KEY_CHUNK_SIZE].load(std::memory_order_acquire);
+}
+
 // Returns whether or not a property is nullable
 // @param property The property to return the nullable attribute off
 // @returns A boolean indicating if the property is nullable
@@ -253,6 +505,10 @@ void stack_property_set_validator(StackProperty *property, stack_property_valida
 			((StackPropertyString*)property)->validator = (stack_property_validator_string_t)validator;
 			((StackPropertyString*)property)->validator_user_data = user_data;
 			break;
+		case STACK_PROPERTY_TYPE_MATRIX:
+			((StackPropertyMatrix*)property)->validator = (stack_property_validator_matrix_t)validator;
+			((StackPropertyMatrix*)property)->validator_user_data = user_data;
+			break;
 	}
 }
 
@@ -327,10 +583,7 @@ void stack_property_set_validator(StackProperty *property, stack_property_valida
 		if (last_value != value) \
 		{ \
 			*target = (p_cast->validator == NULL ? value : p_cast->validator(p_cast, version, value, p_cast->validator_user_data)); \
-			if (!property->change_callbacks_paused && property->changed_callback != NULL) \
-			{ \
-				property->changed_callback(property, version, property->changed_callback_user_data); \
-			} \
+			stack_property_notify(property, version); \
 		} \
 		return true; \
 	}
@@ -422,13 +675,134 @@ bool stack_property_set_string(StackProperty *property, StackPropertyVersion ver
 		}
 
 		// Notify
-		if (!property->change_callbacks_paused && property->changed_callback != NULL)
+		stack_property_notify(property, version);
+	}
+
+	return true;
+}
+
+// Returns the index of a cell in the arrays of a matrix property
+static inline size_t stack_property_matrix_index(const StackPropertyMatrixCells *cells, size_t row, size_t column)
+{
+	return row * cells->columns + column;
+}
+
+// Returns whether the cell at the given index has been set
+static inline bool stack_property_matrix_index_assigned(const StackPropertyMatrixCells *cells, size_t index)
+{
+	return (cells->assigned[index / 64] & ((uint64_t)1 << (index % 64))) != 0;
+}
+
+// Returns the array holding the given version of the cells of a matrix
+static float *stack_property_matrix_version(const StackPropertyMatrixCells *cells, StackPropertyVersion version)
+{
+	switch (version)
+	{
+		case STACK_PROPERTY_VERSION_DEFINED:
+			return cells->defined;
+		case STACK_PROPERTY_VERSION_LIVE:
+			return cells->live;
+		case STACK_PROPERTY_VERSION_TARGET:
+			return cells->target;
+		default:
+			return NULL;
+	}
+}
+
+// Starts a read of a matrix that may happen on any thread, returning the cells
+// to use for it (which may be NULL if the matrix is empty). The cells stay
+// valid until stack_property_matrix_read_end is called. The count of readers
+// is raised before the cells are loaded, and ensure_size publishes new cells
+// before it checks the count, so any read it can't see uses the new cells
+static inline const StackPropertyMatrixCells *stack_property_matrix_read_begin(const StackPropertyMatrix *property)
+{
+	StackPropertyMatrix *p_matrix = const_cast<StackPropertyMatrix*>(property);
+	p_matrix->readers.fetch_add(1, std::memory_order_seq_cst);
+	return p_matrix->cells.load(std::memory_order_seq_cst);
+}
+
+// Ends a read started by stack_property_matrix_read_begin
+static inline void stack_property_matrix_read_end(const StackPropertyMatrix *property)
+{
+	const_cast<StackPropertyMatrix*>(property)->readers.fetch_sub(1, std::memory_order_release);
+}
+
+// Frees the cells that a matrix has replaced, if no read is in progress that
+// could still be using them. Only called by writers
+static void stack_property_matrix_free_retired(StackPropertyMatrix *property)
+{
+	if (property->retired.empty() || property->readers.load(std::memory_order_seq_cst) != 0)
+	{
+		return;
+	}
+
+	for (StackPropertyMatrixCells *cells : property->retired)
+	{
+		stack_property_matrix_free_cells(cells);
+	}
+	property->retired.clear();
+}
+
+// Writes each cell of a matrix that has been set to JSON, with a name of the
+// form <property>_<row>_<column>
+static void stack_property_matrix_write_json(const StackPropertyMatrix *property, Json::Value* json_root)
+{
+	char name[256];
+	char value[32];
+
+	const StackPropertyMatrixCells *cells = stack_property_matrix_read_begin(property);
+	const size_t rows = cells != NULL ? cells->rows : 0;
+	const size_t columns = cells != NULL ? cells->columns : 0;
+	for (size_t row = 0; row < rows; row++)
+	{
+		for (size_t column = 0; column < columns; column++)
 		{
-			property->changed_callback(property, version, property->changed_callback_user_data);
+			const size_t index = stack_property_matrix_index(cells, row, column);
+			if (!stack_property_matrix_index_assigned(cells, index))
+			{
+				continue;
+			}
+
+			snprintf(name, 256, "%s_%lu_%lu", property->super.name, row, column);
+			const float cell = cells->defined[index];
+			if (std::isnan(cell))
+			{
+				(*json_root)[name] = Json::Value::nullSingleton();
+			}
+			else if (!std::isfinite(cell))
+			{
+				(*json_root)[name] = "-Infinite";
+			}
+			else
+			{
+				// Write the shortest decimal that rounds to the float, so that
+				// a value entered as 1.1 isn't saved as 1.100000023841858
+				snprintf(value, 32, "%.7g", cell);
+				(*json_root)[name] = strtod(value, NULL);
+			}
 		}
 	}
 
-	return true;
+	stack_property_matrix_read_end(property);
+}
+
+// Copies the defined values of a matrix to the live values
+static void stack_property_matrix_copy_defined_to_live(StackPropertyMatrix *property)
+{
+	stack_property_matrix_free_retired(property);
+	const StackPropertyMatrixCells *cells = property->cells.load(std::memory_order_acquire);
+	const size_t count = cells != NULL ? cells->rows * cells->columns : 0;
+	if (count == 0 || memcmp(cells->live, cells->defined, count * sizeof(float)) == 0)
+	{
+		return;
+	}
+
+	memcpy(cells->live, cells->defined, count * sizeof(float));
+
+	// Notify (for every cell at once)
+	property->changed_row = SIZE_MAX;
+	property->changed_column = SIZE_MAX;
+	stack_property_notify(&property->super, STACK_PROPERTY_VERSION_LIVE);
 }
 
 void stack_property_write_json(const StackProperty *property, Json::Value* json_root)
@@ -488,6 +862,9 @@ void stack_property_write_json(const StackProperty *property, Json::Value* json_
 		case STACK_PROPERTY_TYPE_STRING:
 			(*json_root)[property->name] = ((StackPropertyString*)property)->defined;
 			break;
+		case STACK_PROPERTY_TYPE_MATRIX:
+			stack_property_matrix_write_json((StackPropertyMatrix*)property, json_root);
+			break;
 	}
 }
 
@@ -522,6 +899,9 @@ void stack_property_copy_defined_to_live(StackProperty *property)
 		CASE_PROPERTY_DEFLIVE(uint64, uint64_t, STACK_PROPERTY_TYPE_UINT64, StackPropertyUInt64)
 		CASE_PROPERTY_DEFLIVE(double, double, STACK_PROPERTY_TYPE_DOUBLE, StackPropertyDouble)
 		CASE_PROPERTY_DEFLIVE(string, char *, STACK_PROPERTY_TYPE_STRING, StackPropertyString)
+		case STACK_PROPERTY_TYPE_MATRIX:
+			stack_property_matrix_copy_defined_to_live((StackPropertyMatrix*)property);
+			break;
 	}
 
 	// Copy whether the value is null
@@ -590,3 +970,247 @@ bool stack_property_set_null(StackProperty *property, StackPropertyVersion versi
 
 	return true;
 }
+
+// Grows a matrix property so that it has at least the given number of rows and
+// columns. Must not be called from the realtime thread
+// @param property The matrix property
+// @param rows The minimum number of rows
+// @param columns The minimum number of columns
+// @returns Whether the property is a matrix
+bool stack_property_matrix_ensure_size(StackProperty *property, size_t rows, size_t columns)
+{
+	StackPropertyMatrix *p_matrix = STACK_PROPERTY_MATRIX(property);
+	if (p_matrix == NULL)
+	{
+		stack_log("stack_property_matrix_ensure_size(): Supplied property was not a matrix\n");
+		return false;
+	}
+
+	// Writers don't race with each other, so this needs no read guard
+	StackPropertyMatrixCells *old_cells = p_matrix->cells.load(std::memory_order_acquire);
+	const size_t old_rows = old_cells != NULL ? old_cells->rows : 0;
+	const size_t old_columns = old_cells != NULL ? old_cells->columns : 0;
+	if (rows <= old_rows && columns <= old_columns)
+	{
+		stack_property_matrix_free_retired(p_matrix);
+		return true;
+	}
+
+	rows = std::max(rows, old_rows);
+	columns = std::max(columns, old_columns);
+
+	// The bitmap and the three versions of the cells share one allocation
+	const size_t count = rows * columns;
+	const size_t bitmap_words = (count + 63) / 64;
+	StackPropertyMatrixCells *cells = new StackPropertyMatrixCells;
+	cells->rows = rows;
+	cells->columns = columns;
+	cells->assigned = new uint64_t[bitmap_words + (count * 3 + 1) / 2]();
+	cells->defined = (float*)&cells->assigned[bitmap_words];
+	cells->live = &cells->defined[count];
+	cells->target = &cells->live[count];
+
+	// Copy across the existing cells
+	for (size_t row = 0; row < old_rows; row++)
+	{
+		for (size_t column = 0; column < old_columns; column++)
+		{
+			const size_t old_index = stack_property_matrix_index(old_cells, row, column);
+			const size_t new_index = stack_property_matrix_index(cells, row, column);
+			cells->defined[new_index] = old_cells->defined[old_index];
+			cells->live[new_index] = old_cells->live[old_index];
+			cells->target[new_index] = old_cells->target[old_index];
+			if (stack_property_matrix_index_assigned(old_cells, old_index))
+			{
+				cells->assigned[new_index / 64] |= (uint64_t)1 << (new_index % 64);
+			}
+		}
+	}
+
+	// Publish the new cells, then keep the old ones until no read that might
+	// have loaded them is still in progress
+	p_matrix->cells.store(cells, std::memory_order_seq_cst);
+	if (old_cells != NULL)
+	{
+		p_matrix->retired.push_back(old_cells);
+	}
+	stack_property_matrix_free_retired(p_matrix);
+
+	return true;
+}
+
+// Gets the size of a matrix property
+// @param property The matrix property
+// @param rows Receives the number of rows
+// @param columns Receives the number of columns
+// @returns Whether the property is a matrix
+bool stack_property_matrix_get_size(const StackProperty *property, size_t *rows, size_t *columns)
+{
+	const StackPropertyMatrix *p_matrix = STACK_PROPERTY_MATRIX(property);
+	if (p_matrix == NULL)
+	{
+		stack_log("stack_property_matrix_get_size(): Supplied property was not a matrix\n");
+		return false;
+	}
+
+	const StackPropertyMatrixCells *cells = stack_property_matrix_read_begin(p_matrix);
+	*rows = cells != NULL ? cells->rows : 0;
+	*columns = cells != NULL ? cells->columns : 0;
+	stack_property_matrix_read_end(p_matrix);
+
+	return true;
+}
+
+// Gets whether a cell of a matrix property has been set
+// @param property The matrix property
+// @param row The row of the cell
+// @param column The column of the cell
+bool stack_property_matrix_get_assigned(const StackProperty *property, size_t row, size_t column)
+{
+	const StackPropertyMatrix *p_matrix = STACK_PROPERTY_MATRIX(property);
+	if (p_matrix == NULL)
+	{
+		return false;
+	}
+
+	const StackPropertyMatrixCells *cells = stack_property_matrix_read_begin(p_matrix);
+	const bool assigned = cells != NULL && row < cells->rows && column < cells->columns && stack_property_matrix_index_assigned(cells, stack_property_matrix_index(cells, row, column));
+	stack_property_matrix_read_end(p_matrix);
+
+	return assigned;
+}
+
+// Gets the value of a cell of a matrix property
+// @param property The matrix property
+// @param version The version of the property to get the value of
+// @param row The row of the cell
+// @param column The column of the cell
+// @param value Receives the value of the cell, which is NaN if the cell is null
+// @returns True if the cell has been set, or false otherwise (in which case
+// value is unchanged)
+bool stack_property_matrix_get(const StackProperty *property, StackPropertyVersion version, size_t row, size_t column, double *value)
+{
+	const StackPropertyMatrix *p_matrix = STACK_PROPERTY_MATRIX(property);
+	if (p_matrix == NULL)
+	{
+		stack_log("stack_property_matrix_get(): Supplied property was not a matrix\n");
+		return false;
+	}
+	if (value == NULL)
+	{
+		stack_log("stack_property_matrix_get(): NULL destination given\n");
+		return false;
+	}
+
+	bool result = false;
+	const StackPropertyMatrixCells *cells = stack_property_matrix_read_begin(p_matrix);
+	if (cells != NULL && row < cells->rows && column < cells->columns)
+	{
+		const size_t index = stack_property_matrix_index(cells, row, column);
+		const float *values = stack_property_matrix_version(cells, version);
+		if (values != NULL && stack_property_matrix_index_assigned(cells, index))
+		{
+			*value = values[index];
+			result = true;
+		}
+	}
+	stack_property_matrix_read_end(p_matrix);
+
+	return result;
+}
+
+// Sets the value of a cell of a matrix property, growing the matrix if
+// necessary
+// @param property The matrix property
+// @param version The version of the property to set the value of
+// @param row The row of the cell
+// @param column The column of the cell
+// @param value The new value of the cell, or NaN to make it null
+// @returns A boolean indicating if the call was successful
+bool stack_property_matrix_set(StackProperty *property, StackPropertyVersion version, size_t row, size_t column, double value)
+{
+	StackPropertyMatrix *p_matrix = STACK_PROPERTY_MATRIX(property);
+	if (p_matrix == NULL)
+	{
+		stack_log("stack_property_matrix_set(): Supplied property was not a matrix\n");
+		return false;
+	}
+	if (std::isnan(value) && !property->nullable)
+	{
+		stack_log("stack_property_matrix_set(): Null value given for non-nullable property '%s'\n", property->name);
+		return false;
+	}
+
+	// This also frees any cells it replaced earlier that are no longer read
+	stack_property_matrix_ensure_size(property, row + 1, column + 1);
+	StackPropertyMatrixCells *cells = p_matrix->cells.load(std::memory_order_acquire);
+	float *values = stack_property_matrix_version(cells, version);
+	if (values == NULL)
+	{
+		return false;
+	}
+
+	const size_t index = stack_property_matrix_index(cells, row, column);
+	const bool was_assigned = stack_property_matrix_index_assigned(cells, index);
+	const float last_value = values[index];
+	if (p_matrix->validator != NULL && !std::isnan(value))
+	{
+		value = p_matrix->validator(p_matrix, version, value, p_matrix->validator_user_data);
+	}
+	values[index] = (float)value;
+	cells->assigned[index / 64] |= (uint64_t)1 << (index % 64);
+
+	// Notify if the cell has changed (treating null as equal to null)
+	const bool changed = !was_assigned || (std::isnan(last_value) ? !std::isnan(values[index]) : last_value != values[index]);
+	if (changed)
+	{
+		// If a batch is already holding back a change to another cell (of
+		// any version, as they share the changed cell), the callback will be
+		// for more than one cell
+		const bool pending = stack_property_batch_pending(property, STACK_PROPERTY_VERSION_DEFINED) || stack_property_batch_pending(property, STACK_PROPERTY_VERSION_LIVE) || stack_property_batch_pending(property, STACK_PROPERTY_VERSION_TARGET);
+		if (pending && (p_matrix->changed_row != row || p_matrix->changed_column != column))
+		{
+			p_matrix->changed_row = SIZE_MAX;
+			p_matrix->changed_column = SIZE_MAX;
+		}
+		else
+		{
+			p_matrix->changed_row = row;
+			p_matrix->changed_column = column;
+		}
+		stack_property_notify(property, version);
+	}
+
+	return true;
+}
+
+// Starts a batch of property changes on the calling thread
+void stack_property_batch_begin()
+{
+	stack_property_batch_depth++;
+}
+
+// Ends a batch of property changes on the calling thread, calling the changed
+// callbacks that were held back if this is the outermost batch
+void stack_property_batch_commit()
+{
+	if (stack_property_batch_depth == 0)
+	{
+		stack_log("stack_property_batch_commit(): No batch in progress\n");
+		return;
+	}
+
+	if (--stack_property_batch_depth > 0)
+	{
+		return;
+	}
+
+	// Take the changes, as the callbacks may make further changes
+	std::vector<StackPropertyChange> changes;
+	changes.swap(stack_property_batch_changes);
+	stack_property_batch_change_set.clear();
+	for (const StackPropertyChange &change : changes)
+	{
+		stack_property_notify(change.first, change.second);
+	}
+}
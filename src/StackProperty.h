@@ -3,6 +3,9 @@
 
 // Includes:
 #include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
 #include <json/json.h>
 
 // Property types:
@@ -20,6 +23,7 @@ enum StackPropertyType
 	STACK_PROPERTY_TYPE_UINT64,
 	STACK_PROPERTY_TYPE_DOUBLE,
 	STACK_PROPERTY_TYPE_STRING,
+	STACK_PROPERTY_TYPE_MATRIX,
 };
 
 // The three versions of the property value:
@@ -35,6 +39,38 @@ enum StackPropertyVersion
 	STACK_PROPERTY_VERSION_TARGET,
 };
 
+// Property keys. A key is an integer that identifies a property name, so that
+// properties can be found without comparing strings. The properties of
+// StackCue itself have fixed keys (below). Cue classes register the names of
+// their own properties with stack_property_register_key when the class is
+// registered, which gives them keys below STACK_PROPERTY_KEY_SLOT_COUNT, and
+// any other name is given a key the first time it is seen by
+// stack_property_key
+typedef uint32_t stack_property_key_t;
+enum
+{
+	STACK_PROPERTY_KEY_NONE = 0,
+
+	// StackCue
+	STACK_PROPERTY_KEY_NAME,
+	STACK_PROPERTY_KEY_SCRIPT_REF,
+	STACK_PROPERTY_KEY_NOTES,
+	STACK_PROPERTY_KEY_R,
+	STACK_PROPERTY_KEY_G,
+	STACK_PROPERTY_KEY_B,
+	STACK_PROPERTY_KEY_PRE_TIME,
+	STACK_PROPERTY_KEY_ACTION_TIME,
+	STACK_PROPERTY_KEY_POST_TIME,
+	STACK_PROPERTY_KEY_POST_TRIGGER,
+
+	// The number of fixed keys
+	STACK_PROPERTY_KEY_BUILTIN_COUNT
+};
+
+// The number of keys (fixed and registered) that cues keep a direct pointer to
+// the property of (see StackCue::property_slots)
+#define STACK_PROPERTY_KEY_SLOT_COUNT 48
+
 // Pre-define this:
 struct StackProperty;
 
@@ -53,6 +89,9 @@ struct StackProperty
 	// The name of the property
 	char *name;
 
+	// The key for the name of the property
+	stack_property_key_t key;
+
 	// A callback to call when the value of the property changes
 	stack_property_changed_t changed_callback;
 
@@ -106,6 +145,59 @@ STACK_PROPERTY_DEFINE(StackPropertyUInt64, uint64_t, uint64)
 STACK_PROPERTY_DEFINE(StackPropertyDouble, double, double)
 STACK_PROPERTY_DEFINE(StackPropertyString, char *, string)
 
+// Matrix property. This holds a grid of values (such as the crosspoints of an
+// audio cue) in one property rather than one property per cell. The values are
+// stored as floats, row by row, with each version in its own array. A NaN value
+// is a null cell (if the property is nullable). Cells that have never been set
+// are tracked separately, and aren't written to JSON. The matrix grows as cells
+// are set but never shrinks
+
+// The cells of a matrix property. The size never changes once the cells have
+// been published, and a larger matrix gets new cells
+struct StackPropertyMatrixCells
+{
+	// The size of the matrix
+	size_t rows;
+	size_t columns;
+
+	// The values of each version of the cells
+	float *defined;
+	float *live;
+	float *target;
+
+	// A bitmap of the cells that have been set. This is the start of the
+	// allocation that also holds the values
+	uint64_t *assigned;
+};
+
+struct StackPropertyMatrix;
+typedef double(*stack_property_validator_matrix_t)(StackPropertyMatrix *, StackPropertyVersion, const double, void *);
+struct StackPropertyMatrix
+{
+	StackProperty super;
+
+	// The current cells, which readers on other threads load once and then
+	// use for the rest of the read
+	std::atomic<StackPropertyMatrixCells*> cells;
+
+	// The number of reads that are in progress, which may still be using
+	// cells that have since been replaced
+	std::atomic<size_t> readers;
+
+	// The row and column of the cell that changed most recently, so that a
+	// changed callback can tell which cell it is being called for. These are
+	// set to SIZE_MAX when more than one cell changed at once
+	size_t changed_row;
+	size_t changed_column;
+
+	// Validator for cell values
+	stack_property_validator_matrix_t validator;
+	void *validator_user_data;
+
+	// Cells that have been replaced by a larger matrix, which are freed once
+	// no reads are in progress
+	std::vector<StackPropertyMatrixCells*> retired;
+};
 // Accessors for typed properties:
 STACK_PROPERTY_DEFINE_ACCESSORS(bool, bool)
 STACK_PROPERTY_DEFINE_ACCESSORS(int8, int8_t)
@@ -144,6 +236,7 @@ STACK_PROPERTY_DEFINE_ACCESSORS(string, char*)
 #define STACK_PROPERTY_UINT64(p) ((p) != NULL && (p)->type == STACK_PROPERTY_TYPE_UINT64 ? (StackPropertyUInt64*)(p) : NULL)
 #define STACK_PROPERTY_DOUBLE(p) ((p) != NULL && (p)->type == STACK_PROPERTY_TYPE_DOUBLE ? (StackPropertyDouble*)(p) : NULL)
 #define STACK_PROPERTY_STRING(p) ((p) != NULL && (p)->type == STACK_PROPERTY_TYPE_STRING ? (StackPropertyString*)(p) : NULL)
+#define STACK_PROPERTY_MATRIX(p) ((p) != NULL && (p)->type == STACK_PROPERTY_TYPE_MATRIX ? (StackPropertyMatrix*)(p) : NULL)
 
 // Creates a new StackProperty object:
 // @param name The name of the property
@@ -151,6 +244,14 @@ STACK_PROPERTY_DEFINE_ACCESSORS(string, char*)
 // @returns A pointer to a new StackProperty-subclassed object, cast back to StackProperty
 StackProperty *stack_property_create(const char *name, StackPropertyType type);
 
+// Creates a new StackProperty object with a name that already has a key, which
+// avoids looking the name up
+// @param key The key of the name of the property (see stack_property_register_key)
+// @param type The type of the property
+// @returns A pointer to a new StackProperty-subclassed object, cast back to
+// StackProperty, or NULL if the key is not known
+StackProperty *stack_property_create_keyed(stack_property_key_t key, StackPropertyType type);
+
 // Destroys a StackProperty object, tidying up any associated data in any sub-classes
 // @param property The property to destroy
 void stack_property_destroy(StackProperty *property);
@@ -159,6 +260,26 @@ void stack_property_destroy(StackProperty *property);
 // @returns The name of the property
 const char *stack_property_get_name(const StackProperty *property);
 
+// Registers the name of a property of a cue class, giving it a key that cues
+// keep a direct pointer to the property for. Should be called when the class
+// is registered. Registering a name that already has a key returns that key
+// @param name The name of the property
+// @returns The key for the name
+stack_property_key_t stack_property_register_key(const char *name);
+
+// Gets the key for a property name, giving the name a new key if it hasn't
+// been seen before. Safe to call from any thread, but takes a lock, so names
+// known in advance should be registered instead
+// @param name The name of the property
+// @returns The key for the name
+stack_property_key_t stack_property_key(const char *name);
+
+// Gets the property name for a key. Safe to call from any thread without
+// taking a lock
+// @param key The key
+// @returns The name of the property, or NULL if the key is not known
+const char *stack_property_key_name(stack_property_key_t key);
+
 // Returns whether or not a property is nullable
 // @param property The property to return the nullable attribute off
 // @returns A boolean indicating if the property is nullable
@@ -212,4 +333,56 @@ bool stack_property_get_null(const StackProperty *property, StackPropertyVersion
 // the property is not nullable)
 bool stack_property_set_null(StackProperty *property, StackPropertyVersion version, bool is_null);
 
+// Starts a batch of property changes on the calling thread. Until the batch is
+// committed, changed callbacks for properties changed on this thread are held
+// back, and then each property gets one callback for each version that
+// changed, in the order they first changed. Batches can be nested, in which
+// case the callbacks happen when the outermost batch is committed
+void stack_property_batch_begin();
+
+// Ends a batch of property changes on the calling thread, calling the changed
+// callbacks that were held back if this is the outermost batch
+void stack_property_batch_commit();
+
+// Grows a matrix property so that it has at least the given number of rows and
+// columns. Must not be called from the realtime thread
+// @param property The matrix property
+// @param rows The minimum number of rows
+// @param columns The minimum number of columns
+// @returns Whether the property is a matrix
+bool stack_property_matrix_ensure_size(StackProperty *property, size_t rows, size_t columns);
+
+// Gets the size of a matrix property
+// @param property The matrix property
+// @param rows Receives the number of rows
+// @param columns Receives the number of columns
+// @returns Whether the property is a matrix
+bool stack_property_matrix_get_size(const StackProperty *property, size_t *rows, size_t *columns);
+
+// Gets whether a cell of a matrix property has been set
+// @param property The matrix property
+// @param row The row of the cell
+// @param column The column of the cell
+bool stack_property_matrix_get_assigned(const StackProperty *property, size_t row, size_t column);
+
+// Gets the value of a cell of a matrix property
+// @param property The matrix property
+// @param version The version of the property to get the value of
+// @param row The row of the cell
+// @param column The column of the cell
+// @param value Receives the value of the cell, which is NaN if the cell is null
+// @returns True if the cell has been set, or false otherwise (in which case
+// value is unchanged)
+bool stack_property_matrix_get(const StackProperty *property, StackPropertyVersion version, size_t row, size_t column, double *value);
+
+// Sets the value of a cell of a matrix property, growing the matrix if
+// necessary
+// @param property The matrix property
+// @param version The version of the property to set the value of
+// @param row The row of the cell
+// @param column The column of the cell
+// @param value The new value of the cell, or NaN to make it null
+// @returns A boolean indicating if the call was successful
+bool stack_property_matrix_set(StackProperty *property, StackPropertyVersion version, size_t row, size_t column, double value);
+
 #endif
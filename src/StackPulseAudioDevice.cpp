@@ -93,7 +93,8 @@ static void stack_pulse_audio_device_output_thread(void *user_data)
 
 			// Determine how many frames of adio (rather than bytes) PulseAudio
 			// wants (pa_stream_begin_write can change the value of 'writable')
-			size_t writable_frames = writable / sizeof(float) / channels;
+			const size_t sample_size = pa_sample_size_of_format(device->format);
+			size_t writable_frames = writable / sample_size / channels;
 
 			// Get up to writable_samples samples from the cue list
 			size_t read = 0;
@@ -105,9 +106,18 @@ static void stack_pulse_audio_device_output_thread(void *user_data)
 			{
 				size_t total_sample_count = writable_frames * channels;
 
-				float *float_buffer = new float[total_sample_count];
+				// Make sure our buffer is big enough
+				if (total_sample_count > device->float_buffer_samples)
+				{
+					delete [] device->float_buffer;
+					device->float_buffer = new float[total_sample_count];
+					device->float_buffer_samples = total_sample_count;
+				}
+
+				float *float_buffer = device->float_buffer;
 				read = STACK_AUDIO_DEVICE(device)->request_audio(writable_frames, float_buffer, STACK_AUDIO_DEVICE(device)->request_audio_user_data);
 
+				// Convert straight in to PulseAudio's buffer
 				if (device->format == PA_SAMPLE_S32NE)
 				{
 					stack_audio_device_to_s32(float_buffer, (int32_t*)buffer, total_sample_count);
@@ -118,14 +128,15 @@ static void stack_pulse_audio_device_output_thread(void *user_data)
 				}
 				else if (device->format == PA_SAMPLE_S16NE)
 				{
-					stack_audio_device_to_s16(float_buffer, (int16_t*)buffer, total_sample_count);
+					StackAudioDevice *super = STACK_AUDIO_DEVICE(device);
+					stack_audio_device_to_s16(float_buffer, (int16_t*)buffer, total_sample_count, super->dither ? &super->dither_state : NULL);
 				}
 			}
 
 			// Warn if we didn't get enough
 			if (read < writable_frames)
 			{
-				writable = read * channels * sizeof(float);
+				writable = read * channels * sample_size;
 				stack_log("Buffer underflow: %lu < %lu!\n", read, writable_frames);
 			}
 
@@ -468,6 +479,9 @@ void stack_pulse_audio_device_destroy(StackAudioDevice *device)
 		}
 	}
 
+	// Tidy up our buffer
+	delete [] STACK_PULSE_AUDIO_DEVICE(device)->float_buffer;
+
 	if (device->device_name != NULL)
 	{
 		free(device->device_name);
@@ -485,6 +499,8 @@ StackAudioDevice *stack_pulse_audio_device_create(const char *name, uint32_t cha
 	StackPulseAudioDevice *device = new StackPulseAudioDevice();
 	device->stream = NULL;
 	device->thread_running = false;
+	device->float_buffer = NULL;
+	device->float_buffer_samples = 0;
 
 	// Just in case the context has been shutdown
 	if (open_streams == 0)
@@ -27,6 +27,11 @@ struct StackPulseAudioDevice
 
 	// Kill flag for the thread
 	bool thread_running;
+
+	// Buffer used by the output thread when the stream isn't float, kept
+	// between writes so we don't allocate every time
+	float *float_buffer;
+	size_t float_buffer_samples;
 };
 
 // Functions: PulseAudio device functions
@@ -5,6 +5,7 @@
 #include "StackRPC.pb-c.h"
 #include "StackLog.h"
 #include "StackCue.h"
+#include "StackCueListSnapshot.h"
 #include <unistd.h>
 #include <cstdlib>
 #include <cstdio>
@@ -12,20 +13,14 @@
 #include <sys/un.h>
 
 // Helper funciton that populates a stackrpc.V1.CueInfo protobuf object with the
-// details about a given cue
-// @param cue The StackCue object that is the source of the cue information
+// details about a given cue. Note that the strings in cue_info point in to the
+// snapshot, so the snapshot must outlive cue_info
+// @param cue The snapshot of the cue that is the source of the cue information
 // @param cue_info The stackrpc.v1.CueInfo protobuf object to populate
-static void stack_rpc_socket_fill_cue_info(StackCue *cue, StackRPC__V1__CueInfo *cue_info)
+static void stack_rpc_socket_fill_cue_info(const StackCueSnapshot *cue, StackRPC__V1__CueInfo *cue_info)
 {
 	cue_info->uid = cue->uid;
-	if (cue->parent_cue != NULL)
-	{
-		cue_info->parent_uid = cue->parent_cue->uid;
-	}
-	else
-	{
-		cue_info->parent_uid = 0;
-	}
+	cue_info->parent_uid = cue->parent_uid;
 	cue_info->id = cue->id;
 
 	// Populate cue state
@@ -54,18 +49,16 @@ static void stack_rpc_socket_fill_cue_info(StackCue *cue, StackRPC__V1__CueInfo
 			break;
 	}
 
-	// Note that we strdup this because it's returned as a const char
-	cue_info->name = strdup(stack_cue_get_rendered_name(cue));
+	// The protobuf object isn't const-correct, but never modifies these
+	cue_info->name = (char*)cue->name.c_str();
 
 	// Populate times
-	stack_property_get_int64(stack_cue_get_property(cue, "pre_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_info->prewait_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "action_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_info->action_time);
-	stack_property_get_int64(stack_cue_get_property(cue, "post_time"), STACK_PROPERTY_VERSION_DEFINED, &cue_info->postwait_time);
+	cue_info->prewait_time = cue->pre_time;
+	cue_info->action_time = cue->action_time;
+	cue_info->postwait_time = cue->post_time;
 
 	// Populate trigger
-	int32_t post_trigger = 0;
-	stack_property_get_int32(stack_cue_get_property(cue, "post_trigger"), STACK_PROPERTY_VERSION_DEFINED, &post_trigger);
-	switch (post_trigger)
+	switch (cue->post_trigger)
 	{
 		case STACK_CUE_WAIT_TRIGGER_NONE:
 			cue_info->post_trigger = STACK_RPC__V1__CUE_WAIT_TRIGGER__None;
@@ -81,19 +74,13 @@ static void stack_rpc_socket_fill_cue_info(StackCue *cue, StackRPC__V1__CueInfo
 			break;
 	}
 
-	// Populate notes - note that we don't strdup this
-	stack_property_get_string(stack_cue_get_property(cue, "notes"), STACK_PROPERTY_VERSION_DEFINED, &cue_info->notes);
-
-	// Populate script ref - again note, not strdup'd
-	stack_property_get_string(stack_cue_get_property(cue, "script_ref"), STACK_PROPERTY_VERSION_DEFINED, &cue_info->script_ref);
+	// Populate notes and script ref
+	cue_info->notes = (char*)cue->notes.c_str();
+	cue_info->script_ref = (char*)cue->script_ref.c_str();
 
 	// Populate the colour as a 24-bit packed RGB integer, as protobuf doesn't
 	// have an 8-bit unsigned integer type
-	uint8_t r = 0, g = 0, b = 0;
-	stack_property_get_uint8(stack_cue_get_property(cue, "r"), STACK_PROPERTY_VERSION_DEFINED, &r);
-	stack_property_get_uint8(stack_cue_get_property(cue, "g"), STACK_PROPERTY_VERSION_DEFINED, &g);
-	stack_property_get_uint8(stack_cue_get_property(cue, "b"), STACK_PROPERTY_VERSION_DEFINED, &b);
-	cue_info->colour = (((int32_t)r) << 16) | (((int32_t)g) << 8) | ((int32_t)b);
+	cue_info->colour = (((int32_t)cue->r) << 16) | (((int32_t)cue->g) << 8) | ((int32_t)cue->b);
 }
 
 // Sends a ControlResponse message back to a client
@@ -151,27 +138,18 @@ static void stack_rpc_socket_handle_list_cues(StackRPCSocketClient *client, Stac
 	response->type_case = STACK_RPC__V1__CONTROL_RESPONSE__TYPE_LIST_CUES_RESPONSE;
 	response->list_cues_response = &list_cues_response;
 
-	stack_cue_list_lock(client->rpc_socket->cue_list);
+	// Answer from the snapshot, so we don't hold up playback
+	std::shared_ptr<const StackCueListSnapshot> snapshot = stack_cue_list_get_snapshot(client->rpc_socket->cue_list);
 
 	if (message->list_cues_request->include_children)
 	{
-		// Count the cues recursively
-		size_t total_cue_count = 0;
-		for (auto iter = client->rpc_socket->cue_list->cues->recursive_begin(); iter != client->rpc_socket->cue_list->cues->recursive_end(); ++iter)
-		{
-			total_cue_count++;
-		}
-
-		list_cues_response.n_cue_uid = total_cue_count;
-		if (total_cue_count > 0)
+		list_cues_response.n_cue_uid = snapshot->cues->size();
+		if (snapshot->cues->size() > 0)
 		{
 			list_cues_response.cue_uid = new int64_t[list_cues_response.n_cue_uid];
-
-			size_t index = 0;
-			for (auto iter = client->rpc_socket->cue_list->cues->recursive_begin(); iter != client->rpc_socket->cue_list->cues->recursive_end(); ++iter)
+			for (size_t index = 0; index < snapshot->cues->size(); index++)
 			{
-				list_cues_response.cue_uid[index] = (*iter)->uid;
-				index++;
+				list_cues_response.cue_uid[index] = (*snapshot->cues)[index]->uid;
 			}
 		}
 		else
@@ -181,15 +159,16 @@ static void stack_rpc_socket_handle_list_cues(StackRPCSocketClient *client, Stac
 	}
 	else
 	{
-		list_cues_response.n_cue_uid = stack_cue_list_count(client->rpc_socket->cue_list);
+		list_cues_response.n_cue_uid = snapshot->top_level_count;
 		if (list_cues_response.n_cue_uid > 0)
 		{
 			list_cues_response.cue_uid = new int64_t[list_cues_response.n_cue_uid];
 
+			// Step over the children of each cue
 			size_t index = 0;
-			for (auto cue : *client->rpc_socket->cue_list->cues)
+			for (size_t i = 0; i < snapshot->cues->size(); i += (*snapshot->cues)[i]->subtree_size)
 			{
-				list_cues_response.cue_uid[index] = cue->uid;
+				list_cues_response.cue_uid[index] = (*snapshot->cues)[i]->uid;
 				index++;
 			}
 		}
@@ -199,8 +178,6 @@ static void stack_rpc_socket_handle_list_cues(StackRPCSocketClient *client, Stac
 		}
 	}
 
-	stack_cue_list_unlock(client->rpc_socket->cue_list);
-
 	// Send the response
 	stack_rpc_socket_send_response(client, response);
 
@@ -221,11 +198,15 @@ static void stack_rpc_socket_handle_get_cues(StackRPCSocketClient *client, Stack
 	response->type_case = STACK_RPC__V1__CONTROL_RESPONSE__TYPE_GET_CUES_RESPONSE;
 	response->get_cues_response = &get_cues_response;
 
+	// Answer from the snapshot, so we don't hold up playback (this must stay
+	// alive until we've sent the response)
+	std::shared_ptr<const StackCueListSnapshot> snapshot = stack_cue_list_get_snapshot(client->rpc_socket->cue_list);
+
 	// Determine how many cues we find to respond with
 	size_t count = 0;
 	for (size_t i = 0; i < message->get_cues_request->n_cue_uid; i++)
 	{
-		StackCue *cue = stack_cue_get_by_uid(message->get_cues_request->cue_uid[i]);
+		const StackCueSnapshot *cue = stack_cue_list_snapshot_find(snapshot.get(), message->get_cues_request->cue_uid[i]);
 		if (cue != NULL)
 		{
 			count++;
@@ -242,7 +223,7 @@ static void stack_rpc_socket_handle_get_cues(StackRPCSocketClient *client, Stack
 
 		for (size_t in = 0, out = 0; in < message->get_cues_request->n_cue_uid; in++)
 		{
-			StackCue *cue = stack_cue_get_by_uid(message->get_cues_request->cue_uid[in]);
+			const StackCueSnapshot *cue = stack_cue_list_snapshot_find(snapshot.get(), message->get_cues_request->cue_uid[in]);
 			if (cue != NULL)
 			{
 				get_cues_response.cue_info[out] = new StackRPC__V1__CueInfo;
@@ -263,8 +244,6 @@ static void stack_rpc_socket_handle_get_cues(StackRPCSocketClient *client, Stack
 	// Tidy up
 	for (size_t i = 0; i < get_cues_response.n_cue_info; i++)
 	{
-		// From strdups in stack_rpc_socket_fill_cue_info
-		free(get_cues_response.cue_info[i]->name);
 		delete get_cues_response.cue_info[i];
 	}
 	delete [] get_cues_response.cue_info;
@@ -31,8 +31,10 @@ bool src_show_dialog(StackAppWindow *window)
 		cue_id_t start = stack_cue_string_to_id(gtk_entry_get_text(start_entry));
 		cue_id_t increment = stack_cue_string_to_id(gtk_entry_get_text(increment_entry));
 
-		// Start renumbering by iterating over the list
+		// Start renumbering by iterating over the list, batching up the
+		// changes so that each cue is only notified once
 		cue_id_t new_cue_id = start;
+		stack_cue_list_begin_changes(window->cue_list);
 		for (auto iter = window->cue_list->cues->recursive_begin(); iter != window->cue_list->cues->recursive_end(); ++iter)
 		{
 			StackCue *cue = *iter;
@@ -45,6 +47,7 @@ bool src_show_dialog(StackAppWindow *window)
 				new_cue_id += increment;
 			}
 		}
+		stack_cue_list_commit_changes(window->cue_list);
 	}
 
 	// Destroy the dialog
@@ -0,0 +1,451 @@
+// Includes:
+#include "StackShowBinary.h"
+#include "StackJson.h"
+#include "StackLog.h"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// The tags that precede each value
+enum StackShowBinaryTag
+{
+	STACK_SHOW_BINARY_NULL = 0,
+	STACK_SHOW_BINARY_FALSE = 1,
+	STACK_SHOW_BINARY_TRUE = 2,
+	STACK_SHOW_BINARY_INT = 3,
+	STACK_SHOW_BINARY_UINT = 4,
+	STACK_SHOW_BINARY_DOUBLE = 5,
+	STACK_SHOW_BINARY_STRING = 6,
+	STACK_SHOW_BINARY_ARRAY = 7,
+	STACK_SHOW_BINARY_OBJECT = 8,
+};
+
+// The size of the header
+#define STACK_SHOW_BINARY_HEADER_SIZE 16
+
+// How deeply arrays and objects may be nested, so that a corrupt file can't
+// exhaust the stack whilst decoding
+#define STACK_SHOW_BINARY_MAX_DEPTH 256
+
+// State whilst encoding
+struct StackShowBinaryWriter
+{
+	std::string &output;
+
+	// The index of each key that has been written so far
+	std::unordered_map<std::string, uint64_t> keys;
+};
+
+// State whilst decoding
+struct StackShowBinaryReader
+{
+	const uint8_t *data;
+	const uint8_t *end;
+
+	// The keys that have been read so far
+	std::vector<std::string> keys;
+};
+
+static void stack_show_binary_write_uint32(std::string &output, uint32_t value)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		output.push_back((char)((value >> (i * 8)) & 0xff));
+	}
+}
+
+static void stack_show_binary_write_varint(std::string &output, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		output.push_back((char)((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	output.push_back((char)value);
+}
+
+static void stack_show_binary_write_bytes(std::string &output, const char *data, size_t size)
+{
+	stack_show_binary_write_varint(output, size);
+	output.append(data, size);
+}
+
+static void stack_show_binary_write_key(StackShowBinaryWriter &writer, const char *key, const char *key_end)
+{
+	auto result = writer.keys.emplace(std::string(key, key_end), writer.keys.size() + 1);
+	if (result.second)
+	{
+		// A key we haven't seen before, so write it out in full
+		stack_show_binary_write_varint(writer.output, 0);
+		stack_show_binary_write_bytes(writer.output, key, key_end - key);
+	}
+	else
+	{
+		stack_show_binary_write_varint(writer.output, result.first->second);
+	}
+}
+
+static void stack_show_binary_write_value(StackShowBinaryWriter &writer, const Json::Value &value)
+{
+	std::string &output = writer.output;
+
+	switch (value.type())
+	{
+		case Json::nullValue:
+			output.push_back(STACK_SHOW_BINARY_NULL);
+			break;
+
+		case Json::booleanValue:
+			output.push_back(value.asBool() ? STACK_SHOW_BINARY_TRUE : STACK_SHOW_BINARY_FALSE);
+			break;
+
+		case Json::intValue:
+		{
+			// Zigzag encode so that small negative numbers stay small
+			const int64_t int_value = value.asInt64();
+			output.push_back(STACK_SHOW_BINARY_INT);
+			stack_show_binary_write_varint(output, ((uint64_t)int_value << 1) ^ (uint64_t)(int_value >> 63));
+			break;
+		}
+
+		case Json::uintValue:
+			output.push_back(STACK_SHOW_BINARY_UINT);
+			stack_show_binary_write_varint(output, value.asUInt64());
+			break;
+
+		case Json::realValue:
+		{
+			const double double_value = value.asDouble();
+			uint64_t bits;
+			memcpy(&bits, &double_value, sizeof(bits));
+			output.push_back(STACK_SHOW_BINARY_DOUBLE);
+			stack_show_binary_write_uint32(output, (uint32_t)bits);
+			stack_show_binary_write_uint32(output, (uint32_t)(bits >> 32));
+			break;
+		}
+
+		case Json::stringValue:
+		{
+			const char *string_start = NULL, *string_end = NULL;
+			value.getString(&string_start, &string_end);
+			output.push_back(STACK_SHOW_BINARY_STRING);
+			stack_show_binary_write_bytes(output, string_start, string_end - string_start);
+			break;
+		}
+
+		case Json::arrayValue:
+			output.push_back(STACK_SHOW_BINARY_ARRAY);
+			stack_show_binary_write_varint(output, value.size());
+			for (const Json::Value &item : value)
+			{
+				stack_show_binary_write_value(writer, item);
+			}
+			break;
+
+		case Json::objectValue:
+			output.push_back(STACK_SHOW_BINARY_OBJECT);
+			stack_show_binary_write_varint(output, value.size());
+			for (auto iter = value.begin(); iter != value.end(); ++iter)
+			{
+				const char *key_end = NULL;
+				const char *key = iter.memberName(&key_end);
+				stack_show_binary_write_key(writer, key, key_end);
+				stack_show_binary_write_value(writer, *iter);
+			}
+			break;
+	}
+}
+
+static bool stack_show_binary_read_varint(StackShowBinaryReader &reader, uint64_t *value)
+{
+	*value = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		if (reader.data >= reader.end)
+		{
+			return false;
+		}
+
+		const uint8_t byte = *reader.data++;
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	// Too long to be a 64-bit value
+	return false;
+}
+
+static bool stack_show_binary_read_bytes(StackShowBinaryReader &reader, const char **data, size_t *size)
+{
+	uint64_t length = 0;
+	if (!stack_show_binary_read_varint(reader, &length) || length > (uint64_t)(reader.end - reader.data))
+	{
+		return false;
+	}
+
+	*data = (const char*)reader.data;
+	*size = (size_t)length;
+	reader.data += length;
+	return true;
+}
+
+static bool stack_show_binary_read_value(StackShowBinaryReader &reader, Json::Value *value, size_t depth)
+{
+	if (reader.data >= reader.end || depth > STACK_SHOW_BINARY_MAX_DEPTH)
+	{
+		return false;
+	}
+
+	switch (*reader.data++)
+	{
+		case STACK_SHOW_BINARY_NULL:
+			*value = Json::Value(Json::nullValue);
+			return true;
+
+		case STACK_SHOW_BINARY_FALSE:
+			*value = false;
+			return true;
+
+		case STACK_SHOW_BINARY_TRUE:
+			*value = true;
+			return true;
+
+		case STACK_SHOW_BINARY_INT:
+		{
+			uint64_t zigzag = 0;
+			if (!stack_show_binary_read_varint(reader, &zigzag))
+			{
+				return false;
+			}
+			*value = (Json::Int64)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+			return true;
+		}
+
+		case STACK_SHOW_BINARY_UINT:
+		{
+			uint64_t uint_value = 0;
+			if (!stack_show_binary_read_varint(reader, &uint_value))
+			{
+				return false;
+			}
+			*value = (Json::UInt64)uint_value;
+			return true;
+		}
+
+		case STACK_SHOW_BINARY_DOUBLE:
+		{
+			if (reader.end - reader.data < 8)
+			{
+				return false;
+			}
+			uint64_t bits = 0;
+			for (size_t i = 0; i < 8; i++)
+			{
+				bits |= (uint64_t)reader.data[i] << (i * 8);
+			}
+			reader.data += 8;
+			double double_value;
+			memcpy(&double_value, &bits, sizeof(double_value));
+			*value = double_value;
+			return true;
+		}
+
+		case STACK_SHOW_BINARY_STRING:
+		{
+			const char *string_data = NULL;
+			size_t string_size = 0;
+			if (!stack_show_binary_read_bytes(reader, &string_data, &string_size))
+			{
+				return false;
+			}
+			*value = Json::Value(string_data, string_data + string_size);
+			return true;
+		}
+
+		case STACK_SHOW_BINARY_ARRAY:
+		{
+			uint64_t count = 0;
+			// Every value takes at least one byte, which bounds the count
+			if (!stack_show_binary_read_varint(reader, &count) || count > (uint64_t)(reader.end - reader.data))
+			{
+				return false;
+			}
+
+			*value = Json::Value(Json::arrayValue);
+			if (count > 0)
+			{
+				value->resize((Json::ArrayIndex)count);
+			}
+			for (uint64_t i = 0; i < count; i++)
+			{
+				if (!stack_show_binary_read_value(reader, &(*value)[(Json::ArrayIndex)i], depth + 1))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		case STACK_SHOW_BINARY_OBJECT:
+		{
+			uint64_t count = 0;
+			// Every key/value pair takes at least two bytes
+			if (!stack_show_binary_read_varint(reader, &count) || count > (uint64_t)(reader.end - reader.data) / 2)
+			{
+				return false;
+			}
+
+			*value = Json::Value(Json::objectValue);
+			for (uint64_t i = 0; i < count; i++)
+			{
+				uint64_t key_index = 0;
+				if (!stack_show_binary_read_varint(reader, &key_index))
+				{
+					return false;
+				}
+
+				if (key_index == 0)
+				{
+					// A new key
+					const char *key_data = NULL;
+					size_t key_size = 0;
+					if (!stack_show_binary_read_bytes(reader, &key_data, &key_size))
+					{
+						return false;
+					}
+					reader.keys.emplace_back(key_data, key_size);
+					key_index = reader.keys.size();
+				}
+				else if (key_index > reader.keys.size())
+				{
+					return false;
+				}
+
+				const std::string &key = reader.keys[key_index - 1];
+				if (!stack_show_binary_read_value(reader, &(*value)[key], depth + 1))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	// Unknown tag
+	return false;
+}
+
+bool stack_show_binary_is_binary(const char *data, size_t size)
+{
+	return size >= STACK_SHOW_BINARY_HEADER_SIZE && memcmp(data, "STKS", 4) == 0;
+}
+
+bool stack_show_binary_uri_is_binary(const char *uri)
+{
+	return g_str_has_suffix(uri, STACK_SHOW_BINARY_EXTENSION);
+}
+
+void stack_show_binary_encode(const Json::Value &root, std::string &output)
+{
+	// Header
+	output.append("STKS", 4);
+	stack_show_binary_write_uint32(output, STACK_SHOW_BINARY_VERSION);
+	stack_show_binary_write_uint32(output, 0);
+	stack_show_binary_write_uint32(output, 0);
+
+	// Content
+	StackShowBinaryWriter writer{output};
+	stack_show_binary_write_value(writer, root);
+}
+
+bool stack_show_binary_decode(const char *data, size_t size, Json::Value *root)
+{
+	if (!stack_show_binary_is_binary(data, size))
+	{
+		stack_log("stack_show_binary_decode(): Not a binary show\n");
+		return false;
+	}
+
+	// Check the version
+	const uint8_t *header = (const uint8_t*)data;
+	const uint32_t version = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+	if (version > STACK_SHOW_BINARY_VERSION)
+	{
+		stack_log("stack_show_binary_decode(): Unsupported version %u\n", version);
+		return false;
+	}
+
+	StackShowBinaryReader reader;
+	reader.data = header + STACK_SHOW_BINARY_HEADER_SIZE;
+	reader.end = header + size;
+	if (!stack_show_binary_read_value(reader, root, 0) || reader.data != reader.end)
+	{
+		stack_log("stack_show_binary_decode(): Show is corrupt\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool stack_show_binary_convert(GFile *input, GFile *output)
+{
+	// Read the input
+	char *contents = NULL;
+	gsize size = 0;
+	GError *error = NULL;
+	if (!g_file_load_contents(input, NULL, &contents, &size, NULL, &error))
+	{
+		stack_log("stack_show_binary_convert(): Failed to read show: %s\n", error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	// Decode it (g_file_load_contents null-terminates the contents)
+	Json::Value root;
+	bool result;
+	if (stack_show_binary_is_binary(contents, size))
+	{
+		result = stack_show_binary_decode(contents, size, &root);
+	}
+	else
+	{
+		result = stack_json_read_string(contents, &root);
+		if (!result)
+		{
+			stack_log("stack_show_binary_convert(): Failed to parse show JSON\n");
+		}
+	}
+	g_free(contents);
+
+	if (!result)
+	{
+		return false;
+	}
+
+	// Encode it in the format of the output
+	std::string encoded;
+	char *output_uri = g_file_get_uri(output);
+	if (stack_show_binary_uri_is_binary(output_uri))
+	{
+		stack_show_binary_encode(root, encoded);
+	}
+	else
+	{
+		Json::StreamWriterBuilder builder;
+		encoded = Json::writeString(builder, root);
+	}
+	g_free(output_uri);
+
+	// Write the output
+	if (!g_file_replace_contents(output, encoded.data(), encoded.size(), NULL, false, G_FILE_CREATE_NONE, NULL, NULL, &error))
+	{
+		stack_log("stack_show_binary_convert(): Failed to write show: %s\n", error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,70 @@
+#ifndef _STACKSHOWBINARY_H_INCLUDED
+#define _STACKSHOWBINARY_H_INCLUDED
+
+// Includes:
+#include <gio/gio.h>
+#include <json/json.h>
+#include <string>
+
+// The binary show format is a compact, lossless encoding of the same document
+// that is saved as JSON, so every cue, property, trigger and MIDI patch that
+// can be saved in one format can be saved in the other. It is written in a
+// single forward pass and read directly from memory (so the file can be mapped
+// rather than read), and it avoids the cost of parsing text when loading very
+// large shows. It is still decoded in to a Json::Value document though, as
+// that is what cues, triggers and MIDI devices are constructed from, so
+// loading saves the parsing but not the building of the document.
+//
+// Layout (all integers little-endian):
+//   Header: "STKS", uint32 version, uint32 flags (zero), uint32 reserved (zero)
+//   Followed by the root value, where each value is a one-byte tag and then:
+//     NULL, FALSE, TRUE:  nothing
+//     INT:     zigzag-encoded varint
+//     UINT:    varint
+//     DOUBLE:  eight bytes (IEEE 754)
+//     STRING:  varint length, then the bytes
+//     ARRAY:   varint count, then that many values
+//     OBJECT:  varint count, then that many key/value pairs
+//   Keys are a varint index in to the table of keys seen so far (starting at
+//   one). An index of zero is followed by a varint length and the bytes of a
+//   new key, which is added to the end of the table
+
+// The version of the format that we write
+#define STACK_SHOW_BINARY_VERSION 1
+
+// The file extension that selects the binary format when saving
+#define STACK_SHOW_BINARY_EXTENSION ".stackb"
+
+// Functions:
+
+// Determines whether a buffer contains a binary show (rather than JSON)
+// @param data The contents of the file
+// @param size The size of the contents
+bool stack_show_binary_is_binary(const char *data, size_t size);
+
+// Determines whether a show should be saved in the binary format, based on
+// the extension of its URI
+// @param uri The URI the show is being saved to
+bool stack_show_binary_uri_is_binary(const char *uri);
+
+// Encodes a show document in the binary format
+// @param root The root of the show document
+// @param output The string to append the encoded show to
+void stack_show_binary_encode(const Json::Value &root, std::string &output);
+
+// Decodes a binary show in to a show document
+// @param data The contents of the file
+// @param size The size of the contents
+// @param root Receives the root of the show document
+// @returns Whether the data was a valid binary show
+bool stack_show_binary_decode(const char *data, size_t size, Json::Value *root);
+
+// Converts a show file between JSON and the binary format without loading it.
+// The format of the input is detected from its contents and the format of the
+// output is chosen by its extension
+// @param input The show file to read
+// @param output The show file to write
+// @returns Whether the conversion succeeded
+bool stack_show_binary_convert(GFile *input, GFile *output);
+
+#endif
@@ -120,6 +120,7 @@ void sss_show_dialog(StackAppWindow *window, StackCueList *cue_list, int tab)
 	GtkComboBox *audio_devices_combo = GTK_COMBO_BOX(gtk_builder_get_object(dialog_data.builder, "sssAudioDeviceCombo"));
 	GtkComboBoxText *sample_rate_combo = GTK_COMBO_BOX_TEXT(gtk_builder_get_object(dialog_data.builder, "sssSampleRateCombo"));
 	GtkComboBoxText *channels_combo = GTK_COMBO_BOX_TEXT(gtk_builder_get_object(dialog_data.builder, "sssChannelsCombo"));
+	GtkToggleButton *dither_check = GTK_TOGGLE_BUTTON(gtk_builder_get_object(dialog_data.builder, "sssDitherCheck"));
 	GtkListStore *liststore = GTK_LIST_STORE(gtk_builder_get_object(dialog_data.builder, "sssMidiListStore"));
 	GtkTreeModel *tree_model = GTK_TREE_MODEL(liststore);
 
@@ -156,6 +157,9 @@ void sss_show_dialog(StackAppWindow *window, StackCueList *cue_list, int tab)
 		GtkWidget *channels_entry = gtk_bin_get_child(GTK_BIN(channels_combo));
 		gtk_entry_set_text(GTK_ENTRY(channels_entry), buffer);
 
+		// Set the dither option
+		gtk_toggle_button_set_active(dither_check, cue_list->audio_device->dither);
+
 		// Reset this to false as setting the active IDs fire the callbacks
 		// (which is useful as it populates the combos for us)
 		dialog_data.audio_device_changed = false;
@@ -274,6 +278,12 @@ void sss_show_dialog(StackAppWindow *window, StackCueList *cue_list, int tab)
 			stack_cue_list_set_show_designer(cue_list, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(dialog_data.builder, "sssShowDesigner"))));
 			stack_cue_list_set_show_revision(cue_list, gtk_entry_get_text(GTK_ENTRY(gtk_builder_get_object(dialog_data.builder, "sssShowRevision"))));
 
+			// Save the dither option (on the new device, if it changed)
+			if (cue_list->audio_device != NULL)
+			{
+				cue_list->audio_device->dither = gtk_toggle_button_get_active(dither_check);
+			}
+
 			// Iterate over the items in the liststore
 			GtkTreeIter new_devices_iter;
 			for (bool iter_result = gtk_tree_model_get_iter_first(tree_model, &new_devices_iter); iter_result; iter_result = gtk_tree_model_iter_next(tree_model, &new_devices_iter))
@@ -180,27 +180,35 @@ StackTriggerAction stack_trigger_get_action(StackTrigger *trigger)
 	return trigger_class_map[string(class_name)]->get_action_func(trigger);
 }
 
-char *stack_trigger_to_json(StackTrigger *trigger)
+// Writes the trigger to a JSON value
+void stack_trigger_to_json_value(StackTrigger *trigger, Json::Value &trigger_root)
 {
 	// Get the class name
 	const char *class_name = trigger->_class_name;
 
 	// Start a JSON response value
-	Json::Value trigger_root;
 	trigger_root["class"] = trigger->_class_name;
 
 	// Iterate up through all the classes
 	while (class_name != NULL)
 	{
 		// Start a node
-		trigger_root[class_name] = Json::Value();
+		Json::Value &class_root = trigger_root[class_name];
+		class_root = Json::Value();
 
-		if (trigger_class_map[class_name]->to_json_func)
+		const StackTriggerClass *trigger_class = trigger_class_map[class_name];
+		if (trigger_class->to_json_value_func)
+		{
+			trigger_class->to_json_value_func(trigger, class_root);
+		}
+		else if (trigger_class->to_json_func)
 		{
-			if (trigger_class_map[class_name]->free_json_func)
+			// Fall back to the string interface
+			if (trigger_class->free_json_func)
 			{
-				char *json_data = trigger_class_map[class_name]->to_json_func(trigger);
-				stack_json_read_string(json_data, &trigger_root[class_name]);
+				char *json_data = trigger_class->to_json_func(trigger);
+				stack_json_read_string(json_data, &class_root);
+				trigger_class->free_json_func(trigger, json_data);
 			}
 			else
 			{
@@ -213,8 +221,14 @@ char *stack_trigger_to_json(StackTrigger *trigger)
 		}
 
 		// Iterate up to superclass
-		class_name = trigger_class_map[class_name]->super_class_name;
+		class_name = trigger_class->super_class_name;
 	}
+}
+
+char *stack_trigger_to_json(StackTrigger *trigger)
+{
+	Json::Value trigger_root;
+	stack_trigger_to_json_value(trigger, trigger_root);
 
 	// Generate JSON string and return it (to be free'd by stack_trigger_free_json)
 	Json::StreamWriterBuilder builder;
@@ -236,8 +250,8 @@ void stack_trigger_free_json(StackTrigger *trigger, char *json_data)
 	trigger_class_map[string(class_name)]->free_json_func(trigger, json_data);
 }
 
-// Generates the trigger from JSON data
-void stack_trigger_from_json(StackTrigger *trigger, const char *json_data)
+// Generates the trigger from a JSON value
+void stack_trigger_from_json_value(StackTrigger *trigger, const Json::Value &trigger_root)
 {
 	if (trigger == NULL)
 	{
@@ -249,13 +263,29 @@ void stack_trigger_from_json(StackTrigger *trigger, const char *json_data)
 	const char *class_name = trigger->_class_name;
 
 	// Look for a from_json function. Iterate through superclasses if we don't have one
-	while (class_name != NULL && trigger_class_map[class_name]->from_json_func == NULL)
+	while (class_name != NULL && trigger_class_map[class_name]->from_json_value_func == NULL && trigger_class_map[class_name]->from_json_func == NULL)
 	{
 		class_name = trigger_class_map[class_name]->super_class_name;
 	}
 
-	// Call the function
-	trigger_class_map[string(class_name)]->from_json_func(trigger, json_data);
+	// Call the function, falling back to the string interface
+	const StackTriggerClass *trigger_class = trigger_class_map[string(class_name)];
+	if (trigger_class->from_json_value_func)
+	{
+		trigger_class->from_json_value_func(trigger, trigger_root);
+	}
+	else
+	{
+		trigger_class->from_json_func(trigger, trigger_root.toStyledString().c_str());
+	}
+}
+
+// Generates the trigger from JSON data
+void stack_trigger_from_json(StackTrigger *trigger, const char *json_data)
+{
+	Json::Value trigger_root;
+	stack_json_read_string(json_data, &trigger_root);
+	stack_trigger_from_json_value(trigger, trigger_root);
 }
 
 bool stack_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *parent, bool new_trigger)
@@ -359,11 +389,15 @@ StackTriggerAction stack_trigger_get_action_base(StackTrigger *trigger)
 	return trigger->action;
 }
 
+void stack_trigger_to_json_value_base(StackTrigger *trigger, Json::Value &trigger_data)
+{
+	trigger_data["action"] = (Json::UInt64)trigger->action;
+}
+
 char* stack_trigger_to_json_base(StackTrigger *trigger)
 {
 	Json::Value trigger_root;
-
-	trigger_root["action"] = (Json::UInt64)trigger->action;
+	stack_trigger_to_json_value_base(trigger, trigger_root);
 
 	Json::StreamWriterBuilder builder;
 	return strdup(Json::writeString(builder, trigger_root).c_str());
@@ -381,8 +415,13 @@ void stack_trigger_from_json_base(StackTrigger *trigger, const char *json_data)
 	// Parse JSON data
 	stack_json_read_string(json_data, &trigger_root);
 
+	stack_trigger_from_json_value_base(trigger, trigger_root);
+}
+
+void stack_trigger_from_json_value_base(StackTrigger *trigger, const Json::Value &trigger_root)
+{
 	// Get the data that's pertinent to us
-	Json::Value& stack_trigger_data = trigger_root["StackTrigger"];
+	const Json::Value& stack_trigger_data = trigger_root["StackTrigger"];
 
 	trigger->action = (StackTriggerAction)stack_trigger_data["action"].asUInt64();
 }
@@ -440,7 +479,7 @@ void stack_trigger_do_action(StackTrigger *trigger)
 void stack_trigger_initsystem()
 {
 	// Register base trigger type
-	StackTriggerClass* stack_trigger_class = new StackTriggerClass{ "StackTrigger", NULL, "No-op abstract", stack_trigger_create_base, stack_trigger_destroy_base, stack_trigger_get_name_base, stack_trigger_get_event_text_base, stack_trigger_get_description_base, stack_trigger_get_action_base, stack_trigger_to_json_base, stack_trigger_free_json_base, stack_trigger_from_json_base, stack_trigger_show_config_ui_base, stack_trigger_config_to_json_base, stack_trigger_config_free_json_base, stack_trigger_config_from_json_base };
+	StackTriggerClass* stack_trigger_class = new StackTriggerClass{ "StackTrigger", NULL, "No-op abstract", stack_trigger_create_base, stack_trigger_destroy_base, stack_trigger_get_name_base, stack_trigger_get_event_text_base, stack_trigger_get_description_base, stack_trigger_get_action_base, stack_trigger_to_json_base, stack_trigger_free_json_base, stack_trigger_from_json_base, stack_trigger_show_config_ui_base, stack_trigger_config_to_json_base, stack_trigger_config_free_json_base, stack_trigger_config_from_json_base, stack_trigger_to_json_value_base, stack_trigger_from_json_value_base };
 	stack_register_trigger_class(stack_trigger_class);
 }
 
@@ -42,6 +42,8 @@ typedef bool(*stack_trigger_show_config_ui_t)(StackTrigger*, GtkWidget*, bool);
 typedef char*(*stack_trigger_config_to_json_t)(void);
 typedef void(*stack_trigger_config_free_json_t)(char*);
 typedef void(*stack_trigger_config_from_json_t)(const char*);
+typedef void(*stack_trigger_to_json_value_t)(StackTrigger*, Json::Value&);
+typedef void(*stack_trigger_from_json_value_t)(StackTrigger*, const Json::Value&);
 
 // Defines information about a class
 typedef struct StackTriggerClass
@@ -64,6 +66,13 @@ typedef struct StackTriggerClass
 	stack_trigger_config_to_json_t config_to_json_func;
 	stack_trigger_config_free_json_t config_free_json_func;
 	stack_trigger_config_from_json_t config_from_json_func;
+
+	// Structured alternatives to to_json_func and from_json_func, used in
+	// preference where provided. to_json_value_func writes the data for its
+	// own class only, whereas from_json_value_func is given the JSON of the
+	// whole trigger
+	stack_trigger_to_json_value_t to_json_value_func;
+	stack_trigger_from_json_value_t from_json_value_func;
 } StackTriggerClass;
 
 // Typedefs:
@@ -90,6 +99,8 @@ StackTriggerAction stack_trigger_get_action(StackTrigger *trigger);
 char* stack_trigger_to_json(StackTrigger *trigger);
 void stack_trigger_free_json(StackTrigger *trigger, char *json_data);
 void stack_trigger_from_json(StackTrigger *trigger, const char *json_data);
+void stack_trigger_to_json_value(StackTrigger *trigger, Json::Value &trigger_root);
+void stack_trigger_from_json_value(StackTrigger *trigger, const Json::Value &trigger_root);
 bool stack_trigger_show_config_ui(StackTrigger *trigger, GtkWidget *parent, bool new_trigger);
 char* stack_trigger_config_to_json(const char *class_name);
 void stack_trigger_config_free_json(const char *class_name, char *json_data);
@@ -107,6 +118,8 @@ StackTriggerAction stack_trigger_get_action_base(StackTrigger *trigger);
 char* stack_trigger_to_json_base(StackTrigger *trigger);
 void stack_trigger_free_json_base(StackTrigger *trigger, char *json_data);
 void stack_trigger_from_json_base(StackTrigger *trigger, const char *json_data);
+void stack_trigger_to_json_value_base(StackTrigger *trigger, Json::Value &trigger_data);
+void stack_trigger_from_json_value_base(StackTrigger *trigger, const Json::Value &trigger_root);
 bool stack_trigger_show_config_ui_base(StackTrigger *trigger, GtkWidget *parent, bool new_trigger);
 char* stack_trigger_config_to_json_base(StackTrigger *trigger);
 void stack_trigger_config_free_json_base(StackTrigger *trigger, char *json_data);
@@ -4,10 +4,17 @@
 #include "StackLog.h"
 #include "StackGtkHelper.h"
 #include "StackJson.h"
+#include "StackShowBinary.h"
+#include "StackCueListSnapshot.h"
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
 #include <list>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 // GTK stuff
 G_DEFINE_TYPE(StackAppWindow, stack_app_window, GTK_TYPE_APPLICATION_WINDOW);
@@ -28,11 +35,23 @@ struct ShowLoadingData
 	const char *message;
 	double progress;
 	bool finished;
+
+	// Asking the user whether to recover unsaved changes (protected by
+	// recover_mutex). The loading thread asks, and the dialog update timer
+	// shows the question on the UI thread
+	std::mutex recover_mutex;
+	std::condition_variable recover_condition;
+	bool recover_asking;
+	bool recover_answered;
+	bool recover_answer;
+	bool recover_cancelled;
 };
 
 // Pre-define some function definitions:
 extern "C" void saw_cue_stop_all_clicked(void* widget, gpointer user_data);
 static void saw_remove_inactive_cue_widgets(StackAppWindow *window);
+static void saw_start_ui_tick(StackAppWindow *window);
+static void saw_watch_cue_list_events(StackAppWindow *window);
 StackTrigger *stack_new_trigger_dialog(StackAppWindow *window, StackCue *cue);
 
 // Callback when loading a show to update our loading dialog
@@ -47,12 +66,50 @@ static void saw_open_file_callback(StackCueList *cue_list, double progress, cons
 	sld->progress = progress;
 }
 
+// Callback when loading a show that wasn't closed cleanly, to ask whether to
+// recover the unsaved changes. Called on the loading thread, so waits for the
+// dialog update timer to ask the question on the UI thread
+static bool saw_open_file_recover_callback(const char *uri, void *data)
+{
+	// Get our show loading data
+	ShowLoadingData *sld = (ShowLoadingData*)data;
+
+	std::unique_lock<std::mutex> lock(sld->recover_mutex);
+	sld->recover_answered = false;
+	sld->recover_asking = true;
+	sld->recover_condition.wait(lock, [sld]{ return sld->recover_answered || sld->recover_cancelled; });
+
+	// If the load was cancelled, nobody is going to ask
+	return sld->recover_answered && sld->recover_answer;
+}
+
 // Timer to update Show Loading dialog and close it when complete
 static gboolean saw_open_file_timer(gpointer data)
 {
 	// Get our show loading data
 	ShowLoadingData *sld = (ShowLoadingData*)data;
 
+	// Ask about recovering unsaved changes if the loading thread wants to
+	// know. This blocks the timer until the question has been answered
+	std::unique_lock<std::mutex> lock(sld->recover_mutex);
+	if (sld->recover_asking)
+	{
+		sld->recover_asking = false;
+		lock.unlock();
+
+		GtkWidget *message_dialog = gtk_message_dialog_new(GTK_WINDOW(sld->dialog), GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, "Recover unsaved changes?");
+		gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(message_dialog), "This show was not closed cleanly and has unsaved changes. Do you want to recover them? If not, the show will be opened as it was last saved.");
+		gtk_window_set_title(GTK_WINDOW(message_dialog), "Recover Show");
+		const bool answer = (gtk_dialog_run(GTK_DIALOG(message_dialog)) == GTK_RESPONSE_YES);
+		gtk_widget_destroy(message_dialog);
+
+		lock.lock();
+		sld->recover_answer = answer;
+		sld->recover_answered = true;
+		sld->recover_condition.notify_all();
+	}
+	lock.unlock();
+
 	if (sld->finished)
 	{
 		// If we're finished, close the dialog. Check if the pointer
@@ -83,7 +140,7 @@ static void saw_open_file_thread(ShowLoadingData *sld)
 	std::this_thread::sleep_for(std::chrono::milliseconds(200));
 
 	// Open the file
-	sld->new_cue_list = stack_cue_list_new_from_file(sld->uri, saw_get_audio_from_cuelist, (void*)sld->window, saw_open_file_callback, (void*)sld);
+	sld->new_cue_list = stack_cue_list_new_from_file(sld->uri, saw_get_audio_from_cuelist, (void*)sld->window, saw_open_file_callback, (void*)sld, saw_open_file_recover_callback, (void*)sld);
 
 	// Note that we've finished and exit the thread
 	sld->finished = true;
@@ -136,15 +193,6 @@ static void saw_update_cue(gpointer user_data, StackCue* cue)
 	}
 }
 
-extern "C" void saw_cue_state_changed(StackCueList *cue_list, StackCue *cue, void *user_data)
-{
-	// Get the window
-	StackAppWindow *window = STACK_APP_WINDOW(user_data);
-
-	// Update the UI
-	stack_cue_list_content_widget_update_cue(window->sclw->content, cue->uid, 0);
-}
-
 // Updates a pre/post wait time on the properties panel
 static void saw_ucp_wait(StackAppWindow *window, StackCue *cue, bool pre)
 {
@@ -441,11 +489,89 @@ static void saw_setup_default_device(StackAppWindow *window)
 	}
 }
 
-// Menu callback
-extern "C" void saw_file_save_as_clicked(void* widget, gpointer user_data)
+// Waits for a save started by stack_cue_list_save_async to finish. The window
+// keeps being drawn (but doesn't take any input) so that the progress of the
+// save can be shown in the title bar
+static StackCueListSaveState saw_wait_for_save(StackAppWindow *window, const char *uri)
+{
+	gtk_widget_set_sensitive(GTK_WIDGET(window), false);
+
+	double progress = 0.0;
+	StackCueListSaveState state;
+	while ((state = stack_cue_list_get_save_state(window->cue_list, &progress)) == STACK_CUE_LIST_SAVE_RUNNING)
+	{
+		char title_buffer[512];
+		snprintf(title_buffer, 512, "%s (Saving %d%%) - Stack", uri, (int)(progress * 100.0));
+		gtk_window_set_title(GTK_WINDOW(window), title_buffer);
+
+		while (gtk_events_pending())
+		{
+			gtk_main_iteration();
+		}
+		g_usleep(10000);
+	}
+
+	gtk_widget_set_sensitive(GTK_WIDGET(window), true);
+
+	return state;
+}
+
+// Saves the show to the given URI. A background save carries on after this
+// returns, and its progress is shown by the UI timer. Otherwise this waits for
+// the save to finish (e.g. before the show is closed)
+static bool saw_save_to_uri(StackAppWindow *window, const char *uri, bool background)
+{
+	// Save the cue list (which takes the lock itself whilst it takes the
+	// snapshot of the cue list to save)
+	bool result = false;
+	if (background)
+	{
+		result = stack_cue_list_save_async(window->cue_list, uri);
+	}
+	else
+	{
+		// Let any background save finish first, as ours replaces it. We take
+		// it over from the UI timer, so that it isn't reported twice
+		if (window->save_uri != NULL)
+		{
+			char *save_uri = window->save_uri;
+			window->save_uri = NULL;
+			saw_wait_for_save(window, save_uri);
+			g_free(save_uri);
+		}
+
+		result = stack_cue_list_save_async(window->cue_list, uri) && saw_wait_for_save(window, uri) == STACK_CUE_LIST_SAVE_SUCCEEDED;
+	}
+
+	if (background && result)
+	{
+		g_free(window->save_uri);
+		window->save_uri = g_strdup(uri);
+		saw_start_ui_tick(window);
+	}
+	else if (!background)
+	{
+		// Update the title bar
+		char title_buffer[512];
+		snprintf(title_buffer, 512, "%s - Stack", uri);
+		gtk_window_set_title(GTK_WINDOW(window), title_buffer);
+
+		if (!result)
+		{
+			GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, "The show could not be saved to %s", uri);
+			gtk_dialog_run(GTK_DIALOG(dialog));
+			gtk_widget_destroy(dialog);
+		}
+	}
+
+	return result;
+}
+
+// Asks the user where to save the show, and saves it there
+static void saw_save_as(StackAppWindow *window, bool background)
 {
 	// Run a Save dialog
-	GtkWidget *dialog = gtk_file_chooser_dialog_new("Save Show As", GTK_WINDOW(user_data), GTK_FILE_CHOOSER_ACTION_SAVE, "_Cancel", GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *dialog = gtk_file_chooser_dialog_new("Save Show As", GTK_WINDOW(window), GTK_FILE_CHOOSER_ACTION_SAVE, "_Cancel", GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
 	gint response = gtk_dialog_run(GTK_DIALOG(dialog));
 
 	// If the user chose to Save...
@@ -455,14 +581,7 @@ extern "C" void saw_file_save_as_clicked(void* widget, gpointer user_data)
 		gchar *uri = gtk_file_chooser_get_uri(GTK_FILE_CHOOSER(dialog));
 
 		// Save the cue list to the file
-		stack_cue_list_lock(STACK_APP_WINDOW(user_data)->cue_list);
-		stack_cue_list_save(STACK_APP_WINDOW(user_data)->cue_list, uri);
-		stack_cue_list_unlock(STACK_APP_WINDOW(user_data)->cue_list);
-
-		// Update the title bar
-		char title_buffer[512];
-		snprintf(title_buffer, 512, "%s - Stack", uri);
-		gtk_window_set_title(GTK_WINDOW(user_data), title_buffer);
+		saw_save_to_uri(window, uri, background);
 
 		// Tidy up
 		g_free(uri);
@@ -471,24 +590,82 @@ extern "C" void saw_file_save_as_clicked(void* widget, gpointer user_data)
 	gtk_widget_destroy(dialog);
 }
 
-// Menu/toolbar callback
-extern "C" void saw_file_save_clicked(void* widget, gpointer user_data)
+// Saves the show, asking the user where to save it if it has never been saved
+static void saw_save(StackAppWindow *window, bool background)
 {
 	// If the current cue list has no URI
-	if (STACK_APP_WINDOW(user_data)->cue_list->uri == NULL)
+	if (window->cue_list->uri == NULL)
 	{
 		// ...call Save As instead
-		saw_file_save_as_clicked(widget, user_data);
+		saw_save_as(window, background);
 	}
 	else
 	{
 		// ...otherwise overwrite
-		stack_cue_list_lock(STACK_APP_WINDOW(user_data)->cue_list);
-		stack_cue_list_save(STACK_APP_WINDOW(user_data)->cue_list, STACK_APP_WINDOW(user_data)->cue_list->uri);
-		stack_cue_list_unlock(STACK_APP_WINDOW(user_data)->cue_list);
+		saw_save_to_uri(window, window->cue_list->uri, background);
 	}
 }
 
+// Shows the progress of a background save in the title bar, and lets the user
+// know if it failed. Called from the UI timer
+static void saw_update_save_progress(StackAppWindow *window)
+{
+	if (window->save_uri == NULL)
+	{
+		return;
+	}
+
+	double progress = 0.0;
+	StackCueListSaveState state = stack_cue_list_get_save_state(window->cue_list, &progress);
+
+	char title_buffer[512];
+	switch (state)
+	{
+		case STACK_CUE_LIST_SAVE_RUNNING:
+			snprintf(title_buffer, 512, "%s (Saving %d%%) - Stack", window->save_uri, (int)(progress * 100.0));
+			gtk_window_set_title(GTK_WINDOW(window), title_buffer);
+			return;
+
+		case STACK_CUE_LIST_SAVE_SUCCEEDED:
+			stack_log("saw_update_save_progress(): Saved %s\n", window->save_uri);
+			snprintf(title_buffer, 512, "%s - Stack", window->save_uri);
+			gtk_window_set_title(GTK_WINDOW(window), title_buffer);
+			break;
+
+		case STACK_CUE_LIST_SAVE_FAILED:
+		{
+			snprintf(title_buffer, 512, "%s - Stack", window->save_uri);
+			gtk_window_set_title(GTK_WINDOW(window), title_buffer);
+
+			// Don't block the UI timer whilst the message is showing
+			GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, "The show could not be saved to %s", window->save_uri);
+			g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+			gtk_widget_show(dialog);
+			break;
+		}
+
+		case STACK_CUE_LIST_SAVE_IDLE:
+			// The save was finished some other way (e.g. by the cue list
+			// being closed), and whoever did that has updated the title
+			break;
+	}
+
+	g_free(window->save_uri);
+	window->save_uri = NULL;
+}
+
+// Menu callback
+extern "C" void saw_file_save_as_clicked(void* widget, gpointer user_data)
+{
+	saw_save_as(STACK_APP_WINDOW(user_data), true);
+}
+
+// Menu/toolbar callback
+extern "C" void saw_file_save_clicked(void* widget, gpointer user_data)
+{
+	saw_save(STACK_APP_WINDOW(user_data), true);
+}
+
 // Menu/toolbar callback
 extern "C" void saw_file_open_clicked(void* widget, gpointer user_data)
 {
@@ -513,7 +690,8 @@ extern "C" void saw_file_open_clicked(void* widget, gpointer user_data)
 		}
 		else if (result == GTK_RESPONSE_YES)
 		{
-			saw_file_save_clicked(widget, user_data);
+			// Wait for the save, as we're about to close the show
+			saw_save(window, false);
 
 			// If the file wasn't saved as a result of the above...
 			if (window->cue_list->changed)
@@ -530,7 +708,8 @@ extern "C" void saw_file_open_clicked(void* widget, gpointer user_data)
 	// Add filters to it (the file chooser takes ownership, so we don't have to tidy them up)
 	GtkFileFilter *stack_filter = gtk_file_filter_new();
 	gtk_file_filter_add_pattern(stack_filter, "*.stack");
-	gtk_file_filter_set_name(stack_filter, "Stack Show Files (*.stack)");
+	gtk_file_filter_add_pattern(stack_filter, "*" STACK_SHOW_BINARY_EXTENSION);
+	gtk_file_filter_set_name(stack_filter, "Stack Show Files (*.stack, *" STACK_SHOW_BINARY_EXTENSION ")");
 	gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), stack_filter);
 	GtkFileFilter *all_filter = gtk_file_filter_new();
 	gtk_file_filter_add_pattern(all_filter, "*");
@@ -581,7 +760,8 @@ extern "C" void saw_file_new_clicked(void* widget, gpointer user_data)
 		}
 		else if (result == GTK_RESPONSE_YES)
 		{
-			saw_file_save_clicked(widget, user_data);
+			// Wait for the save, as we're about to close the show
+			saw_save(window, false);
 
 			// If the file wasn't saved as a result of the above...
 			if (window->cue_list->changed)
@@ -613,9 +793,8 @@ extern "C" void saw_file_new_clicked(void* widget, gpointer user_data)
 
 	// Initialise a new cue list, defaulting to two channels
 	window->cue_list = stack_cue_list_new(2);
-	window->cue_list->state_change_func = saw_cue_state_changed;
-	window->cue_list->state_change_func_data = (void*)window;
 	stack_cue_list_content_widget_set_cue_list(window->sclw->content, window->cue_list);
+	saw_watch_cue_list_events(window);
 
 	// Refresh the cue list
 	gtk_window_set_title(GTK_WINDOW(window), "Stack");
@@ -908,6 +1087,8 @@ extern "C" void saw_edit_paste_clicked(void* widget, gpointer user_data)
 	// Keep track of the cue we're inserting after
 	StackCue *insert_after = window->selected_cue;
 
+	bool pasted = false;
+
 	for (auto iter : cues_root)
 	{
 		// Try and create the cue
@@ -937,12 +1118,16 @@ extern "C" void saw_edit_paste_clicked(void* widget, gpointer user_data)
 
 			// Select the new cue
 			stack_cue_list_content_widget_select_single_cue(window->sclw->content, new_cue->uid);
-
-			// Tell the cue list to redraw
-			stack_cue_list_content_widget_list_modified(window->sclw->content);
+			pasted = true;
 		}
 	}
 
+	// Tell the cue list to redraw
+	if (pasted)
+	{
+		stack_cue_list_content_widget_list_modified(window->sclw->content);
+	}
+
 	// Free the selection
 	gtk_selection_data_free(data);
 }
@@ -1196,6 +1381,7 @@ extern "C" void saw_cue_trigger_add_clicked(void *widget, gpointer user_data)
 		{
 			// Add the returned trigger
 			stack_cue_add_trigger(window->selected_cue, trigger);
+			stack_cue_list_changed(window->cue_list, window->selected_cue, NULL);
 
 			// Add to the UI
 			saw_add_trigger_to_liststore(window, trigger);
@@ -1232,6 +1418,9 @@ extern "C" void saw_cue_trigger_edit_clicked(void *widget, gpointer user_data)
 	// Show the config UI
 	if (stack_trigger_show_config_ui(trigger, GTK_WIDGET(window), false))
 	{
+		// The trigger is saved as part of the cue
+		stack_cue_list_changed(window->cue_list, window->selected_cue, NULL);
+
 		// Get the selected action
 		StackTriggerAction action = stack_trigger_get_action(trigger);
 		const char *action_text;
@@ -1293,6 +1482,7 @@ extern "C" void saw_cue_trigger_delete_clicked(void *widget, gpointer user_data)
 
 	// Remove from the cue
 	stack_cue_remove_trigger(window->selected_cue, trigger);
+	stack_cue_list_changed(window->cue_list, window->selected_cue, NULL);
 }
 
 // Trigger toolbar callback
@@ -1313,6 +1503,7 @@ extern "C" void saw_cue_trigger_clear_clicked(void *widget, gpointer user_data)
 
 	// Remove all triggers from the cue
 	stack_cue_clear_triggers(window->selected_cue);
+	stack_cue_list_changed(window->cue_list, window->selected_cue, NULL);
 }
 
 // Trigger double-clicked
@@ -1328,27 +1519,27 @@ static void saw_remove_inactive_cue_widgets(StackAppWindow *window)
 	// Get the UI item to remov the cue from
 	GtkBox *active_cues = GTK_BOX(gtk_builder_get_object(window->builder, "sawActiveCuesBox"));
 
-	for (auto citer = window->cue_list->cues->recursive_begin(); citer != window->cue_list->cues->recursive_end(); ++citer)
+	for (auto find_widget = window->active_cue_widgets.begin(); find_widget != window->active_cue_widgets.end(); )
 	{
-		StackCue *cue = *citer;
-		// We're looking for cues that are stopped but have widgets
-		if (cue->state == STACK_CUE_STATE_STOPPED)
+		// We're looking for cues that are stopped (or gone) but have widgets
+		StackCue *cue = stack_cue_get_by_uid(find_widget->first);
+		if (cue == NULL || cue->state == STACK_CUE_STATE_STOPPED)
 		{
-			auto find_widget = window->active_cue_widgets.find(cue->uid);
-			if (find_widget != window->active_cue_widgets.end())
-			{
-				StackActiveCueWidget *widget = find_widget->second;
+			StackActiveCueWidget *widget = find_widget->second;
 
-				// Note that this should also destroy the children so we don't
-				// need to delete them (as their refcount should hit zero)
-				gtk_container_remove(GTK_CONTAINER(active_cues), GTK_WIDGET(widget->vbox));
+			// Note that this should also destroy the children so we don't
+			// need to delete them (as their refcount should hit zero)
+			gtk_container_remove(GTK_CONTAINER(active_cues), GTK_WIDGET(widget->vbox));
 
-				// Tidy up the structure
-				delete widget;
+			// Tidy up the structure
+			delete widget;
 
-				// Remove from the map
-				window->active_cue_widgets.erase(find_widget);
-			}
+			// Remove from the map
+			find_widget = window->active_cue_widgets.erase(find_widget);
+		}
+		else
+		{
+			++find_widget;
 		}
 	}
 }
@@ -1481,69 +1672,156 @@ static void saw_add_or_update_active_cue_widget(StackAppWindow *window, StackCue
 	gtk_label_set_text(cue_widget->time, time_text);
 }
 
-// Callback for UI timer
-static gboolean saw_ui_timer(gpointer user_data)
+// Frame clock tick callback for the window. Drains the events that the cue
+// list has sent since the last frame and updates only what they say has
+// changed, so that the work done scales with how much is happening rather than
+// with the size of the show. Row updates are drawn in to the cue list widget
+// and it is redrawn once for the frame
+static gboolean saw_ui_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
 {
 	StackAppWindow *window = STACK_APP_WINDOW(user_data);
+	StackCueList *cue_list = window->cue_list;
+
+	// If we've missed events, refresh everything
+	const bool refresh_all = stack_event_queue_take_overflow(cue_list->events);
+	bool times_changed = refresh_all;
+	bool meters_changed = refresh_all;
 
-	// Let the app know that we're running
-	if (window->timer_state == 0)
+	// Drain the queue, de-duplicating state changes
+	std::unordered_set<cue_uid_t> state_changes;
+	StackEvent event;
+	while (stack_event_queue_pop(cue_list->events, &event))
 	{
-		window->timer_state = 1;
+		switch (event.type)
+		{
+			case STACK_CUE_LIST_EVENT_STATE:
+				state_changes.insert((cue_uid_t)event.data);
+				break;
+			case STACK_CUE_LIST_EVENT_TIMES:
+				times_changed = true;
+				break;
+			case STACK_CUE_LIST_EVENT_METERS:
+				meters_changed = true;
+				break;
+		}
 	}
 
-	// If the timer is supposed to be stopping...
-	if (window->timer_state == 2)
+	if (refresh_all || times_changed || meters_changed || !state_changes.empty())
 	{
-		// Set the timer state to stopped
-		window->timer_state = 3;
+		// The snapshot tells us which cues are running
+		std::shared_ptr<const StackCueListSnapshot> snapshot = stack_cue_list_get_snapshot(cue_list);
 
-		// Prevent timer re-occurence
-		return false;
-	}
+		// Lock the cue list
+		stack_cue_list_lock(cue_list);
 
-	// Lock the cue list
-	stack_cue_list_lock(window->cue_list);
+		if (refresh_all)
+		{
+			stack_cue_list_content_widget_list_modified(window->sclw->content);
+		}
 
-	// Make sure we have the right number of channels on our master out meter
-	if (window->master_out_meter->channels != window->cue_list->channels)
-	{
-		stack_level_meter_set_channels(window->master_out_meter, window->cue_list->channels);
-	}
+		// Update the cues that have changed state
+		for (cue_uid_t uid : state_changes)
+		{
+			stack_cue_list_content_widget_refresh_cue(window->sclw->content, uid, 0);
 
-	// Iterate over the cue list
-	for (auto citer = window->cue_list->cues->recursive_begin(); citer != window->cue_list->cues->recursive_end(); ++citer)
-	{
-		StackCue *cue = *citer;
-		if (cue->state == STACK_CUE_STATE_PAUSED || (cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST))
+			StackCue *cue = stack_cue_get_by_uid(uid);
+			if (cue != NULL && (cue->state == STACK_CUE_STATE_PAUSED || (cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST)))
+			{
+				saw_add_or_update_active_cue_widget(window, cue);
+			}
+		}
+
+		// Update the times of the running cues
+		if (times_changed)
 		{
-			// Update the row (times only)
-			stack_cue_list_content_widget_update_cue(window->sclw->content, cue->uid, 4);
+			for (const StackCueSnapshotTimes &times : snapshot->active)
+			{
+				StackCue *cue = stack_cue_get_by_uid((*snapshot->cues)[times.index]->uid);
+				if (cue != NULL && (cue->state == STACK_CUE_STATE_PAUSED || (cue->state >= STACK_CUE_STATE_PLAYING_PRE && cue->state <= STACK_CUE_STATE_PLAYING_POST)))
+				{
+					// Update the row (times only)
+					stack_cue_list_content_widget_refresh_cue(window->sclw->content, cue->uid, 4);
 
-			// Update active cue panel
-			saw_add_or_update_active_cue_widget(window, cue);
+					// Update active cue panel
+					saw_add_or_update_active_cue_widget(window, cue);
+				}
+			}
 		}
-	}
 
-	// Remove any inactive cues
-	saw_remove_inactive_cue_widgets(window);
+		// Remove any inactive cues
+		if (refresh_all || !state_changes.empty())
+		{
+			saw_remove_inactive_cue_widgets(window);
+		}
 
-	stack_time_t current_time = stack_get_clock_time();
+		// Make sure we have the right number of channels on our master out meter
+		if (window->master_out_meter->channels != cue_list->channels)
+		{
+			stack_level_meter_set_channels(window->master_out_meter, cue_list->channels);
+			meters_changed = true;
+		}
 
-	// Update the master RMS data
-	for (size_t i = 0; i < window->cue_list->channels; i++)
-	{
-		stack_level_meter_set_level_and_peak(window->master_out_meter, i, window->cue_list->master_rms_data[i].current_level, window->cue_list->master_rms_data[i].peak_level);
-		if (window->cue_list->master_rms_data[i].clipped)
+		// Update the master RMS data
+		if (meters_changed)
 		{
-			stack_level_meter_set_clipped(window->master_out_meter, i, true);
+			for (size_t i = 0; i < cue_list->channels; i++)
+			{
+				stack_level_meter_set_level_and_peak(window->master_out_meter, i, cue_list->master_rms_data[i].current_level, cue_list->master_rms_data[i].peak_level);
+				if (cue_list->master_rms_data[i].clipped)
+				{
+					stack_level_meter_set_clipped(window->master_out_meter, i, true);
+				}
+			}
 		}
+
+		// Unlock the cue list
+		stack_cue_list_unlock(cue_list);
 	}
 
-	// Unlock the cue list
-	stack_cue_list_unlock(window->cue_list);
+	// Update the progress of any background save
+	saw_update_save_progress(window);
+
+	// If nothing is happening, stop ticking until the cue list sends an event
+	if (!refresh_all && !times_changed && !meters_changed && state_changes.empty() && window->active_cue_widgets.empty() && window->save_uri == NULL && stack_event_queue_wait(cue_list->events))
+	{
+		window->tick_callback = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
 
-	return true;
+// Installs the frame clock tick callback that refreshes the UI, if it isn't
+// already installed
+static void saw_start_ui_tick(StackAppWindow *window)
+{
+	if (window->tick_callback == 0 && window->cue_list != NULL)
+	{
+		window->tick_callback = gtk_widget_add_tick_callback(GTK_WIDGET(window), saw_ui_tick, (gpointer)window, NULL);
+	}
+}
+
+// Idle callback that restarts the UI tick after the cue list has sent an event
+static gboolean saw_wake_ui_tick(gpointer user_data)
+{
+	saw_start_ui_tick(STACK_APP_WINDOW(user_data));
+	return G_SOURCE_REMOVE;
+}
+
+// Called by the event queue of the cue list when an event arrives whilst the
+// UI tick is stopped. This can be on any thread, so we hand over to the UI
+// thread (keeping the window alive until the idle callback has run)
+static void saw_cue_list_events_waiting(void *user_data)
+{
+	g_idle_add_full(G_PRIORITY_DEFAULT, saw_wake_ui_tick, g_object_ref(user_data), g_object_unref);
+}
+
+// Starts refreshing the UI from the events of the window's cue list, which
+// should be called whenever the window gets a new cue list
+static void saw_watch_cue_list_events(StackAppWindow *window)
+{
+	stack_event_queue_set_wake(window->cue_list->events, saw_cue_list_events_waiting, (gpointer)window);
+	saw_start_ui_tick(window);
 }
 
 // Callback for when the selected cue changes
@@ -1597,24 +1875,20 @@ static void saw_destroy(GtkWidget* widget, gpointer user_data)
 		window->selected_cue = NULL;
 	}
 
-	// Instruct the timer to stop
-	stack_log("saw_destroy(): Waiting for UI timer to stop\n");
-	window->timer_state = 2;
-
-	// Wait for the timer to stop
-	while (window->timer_state != 3)
+	// Stop updating the UI. The tick callback runs on this thread, so it
+	// won't be called again once this returns
+	if (window->tick_callback != 0)
 	{
-		// Run an event loop to let the timer fire
-		while (gtk_events_pending())
-		{
-			gtk_main_iteration();
-		}
+		gtk_widget_remove_tick_callback(GTK_WIDGET(window), window->tick_callback);
+		window->tick_callback = 0;
 	}
 
-	stack_log("saw_destroy(): Timer stopped\n");
-
-	// Destroy the cue list
+	// Destroy the cue list (which waits for any save to finish). Clearing it
+	// stops a pending wake from restarting the tick
 	stack_cue_list_destroy(window->cue_list);
+	window->cue_list = NULL;
+	g_free(window->save_uri);
+	window->save_uri = NULL;
 
 	// Tidy up the builder
 	g_object_unref(window->builder);
@@ -1953,8 +2227,6 @@ static void stack_app_window_init(StackAppWindow *window)
 
 	// Initialise this windows cue stack, defaulting to two channels
 	window->cue_list = stack_cue_list_new(2);
-	window->cue_list->state_change_func = saw_cue_state_changed;
-	window->cue_list->state_change_func_data = (void*)window;
 
 	if (window->use_custom_style)
 	{
@@ -2083,9 +2355,9 @@ static void stack_app_window_init(StackAppWindow *window)
 	// Set up clipboard
 	window->clipboard_target = gtk_target_entry_new(stack_cue_data_atom_name, 0, 1000);
 
-	// Set up a timer to periodically refresh the UI
-	window->timer_state = 0;
-	gdk_threads_add_timeout(33, (GSourceFunc)saw_ui_timer, (gpointer)window);
+	// Refresh the UI on each frame whilst the cue list is sending events
+	window->tick_callback = 0;
+	saw_watch_cue_list_events(window);
 
 	// Setup the default device
 	saw_setup_default_device(window);
@@ -2196,14 +2468,13 @@ StackCue* stack_select_cue_dialog(StackAppWindow *window, StackCue *current, Sta
 	GtkTreeView *treeview = GTK_TREE_VIEW(gtk_builder_get_object(builder, "csdTreeView"));
 	GtkListStore *store = GTK_LIST_STORE(gtk_tree_view_get_model(treeview));
 
-	// Lock the cue list
-	stack_cue_list_lock(window->cue_list);
-
-	// Iterate over the cue list
-	for (auto citer = window->cue_list->cues->recursive_begin(); citer != window->cue_list->cues->recursive_end(); ++citer)
+	// Iterate over the cue list (using the snapshot, so that we don't need to
+	// take the lock)
+	std::shared_ptr<const StackCueListSnapshot> snapshot = stack_cue_list_get_snapshot(window->cue_list);
+	for (const std::shared_ptr<const StackCueSnapshot> &cue_snapshot : *snapshot->cues)
 	{
-		StackCue *cue = *citer;
-		if (cue != hide)
+		StackCue *cue = stack_cue_get_by_uid(cue_snapshot->uid);
+		if (cue != NULL && cue != hide)
 		{
 			// Append a row to the dialog
 			GtkTreeIter iter;
@@ -2217,19 +2488,16 @@ StackCue* stack_select_cue_dialog(StackAppWindow *window, StackCue *current, Sta
 
 			// Build cue number
 			char cue_number[32];
-			stack_cue_id_to_string(cue->id, cue_number, 32);
+			stack_cue_id_to_string(cue_snapshot->id, cue_number, 32);
 
 			// Update iterator
 			gtk_list_store_set(store, &iter,
 				0, cue_number,
-				1, stack_cue_get_rendered_name(cue),
+				1, cue_snapshot->name.c_str(),
 				2, (gpointer)cue, -1);
 		}
 	}
 
-	// Unlock the cue list
-	stack_cue_list_unlock(window->cue_list);
-
 	// Run the dialog
 	gint response = gtk_dialog_run(dialog);
 
@@ -2345,6 +2613,10 @@ void stack_app_window_open(StackAppWindow *window, GFile *file)
 	sld.finished = false;
 	sld.progress = 0;
 	sld.message = NULL;
+	sld.recover_asking = false;
+	sld.recover_answered = false;
+	sld.recover_answer = false;
+	sld.recover_cancelled = false;
 	gtk_window_set_transient_for(GTK_WINDOW(sld.dialog), GTK_WINDOW(window));
 	gtk_window_set_default_size(GTK_WINDOW(sld.dialog), 350, 150);
 	gtk_dialog_add_buttons(sld.dialog, "Cancel", 1, NULL);
@@ -2358,7 +2630,13 @@ void stack_app_window_open(StackAppWindow *window, GFile *file)
 	gint result = gtk_dialog_run(sld.dialog);
 
 	// If we get here, either the timer killed the dialog, or the user
-	// cancelled. In either case, wait for the thread to die
+	// cancelled. In either case, wait for the thread to die (making sure it's
+	// not waiting for us to ask about recovering the show)
+	{
+		std::unique_lock<std::mutex> lock(sld.recover_mutex);
+		sld.recover_cancelled = true;
+	}
+	sld.recover_condition.notify_all();
 	thread.join();
 
 	// If the result from the dialog was 1 (Cancel - see gtk_dialog_add_buttons
@@ -2386,10 +2664,6 @@ void stack_app_window_open(StackAppWindow *window, GFile *file)
 
 	if (sld.new_cue_list != NULL)
 	{
-		// Set up state change notification
-		sld.new_cue_list->state_change_func = saw_cue_state_changed;
-		sld.new_cue_list->state_change_func_data = (void*)window;
-
 		// Stop all the cues
 		saw_cue_stop_all_clicked(NULL, (gpointer)window);
 
@@ -2411,6 +2685,7 @@ void stack_app_window_open(StackAppWindow *window, GFile *file)
 		window->cue_list = sld.new_cue_list;
 		window->loading_cue_list = NULL;
 		stack_cue_list_content_widget_set_cue_list(window->sclw->content, window->cue_list);
+		saw_watch_cue_list_events(window);
 
 		// Destroy the old cue list (do this after setting thew new one, so that
 		// any still-running event callbacks always have a valid cue list available)
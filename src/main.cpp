@@ -1,10 +1,23 @@
 // Includes:
 #include "StackApp.h"
+#include "StackShowBinary.h"
+#include <cstring>
 
 // Entry point for the application
 int main(int argc, char **argv)
 {
+	// Convert a show between JSON and the binary format without starting the
+	// user interface: runstack --convert-show <input> <output>
+	if (argc == 4 && strcmp(argv[1], "--convert-show") == 0)
+	{
+		GFile *input = g_file_new_for_commandline_arg(argv[2]);
+		GFile *output = g_file_new_for_commandline_arg(argv[3]);
+		bool result = stack_show_binary_convert(input, output);
+		g_object_unref(input);
+		g_object_unref(output);
+		return result ? 0 : 1;
+	}
+
 	// Start the application
 	return g_application_run(G_APPLICATION(stack_app_new()), argc, argv);
 }
-
@@ -0,0 +1,54 @@
+// Times stack_audio_file_convert for each sample format, converting one second
+// of 64 channel, 96kHz audio per iteration
+// Usage: StackAudioFileConvertBench [iterations]
+
+// Includes:
+#include "StackTest.h"
+#include "src/StackAudioFile.h"
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+	const size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+	const size_t samples = 64 * 96000;
+
+	// Random input is big enough for the largest format
+	std::vector<uint8_t> input(samples * 8);
+	std::mt19937 random(1);
+	for (auto &byte : input)
+	{
+		byte = (uint8_t)random();
+	}
+	std::vector<float> output(samples);
+
+	const struct { StackSampleFormat format; const char *name; } formats[] = {
+		{ STACK_SAMPLE_FORMAT_INT8, "int8" },
+		{ STACK_SAMPLE_FORMAT_INT16, "int16" },
+		{ STACK_SAMPLE_FORMAT_INT24, "int24" },
+		{ STACK_SAMPLE_FORMAT_INT32, "int32" },
+		{ STACK_SAMPLE_FORMAT_FLOAT32, "float32" },
+		{ STACK_SAMPLE_FORMAT_FLOAT64, "float64" },
+	};
+
+	// Make sure the converters are chosen before we start timing
+	stack_audio_file_convert(STACK_SAMPLE_FORMAT_INT16, input.data(), 1, output.data());
+
+	printf("Converting %lu samples, %lu iteration(s)\n", samples, iterations);
+	for (auto &format : formats)
+	{
+		stack_time_t start_time = stack_get_clock_time();
+		for (size_t i = 0; i < iterations; i++)
+		{
+			if (!stack_audio_file_convert(format.format, input.data(), samples, output.data()))
+			{
+				fprintf(stderr, "Failed to convert %s\n", format.name);
+				return 1;
+			}
+		}
+		stack_bench_report(format.name, start_time, samples * iterations);
+	}
+
+	return 0;
+}
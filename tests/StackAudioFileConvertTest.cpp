@@ -0,0 +1,203 @@
+// Checks stack_audio_file_convert against straightforward scalar conversions,
+// forcing each of the conversion paths (scalar, SSE2 and AVX2) that the CPU
+// supports in turn. The integer formats up to 24-bit are checked exhaustively,
+// and every format is checked at a range of lengths and alignments so that the
+// heads and tails of the vector loops are covered
+
+// Includes:
+#include "StackTest.h"
+#include "src/StackAudioFile.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Scalars for converting integer samples, matching those in StackAudioFile.cpp
+static const float INT8_SCALAR = 7.8125e-3f;
+static const float INT16_SCALAR = 3.051757812e-5f;
+static const float INT24_SCALAR = 1.192092896e-7f;
+static const float INT32_SCALAR = 4.656612873e-10;
+
+// The name of the conversion path being tested, for reporting failures
+static const char *current_path = "";
+
+// Returns the number of bytes in a sample of the given format
+static size_t sample_size(StackSampleFormat format)
+{
+	switch (format)
+	{
+		case STACK_SAMPLE_FORMAT_INT8:
+			return 1;
+		case STACK_SAMPLE_FORMAT_INT16:
+			return 2;
+		case STACK_SAMPLE_FORMAT_INT24:
+			return 3;
+		case STACK_SAMPLE_FORMAT_INT32:
+		case STACK_SAMPLE_FORMAT_FLOAT32:
+			return 4;
+		case STACK_SAMPLE_FORMAT_FLOAT64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+// Converts a single little-endian sample to float, one byte at a time
+static float reference_convert(StackSampleFormat format, const uint8_t *input)
+{
+	uint64_t bits = 0;
+	for (size_t i = 0; i < sample_size(format); i++)
+	{
+		bits |= (uint64_t)input[i] << (8 * i);
+	}
+
+	switch (format)
+	{
+		case STACK_SAMPLE_FORMAT_INT8:
+			return (float)(int8_t)bits * INT8_SCALAR;
+		case STACK_SAMPLE_FORMAT_INT16:
+			return (float)(int16_t)bits * INT16_SCALAR;
+		case STACK_SAMPLE_FORMAT_INT24:
+			return (float)((int32_t)(uint32_t)(bits << 8) >> 8) * INT24_SCALAR;
+		case STACK_SAMPLE_FORMAT_INT32:
+			return (float)(int32_t)bits * INT32_SCALAR;
+		case STACK_SAMPLE_FORMAT_FLOAT32:
+		{
+			uint32_t bits32 = (uint32_t)bits;
+			float sample;
+			memcpy(&sample, &bits32, sizeof(float));
+			return sample;
+		}
+		case STACK_SAMPLE_FORMAT_FLOAT64:
+		{
+			double sample;
+			memcpy(&sample, &bits, sizeof(double));
+			return (float)sample;
+		}
+		default:
+			return 0.0f;
+	}
+}
+
+// Converts the given samples and checks that every one matches the reference
+// exactly. Returns false on the first mismatch
+static bool check_convert(StackSampleFormat format, const uint8_t *input, size_t samples, float *output, const char *description)
+{
+	if (!stack_audio_file_convert(format, input, samples, output))
+	{
+		STACK_TEST_CHECK(false, "%s: format %d (%s): conversion failed", current_path, format, description);
+		return false;
+	}
+
+	const size_t size = sample_size(format);
+	for (size_t i = 0; i < samples; i++)
+	{
+		const float expected = reference_convert(format, &input[i * size]);
+
+		// Compare the bits so that NaNs from float formats compare equal
+		if (memcmp(&output[i], &expected, sizeof(float)) != 0)
+		{
+			STACK_TEST_CHECK(false, "%s: format %d (%s): sample %lu is %.9g, expected %.9g", current_path, format, description, i, output[i], expected);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Checks every possible value of a format with at most 24 bits
+static void test_exhaustive(StackSampleFormat format)
+{
+	const size_t size = sample_size(format);
+	const size_t samples = (size_t)1 << (8 * size);
+
+	std::vector<uint8_t> input(samples * size);
+	for (size_t i = 0; i < samples; i++)
+	{
+		for (size_t j = 0; j < size; j++)
+		{
+			input[i * size + j] = (uint8_t)(i >> (8 * j));
+		}
+	}
+
+	std::vector<float> output(samples);
+	check_convert(format, input.data(), samples, output.data(), "exhaustive");
+}
+
+// Checks random data at every length up to a few vectors, and at every
+// alignment of the input and output
+static void test_lengths_and_alignments(StackSampleFormat format, std::mt19937 &random)
+{
+	const size_t size = sample_size(format);
+	const size_t max_samples = 67;
+	const size_t max_offset = 8;
+
+	std::vector<uint8_t> input((max_samples + max_offset) * size);
+	std::vector<float> output(max_samples + max_offset + 1);
+
+	for (size_t samples = 0; samples <= max_samples; samples++)
+	{
+		for (size_t input_offset = 0; input_offset < max_offset; input_offset++)
+		{
+			for (size_t output_offset = 0; output_offset < 4; output_offset++)
+			{
+				for (auto &byte : input)
+				{
+					byte = (uint8_t)random();
+				}
+
+				// Fill the output with a marker so that we can tell if the
+				// converter writes past the end
+				const float marker = 12345.0f;
+				for (auto &sample : output)
+				{
+					sample = marker;
+				}
+
+				char description[64];
+				snprintf(description, sizeof(description), "%lu samples, offsets %lu/%lu", samples, input_offset, output_offset);
+				if (!check_convert(format, &input[input_offset], samples, &output[output_offset], description))
+				{
+					return;
+				}
+				STACK_TEST_CHECK(output[output_offset + samples] == marker, "%s: format %d (%s): wrote past the end of the output", current_path, format, description);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const StackSampleFormat formats[] = { STACK_SAMPLE_FORMAT_INT8, STACK_SAMPLE_FORMAT_INT16, STACK_SAMPLE_FORMAT_INT24, STACK_SAMPLE_FORMAT_INT32, STACK_SAMPLE_FORMAT_FLOAT32, STACK_SAMPLE_FORMAT_FLOAT64 };
+
+	const StackAudioFileConvertPath paths[] = { STACK_AUDIO_FILE_CONVERT_SCALAR, STACK_AUDIO_FILE_CONVERT_SSE2, STACK_AUDIO_FILE_CONVERT_AVX2 };
+	const char *path_names[] = { "scalar", "SSE2", "AVX2" };
+
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+	{
+		// The scalar path must always be available
+		if (!stack_audio_file_set_convert_path(paths[i]))
+		{
+			STACK_TEST_CHECK(paths[i] != STACK_AUDIO_FILE_CONVERT_SCALAR, "scalar conversion is unavailable");
+			fprintf(stderr, "Skipping %s conversion: not supported\n", path_names[i]);
+			continue;
+		}
+		current_path = path_names[i];
+
+		test_exhaustive(STACK_SAMPLE_FORMAT_INT8);
+		test_exhaustive(STACK_SAMPLE_FORMAT_INT16);
+		test_exhaustive(STACK_SAMPLE_FORMAT_INT24);
+
+		std::mt19937 random(1);
+		for (auto format : formats)
+		{
+			test_lengths_and_alignments(format, random);
+		}
+	}
+	STACK_TEST_CHECK(stack_audio_file_set_convert_path(STACK_AUDIO_FILE_CONVERT_AUTO), "automatic conversion is unavailable");
+
+	// Unknown formats should be rejected
+	float output;
+	STACK_TEST_CHECK(!stack_audio_file_convert(STACK_SAMPLE_FORMAT_UNKNOWN, "", 0, &output), "unknown format was accepted");
+
+	return stack_test_result();
+}
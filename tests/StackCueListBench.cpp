@@ -0,0 +1,191 @@
+// Times building, looking up and moving cues in, serialising, saving and loading
+// large cue lists, in JSON and the binary show format. The cues are empty group
+// cues, as they're built in and have no media
+// Usage: StackCueListBench [cue count...] (default 10000 100000)
+
+// Includes:
+#include "StackTest.h"
+#include "src/StackCueList.h"
+#include "src/StackShowBinary.h"
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+// Saves the cue list in the format given by the extension, then loads it back
+static bool bench_save_and_load(StackCueList *cue_list, size_t count, const char *extension)
+{
+	char *filename = g_strdup_printf("%s/stack-bench-%d%s", g_get_tmp_dir(), (int)getpid(), extension);
+	char *uri = g_filename_to_uri(filename, NULL, NULL);
+
+	char name[64];
+	snprintf(name, sizeof(name), "save (%s)", extension);
+	stack_time_t start_time = stack_get_clock_time();
+	bool result = stack_cue_list_save(cue_list, uri);
+	stack_bench_report(name, start_time, count);
+
+	if (result)
+	{
+		snprintf(name, sizeof(name), "load (%s)", extension);
+		start_time = stack_get_clock_time();
+		StackCueList *loaded = stack_cue_list_new_from_file(uri, NULL, NULL);
+		stack_bench_report(name, start_time, count);
+
+		result = loaded != NULL && stack_cue_list_count(loaded) == count;
+		if (loaded != NULL)
+		{
+			stack_cue_list_destroy(loaded);
+		}
+	}
+
+	if (!result)
+	{
+		fprintf(stderr, "Failed to save and load %s\n", filename);
+	}
+
+	g_unlink(filename);
+	g_free(uri);
+	g_free(filename);
+
+	return result;
+}
+
+// Runs every benchmark with a cue list of the given size
+static bool bench_cue_list(size_t count)
+{
+	printf("\n%lu cues:\n", count);
+	StackCueList *cue_list = stack_cue_list_new(2);
+
+	// Build the cue list
+	std::vector<cue_uid_t> uids;
+	stack_time_t start_time = stack_get_clock_time();
+	stack_cue_list_lock(cue_list);
+	for (size_t i = 0; i < count; i++)
+	{
+		StackCue *cue = stack_cue_new("StackGroupCue", cue_list);
+		if (cue == NULL)
+		{
+			stack_cue_list_unlock(cue_list);
+			fprintf(stderr, "Failed to create cue\n");
+			return false;
+		}
+		stack_cue_set_id(cue, (cue_id_t)((i + 1) * 1000));
+		stack_cue_list_append(cue_list, cue);
+		uids.push_back(cue->uid);
+	}
+	stack_cue_list_unlock(cue_list);
+	stack_bench_report("create and append", start_time, count);
+
+	// Look up every cue in a random order
+	std::mt19937 random(1);
+	std::shuffle(uids.begin(), uids.end(), random);
+	std::vector<size_t> indices(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		indices[i] = i;
+	}
+	std::shuffle(indices.begin(), indices.end(), random);
+
+	bool result = true;
+	stack_cue_list_lock(cue_list);
+
+	start_time = stack_get_clock_time();
+	for (auto uid : uids)
+	{
+		result = stack_cue_list_get_cue_by_uid(cue_list, uid) != NULL && result;
+	}
+	stack_bench_report("get_cue_by_uid", start_time, count);
+
+	start_time = stack_get_clock_time();
+	for (auto index : indices)
+	{
+		result = stack_cue_list_get_cue_by_index(cue_list, index) != NULL && result;
+	}
+	stack_bench_report("get_cue_by_index", start_time, count);
+
+	start_time = stack_get_clock_time();
+	for (auto uid : uids)
+	{
+		size_t index = 0;
+		result = stack_cue_list_recursive_iter_at(cue_list, uid, &index) != cue_list->cues->recursive_end() && result;
+	}
+	stack_bench_report("recursive_iter_at", start_time, count);
+
+	start_time = stack_get_clock_time();
+	for (size_t i = 0; i < 1000; i++)
+	{
+		result = stack_cue_list_get_next_cue_number(cue_list) > (cue_id_t)(count * 1000) && result;
+	}
+	stack_bench_report("get_next_cue_number", start_time, 1000);
+
+	// Move cues around, looking one up after each move as the UI would
+	start_time = stack_get_clock_time();
+	for (size_t i = 0; i < count; i++)
+	{
+		StackCue *cue = stack_cue_get_by_uid(uids[i]);
+		StackCue *dest = stack_cue_get_by_uid(uids[(i * 7 + 1) % count]);
+		if (cue != dest)
+		{
+			stack_cue_list_move(cue_list, cue, dest, i % 2 == 0, false);
+		}
+		result = stack_cue_list_get_cue_by_index(cue_list, indices[i]) != NULL && result;
+	}
+	stack_bench_report("move and get_cue_by_index", start_time, count);
+
+	// Every cue must still be where the lookup tables say it is
+	size_t position = 0;
+	for (auto iter = cue_list->cues->begin(); iter != cue_list->cues->end(); ++iter, position++)
+	{
+		size_t index = -1;
+		stack_cue_list_iter_at(cue_list, (*iter)->uid, &index);
+		result = index == position && result;
+	}
+
+	// Serialise the show
+	start_time = stack_get_clock_time();
+	Json::Value root;
+	stack_cue_list_to_json_value(cue_list, root);
+	stack_bench_report("to_json_value", start_time, count);
+
+	stack_cue_list_unlock(cue_list);
+
+	if (!result)
+	{
+		fprintf(stderr, "A lookup failed\n");
+	}
+
+	// Save and load the show in each format
+	result = bench_save_and_load(cue_list, count, ".stack") && result;
+	result = bench_save_and_load(cue_list, count, STACK_SHOW_BINARY_EXTENSION) && result;
+
+	start_time = stack_get_clock_time();
+	stack_cue_list_destroy(cue_list);
+	stack_bench_report("destroy", start_time, count);
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	stack_cue_initsystem();
+
+	std::vector<size_t> counts;
+	for (int i = 1; i < argc; i++)
+	{
+		counts.push_back(strtoul(argv[i], NULL, 10));
+	}
+	if (counts.empty())
+	{
+		counts = { 10000, 100000 };
+	}
+
+	bool result = true;
+	for (auto count : counts)
+	{
+		result = bench_cue_list(count) && result;
+	}
+
+	return result ? 0 : 1;
+}
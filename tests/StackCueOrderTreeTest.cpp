@@ -0,0 +1,75 @@
+// Checks the order tree that the cue list uses for the positions of its cues
+// against a plain vector, by making random insertions, removals and weight
+// changes and checking every position, index and weight after each one
+// Usage: StackCueOrderTreeTest [operations]
+
+// Includes:
+#include "StackTest.h"
+#include "src/StackCueOrderTree.h"
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Checks every cue in the tree against the model
+static void check_tree(const StackCueOrderTree *tree, const std::vector<StackCueOrderNode*> &model, size_t step)
+{
+	STACK_TEST_CHECK(stack_cue_order_tree_size(tree) == model.size(), "step %lu: size %lu, expected %lu", step, stack_cue_order_tree_size(tree), model.size());
+
+	size_t weight_before = 0;
+	for (size_t i = 0; i < model.size(); i++)
+	{
+		const StackCueOrderNode *node = model[i];
+		STACK_TEST_CHECK(stack_cue_order_tree_at(tree, i) == node, "step %lu: wrong node at %lu", step, i);
+		STACK_TEST_CHECK(stack_cue_order_tree_index(node) == i, "step %lu: index %lu, expected %lu", step, stack_cue_order_tree_index(node), i);
+		STACK_TEST_CHECK(stack_cue_order_tree_weight_before(node) == weight_before, "step %lu: weight before %lu is %lu, expected %lu", step, i, stack_cue_order_tree_weight_before(node), weight_before);
+		weight_before += node->weight;
+	}
+
+	STACK_TEST_CHECK(stack_cue_order_tree_at(tree, model.size()) == NULL, "step %lu: found a node past the end", step);
+}
+
+int main(int argc, char **argv)
+{
+	const size_t operations = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+
+	StackCueOrderTree tree;
+	stack_cue_order_tree_init(&tree);
+	std::vector<StackCueOrderNode*> model;
+	std::mt19937 random(1);
+
+	for (size_t step = 0; step < operations; step++)
+	{
+		// Favour inserting, so that the tree grows
+		const uint32_t operation = random() % 8;
+		if (operation < 4 || model.empty())
+		{
+			const size_t index = random() % (model.size() + 1);
+			StackCue *cue = (StackCue*)(uintptr_t)(step + 1);
+			StackCueOrderNode *node = stack_cue_order_tree_insert(&tree, index, cue, 1 + random() % 5);
+			STACK_TEST_CHECK(node->cue == cue, "step %lu: node holds the wrong cue", step);
+			model.insert(model.begin() + index, node);
+		}
+		else if (operation < 7)
+		{
+			const size_t index = random() % model.size();
+			stack_cue_order_tree_erase(&tree, model[index]);
+			model.erase(model.begin() + index);
+		}
+		else
+		{
+			stack_cue_order_tree_set_weight(model[random() % model.size()], 1 + random() % 5);
+		}
+
+		check_tree(&tree, model, step);
+	}
+
+	// Inserting past the end appends
+	StackCueOrderNode *last = stack_cue_order_tree_insert(&tree, model.size() + 10, NULL, 1);
+	model.push_back(last);
+	check_tree(&tree, model, operations);
+
+	stack_cue_order_tree_clear(&tree);
+	STACK_TEST_CHECK(stack_cue_order_tree_size(&tree) == 0, "tree not empty after clearing");
+
+	return stack_test_result();
+}
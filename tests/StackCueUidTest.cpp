@@ -0,0 +1,130 @@
+// Stress tests the cue UID registry by creating, looking up and destroying cues
+// on several threads at once. Each thread checks that it can always find its
+// own cues, and that they're gone once destroyed, whilst also looking up the
+// cues that the other threads are busy creating and destroying. Every UID
+// generated is checked to be unique at the end
+// Usage: StackCueUidTest [rounds]
+
+// Includes:
+#include "StackTest.h"
+#include "src/StackCueList.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The number of threads to run, and the number of cues each creates per round
+static const size_t THREAD_COUNT = 8;
+static const size_t CUES_PER_ROUND = 32;
+
+// The most recently created UID of each thread, for the other threads to look
+// up whilst it might be being destroyed
+static std::atomic<cue_uid_t> latest_uids[THREAD_COUNT];
+
+// Guards the checks, as STACK_TEST_CHECK isn't thread-safe
+static std::mutex check_mutex;
+
+// Runs the rounds for one thread, storing every UID that it generated
+static void test_thread(size_t thread_index, size_t rounds, std::vector<cue_uid_t> *all_uids)
+{
+	// Each thread uses its own cue list so that the registry is the only
+	// thing being shared between them
+	StackCueList *cue_list = stack_cue_list_new(2);
+	size_t failures = 0;
+
+	for (size_t round = 0; round < rounds; round++)
+	{
+		std::vector<StackCue*> cues;
+		for (size_t i = 0; i < CUES_PER_ROUND; i++)
+		{
+			StackCue *cue = stack_cue_new("StackGroupCue", cue_list);
+			if (cue == NULL)
+			{
+				failures++;
+				continue;
+			}
+
+			cues.push_back(cue);
+			all_uids->push_back(cue->uid);
+			latest_uids[thread_index].store(cue->uid);
+		}
+
+		// Our own cues must always be found, whatever else is going on
+		for (auto cue : cues)
+		{
+			if (stack_cue_get_by_uid(cue->uid) != cue)
+			{
+				failures++;
+			}
+
+			// Look up the other threads' cues. We can't check the result as
+			// they could be destroyed at any moment, but it mustn't crash or
+			// return one of our cues
+			for (size_t other = 0; other < THREAD_COUNT; other++)
+			{
+				if (other != thread_index)
+				{
+					StackCue *other_cue = stack_cue_get_by_uid(latest_uids[other].load());
+					if (other_cue != NULL && std::find(cues.begin(), cues.end(), other_cue) != cues.end())
+					{
+						failures++;
+					}
+				}
+			}
+		}
+
+		// Destroy the cues, which must remove them from the registry
+		for (auto cue : cues)
+		{
+			const cue_uid_t uid = cue->uid;
+			stack_cue_destroy(cue);
+			if (stack_cue_get_by_uid(uid) != NULL)
+			{
+				failures++;
+			}
+		}
+	}
+
+	stack_cue_list_destroy(cue_list);
+
+	std::unique_lock<std::mutex> lock(check_mutex);
+	STACK_TEST_CHECK(failures == 0, "thread %lu: %lu lookup(s) failed", thread_index, failures);
+}
+
+int main(int argc, char **argv)
+{
+	const size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 50;
+
+	stack_cue_initsystem();
+
+	for (auto &uid : latest_uids)
+	{
+		uid.store(STACK_CUE_UID_NONE);
+	}
+
+	std::vector<std::vector<cue_uid_t>> thread_uids(THREAD_COUNT);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < THREAD_COUNT; i++)
+	{
+		threads.push_back(std::thread(test_thread, i, rounds, &thread_uids[i]));
+	}
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	// Every UID that was generated must be valid and unique
+	std::vector<cue_uid_t> all_uids;
+	for (auto &uids : thread_uids)
+	{
+		all_uids.insert(all_uids.end(), uids.begin(), uids.end());
+	}
+	STACK_TEST_CHECK(all_uids.size() == THREAD_COUNT * rounds * CUES_PER_ROUND, "generated %lu UIDs, expected %lu", all_uids.size(), THREAD_COUNT * rounds * CUES_PER_ROUND);
+	STACK_TEST_CHECK(std::find(all_uids.begin(), all_uids.end(), STACK_CUE_UID_NONE) == all_uids.end(), "generated STACK_CUE_UID_NONE");
+	std::sort(all_uids.begin(), all_uids.end());
+	STACK_TEST_CHECK(std::adjacent_find(all_uids.begin(), all_uids.end()) == all_uids.end(), "generated a duplicate UID");
+
+	return stack_test_result();
+}
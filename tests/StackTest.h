@@ -0,0 +1,55 @@
+#ifndef _STACKTEST_H_INCLUDED
+#define _STACKTEST_H_INCLUDED
+
+// Includes:
+#include "src/StackCue.h"
+#include <cstdio>
+
+// The number of failed checks in the current test program
+static size_t stack_test_failures = 0;
+
+// Checks that a condition holds, printing a message and counting a failure if
+// it doesn't. Carries on either way so that one run reports every failure
+#define STACK_TEST_CHECK(condition, ...) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: Check failed: %s: ", __FILE__, __LINE__, #condition); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			stack_test_failures++; \
+		} \
+	} while (0)
+
+// Returns the exit code for the test program, reporting the number of failures
+static inline int stack_test_result()
+{
+	if (stack_test_failures > 0)
+	{
+		fprintf(stderr, "%lu check(s) failed\n", stack_test_failures);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Prints the time taken for part of a benchmark
+// @param name The name of what was timed
+// @param start_time The clock time (from stack_get_clock_time) that it started
+// @param count The number of operations that were timed, or zero to not show
+// the time per operation
+static inline void stack_bench_report(const char *name, stack_time_t start_time, size_t count)
+{
+	const double elapsed = (double)(stack_get_clock_time() - start_time) / NANOSECS_PER_SEC_F;
+	if (count > 0)
+	{
+		printf("%-40s %10.3f ms  %10.1f ns/op\n", name, elapsed * 1000.0, elapsed * 1.0e9 / (double)count);
+	}
+	else
+	{
+		printf("%-40s %10.3f ms\n", name, elapsed * 1000.0);
+	}
+}
+
+#endif